@@ -20,6 +20,18 @@
     void    (^_completionHandler)(NSError *error);
     void    (^_dataBlock)(NSData *data);
     CK2ProgressBlock _progressBlock;
+    
+  @private
+    NSURLCredential *_credential;
+    
+    // Batched commands
+    NSURLRequest    *_batchRequest;
+    NSMutableArray  *_batchCommands;
+    NSMutableArray  *_batchURLs;
+    NSUInteger      _batchCommandsInFlight;
+    NSUInteger      _batchCommandsSent;
+    NSUInteger      _batchItemCommandsSent;
+    void            (^_batchItemHandler)(NSURL *url, NSError *error);
 }
 
 #pragma mark Initialisation
@@ -31,6 +43,20 @@
 
 - (id)initWithCustomCommands:(NSArray *)commands request:(NSURLRequest *)childRequest createIntermediateDirectories:(BOOL)createIntermediates client:(id <CK2ProtocolClient>)client completionHandler:(void (^)(NSError *error))handler;
 
+// Sends a command per URL as a single quote list. URLs must all be in the same directory. An item needing more than one command (e.g. FTP's RNFR/RNTO) can supply an array of them in place of a single command
+// Should one of the commands fail, that item is reported as failed and the ones after it go out in a fresh list. The item handler is called with each URL's result; if nil, it's reported straight to the client
+- (id)initWithBatchedCustomCommands:(NSArray *)commands forURLs:(NSArray *)urls request:(NSURLRequest *)childRequest createIntermediateDirectories:(BOOL)createIntermediates client:(id <CK2ProtocolClient>)client itemHandler:(void (^)(NSURL *url, NSError *error))itemHandler;
+
+// A command per URL, filling in the format with the item's name, as an argument
++ (NSArray *)commandsWithFormat:(NSString *)format forURLs:(NSArray *)urls;
++ (NSArray *)commandsWithFormat:(NSString *)format directoryFormat:(NSString *)directoryFormat forURLs:(NSArray *)urls;  // URLs with a directory path get the directory format instead
+
+// Filenames and paths going into a custom command need passing through this. Default returns the argument unchanged, which suits FTP, where the argument runs to the end of the line. Subclasses whose commands split arguments at spaces should quote and escape it
++ (NSString *)commandArgumentWithString:(NSString *)string;
+
+// To find out which command of a batch failed, libcurl needs to report each as it goes out. Backends which don't (e.g. SFTP) can supply a harmless command that is reported, to follow each one in the list instead. Default is nil
++ (NSString *)batchProgressCommand;
+
 // Already handled for you; can override in a subclass if you want
 - (id)initForEnumeratingDirectoryWithRequest:(NSURLRequest *)request includingPropertiesForKeys:(NSArray *)keys options:(NSDirectoryEnumerationOptions)mask client:(id<CK2ProtocolClient>)client;
 
@@ -46,6 +72,9 @@
 + (CK2RemoteURL *)URLByAppendingPathComponent:(NSString *)pathComponent toURL:(NSURL *)directoryURL isDirectory:(BOOL)isDirectory;
 + (BOOL)URLHasDirectoryPath:(NSURL *)url;
 
+// Custom commands are issued from the directory containing the request's URL. This gives a path to reference another item on the server from there
++ (NSString *)pathOfURL:(NSURL *)url relativeToDirectoryOfURL:(NSURL *)baseURL;
+
 
 #pragma mark Customization
 + (BOOL)usesMultiHandle;    // defaults to YES. Subclasses can override to be NO and fall back to the old synchronous "easy" backend
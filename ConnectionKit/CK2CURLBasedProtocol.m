@@ -65,6 +65,145 @@
     return self;
 }
 
+#pragma mark Batched Commands
+
+- (id)initWithBatchedCustomCommands:(NSArray *)commands forURLs:(NSArray *)urls request:(NSURLRequest *)childRequest createIntermediateDirectories:(BOOL)createIntermediates client:(id <CK2ProtocolClient>)client itemHandler:(void (^)(NSURL *url, NSError *error))itemHandler;
+{
+    NSParameterAssert([commands count] == [urls count]);
+    
+    self = [self initWithCustomCommands:[[self class] quoteListForBatchedCommands:commands] request:childRequest createIntermediateDirectories:createIntermediates client:client completionHandler:^(NSError *error) {
+        [self batchDidCompleteWithError:error];
+    }];
+    
+    if (self)
+    {
+        _batchCommands = [commands mutableCopy];
+        _batchURLs = [urls mutableCopy];
+        _batchCommandsInFlight = [commands count];
+        _batchItemHandler = [itemHandler copy];
+    }
+    
+    return self;
+}
+
++ (NSArray *)commandsWithFormat:(NSString *)format forURLs:(NSArray *)urls;
+{
+    return [self commandsWithFormat:format directoryFormat:format forURLs:urls];
+}
+
++ (NSArray *)commandsWithFormat:(NSString *)format directoryFormat:(NSString *)directoryFormat forURLs:(NSArray *)urls;
+{
+    NSMutableArray *result = [NSMutableArray arrayWithCapacity:[urls count]];
+    for (NSURL *aURL in urls)
+    {
+        [result addObject:[NSString stringWithFormat:([self URLHasDirectoryPath:aURL] ? directoryFormat : format), [self commandArgumentWithString:[aURL lastPathComponent]]]];
+    }
+    return result;
+}
+
++ (NSString *)commandArgumentWithString:(NSString *)string; { return string; }
+
++ (NSString *)batchProgressCommand; { return nil; }
+
++ (NSArray *)commandsForBatchItem:(id)item;
+{
+    return ([item isKindOfClass:[NSArray class]] ? item : [NSArray arrayWithObject:item]);
+}
+
++ (NSArray *)quoteListForBatchedCommands:(NSArray *)commands;
+{
+    NSString *progressCommand = [self batchProgressCommand];
+    
+    NSMutableArray *result = [NSMutableArray arrayWithCapacity:2 * [commands count]];
+    for (id anItem in commands)
+    {
+        [result addObjectsFromArray:[self commandsForBatchItem:anItem]];
+        if (progressCommand) [result addObject:progressCommand];
+    }
+    return result;
+}
+
+- (void)reportBatchItemAtURL:(NSURL *)url error:(NSError *)error;
+{
+    if (_batchItemHandler)
+    {
+        _batchItemHandler(url, error);
+    }
+    else
+    {
+        [[self client] protocol:self didCompleteItemAtURL:url error:error];
+    }
+}
+
+- (void)reportBatchItemsInRange:(NSRange)range error:(NSError *)error;
+{
+    for (NSURL *aURL in [_batchURLs subarrayWithRange:range])
+    {
+        [self reportBatchItemAtURL:aURL error:error];
+    }
+    
+    [_batchURLs removeObjectsInRange:range];
+    [_batchCommands removeObjectsInRange:range];
+}
+
+- (void)batchDidCompleteWithError:(NSError *)error;
+{
+    if (!error)
+    {
+        [self reportBatchItemsInRange:NSMakeRange(0, _batchCommandsInFlight) error:nil];
+    }
+    else if ([error code] == CURLE_QUOTE_ERROR && [[error domain] isEqualToString:CURLcodeErrorDomain])
+    {
+        // libcurl stops at the first failed command, so everything before it succeeded. Those mustn't be sent again, as repeating them would fail with the likes of "no such file"
+        // With a progress command, each one seen means the item before it succeeded. Otherwise, the last command seen going out is the one that failed, and belongs to the item part way through if there is one
+        NSUInteger succeeded;
+        if ([[self class] batchProgressCommand] || _batchItemCommandsSent > 0)
+        {
+            succeeded = _batchCommandsSent;
+        }
+        else
+        {
+            succeeded = (_batchCommandsSent > 0 ? _batchCommandsSent - 1 : NSNotFound);
+        }
+        
+        if (succeeded < _batchCommandsInFlight)
+        {
+            [self reportBatchItemsInRange:NSMakeRange(0, succeeded) error:nil];
+            [self reportBatchItemsInRange:NSMakeRange(0, 1) error:error];
+        }
+        else
+        {
+            // No idea how far through libcurl got, so the safest course is to fail everything that was sent, rather than risk repeating any
+            [self reportBatchItemsInRange:NSMakeRange(0, _batchCommandsInFlight) error:error];
+        }
+    }
+    else
+    {
+        // Something more serious than an individual item
+        [[self client] protocol:self didFailWithError:error];
+        return;
+    }
+    
+    
+    if ([_batchCommands count])
+    {
+        // Start over with the remaining commands
+        _batchCommandsInFlight = [_batchCommands count];
+        _batchCommandsSent = 0;
+        _batchItemCommandsSent = 0;
+        
+        NSMutableURLRequest *request = [(_batchRequest ? _batchRequest : [self request]) mutableCopy];
+        [request curl_setPostTransferCommands:[[self class] quoteListForBatchedCommands:_batchCommands]];
+        [_batchRequest release]; _batchRequest = request;
+        
+        [self startWithCredential:_credential];
+    }
+    else
+    {
+        [[self client] protocolDidFinish:self];
+    }
+}
+
 #pragma mark Directory Enumeration
 
 - (BOOL)shouldEnumerateFilename:(NSString *)name options:(NSDirectoryEnumerationOptions)mask;
@@ -321,6 +460,11 @@
     [_completionHandler release];
     [_dataBlock release];
     [_progressBlock release];
+    [_credential release];
+    [_batchRequest release];
+    [_batchCommands release];
+    [_batchURLs release];
+    [_batchItemHandler release];
     
     [super dealloc];
 }
@@ -331,9 +475,17 @@
 
 - (void)startWithCredential:(NSURLCredential *)credential;
 {
+    // Hang onto the credential in case a batch needs to start over
+    if (credential != _credential)
+    {
+        [_credential release]; _credential = [credential retain];
+    }
+    
+    NSURLRequest *request = (_batchRequest ? _batchRequest : [self request]);
+    
     if ([[self class] usesMultiHandle])
     {
-        _handle = [[CURLHandle alloc] initWithRequest:[self request]
+        _handle = [[CURLHandle alloc] initWithRequest:request
                                            credential:credential
                                              delegate:self
                                                 multi:nil];
@@ -354,13 +506,16 @@
         // Let the work commence!
         dispatch_async(queue, ^{
             _handle = [handle retain];
-            [_handle sendSynchronousRequest:self.request credential:credential delegate:self];
+            [_handle sendSynchronousRequest:request credential:credential delegate:self];
         });
     }
 }
 
 - (void)endWithError:(NSError *)error;
 {
+    // Completion handler might start up a fresh handle, e.g. for a batch
+    CURLHandle *handle = _handle;
+    
     if (_completionHandler)
     {
         _completionHandler(error);
@@ -377,7 +532,8 @@
         }
     }
     
-    [_handle release]; _handle = nil;
+    if (_handle == handle) _handle = nil;
+    [handle release];
 }
 
 - (void)stop;
@@ -415,6 +571,36 @@
     return CFURLHasDirectoryPath((CFURLRef)url);
 }
 
++ (NSString *)pathOfURL:(NSURL *)url relativeToDirectoryOfURL:(NSURL *)baseURL;
+{
+    NSString *path = [self pathOfURLRelativeToHomeDirectory:url];
+    NSString *directory = [self pathOfURLRelativeToHomeDirectory:[baseURL URLByDeletingLastPathComponent]];
+    
+    // Absolute paths can be used as-is. Likewise if the base is absolute, there's no way to know where the home directory is, so can only hope the server resolves it the same
+    if ([path length] == 0 || [path isAbsolutePath] || [directory isAbsolutePath]) return path;
+    
+    // Both are relative to the home directory, so step up out of the base directory as far as needed
+    NSArray *pathComponents = [[path pathComponents] filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"SELF != '.'"]];
+    NSArray *directoryComponents = [[directory pathComponents] filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"SELF != '.'"]];
+    
+    NSUInteger common = 0;
+    while (common + 1 < [pathComponents count] &&
+           common < [directoryComponents count] &&
+           [[pathComponents objectAtIndex:common] isEqualToString:[directoryComponents objectAtIndex:common]])
+    {
+        common++;
+    }
+    
+    NSMutableArray *components = [NSMutableArray array];
+    for (NSUInteger i = common; i < [directoryComponents count]; i++)
+    {
+        [components addObject:@".."];
+    }
+    [components addObjectsFromArray:[pathComponents subarrayWithRange:NSMakeRange(common, [pathComponents count] - common)]];
+    
+    return [NSString pathWithComponents:components];
+}
+
 #pragma mark CURLHandleDelegate
 
 - (void)handle:(CURLHandle *)handle didFailWithError:(NSError *)error;
@@ -425,11 +611,13 @@
 
 - (void)handle:(CURLHandle *)handle didReceiveData:(NSData *)data;
 {
+    [[self client] protocol:self didSendBytes:0 receivedBytes:[data length]];
     if (_dataBlock) _dataBlock(data);
 }
 
 - (void)handle:(CURLHandle *)handle willSendBodyDataOfLength:(NSUInteger)bytesWritten
 {
+    [[self client] protocol:self didSendBytes:bytesWritten receivedBytes:0];
     if (_progressBlock) _progressBlock(bytesWritten, 0);
 }
 
@@ -440,9 +628,74 @@
 
 - (void)handle:(CURLHandle *)handle didReceiveDebugInformation:(NSString *)string ofType:(curl_infotype)type;
 {
+    // Keep track of how far through a batch of commands we are. They go out in order, so only need to check for the next one, or the next progress command
+    if (type == CURLINFO_HEADER_OUT && _batchCommandsSent < _batchCommandsInFlight)
+    {
+        NSString *command = [string stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+        NSString *progressCommand = [[self class] batchProgressCommand];
+        
+        if (progressCommand)
+        {
+            if ([command caseInsensitiveCompare:progressCommand] == NSOrderedSame) _batchCommandsSent++;
+        }
+        else
+        {
+            // An item only counts as sent once its last command has gone out
+            NSArray *itemCommands = [[self class] commandsForBatchItem:[_batchCommands objectAtIndex:_batchCommandsSent]];
+            if ([command isEqualToString:[itemCommands objectAtIndex:_batchItemCommandsSent]])
+            {
+                _batchItemCommandsSent++;
+                if (_batchItemCommandsSent == [itemCommands count])
+                {
+                    _batchCommandsSent++;
+                    _batchItemCommandsSent = 0;
+                }
+            }
+        }
+    }
+    
+    [self reportMetricsForDebugInformation:string ofType:type];
     [[self client] protocol:self appendString:string toTranscript:(type == CURLINFO_HEADER_IN ? CKTranscriptReceived : CKTranscriptSent)];
 }
 
+#pragma mark Metrics
+
+- (void)reportMetricsForDebugInformation:(NSString *)string ofType:(curl_infotype)type;
+{
+    id <CK2ProtocolClient> client = [self client];
+    
+    switch (type)
+    {
+        case CURLINFO_TEXT:
+            // libcurl's pool of connections lives in the multi handle, and it tells us whenever it makes use of one
+            if ([string hasPrefix:@"Re-using existing connection"])
+            {
+                [client protocol:self didConnectReusingConnection:YES];
+            }
+            else if ([string hasPrefix:@"Connected to "])
+            {
+                [client protocol:self didConnectReusingConnection:NO];
+            }
+            else if ([string hasPrefix:@"Authentication complete"])   // SSH
+            {
+                [client protocolDidAuthenticate:self];
+            }
+            break;
+            
+        case CURLINFO_HEADER_IN:
+            if ([string hasPrefix:@"230"]) [client protocolDidAuthenticate:self];   // FTP "User logged in"
+            [client protocol:self didSendBytes:0 receivedBytes:[string lengthOfBytesUsingEncoding:NSUTF8StringEncoding]];
+            break;
+            
+        case CURLINFO_HEADER_OUT:
+            [client protocol:self didSendBytes:[string lengthOfBytesUsingEncoding:NSUTF8StringEncoding] receivedBytes:0];
+            break;
+            
+        default:
+            break;
+    }
+}
+
 #pragma mark NSURLAuthenticationChallengeSender
 
 - (void)useCredential:(NSURLCredential *)credential forAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge;
@@ -152,19 +152,7 @@
                                      client:client
                           completionHandler:^(NSError *error) {
                               
-                              if (error)
-                              {
-                                  // CHMOD failures for unsupported or unrecognized command should go ignored
-                                  if ([error code] == CURLE_QUOTE_ERROR && [[error domain] isEqualToString:CURLcodeErrorDomain])
-                                  {
-                                      NSUInteger responseCode = [error curlResponseCode];
-                                      if (responseCode == 500 || responseCode == 502 || responseCode == 504)
-                                      {
-                                          error = nil;
-                                      }
-                                  }
-                              }
-
+                              if ([self isUnsupportedCHMODError:error]) error = nil;
                               [self translateStandardErrors:error client:client];
                           }];
     }
@@ -175,6 +163,100 @@
     }
 }
 
+- (id)initForMovingItemWithRequest:(NSURLRequest *)request toURL:(NSURL *)destinationURL client:(id<CK2ProtocolClient>)client;
+{
+    NSArray *commands = [NSArray arrayWithObjects:
+                         [@"RNFR " stringByAppendingString:[[request URL] lastPathComponent]],
+                         [@"RNTO " stringByAppendingString:[[self class] pathOfURL:destinationURL relativeToDirectoryOfURL:[request URL]]],
+                         nil];
+    
+    return [self initWithCustomCommands:commands
+                                request:request
+          createIntermediateDirectories:NO
+                                 client:client
+                      completionHandler:^(NSError *error) {
+                          [self translateStandardErrors:error client:client];
+                      }];
+}
+
+#pragma mark Batch Operations
+
+- (id)initForCreatingDirectoriesWithRequests:(NSArray *)requests withIntermediateDirectories:(BOOL)createIntermediates openingAttributes:(NSDictionary *)attributes client:(id<CK2ProtocolClient>)client;
+{
+    NSArray *urls = [requests valueForKey:@"URL"];
+    
+    return [self initWithBatchedCustomCommands:[[self class] commandsWithFormat:@"MKD %@" forURLs:urls]
+                                       forURLs:urls
+                                       request:[requests objectAtIndex:0]
+                 createIntermediateDirectories:createIntermediates
+                                        client:client
+                                   itemHandler:^(NSURL *url, NSError *error) {
+                                       [client protocol:self didCompleteItemAtURL:url error:[self translatedStandardError:error]];
+                                   }];
+}
+
+- (id)initForRemovingFilesWithRequests:(NSArray *)requests client:(id<CK2ProtocolClient>)client;
+{
+    NSArray *urls = [requests valueForKey:@"URL"];
+    
+    return [self initWithBatchedCustomCommands:[[self class] commandsWithFormat:@"DELE %@" directoryFormat:@"RMD %@" forURLs:urls]
+                                       forURLs:urls
+                                       request:[requests objectAtIndex:0]
+                 createIntermediateDirectories:NO
+                                        client:client
+                                   itemHandler:^(NSURL *url, NSError *error) {
+                                       [client protocol:self didCompleteItemAtURL:url error:[self translatedStandardError:error]];
+                                   }];
+}
+
+- (id)initForSettingAttributes:(NSDictionary *)keyedValues ofItemsWithRequests:(NSArray *)requests client:(id<CK2ProtocolClient>)client;
+{
+    NSNumber *permissions = [keyedValues objectForKey:NSFilePosixPermissions];
+    if (!permissions)
+    {
+        // Nothing we can do over FTP, so the client might as well handle the items individually, which will be a no-op
+        [self release];
+        return nil;
+    }
+    
+    NSArray *urls = [requests valueForKey:@"URL"];
+    NSString *format = [NSString stringWithFormat:@"SITE CHMOD %lo %%@", [permissions unsignedLongValue]];
+    
+    return [self initWithBatchedCustomCommands:[[self class] commandsWithFormat:format forURLs:urls]
+                                       forURLs:urls
+                                       request:[requests objectAtIndex:0]
+                 createIntermediateDirectories:NO
+                                        client:client
+                                   itemHandler:^(NSURL *url, NSError *error) {
+                                       
+                                       if ([self isUnsupportedCHMODError:error]) error = nil;
+                                       [client protocol:self didCompleteItemAtURL:url error:[self translatedStandardError:error]];
+                                   }];
+}
+
+- (id)initForMovingItemsWithRequests:(NSArray *)requests toURLs:(NSArray *)destinationURLs client:(id<CK2ProtocolClient>)client;
+{
+    NSArray *urls = [requests valueForKey:@"URL"];
+    
+    // Each item is an RNFR/RNTO pair
+    NSMutableArray *commands = [NSMutableArray arrayWithCapacity:[urls count]];
+    [urls enumerateObjectsUsingBlock:^(NSURL *aURL, NSUInteger idx, BOOL *stop) {
+        [commands addObject:[NSArray arrayWithObjects:
+                             [@"RNFR " stringByAppendingString:[aURL lastPathComponent]],
+                             [@"RNTO " stringByAppendingString:[[self class] pathOfURL:[destinationURLs objectAtIndex:idx] relativeToDirectoryOfURL:aURL]],
+                             nil]];
+    }];
+    
+    return [self initWithBatchedCustomCommands:commands
+                                       forURLs:urls
+                                       request:[requests objectAtIndex:0]
+                 createIntermediateDirectories:NO
+                                        client:client
+                                   itemHandler:^(NSURL *url, NSError *error) {
+                                       [client protocol:self didCompleteItemAtURL:url error:[self translatedStandardError:error]];
+                                   }];
+}
+
 #pragma mark Lifecycle
 
 - (void)start;
@@ -211,24 +293,40 @@
 
 #pragma mark - Error Translation
 
-- (void)translateStandardErrors:(NSError*)error client:(id<CK2ProtocolClient>)client
+- (NSError *)translatedStandardError:(NSError *)error;
 {
-    if (error)
+    if ([error code] == CURLE_QUOTE_ERROR && [[error domain] isEqualToString:CURLcodeErrorDomain])
     {
-        if ([error code] == CURLE_QUOTE_ERROR && [[error domain] isEqualToString:CURLcodeErrorDomain])
+        NSUInteger responseCode = [error curlResponseCode];
+        if (responseCode == 550)
         {
-            NSUInteger responseCode = [error curlResponseCode];
-            if (responseCode == 550)
-            {
-                // Nicer Cocoa-style error. Can't definitely tell the difference between the file not existing, and permission denied, sadly
-                error = [NSError errorWithDomain:NSCocoaErrorDomain
-                                            code:NSFileWriteUnknownError
-                                        userInfo:@{ NSUnderlyingErrorKey : error }];
-            }
+            // Nicer Cocoa-style error. Can't definitely tell the difference between the file not existing, and permission denied, sadly
+            error = [NSError errorWithDomain:NSCocoaErrorDomain
+                                        code:NSFileWriteUnknownError
+                                    userInfo:@{ NSUnderlyingErrorKey : error }];
         }
+    }
+    
+    return error;
+}
 
+- (BOOL)isUnsupportedCHMODError:(NSError *)error;
+{
+    // CHMOD failures for unsupported or unrecognized command should go ignored
+    if ([error code] == CURLE_QUOTE_ERROR && [[error domain] isEqualToString:CURLcodeErrorDomain])
+    {
+        NSUInteger responseCode = [error curlResponseCode];
+        return (responseCode == 500 || responseCode == 502 || responseCode == 504);
+    }
+    
+    return NO;
+}
 
-        [client protocol:self didFailWithError:error];
+- (void)translateStandardErrors:(NSError*)error client:(id<CK2ProtocolClient>)client
+{
+    if (error)
+    {
+        [client protocol:self didFailWithError:[self translatedStandardError:error]];
     }
     else
     {
@@ -19,12 +19,19 @@ extern NSString * const CK2FileMIMEType;
 
 
 @protocol CK2FileManagerDelegate;
+@class CK2FileOperationMetrics, CK2FileOperationMetricsCollector, CK2Transcript;
 
 
 @interface CK2FileManager : NSObject
 {
   @private
     id <CK2FileManagerDelegate> _delegate;
+    CK2FileOperationMetricsCollector    *_metricsCollector;
+    
+    CK2Transcript       *_transcript;
+    dispatch_queue_t    _transcriptQueue;
+    int64_t             _transcriptSequence;
+    volatile int32_t    _transcriptDeliveryPending;
 }
 
 #pragma mark Discovering Directory Contents
@@ -78,6 +85,19 @@ extern NSString * const CK2URLSymbolicLinkDestinationKey; // The destination URL
 - (id)removeItemAtURL:(NSURL *)url completionHandler:(void (^)(NSError *error))handler;
 
 
+#pragma mark Moving and Copying Items
+// Performed server-side, so the destination must be on the same server as the source. Moving is the cheap way to swap freshly uploaded content into place, and in practice at present should mean:
+//
+//  FTP:    RNFR/RNTO. Whether an existing item at the destination is replaced is up to the server
+//  SFTP:   rename, asking for an atomic overwrite of any existing item. Servers without the posix-rename extension will fail instead
+//  WebDAV: MOVE and COPY. Moving overwrites any existing item, copying does not
+//  file:   rename(2) and NSFileManager's copying
+//
+// Copying is not supported by FTP or SFTP; the completion handler receives NSFeatureUnsupportedError
+- (id)moveItemAtURL:(NSURL *)srcURL toURL:(NSURL *)dstURL completionHandler:(void (^)(NSError *error))handler;
+- (id)copyItemAtURL:(NSURL *)srcURL toURL:(NSURL *)dstURL completionHandler:(void (^)(NSError *error))handler NS_RETURNS_NOT_RETAINED;
+
+
 #pragma mark Getting and Setting Attributes
 // It is up to the protocol used to decide precisely how it wants to handle the attributes and any errors. In practice at present that should mean:
 //
@@ -88,6 +108,27 @@ extern NSString * const CK2URLSymbolicLinkDestinationKey; // The destination URL
 - (id)setAttributes:(NSDictionary *)keyedValues ofItemAtURL:(NSURL *)url completionHandler:(void (^)(NSError *error))handler;
 
 
+#pragma mark Batch Operations
+// Variants of the above for dealing with large numbers of items at once. URLs are grouped by their parent directory, and each group handed to the protocol as a single unit of work, so it can avoid setting up a new connection/request per-item. In practice at present that should mean:
+//
+//  FTP:    One control connection per directory, with all the commands sent as a single quote list
+//  SFTP:   Same as FTP
+//  file:   Performed directly, one after another
+//  WebDAV: A request per-item
+//
+// The item handler is called once for each URL, with nil for success, or an error specific to that item. The completion handler is called once all items have been dealt with. Its error is only non-nil if the batch as a whole failed (e.g. couldn't connect, or cancelled), in which case some items may have gone unreported
+// All URLs must share the same scheme and host
+- (id)createDirectoriesAtURLs:(NSArray *)urls withIntermediateDirectories:(BOOL)createIntermediates openingAttributes:(NSDictionary *)attributes itemHandler:(void (^)(NSURL *url, NSError *error))itemHandler completionHandler:(void (^)(NSError *error))handler;
+
+// Unlike -removeItemAtURL:completionHandler:, FTP and SFTP can remove empty directories this way too. Give them a directory path (trailing slash), and they're sent as RMD/rmdir rather than DELE/rm
+- (id)removeItemsAtURLs:(NSArray *)urls itemHandler:(void (^)(NSURL *url, NSError *error))itemHandler completionHandler:(void (^)(NSError *error))handler;
+
+- (id)setAttributes:(NSDictionary *)keyedValues ofItemsAtURLs:(NSArray *)urls itemHandler:(void (^)(NSURL *url, NSError *error))itemHandler completionHandler:(void (^)(NSError *error))handler;
+
+// Moves each source URL to the destination at the same index, as -moveItemAtURL:toURL:… does. Grouped by the source's directory, and reported by source URL
+- (id)moveItemsAtURLs:(NSArray *)srcURLs toURLs:(NSArray *)dstURLs itemHandler:(void (^)(NSURL *url, NSError *error))itemHandler completionHandler:(void (^)(NSError *error))handler;
+
+
 #pragma mark Cancelling Operations
 // If an operation is cancelled, the completion handler will be called with a NSURLErrorCancelled error.
 - (void)cancelOperation:(id)operation;
@@ -99,6 +140,16 @@ extern NSString * const CK2URLSymbolicLinkDestinationKey; // The destination URL
 @property(assign) id <CK2FileManagerDelegate> delegate;
 
 
+#pragma mark Transcript
+// The most recent transcript entries from all operations. Always captured; reading is up to you. If the delegate implements -fileManager:appendString:toTranscript: it's fed the entries in order, in batches, as they arrive
+@property(readonly) CK2Transcript *transcript;
+
+
+#pragma mark Metrics
+// Every operation keeps track of its timings and traffic. Once it completes, they're added to the collector, and handed to the delegate if it wants them
+@property(retain) CK2FileOperationMetricsCollector *metricsCollector;
+
+
 #pragma mark URLs
 // These two methods take into account the specifics of different URL schemes. e.g. for the same relative path, but different base schemes:
 //  http://example.com/relative/path
@@ -143,6 +194,9 @@ extern NSString * const CK2URLSymbolicLinkDestinationKey; // The destination URL
 
 - (void)fileManager:(CK2FileManager *)manager appendString:(NSString *)info toTranscript:(CKTranscriptType)transcript;
 
+// Called once an operation's completion handler has been, with the operation's token as returned by the method which started it
+- (void)fileManager:(CK2FileManager *)manager didFinishOperation:(id)operation withMetrics:(CK2FileOperationMetrics *)metrics;
+
 @end
 
 
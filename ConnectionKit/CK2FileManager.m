@@ -8,6 +8,11 @@
 
 #import "CK2FileManager.h"
 #import "CK2Protocol.h"
+#import "CK2LocalFileSource.h"
+#import "CK2FileOperationMetrics.h"
+#import "CK2Transcript.h"
+
+#include <libkern/OSAtomic.h>
 
 
 NSString * const CK2FileMIMEType = @"CK2FileMIMEType";
@@ -27,6 +32,18 @@ NSString * const CK2FileMIMEType = @"CK2FileMIMEType";
     void    (^_enumerationBlock)(NSURL *);
     NSURL   *_localURL;
     
+    // Batches
+    NSMutableArray  *_batches;      // arrays of URLs grouped by directory, yet to be handed to a protocol
+    NSMutableArray  *_fallbackURLs; // URLs from a batch the protocol couldn't handle, to be performed individually
+    NSURL           *_currentItemURL;
+    Class           _protocolClass;
+    CK2Protocol     *_previousProtocol;
+    void            (^_itemBlock)(NSURL *, NSError *);
+    CK2Protocol     *(^_createBatchProtocolBlock)(Class, NSArray *);
+    CK2Protocol     *(^_createItemProtocolBlock)(Class, NSURLRequest *);
+    
+    CK2FileOperationMetrics *_metrics;
+    CK2Transcript           *_transcript;
     BOOL    _cancelled;
 }
 
@@ -68,8 +85,45 @@ NSString * const CK2FileMIMEType = @"CK2FileMIMEType";
                                        manager:(CK2FileManager *)manager
                                completionBlock:(void (^)(NSError *))block;
 
+- (id)initMoveOperationWithURL:(NSURL *)url
+                         toURL:(NSURL *)destinationURL
+                       manager:(CK2FileManager *)manager
+               completionBlock:(void (^)(NSError *))block;
+
+- (id)initCopyOperationWithURL:(NSURL *)url
+                         toURL:(NSURL *)destinationURL
+                       manager:(CK2FileManager *)manager
+               completionBlock:(void (^)(NSError *))block;
+
+- (id)initBatchDirectoryCreationOperationWithURLs:(NSArray *)urls
+                      withIntermediateDirectories:(BOOL)createIntermediates
+                                openingAttributes:(NSDictionary *)attributes
+                                          manager:(CK2FileManager *)manager
+                                      itemHandler:(void (^)(NSURL *, NSError *))itemBlock
+                                  completionBlock:(void (^)(NSError *))block;
+
+- (id)initBatchRemovalOperationWithURLs:(NSArray *)urls
+                                manager:(CK2FileManager *)manager
+                            itemHandler:(void (^)(NSURL *, NSError *))itemBlock
+                        completionBlock:(void (^)(NSError *))block;
+
+- (id)initBatchResourceValueSettingOperationWithURLs:(NSArray *)urls
+                                              values:(NSDictionary *)keyedValues
+                                             manager:(CK2FileManager *)manager
+                                         itemHandler:(void (^)(NSURL *, NSError *))itemBlock
+                                     completionBlock:(void (^)(NSError *))block;
+
+- (id)initBatchMoveOperationWithURLs:(NSArray *)urls
+                              toURLs:(NSArray *)destinationURLs
+                             manager:(CK2FileManager *)manager
+                         itemHandler:(void (^)(NSURL *, NSError *))itemBlock
+                     completionBlock:(void (^)(NSError *))block;
+
 - (void)cancel;
 
+// For when the protocol can't do what was asked of it
+- (NSError *)unsupportedErrorForURL:(NSURL *)url;
+
 @end
 
 
@@ -103,6 +157,25 @@ NSString * const CK2FileMIMEType = @"CK2FileMIMEType";
 @end
 
 
+@interface CK2FileManager (Internals)
+- (void)transcriptDidAppend;    // call from any thread
+@end
+
+
+@interface CK2FileOperationMetrics (Recording)
+
+// The started phase is recorded at initialization
+- (id)initWithName:(NSString *)name URL:(NSURL *)url;
+
+- (void)recordPhase:(CK2FileOperationPhase)phase;
+- (void)recordBytesSent:(unsigned long long)sent received:(unsigned long long)received;
+- (void)recordRetry;
+- (void)recordConnectionReused:(BOOL)reused;
+- (void)recordCompletionWithError:(NSError *)error;
+
+@end
+
+
 #pragma mark -
 
 
@@ -216,10 +289,150 @@ NSString * const CK2URLSymbolicLinkDestinationKey = @"CK2URLSymbolicLinkDestinat
     return [operation autorelease];
 }
 
+#pragma mark Moving and Copying Items
+
+- (BOOL)URL:(NSURL *)srcURL isOnSameServerAsURL:(NSURL *)dstURL;
+{
+    return ([[srcURL scheme] caseInsensitiveCompare:[dstURL scheme]] == NSOrderedSame &&
+            ([srcURL host] == [dstURL host] || [[srcURL host] caseInsensitiveCompare:[dstURL host]] == NSOrderedSame) &&
+            ([srcURL port] == [dstURL port] || [[srcURL port] isEqual:[dstURL port]]));
+}
+
+- (id)moveItemAtURL:(NSURL *)srcURL toURL:(NSURL *)dstURL completionHandler:(void (^)(NSError *))handler;
+{
+    NSParameterAssert(srcURL);
+    NSParameterAssert(dstURL);
+    NSParameterAssert([self URL:srcURL isOnSameServerAsURL:dstURL]);
+    
+    CK2FileOperation *operation = [[CK2FileOperation alloc] initMoveOperationWithURL:srcURL
+                                                                               toURL:dstURL
+                                                                             manager:self
+                                                                     completionBlock:handler];
+    return [operation autorelease];
+}
+
+- (id)copyItemAtURL:(NSURL *)srcURL toURL:(NSURL *)dstURL completionHandler:(void (^)(NSError *))handler;
+{
+    NSParameterAssert(srcURL);
+    NSParameterAssert(dstURL);
+    NSParameterAssert([self URL:srcURL isOnSameServerAsURL:dstURL]);
+    
+    CK2FileOperation *operation = [[CK2FileOperation alloc] initCopyOperationWithURL:srcURL
+                                                                               toURL:dstURL
+                                                                             manager:self
+                                                                     completionBlock:handler];
+    return [operation autorelease];
+}
+
+#pragma mark Batch Operations
+
+- (id)createDirectoriesAtURLs:(NSArray *)urls withIntermediateDirectories:(BOOL)createIntermediates openingAttributes:(NSDictionary *)attributes itemHandler:(void (^)(NSURL *, NSError *))itemHandler completionHandler:(void (^)(NSError *))handler;
+{
+    NSParameterAssert([urls count]);
+    
+    CK2FileOperation *operation = [[CK2FileOperation alloc] initBatchDirectoryCreationOperationWithURLs:urls
+                                                                            withIntermediateDirectories:createIntermediates
+                                                                                      openingAttributes:attributes
+                                                                                                manager:self
+                                                                                            itemHandler:itemHandler
+                                                                                        completionBlock:handler];
+    return [operation autorelease];
+}
+
+- (id)removeItemsAtURLs:(NSArray *)urls itemHandler:(void (^)(NSURL *, NSError *))itemHandler completionHandler:(void (^)(NSError *))handler;
+{
+    NSParameterAssert([urls count]);
+    
+    CK2FileOperation *operation = [[CK2FileOperation alloc] initBatchRemovalOperationWithURLs:urls
+                                                                                      manager:self
+                                                                                  itemHandler:itemHandler
+                                                                              completionBlock:handler];
+    return [operation autorelease];
+}
+
+- (id)setAttributes:(NSDictionary *)keyedValues ofItemsAtURLs:(NSArray *)urls itemHandler:(void (^)(NSURL *, NSError *))itemHandler completionHandler:(void (^)(NSError *))handler;
+{
+    NSParameterAssert(keyedValues);
+    NSParameterAssert([urls count]);
+    
+    CK2FileOperation *operation = [[CK2FileOperation alloc] initBatchResourceValueSettingOperationWithURLs:urls
+                                                                                                    values:keyedValues
+                                                                                                   manager:self
+                                                                                               itemHandler:itemHandler
+                                                                                           completionBlock:handler];
+    return [operation autorelease];
+}
+
+- (id)moveItemsAtURLs:(NSArray *)srcURLs toURLs:(NSArray *)dstURLs itemHandler:(void (^)(NSURL *, NSError *))itemHandler completionHandler:(void (^)(NSError *))handler;
+{
+    NSParameterAssert([srcURLs count]);
+    NSParameterAssert([srcURLs count] == [dstURLs count]);
+    
+    CK2FileOperation *operation = [[CK2FileOperation alloc] initBatchMoveOperationWithURLs:srcURLs
+                                                                                    toURLs:dstURLs
+                                                                                   manager:self
+                                                                               itemHandler:itemHandler
+                                                                           completionBlock:handler];
+    return [operation autorelease];
+}
+
+#pragma mark Lifecycle
+
+- (id)init;
+{
+    if (self = [super init])
+    {
+        _transcript = [[CK2Transcript alloc] init];
+        _transcriptQueue = dispatch_queue_create("com.karelia.connection.transcript", NULL);
+    }
+    
+    return self;
+}
+
+- (void)dealloc;
+{
+    [_metricsCollector release];
+    [_transcript release];
+    if (_transcriptQueue) dispatch_release(_transcriptQueue);
+    
+    [super dealloc];
+}
+
 #pragma mark Delegate
 
 @synthesize delegate = _delegate;
 
+#pragma mark Transcript
+
+@synthesize transcript = _transcript;
+
+- (void)transcriptDidAppend;
+{
+    // With nobody listening, entries just wait in the buffer until someone reads it
+    if (![[self delegate] respondsToSelector:@selector(fileManager:appendString:toTranscript:)]) return;
+    
+    // One delivery queued up at a time is enough; it picks up everything appended before it runs
+    if (!OSAtomicCompareAndSwap32Barrier(0, 1, &_transcriptDeliveryPending)) return;
+    
+    dispatch_async(_transcriptQueue, ^{
+        
+        // Anything appended from here on queues up another delivery
+        _transcriptDeliveryPending = 0;
+        OSMemoryBarrier();
+        
+        id <CK2FileManagerDelegate> delegate = [self delegate];
+        if (![delegate respondsToSelector:@selector(fileManager:appendString:toTranscript:)]) return;
+        
+        _transcriptSequence = [_transcript enumerateEntriesFromSequence:_transcriptSequence usingBlock:^(NSDate *date, CKTranscriptType type, NSString *string) {
+            [delegate fileManager:self appendString:string toTranscript:type];
+        }];
+    });
+}
+
+#pragma mark Metrics
+
+@synthesize metricsCollector = _metricsCollector;
+
 #pragma mark URLs
 
 + (NSURL *)URLWithPath:(NSString *)path relativeToURL:(NSURL *)baseURL;
@@ -272,6 +485,7 @@ NSString * const CK2URLSymbolicLinkDestinationKey = @"CK2URLSymbolicLinkDestinat
 #pragma mark Lifecycle
 
 - (id)initWithURL:(NSURL *)url
+             name:(NSString *)name
           manager:(CK2FileManager *)manager
 completionHandler:(void (^)(NSError *))completionBlock
 createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
@@ -285,6 +499,8 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
         _URL = [url copy];
         _completionBlock = [completionBlock copy];
         _queue = dispatch_queue_create("com.karelia.connection.file-operation", NULL);
+        _metrics = [[CK2FileOperationMetrics alloc] initWithName:name URL:url];
+        _transcript = [[manager transcript] retain];
         
         [CK2Protocol classForURL:url completionHandler:^(Class protocolClass) {
             
@@ -297,9 +513,17 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
                     if (![self isCancelled])
                     {
                         _protocol = createBlock(protocolClass);
-                        // TODO: Handle protocol's init method returning nil
                         
-                        if (![self isCancelled]) [_protocol start];
+                        if (!_protocol)
+                        {
+                            // Protocol doesn't support this operation. If the create block already reported an error, this will go ignored
+                            [self finishWithError:[self unsupportedErrorForURL:url]];
+                        }
+                        else if (![self isCancelled])
+                        {
+                            [_metrics recordPhase:CK2FileOperationPhaseProtocolResolved];
+                            [_protocol start];
+                        }
                     }
                 });
             }
@@ -323,7 +547,7 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
                      enumerationBlock:(void (^)(NSURL *))enumBlock
                       completionBlock:(void (^)(NSError *))block;
 {
-    self = [self initWithURL:url manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
+    self = [self initWithURL:url name:@"list" manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
         
         // If we try to do this outside the block there's a risk the protocol object will be created *before* the enum block has been stored, which ends real badly
         _enumerationBlock = [enumBlock copy];
@@ -343,7 +567,7 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
                                     manager:(CK2FileManager *)manager
                             completionBlock:(void (^)(NSError *))block;
 {
-    return [self initWithURL:url manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
+    return [self initWithURL:url name:@"mkdir" manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
         
         return [[protocolClass alloc] initForCreatingDirectoryWithRequest:[manager requestWithURL:url]
                                               withIntermediateDirectories:createIntermediates
@@ -360,7 +584,7 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
                          progressBlock:(CK2ProgressBlock)progressBlock
                        completionBlock:(void (^)(NSError *))block;
 {
-    return [self initWithURL:url manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
+    return [self initWithURL:url name:@"upload" manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
         
         NSMutableURLRequest *request = [[manager requestWithURL:url] mutableCopy];
         request.HTTPBody = data;
@@ -384,15 +608,23 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
                          progressBlock:(CK2ProgressBlock)progressBlock
                        completionBlock:(void (^)(NSError *))block;
 {
-    return [self initWithURL:url manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
+    return [self initWithURL:url name:@"upload" manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
         
         _localURL = [sourceURL copy];
         
         NSMutableURLRequest *request = [[manager requestWithURL:url] mutableCopy];
         
-        // Read the data using an input stream if possible, and know file size
+        // Best is to map the file into memory, so protocols can read straight from it, without buffering through a stream
+        CK2LocalFileSource *source = ([sourceURL isFileURL] ? [[CK2LocalFileSource alloc] initWithURL:sourceURL error:NULL] : nil);
+        if (source)
+        {
+            [request setHTTPBody:[source data]];
+            [source release];
+        }
+        
+        // Otherwise read the data using an input stream if possible, and know file size
         NSNumber *fileSize;
-        if ([sourceURL getResourceValue:&fileSize forKey:NSURLFileSizeKey error:NULL] && fileSize)
+        if (!request.HTTPBody && [sourceURL getResourceValue:&fileSize forKey:NSURLFileSizeKey error:NULL] && fileSize)
         {
             NSString *length = [NSString stringWithFormat:@"%llu", fileSize.unsignedLongLongValue];
             
@@ -404,7 +636,7 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
             }
         }
         
-        if (!request.HTTPBodyStream)
+        if (!request.HTTPBody && !request.HTTPBodyStream)
         {
             NSError *error;
             NSData *data = [[NSData alloc] initWithContentsOfURL:sourceURL options:0 error:&error];
@@ -438,7 +670,7 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
                           manager:(CK2FileManager *)manager
                   completionBlock:(void (^)(NSError *))block;
 {
-    return [self initWithURL:url manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
+    return [self initWithURL:url name:@"remove" manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
         
         return [[protocolClass alloc] initForRemovingFileWithRequest:[manager requestWithURL:url] client:self];
     }];
@@ -449,7 +681,7 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
                                        manager:(CK2FileManager *)manager
                                completionBlock:(void (^)(NSError *))block;
 {
-    return [self initWithURL:url manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
+    return [self initWithURL:url name:@"setAttributes" manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
         
         return [[protocolClass alloc] initForSettingAttributes:keyedValues
                                                  ofItemWithRequest:[manager requestWithURL:url]
@@ -457,16 +689,264 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
     }];
 }
 
+- (id)initMoveOperationWithURL:(NSURL *)url
+                         toURL:(NSURL *)destinationURL
+                       manager:(CK2FileManager *)manager
+               completionBlock:(void (^)(NSError *))block;
+{
+    return [self initWithURL:url name:@"move" manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
+        
+        return [[protocolClass alloc] initForMovingItemWithRequest:[manager requestWithURL:url]
+                                                             toURL:destinationURL
+                                                            client:self];
+    }];
+}
+
+- (id)initCopyOperationWithURL:(NSURL *)url
+                         toURL:(NSURL *)destinationURL
+                       manager:(CK2FileManager *)manager
+               completionBlock:(void (^)(NSError *))block;
+{
+    return [self initWithURL:url name:@"copy" manager:manager completionHandler:block createProtocolBlock:^CK2Protocol *(Class protocolClass) {
+        
+        return [[protocolClass alloc] initForCopyingItemWithRequest:[manager requestWithURL:url]
+                                                              toURL:destinationURL
+                                                             client:self];
+    }];
+}
+
+#pragma mark Batches
+
+- (id)initWithURLs:(NSArray *)urls
+              name:(NSString *)name
+           manager:(CK2FileManager *)manager
+       itemHandler:(void (^)(NSURL *, NSError *))itemBlock
+ completionHandler:(void (^)(NSError *))completionBlock
+createBatchProtocolBlock:(CK2Protocol *(^)(Class protocolClass, NSArray *requests))batchBlock
+createItemProtocolBlock:(CK2Protocol *(^)(Class protocolClass, NSURLRequest *request))itemProtocolBlock;
+{
+    NSParameterAssert([urls count]);
+    
+    // Group by directory, maintaining the order in which directories were first encountered, as clients might be relying on that to create parents first
+    NSMutableArray *batches = [[NSMutableArray alloc] init];
+    NSMutableDictionary *batchesByDirectory = [[NSMutableDictionary alloc] init];
+    
+    for (NSURL *aURL in urls)
+    {
+        NSString *directory = [[[aURL URLByDeletingLastPathComponent] absoluteURL] absoluteString];
+        NSMutableArray *batch = [batchesByDirectory objectForKey:directory];
+        if (!batch)
+        {
+            batch = [[NSMutableArray alloc] init];
+            [batchesByDirectory setObject:batch forKey:directory];
+            [batches addObject:batch];
+            [batch release];
+        }
+        
+        [batch addObject:aURL];
+    }
+    
+    [batchesByDirectory release];
+    
+    
+    self = [self initWithURL:[urls objectAtIndex:0] name:name manager:manager completionHandler:completionBlock createProtocolBlock:^CK2Protocol *(Class protocolClass) {
+        
+        // As with enumeration, have to store these here rather than after init, otherwise the protocol could be created first
+        _protocolClass = protocolClass;
+        _batches = [batches retain];
+        _itemBlock = [itemBlock copy];
+        _createBatchProtocolBlock = [batchBlock copy];
+        _createItemProtocolBlock = [itemProtocolBlock copy];
+        
+        // If there's nothing the protocol can do, every item's already been reported as unsupported, so the operation itself has succeeded in reporting that. Finishing first means the generic unsupported error goes ignored
+        CK2Protocol *result = [self newProtocolForNextBatch];
+        if (!result) [self finishWithError:nil];
+        return result;
+    }];
+    
+    [batches release];
+    return self;
+}
+
+- (id)initBatchDirectoryCreationOperationWithURLs:(NSArray *)urls
+                      withIntermediateDirectories:(BOOL)createIntermediates
+                                openingAttributes:(NSDictionary *)attributes
+                                          manager:(CK2FileManager *)manager
+                                      itemHandler:(void (^)(NSURL *, NSError *))itemBlock
+                                  completionBlock:(void (^)(NSError *))block;
+{
+    return [self initWithURLs:urls name:@"batchMkdir" manager:manager itemHandler:itemBlock completionHandler:block createBatchProtocolBlock:^CK2Protocol *(Class protocolClass, NSArray *requests) {
+        
+        return [[protocolClass alloc] initForCreatingDirectoriesWithRequests:requests
+                                                 withIntermediateDirectories:createIntermediates
+                                                           openingAttributes:attributes
+                                                                      client:self];
+        
+    } createItemProtocolBlock:^CK2Protocol *(Class protocolClass, NSURLRequest *request) {
+        
+        return [[protocolClass alloc] initForCreatingDirectoryWithRequest:request
+                                              withIntermediateDirectories:createIntermediates
+                                                        openingAttributes:attributes
+                                                                   client:self];
+    }];
+}
+
+- (id)initBatchRemovalOperationWithURLs:(NSArray *)urls
+                                manager:(CK2FileManager *)manager
+                            itemHandler:(void (^)(NSURL *, NSError *))itemBlock
+                        completionBlock:(void (^)(NSError *))block;
+{
+    return [self initWithURLs:urls name:@"batchRemove" manager:manager itemHandler:itemBlock completionHandler:block createBatchProtocolBlock:^CK2Protocol *(Class protocolClass, NSArray *requests) {
+        
+        return [[protocolClass alloc] initForRemovingFilesWithRequests:requests client:self];
+        
+    } createItemProtocolBlock:^CK2Protocol *(Class protocolClass, NSURLRequest *request) {
+        
+        return [[protocolClass alloc] initForRemovingFileWithRequest:request client:self];
+    }];
+}
+
+- (id)initBatchResourceValueSettingOperationWithURLs:(NSArray *)urls
+                                              values:(NSDictionary *)keyedValues
+                                             manager:(CK2FileManager *)manager
+                                         itemHandler:(void (^)(NSURL *, NSError *))itemBlock
+                                     completionBlock:(void (^)(NSError *))block;
+{
+    return [self initWithURLs:urls name:@"batchSetAttributes" manager:manager itemHandler:itemBlock completionHandler:block createBatchProtocolBlock:^CK2Protocol *(Class protocolClass, NSArray *requests) {
+        
+        return [[protocolClass alloc] initForSettingAttributes:keyedValues ofItemsWithRequests:requests client:self];
+        
+    } createItemProtocolBlock:^CK2Protocol *(Class protocolClass, NSURLRequest *request) {
+        
+        return [[protocolClass alloc] initForSettingAttributes:keyedValues ofItemWithRequest:request client:self];
+    }];
+}
+
+- (id)initBatchMoveOperationWithURLs:(NSArray *)urls
+                              toURLs:(NSArray *)destinationURLs
+                             manager:(CK2FileManager *)manager
+                         itemHandler:(void (^)(NSURL *, NSError *))itemBlock
+                     completionBlock:(void (^)(NSError *))block;
+{
+    // Batches are made up of the sources, so look up where each is going
+    NSDictionary *destinations = [NSDictionary dictionaryWithObjects:destinationURLs forKeys:urls];
+    
+    return [self initWithURLs:urls name:@"batchMove" manager:manager itemHandler:itemBlock completionHandler:block createBatchProtocolBlock:^CK2Protocol *(Class protocolClass, NSArray *requests) {
+        
+        NSMutableArray *batchDestinations = [NSMutableArray arrayWithCapacity:[requests count]];
+        for (NSURLRequest *aRequest in requests)
+        {
+            [batchDestinations addObject:[destinations objectForKey:[aRequest URL]]];
+        }
+        
+        return [[protocolClass alloc] initForMovingItemsWithRequests:requests toURLs:batchDestinations client:self];
+        
+    } createItemProtocolBlock:^CK2Protocol *(Class protocolClass, NSURLRequest *request) {
+        
+        return [[protocolClass alloc] initForMovingItemWithRequest:request toURL:[destinations objectForKey:[request URL]] client:self];
+    }];
+}
+
+// Only call on the operation's queue
+- (CK2Protocol *)newProtocolForNextBatch;
+{
+    [_currentItemURL release]; _currentItemURL = nil;
+    
+    while ([_fallbackURLs count] || [_batches count])
+    {
+        // Work through any items the protocol couldn't handle as a batch, one at a time
+        if ([_fallbackURLs count])
+        {
+            _currentItemURL = [[_fallbackURLs objectAtIndex:0] retain];
+            [_fallbackURLs removeObjectAtIndex:0];
+            
+            CK2Protocol *result = _createItemProtocolBlock(_protocolClass, [_manager requestWithURL:_currentItemURL]);
+            if (result) return result;
+            
+            [self reportItemAtURL:_currentItemURL error:[self unsupportedErrorForURL:_currentItemURL]];
+            [_currentItemURL release]; _currentItemURL = nil;
+            continue;
+        }
+        
+        NSArray *batch = [[_batches objectAtIndex:0] retain];
+        [_batches removeObjectAtIndex:0];
+        
+        NSMutableArray *requests = [[NSMutableArray alloc] initWithCapacity:[batch count]];
+        for (NSURL *aURL in batch)
+        {
+            [requests addObject:[_manager requestWithURL:aURL]];
+        }
+        
+        CK2Protocol *result = _createBatchProtocolBlock(_protocolClass, requests);
+        [requests release];
+        
+        if (!result)
+        {
+            [_fallbackURLs release]; _fallbackURLs = [batch mutableCopy];
+        }
+        
+        [batch release];
+        if (result) return result;
+    }
+    
+    return nil;
+}
+
+- (void)startNextBatch;
+{
+    dispatch_async(_queue, ^{
+        
+        if ([self isCancelled]) return;
+        
+        // The finished protocol might well still be unwinding its stack, so hang onto it until the next one is done
+        [_previousProtocol release]; _previousProtocol = _protocol;
+        _protocol = [self newProtocolForNextBatch];
+        
+        if (_protocol)
+        {
+            [_protocol start];
+        }
+        else
+        {
+            [self finishWithError:nil];
+        }
+    });
+}
+
+- (void)reportItemAtURL:(NSURL *)url error:(NSError *)error;
+{
+    // Run on own queue so that items are always reported before the completion block, and never after it
+    dispatch_async(_queue, ^{
+        if (_itemBlock) _itemBlock(url, error);
+    });
+}
+
+#pragma mark Completion
+
+- (NSError *)unsupportedErrorForURL:(NSURL *)url;
+{
+    NSDictionary *info = @{NSURLErrorKey : url, NSURLErrorFailingURLErrorKey : url, NSURLErrorFailingURLStringErrorKey : [url absoluteString]};
+    return [NSError errorWithDomain:NSCocoaErrorDomain code:NSFeatureUnsupportedError userInfo:info];
+}
+
 - (void)finishWithError:(NSError *)error;
 {
     // Run completion block on own queue so that:
     //  A) It doesn't potentially hold up the calling queue for too long
     //  B) Serialises access, guaranteeing the block is only run once
+    // The manager is captured up front for reporting metrics, as the ivar is about to be cleared
+    CK2FileManager *manager = _manager;
+    
     dispatch_async(_queue, ^{
         if (_completionBlock)
         {
+            [_metrics recordCompletionWithError:error];
+            
             _completionBlock(error);
             [_completionBlock release]; _completionBlock = nil;
+            [_itemBlock release]; _itemBlock = nil;
+            
+            [self reportMetricsToManager:manager];
         }
     });
     
@@ -475,6 +955,21 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
     [_manager release]; _manager = nil;
 }
 
+// Only call on the operation's queue, once complete
+- (void)reportMetricsToManager:(CK2FileManager *)manager;
+{
+    CK2FileOperationMetricsCollector *collector = [manager metricsCollector];
+    id <CK2FileManagerDelegate> delegate = [manager delegate];
+    BOOL delegateWantsMetrics = [delegate respondsToSelector:@selector(fileManager:didFinishOperation:withMetrics:)];
+    if (!collector && !delegateWantsMetrics) return;
+    
+    // A protocol that's been cancelled might still be winding down, so hand out a snapshot that won't change underneath anyone
+    CK2FileOperationMetrics *metrics = [_metrics copy];
+    [collector addMetrics:metrics];
+    if (delegateWantsMetrics) [delegate fileManager:manager didFinishOperation:self withMetrics:metrics];
+    [metrics release];
+}
+
 - (void)dealloc
 {
     [_protocol release];
@@ -484,6 +979,15 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
     [_completionBlock release];
     [_enumerationBlock release];
     [_localURL release];
+    [_batches release];
+    [_fallbackURLs release];
+    [_currentItemURL release];
+    [_previousProtocol release];
+    [_itemBlock release];
+    [_createBatchProtocolBlock release];
+    [_createItemProtocolBlock release];
+    [_metrics release];
+    [_transcript release];
     
     [super dealloc];
 }
@@ -510,51 +1014,78 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
 
 #pragma mark CK2ProtocolClient
 
+// Once a batch's protocol has finished, the next one takes over while the previous might still be unwinding and reporting in. Anything from other than the current protocol is stale, so gets ignored
+- (BOOL)isCurrentProtocol:(CK2Protocol *)protocol;
+{
+    if (protocol == _protocol) return YES;
+    
+    NSParameterAssert(_batches);
+    return NO;
+}
+
 - (void)protocol:(CK2Protocol *)protocol didFailWithError:(NSError *)error;
 {
-    NSParameterAssert(protocol == _protocol);
+    if (![self isCurrentProtocol:protocol]) return;
     if ([self isCancelled]) return; // ignore errors once cancelled as protocol might be trying to invent its own
     
     if (!error) error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorUnknown userInfo:nil];
+    
+    // Individual items failing don't stop the rest of a batch
+    if (_currentItemURL)
+    {
+        [self reportItemAtURL:_currentItemURL error:error];
+        [self startNextBatch];
+        return;
+    }
+    
     [self finishWithError:error];
 }
 
 - (void)protocolDidFinish:(CK2Protocol *)protocol;
 {
-    NSParameterAssert(protocol == _protocol);
+    if (![self isCurrentProtocol:protocol]) return;
     // Might as well report success even if cancelled
     
+    if (_batches)
+    {
+        if (_currentItemURL) [self reportItemAtURL:_currentItemURL error:nil];
+        [self startNextBatch];
+        return;
+    }
+    
     [self finishWithError:nil];
 }
 
+- (void)protocol:(CK2Protocol *)protocol didCompleteItemAtURL:(NSURL *)url error:(NSError *)error;
+{
+    if (![self isCurrentProtocol:protocol]) return;
+    [self reportItemAtURL:url error:error];
+}
+
 - (void)protocol:(CK2Protocol *)protocol didReceiveAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge;
 {
-    NSParameterAssert(protocol == _protocol);
+    if (![self isCurrentProtocol:protocol]) return;
     if ([self isCancelled]) return; // don't care about auth once cancelled
     
+    if ([challenge previousFailureCount] > 0) [_metrics recordRetry];
     [CK2AuthenticationChallengeTrampoline handleChallenge:challenge operation:self];
     // TODO: Cache credentials per protection space
 }
 
 - (void)protocol:(CK2Protocol *)protocol appendString:(NSString *)info toTranscript:(CKTranscriptType)transcript;
 {
-    NSParameterAssert(protocol == _protocol);
-    // Even if cancelled, allow through since could well be valuable debugging info
+    NSParameterAssert(protocol == _protocol || _batches);
+    // Even if cancelled, or from a batch's previous protocol, allow through since could well be valuable debugging info
     
-    // Tell delegate on a global queue so that we don't risk blocking the op's serial queue, delaying cancellation
-    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-        
-        id <CK2FileManagerDelegate> delegate = [_manager delegate];
-        if ([delegate respondsToSelector:@selector(fileManager:appendString:toTranscript:)])
-        {
-            [delegate fileManager:_manager appendString:info toTranscript:transcript];
-        }
-    });
+    // Capturing is cheap; the manager takes care of handing entries on to its delegate, off on its own queue so as not to block the op's serial queue, delaying cancellation
+    // Once finished, the manager's already been let go, so any stragglers only make it to the delegate alongside the next operation's entries
+    [_transcript appendString:info ofType:transcript];
+    [_manager transcriptDidAppend];
 }
 
 - (void)protocol:(CK2Protocol *)protocol didDiscoverItemAtURL:(NSURL *)url;
 {
-    NSParameterAssert(protocol == _protocol);
+    if (![self isCurrentProtocol:protocol]) return;
     // Even if cancelled, allow through as the discovery still stands; might be useful for caching elsewhere
     
     if (_enumerationBlock) _enumerationBlock(url);
@@ -563,11 +1094,33 @@ createProtocolBlock:(CK2Protocol *(^)(Class protocolClass))createBlock;
 - (NSInputStream *)protocol:(CK2Protocol *)protocol needNewBodyStream:(NSURLRequest *)request;
 {
     NSParameterAssert(protocol == _protocol);
+    
+    // The operation itself asks for the initial stream, without a protocol
+    if (protocol) [_metrics recordRetry];
 
     NSInputStream *stream = [[NSInputStream alloc] initWithURL:_localURL];
     return [stream autorelease];
 }
 
+#pragma mark Metrics
+
+// No point asserting the protocol here, as a batch's previous protocol might still be reporting in while it unwinds
+
+- (void)protocol:(CK2Protocol *)protocol didConnectReusingConnection:(BOOL)reused;
+{
+    [_metrics recordConnectionReused:reused];
+}
+
+- (void)protocolDidAuthenticate:(CK2Protocol *)protocol;
+{
+    [_metrics recordPhase:CK2FileOperationPhaseAuthenticated];
+}
+
+- (void)protocol:(CK2Protocol *)protocol didSendBytes:(unsigned long long)sent receivedBytes:(unsigned long long)received;
+{
+    [_metrics recordBytesSent:sent received:received];
+}
+
 @end
 
 
@@ -0,0 +1,88 @@
+//
+//  CK2FileOperationMetrics.h
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import <Foundation/Foundation.h>
+
+
+// Points in the life of a CK2FileManager operation. Not every operation passes through them all; e.g. file: URLs never connect, and directory creation has no body to send
+typedef NS_ENUM(NSInteger, CK2FileOperationPhase) {
+    CK2FileOperationPhaseStarted,           // operation was created, and began looking up a protocol to handle the URL
+    CK2FileOperationPhaseProtocolResolved,  // protocol instance created and about to start
+    CK2FileOperationPhaseConnected,         // first connection opened, or picked up from the protocol's pool
+    CK2FileOperationPhaseAuthenticated,     // server accepted our credentials
+    CK2FileOperationPhaseFirstByte,         // first bytes sent or received
+    CK2FileOperationPhaseLastByte,          // most recent bytes sent or received
+    CK2FileOperationPhaseCompleted,         // completion handler called
+    CK2FileOperationPhaseCount
+};
+
+
+// A record of where the time went in an operation, and how much it shifted. Handed out once the operation completes, at which point it's immutable
+@interface CK2FileOperationMetrics : NSObject <NSCopying>
+{
+  @private
+    NSString    *_name;
+    NSURL       *_URL;
+    NSError     *_error;
+
+    volatile int64_t    _phaseTimes[CK2FileOperationPhaseCount];    // mach_absolute_time(); 0 if not reached
+    volatile int64_t    _bytesSent;
+    volatile int64_t    _bytesReceived;
+    volatile int32_t    _retryCount;
+    volatile int32_t    _reusedConnection;  // 0 if not known, otherwise 1 + whether reused
+}
+
+// Short name for the kind of operation, e.g. @"upload" or @"mkdir", suitable for grouping
+@property(nonatomic, readonly, copy) NSString *name;
+@property(nonatomic, readonly, copy) NSURL *URL;
+
+// nil if the operation succeeded
+@property(nonatomic, readonly, retain) NSError *error;
+
+// Seconds from the start of the operation until the phase was reached, or a negative number if it never was
+- (NSTimeInterval)timeToPhase:(CK2FileOperationPhase)phase;
++ (NSString *)nameOfPhase:(CK2FileOperationPhase)phase;
+
+@property(nonatomic, readonly) unsigned long long bytesSent;
+@property(nonatomic, readonly) unsigned long long bytesReceived;
+
+// Authentication attempts beyond the first, and restarts of the body stream
+@property(nonatomic, readonly) NSUInteger retryCount;
+
+// Boolean for whether the protocol could re-use an existing connection, rather than opening a new one. nil if the protocol didn't say, e.g. it doesn't pool connections
+@property(nonatomic, readonly, copy) NSNumber *reusedConnection;
+
+// Property list of all the above, for logging or exporting as JSON
+- (NSDictionary *)dictionaryRepresentation;
+
+@end
+
+
+// Aggregates metrics from any number of operations into counters and histograms. Cheap enough to leave hooked up to a CK2FileManager permanently; all methods are threadsafe
+@interface CK2FileOperationMetricsCollector : NSObject
+{
+  @private
+    dispatch_queue_t    _queue;
+    NSMutableDictionary *_counters;
+    NSUInteger          _histograms[CK2FileOperationPhaseCount][16];
+}
+
+- (void)addMetrics:(CK2FileOperationMetrics *)metrics;
+- (void)reset;
+
+// Totals across all operations so far, keyed by name. Operations are counted per-kind too, as @"operations.<name>" and @"failures.<name>"
+- (NSDictionary *)counters;
+
+// Keyed by phase name, each an array of operation counts, bucketed by time to reach that phase. The buckets' upper bounds are given by +histogramBucketBounds
+- (NSDictionary *)histograms;
++ (NSArray *)histogramBucketBounds; // seconds. The last bucket is unbounded
+
+// Counters and histograms together, ready for NSJSONSerialization
+- (NSDictionary *)dictionaryRepresentation;
+
+@end
@@ -0,0 +1,338 @@
+//
+//  CK2FileOperationMetrics.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CK2FileOperationMetrics.h"
+
+#include <libkern/OSAtomic.h>
+#include <mach/mach_time.h>
+
+
+#define kHistogramBucketCount 16
+
+// Roughly logarithmic, from a quick local operation up to a stalled connection. Anything slower lands in the final, unbounded bucket
+static const NSTimeInterval kHistogramBucketBounds[kHistogramBucketCount - 1] = {
+    0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1, 2, 5, 10, 30, 60
+};
+
+
+static NSTimeInterval CK2SecondsFromMachTime(uint64_t interval)
+{
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) mach_timebase_info(&timebase);
+
+    return (double)interval * timebase.numer / timebase.denom / NSEC_PER_SEC;
+}
+
+
+@implementation CK2FileOperationMetrics
+
+#pragma mark Lifecycle
+
+- (id)initWithName:(NSString *)name URL:(NSURL *)url;
+{
+    if (self = [self init])
+    {
+        _name = [name copy];
+        _URL = [url copy];
+        _phaseTimes[CK2FileOperationPhaseStarted] = mach_absolute_time();
+    }
+
+    return self;
+}
+
+- (void)dealloc;
+{
+    [_name release];
+    [_URL release];
+    [_error release];
+
+    [super dealloc];
+}
+
+- (id)copyWithZone:(NSZone *)zone;
+{
+    CK2FileOperationMetrics *result = [[[self class] allocWithZone:zone] initWithName:_name URL:_URL];
+
+    for (CK2FileOperationPhase phase = 0; phase < CK2FileOperationPhaseCount; phase++)
+    {
+        result->_phaseTimes[phase] = _phaseTimes[phase];
+    }
+    result->_bytesSent = _bytesSent;
+    result->_bytesReceived = _bytesReceived;
+    result->_retryCount = _retryCount;
+    result->_error = [[self error] retain];
+    result->_reusedConnection = _reusedConnection;
+
+    return result;
+}
+
+#pragma mark Recording
+// Protocols report in from whichever thread suits them, so these stick to atomic stores, adds and swaps rather than taking a lock
+
+- (void)recordPhase:(CK2FileOperationPhase)phase;
+{
+    NSParameterAssert(phase >= 0 && phase < CK2FileOperationPhaseCount);
+
+    // Only the first time a phase is reached counts, bar the last byte which keeps moving on
+    int64_t now = mach_absolute_time();
+    if (phase == CK2FileOperationPhaseLastByte)
+    {
+        int64_t last;
+        do
+        {
+            last = _phaseTimes[phase];
+        } while (now > last && !OSAtomicCompareAndSwap64Barrier(last, now, &_phaseTimes[phase]));
+    }
+    else
+    {
+        OSAtomicCompareAndSwap64Barrier(0, now, &_phaseTimes[phase]);
+    }
+}
+
+- (void)recordBytesSent:(unsigned long long)sent received:(unsigned long long)received;
+{
+    if (sent) OSAtomicAdd64Barrier(sent, &_bytesSent);
+    if (received) OSAtomicAdd64Barrier(received, &_bytesReceived);
+
+    if (sent || received)
+    {
+        [self recordPhase:CK2FileOperationPhaseFirstByte];
+        [self recordPhase:CK2FileOperationPhaseLastByte];
+    }
+}
+
+- (void)recordRetry;
+{
+    OSAtomicIncrement32Barrier(&_retryCount);
+}
+
+- (void)recordConnectionReused:(BOOL)reused;
+{
+    // Only interested in the first connection, same as the phase
+    if (OSAtomicCompareAndSwap32Barrier(0, (reused ? 2 : 1), &_reusedConnection))
+    {
+        [self recordPhase:CK2FileOperationPhaseConnected];
+    }
+}
+
+- (void)recordCompletionWithError:(NSError *)error;
+{
+    [self recordPhase:CK2FileOperationPhaseCompleted];
+
+    // Likewise only the first completion, should there somehow be more
+    if (error && OSAtomicCompareAndSwapPtrBarrier(nil, error, (void * volatile *)&_error)) [error retain];
+}
+
+#pragma mark Properties
+
+@synthesize name = _name;
+@synthesize URL = _URL;
+- (NSError *)error;
+{
+    OSMemoryBarrier();
+    return _error;
+}
+
+- (NSNumber *)reusedConnection;
+{
+    switch (_reusedConnection)
+    {
+        case 1:     return [NSNumber numberWithBool:NO];
+        case 2:     return [NSNumber numberWithBool:YES];
+        default:    return nil;
+    }
+}
+
+- (unsigned long long)bytesSent; { return _bytesSent; }
+- (unsigned long long)bytesReceived; { return _bytesReceived; }
+- (NSUInteger)retryCount; { return _retryCount; }
+
+- (NSTimeInterval)timeToPhase:(CK2FileOperationPhase)phase;
+{
+    NSParameterAssert(phase >= 0 && phase < CK2FileOperationPhaseCount);
+
+    int64_t time = _phaseTimes[phase];
+    if (time == 0) return -1.0;
+    return CK2SecondsFromMachTime(time - _phaseTimes[CK2FileOperationPhaseStarted]);
+}
+
++ (NSString *)nameOfPhase:(CK2FileOperationPhase)phase;
+{
+    switch (phase)
+    {
+        case CK2FileOperationPhaseStarted:          return @"started";
+        case CK2FileOperationPhaseProtocolResolved: return @"protocolResolved";
+        case CK2FileOperationPhaseConnected:        return @"connected";
+        case CK2FileOperationPhaseAuthenticated:    return @"authenticated";
+        case CK2FileOperationPhaseFirstByte:        return @"firstByte";
+        case CK2FileOperationPhaseLastByte:         return @"lastByte";
+        case CK2FileOperationPhaseCompleted:        return @"completed";
+        default:                                    return nil;
+    }
+}
+
+- (NSDictionary *)dictionaryRepresentation;
+{
+    NSMutableDictionary *phases = [NSMutableDictionary dictionaryWithCapacity:CK2FileOperationPhaseCount];
+    for (CK2FileOperationPhase phase = CK2FileOperationPhaseProtocolResolved; phase < CK2FileOperationPhaseCount; phase++)
+    {
+        NSTimeInterval time = [self timeToPhase:phase];
+        if (time >= 0.0) [phases setObject:@(time) forKey:[[self class] nameOfPhase:phase]];
+    }
+
+    NSMutableDictionary *result = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                   _name, @"name",
+                                   [_URL absoluteString], @"url",
+                                   phases, @"phases",
+                                   @([self bytesSent]), @"bytesSent",
+                                   @([self bytesReceived]), @"bytesReceived",
+                                   @([self retryCount]), @"retries",
+                                   nil];
+
+    NSNumber *reused = [self reusedConnection];
+    NSError *error = [self error];
+    if (reused) [result setObject:reused forKey:@"reusedConnection"];
+    if (error) [result setObject:[NSString stringWithFormat:@"%@ %ld", [error domain], (long)[error code]] forKey:@"error"];
+
+    return result;
+}
+
+- (NSString *)description;
+{
+    return [NSString stringWithFormat:@"<%@ %p %@>", NSStringFromClass([self class]), self, [self dictionaryRepresentation]];
+}
+
+@end
+
+
+#pragma mark -
+
+
+@implementation CK2FileOperationMetricsCollector
+
+- (id)init;
+{
+    if (self = [super init])
+    {
+        _queue = dispatch_queue_create("com.karelia.connection.metrics-collector", NULL);
+        _counters = [[NSMutableDictionary alloc] init];
+    }
+
+    return self;
+}
+
+- (void)dealloc;
+{
+    if (_queue) dispatch_release(_queue);
+    [_counters release];
+
+    [super dealloc];
+}
+
+#pragma mark Recording
+
+- (void)incrementCounter:(NSString *)key by:(unsigned long long)amount;
+{
+    NSNumber *count = [_counters objectForKey:key];
+    [_counters setObject:@([count unsignedLongLongValue] + amount) forKey:key];
+}
+
+- (void)addMetrics:(CK2FileOperationMetrics *)metrics;
+{
+    // Asynchronous so reporting operations never wait on someone else reading out the results
+    dispatch_async(_queue, ^{
+
+        NSString *name = [metrics name];
+        [self incrementCounter:@"operations" by:1];
+        [self incrementCounter:[@"operations." stringByAppendingString:name] by:1];
+
+        if ([metrics error])
+        {
+            [self incrementCounter:@"failures" by:1];
+            [self incrementCounter:[@"failures." stringByAppendingString:name] by:1];
+        }
+
+        [self incrementCounter:@"bytesSent" by:[metrics bytesSent]];
+        [self incrementCounter:@"bytesReceived" by:[metrics bytesReceived]];
+        [self incrementCounter:@"retries" by:[metrics retryCount]];
+
+        NSNumber *reused = [metrics reusedConnection];
+        if (reused) [self incrementCounter:([reused boolValue] ? @"connections.reused" : @"connections.new") by:1];
+
+        for (CK2FileOperationPhase phase = CK2FileOperationPhaseProtocolResolved; phase < CK2FileOperationPhaseCount; phase++)
+        {
+            NSTimeInterval time = [metrics timeToPhase:phase];
+            if (time < 0.0) continue;
+
+            NSUInteger bucket = 0;
+            while (bucket < kHistogramBucketCount - 1 && time > kHistogramBucketBounds[bucket]) bucket++;
+            _histograms[phase][bucket]++;
+        }
+    });
+}
+
+- (void)reset;
+{
+    dispatch_async(_queue, ^{
+        [_counters removeAllObjects];
+        memset(_histograms, 0, sizeof(_histograms));
+    });
+}
+
+#pragma mark Results
+
+- (NSDictionary *)counters;
+{
+    __block NSDictionary *result;
+    dispatch_sync(_queue, ^{
+        result = [_counters copy];
+    });
+
+    return [result autorelease];
+}
+
+- (NSDictionary *)histograms;
+{
+    NSMutableDictionary *result = [NSMutableDictionary dictionaryWithCapacity:CK2FileOperationPhaseCount];
+
+    dispatch_sync(_queue, ^{
+        for (CK2FileOperationPhase phase = CK2FileOperationPhaseProtocolResolved; phase < CK2FileOperationPhaseCount; phase++)
+        {
+            NSMutableArray *buckets = [[NSMutableArray alloc] initWithCapacity:kHistogramBucketCount];
+            for (NSUInteger i = 0; i < kHistogramBucketCount; i++)
+            {
+                [buckets addObject:@(_histograms[phase][i])];
+            }
+
+            [result setObject:buckets forKey:[CK2FileOperationMetrics nameOfPhase:phase]];
+            [buckets release];
+        }
+    });
+
+    return result;
+}
+
++ (NSArray *)histogramBucketBounds;
+{
+    NSMutableArray *result = [NSMutableArray arrayWithCapacity:kHistogramBucketCount - 1];
+    for (NSUInteger i = 0; i < kHistogramBucketCount - 1; i++)
+    {
+        [result addObject:@(kHistogramBucketBounds[i])];
+    }
+
+    return result;
+}
+
+- (NSDictionary *)dictionaryRepresentation;
+{
+    return @{ @"counters" : [self counters],
+              @"histograms" : [self histograms],
+              @"bucketBounds" : [[self class] histogramBucketBounds] };
+}
+
+@end
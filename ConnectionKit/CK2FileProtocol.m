@@ -9,6 +9,10 @@
 #import "CK2FileProtocol.h"
 
 #import "CK2CURLBasedProtocol.h"
+#import "CK2LocalFileSource.h"
+
+#include <copyfile.h>
+#include <sys/stat.h>
 
 // alternate implementations for initForCreatingFileWithRequest
 // whilst we're developing, I'm keeping around the code for all of them
@@ -21,7 +25,20 @@ typedef enum
 
 static const CreateMode kCreateMode = kCreateWithPOSIXAndGCD;
 
-static size_t kCopyBufferSize = 4096;
+// Big enough that copying a large file isn't dominated by syscall overhead. Page-aligned so the kernel can move whole pages around
+static size_t kCopyBufferSize = 1024 * 1024;
+
+// umask() can only be read by setting it, so do so the once, before any files get created
+static mode_t CK2FileProtocolUmask(void)
+{
+    static mode_t sUmask;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sUmask = umask(0);
+        umask(sUmask);
+    });
+    return sUmask;
+}
 
 @interface CK2FileProtocol()
 
@@ -181,6 +198,110 @@ static size_t kCopyBufferSize = 4096;
     }];
 }
 
+- (id)initForMovingItemWithRequest:(NSURLRequest *)request toURL:(NSURL *)destinationURL client:(id<CK2ProtocolClient>)client;
+{
+    return [self initWithBlock:^{
+
+        // rename() atomically replaces any existing file, which NSFileManager refuses to do
+        if (rename([[[request URL] path] fileSystemRepresentation], [[destinationURL path] fileSystemRepresentation]) == 0)
+        {
+            [client protocolDidFinish:self];
+            return;
+        }
+
+        // Moving across volumes is beyond rename(), so fall back to NSFileManager
+        if (errno == EXDEV)
+        {
+            NSError *error;
+            if ([[NSFileManager defaultManager] moveItemAtURL:[request URL] toURL:destinationURL error:&error])
+            {
+                [client protocolDidFinish:self];
+            }
+            else
+            {
+                [client protocol:self didFailWithError:error];
+            }
+            return;
+        }
+
+        [client protocol:self didFailWithError:[self currentPOSIXError]];
+    }];
+}
+
+- (id)initForCopyingItemWithRequest:(NSURLRequest *)request toURL:(NSURL *)destinationURL client:(id<CK2ProtocolClient>)client;
+{
+    return [self initWithBlock:^{
+
+        NSError *error;
+        if ([[NSFileManager defaultManager] copyItemAtURL:[request URL] toURL:destinationURL error:&error])
+        {
+            [client protocolDidFinish:self];
+        }
+        else
+        {
+            [client protocol:self didFailWithError:error];
+        }
+    }];
+}
+
+#pragma mark Batch Operations
+
+- (id)initForCreatingDirectoriesWithRequests:(NSArray *)requests withIntermediateDirectories:(BOOL)createIntermediates openingAttributes:(NSDictionary *)attributes client:(id<CK2ProtocolClient>)client;
+{
+    return [self initWithBlock:^{
+
+        NSFileManager *manager = [NSFileManager defaultManager];
+        for (NSURLRequest *aRequest in requests)
+        {
+            if (_cancelled) break;
+
+            NSError *error = nil;
+            if ([manager createDirectoryAtURL:[aRequest URL] withIntermediateDirectories:createIntermediates attributes:attributes error:&error]) error = nil;
+            [client protocol:self didCompleteItemAtURL:[aRequest URL] error:error];
+        }
+
+        [client protocolDidFinish:self];
+    }];
+}
+
+- (id)initForRemovingFilesWithRequests:(NSArray *)requests client:(id<CK2ProtocolClient>)client;
+{
+    return [self initWithBlock:^{
+
+        NSFileManager *manager = [NSFileManager defaultManager];
+        for (NSURLRequest *aRequest in requests)
+        {
+            if (_cancelled) break;
+
+            NSError *error = nil;
+            if ([manager removeItemAtURL:[aRequest URL] error:&error]) error = nil;
+            [client protocol:self didCompleteItemAtURL:[aRequest URL] error:error];
+        }
+
+        [client protocolDidFinish:self];
+    }];
+}
+
+- (id)initForSettingAttributes:(NSDictionary *)keyedValues ofItemsWithRequests:(NSArray *)requests client:(id<CK2ProtocolClient>)client;
+{
+    return [self initWithBlock:^{
+
+        NSFileManager *manager = [NSFileManager defaultManager];
+        for (NSURLRequest *aRequest in requests)
+        {
+            if (_cancelled) break;
+
+            NSError *error = nil;
+            if ([manager setAttributes:keyedValues ofItemAtPath:[[aRequest URL] path] error:&error]) error = nil;
+            [client protocol:self didCompleteItemAtURL:[aRequest URL] error:error];
+        }
+
+        [client protocolDidFinish:self];
+    }];
+}
+
+#pragma mark Lifecycle
+
 - (void)start;
 {
     _block();
@@ -247,8 +368,13 @@ static size_t kCopyBufferSize = 4096;
 
 - (void)createFileWithCURLForRequest:(NSURLRequest*)request openingAttributes:(NSDictionary *)attributes client:(id<CK2ProtocolClient>)client progressBlock:(CK2ProgressBlock)progressBlock
 {
-    // Hand off to CURLHandle to create the file
-    __block CK2CURLBasedProtocol *curlProtocol = [[CK2CURLBasedProtocol alloc] initWithRequest:request client:nil progressBlock:progressBlock completionHandler:^(NSError *error) {
+    // Hand off to CURLHandle to create the file. It has no client of its own, so pass on what it sends for the metrics
+    CK2ProgressBlock curlProgressBlock = ^(NSUInteger bytesWritten, NSUInteger previousAttemptCount) {
+        [client protocol:self didSendBytes:bytesWritten receivedBytes:0];
+        if (progressBlock) progressBlock(bytesWritten, previousAttemptCount);
+    };
+    
+    __block CK2CURLBasedProtocol *curlProtocol = [[CK2CURLBasedProtocol alloc] initWithRequest:request client:nil progressBlock:curlProgressBlock completionHandler:^(NSError *error) {
 
         if (error)
         {
@@ -280,7 +406,7 @@ static size_t kCopyBufferSize = 4096;
     NSError* error = nil;
     if (inputStream && outputStream)
     {
-        uint8_t buffer[kCopyBufferSize];
+        uint8_t *buffer = valloc(kCopyBufferSize);
         while ([inputStream hasBytesAvailable])
         {
             NSInteger length = [inputStream read:buffer maxLength:kCopyBufferSize];
@@ -297,12 +423,14 @@ static size_t kCopyBufferSize = 4096;
                 break;
             }
 
+            [client protocol:self didSendBytes:length receivedBytes:0];
             if (progressBlock)
             {
                 progressBlock(length, 0);
             }
         }
         
+        free(buffer);
         [inputStream close];
         [outputStream close];
         [outputStream release];
@@ -322,18 +450,114 @@ static size_t kCopyBufferSize = 4096;
     }
 }
 
+- (mode_t)permissionsForCreatingFileWithAttributes:(NSDictionary *)attributes
+{
+    mode_t perms = [attributes filePosixPermissions];
+    if (perms == 0)
+    {
+        perms = 0744;
+    }
+    return perms;
+}
+
+/**
+ open() is subject to the umask, so the requested permissions need applying explicitly afterwards.
+ */
+
+- (BOOL)applyPermissionsFromAttributes:(NSDictionary *)attributes toFileDescriptor:(int)fd
+{
+    NSNumber *perms = [attributes objectForKey:NSFilePosixPermissions];
+    return (perms == nil || fchmod(fd, [perms unsignedShortValue]) == 0);
+}
+
+/**
+ File creation from a memory-mapped local file.
+ Both ends are on local disk, so there's no stream to pump. In order of preference:
+  - clone the file, which on APFS costs nothing no matter the size
+  - have the kernel copy the data across
+  - write straight out of the mapping
+ */
+
+- (void)createFileForRequest:(NSURLRequest*)request fromSource:(CK2LocalFileSource *)source openingAttributes:(NSDictionary *)attributes client:(id<CK2ProtocolClient>)client progressBlock:(CK2ProgressBlock)progressBlock
+{
+    NSURL* url = [request URL];
+    NSAssert([url isFileURL], @"wrong URL scheme: %@", url);
+    const char *path = [[url path] fileSystemRepresentation];
+    
+    NSError *error = nil;
+    BOOL result = NO;
+    BOOL cloned = NO;
+    
+#ifdef COPYFILE_CLONE_FORCE
+    // Cloning can only create a new file, not replace an existing one. The clone picks up the source's mode, so reset that to what a freshly created file would get. By path, as the source might well be read-only, and so the clone unopenable for writing
+    if (copyfile([[[source URL] path] fileSystemRepresentation], path, NULL, COPYFILE_CLONE_FORCE) == 0)
+    {
+        cloned = YES;
+        
+        // Match what open() and -applyPermissionsFromAttributes:… give below: requested permissions exactly, the default masked by the umask
+        mode_t perms = [self permissionsForCreatingFileWithAttributes:attributes];
+        if (![attributes objectForKey:NSFilePosixPermissions]) perms &= ~CK2FileProtocolUmask();
+        
+        result = (chmod(path, perms) == 0);
+        if (!result)
+        {
+            error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+            unlink(path);   // rather than leave it behind with the wrong permissions
+        }
+    }
+#endif
+    
+    if (!cloned)
+    {
+        int outfile = open(path, O_CREAT | O_TRUNC | O_WRONLY, [self permissionsForCreatingFileWithAttributes:attributes]);
+        if (outfile == -1)
+        {
+            [client protocol:self didFailWithError:[self currentPOSIXError]];
+            return;
+        }
+        
+        result = [source writeToFileDescriptor:outfile error:&error];
+        
+        if (result && ![self applyPermissionsFromAttributes:attributes toFileDescriptor:outfile])
+        {
+            error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+            result = NO;
+        }
+        close(outfile);
+    }
+    
+    if (result)
+    {
+        [client protocol:self didSendBytes:[source length] receivedBytes:0];
+        if (progressBlock) progressBlock((NSUInteger)[source length], 0);
+        [client protocolDidFinish:self];
+    }
+    else
+    {
+        [client protocol:self didFailWithError:[self modifiedErrorForFileError:error]];
+    }
+}
+
 /**
  File creation implementation which works asynchronously.
  We open an input stream for the input.
  We open an output file for writing using POSIX open/write calls.
  We then attach a gcd dispatch source to it, and use that to pull input from the stream and write it to the file.
  
- We make a dedicated queue to attach the source to, and release it in the cancel handler of the source, so
- it only lives for the duration of the operation.
+ The source is attached to a global queue; its event handler is never run concurrently with itself, so there's no need for a
+ dedicated queue per file. The copy buffer is allocated once up front, and freed in the source's cancel handler.
  */
 
 - (void)createFileAsyncForRequest:(NSURLRequest*)request openingAttributes:(NSDictionary *)attributes client:(id<CK2ProtocolClient>)client progressBlock:(CK2ProgressBlock)progressBlock
 {
+    // Local files mapped into memory can be copied by the kernel
+    CK2LocalFileSource *source = [CK2LocalFileSource sourceOfData:[request HTTPBody]];
+    if (source)
+    {
+        [self createFileForRequest:request fromSource:source openingAttributes:attributes client:client progressBlock:progressBlock];
+        return;
+    }
+    
     NSInputStream *inputStream = [self inputStreamForRequest:request];
     NSError* error = nil;
 
@@ -344,19 +568,20 @@ static size_t kCopyBufferSize = 4096;
         NSURL* url = [request URL];
         NSAssert([url isFileURL], @"wrong URL scheme: %@", url);
         NSString* path = [url path];
-        int perms = [attributes filePosixPermissions];
-        if (perms == 0)
+        int outfile = open([path fileSystemRepresentation], O_CREAT | O_TRUNC | O_WRONLY, [self permissionsForCreatingFileWithAttributes:attributes]);
+        if (outfile != -1 && ![self applyPermissionsFromAttributes:attributes toFileDescriptor:outfile])
         {
-            perms = 0744;
+            close(outfile);
+            outfile = -1;
         }
-        int outfile = open([path UTF8String], O_CREAT | O_TRUNC | O_WRONLY, perms);
+        
         if (outfile != -1)
         {
-            dispatch_queue_t queue = dispatch_queue_create("CK2FileProtocol", NULL);
+            dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
             dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_WRITE, outfile, 0, queue);
+            uint8_t *buffer = valloc(kCopyBufferSize);
 
             dispatch_source_set_event_handler(source, ^{
-                uint8_t buffer[kCopyBufferSize];
                 NSInteger length = [inputStream read:buffer maxLength:kCopyBufferSize];
                 if (length < 0)
                 {
@@ -373,15 +598,21 @@ static size_t kCopyBufferSize = 4096;
                     ssize_t written = write(outfile, buffer, length);
                     if (written != length)
                     {
+                        dispatch_source_cancel(source);
                         [client protocol:self didFailWithError:[self currentPOSIXError]];
                     }
+                    else
+                    {
+                        [client protocol:self didSendBytes:length receivedBytes:0];
+                        if (progressBlock) progressBlock(length, 0);
+                    }
                 }
             });
 
             dispatch_source_set_cancel_handler(source, ^{
                 close(outfile);
+                free(buffer);
                 dispatch_release(source);
-                dispatch_release(queue);
             });
             
             dispatch_resume(source);
@@ -0,0 +1,39 @@
+//
+//  CK2LocalFileSource.h
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import <Foundation/Foundation.h>
+
+// Read-only, memory-mapped view of a local file, for uploading from
+// Slices of the file are handed out as NSData objects that point straight into the mapping, so large uploads don't churn through a fresh chunk-sized buffer for each read
+@interface CK2LocalFileSource : NSObject
+{
+  @private
+    NSURL               *_URL;
+    int                 _fileDescriptor;
+    void                *_bytes;
+    unsigned long long  _length;
+}
+
+// Returns nil if the file can't be safely mapped, e.g. it's not a regular file, or lives on a network volume where it might vanish from underneath us. Fall back to streaming in that case
+- (id)initWithURL:(NSURL *)url error:(NSError **)outError;
+
+@property(nonatomic, readonly, copy) NSURL *URL;
+@property(nonatomic, readonly) unsigned long long length;
+
+// The whole file, or a slice of it. No bytes are copied; the data keeps the receiver alive for as long as needed
+// nil if the file has since been truncated short of the range. Should that happen while the data's being read, reading it crashes, so only map files that aren't expected to be rewritten in place mid-upload
+- (NSData *)data;
+- (NSData *)dataWithRange:(NSRange)range;
+
+// If the data is one vended by a source, returns that source. Lets consumers handed the data (e.g. as a request's HTTPBody) take a faster path
++ (CK2LocalFileSource *)sourceOfData:(NSData *)data;
+
+// Copies the whole file to the descriptor, using the kernel to do so where possible. Doesn't read from the mapping, so fails cleanly if the file's been truncated
+- (BOOL)writeToFileDescriptor:(int)fileDescriptor error:(NSError **)outError;
+
+@end
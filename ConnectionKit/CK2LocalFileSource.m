@@ -0,0 +1,244 @@
+//
+//  CK2LocalFileSource.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CK2LocalFileSource.h"
+
+#include <copyfile.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// Copying without the kernel's help goes through a buffer this big, read with pread() rather than from the mapping
+static const size_t kCopyBufferLength = 1024 * 1024;
+
+
+@interface CK2LocalFileSourceData : NSData
+{
+  @private
+    CK2LocalFileSource  *_source;
+    const void          *_bytes;
+    NSUInteger          _length;
+}
+
+- (id)initWithSource:(CK2LocalFileSource *)source bytes:(const void *)bytes length:(NSUInteger)length;
+@property(nonatomic, readonly) CK2LocalFileSource *source;
+
+@end
+
+
+@interface CK2LocalFileSource ()
+- (BOOL)copyToFileDescriptor:(int)fileDescriptor error:(NSError **)outError;  // what -writeToFileDescriptor:error: falls back to without the kernel's help
+@end
+
+
+#pragma mark -
+
+
+@implementation CK2LocalFileSource
+
+#pragma mark Lifecycle
+
+- (id)initWithURL:(NSURL *)url error:(NSError **)outError;
+{
+    NSParameterAssert([url isFileURL]);
+
+    if (self = [self init])
+    {
+        _URL = [url copy];
+        _fileDescriptor = -1;
+
+
+        // Mapping files from network volumes risks a crash should the server go away
+        NSNumber *isLocal;
+        if ([url getResourceValue:&isLocal forKey:NSURLVolumeIsLocalKey error:NULL] && isLocal && ![isLocal boolValue])
+        {
+            if (outError) *outError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadUnknownError userInfo:@{ NSURLErrorKey : url }];
+            [self release]; return nil;
+        }
+
+        _fileDescriptor = open([[url path] fileSystemRepresentation], O_RDONLY);
+
+        struct stat info;
+        if (_fileDescriptor == -1 || fstat(_fileDescriptor, &info) != 0 || !S_ISREG(info.st_mode) || (unsigned long long)info.st_size > SIZE_MAX)
+        {
+            if (outError) *outError = [NSError errorWithDomain:NSPOSIXErrorDomain code:(errno ? errno : EINVAL) userInfo:@{ NSURLErrorKey : url }];
+            [self release]; return nil;
+        }
+
+        _length = info.st_size;
+
+        // Can't map an empty file, but then there's nothing to read either
+        if (_length)
+        {
+            _bytes = mmap(NULL, (size_t)_length, PROT_READ, MAP_PRIVATE, _fileDescriptor, 0);
+            if (_bytes == MAP_FAILED)
+            {
+                _bytes = NULL;
+                if (outError) *outError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSURLErrorKey : url }];
+                [self release]; return nil;
+            }
+
+            // Uploads read front to back, so let the kernel read ahead aggressively and drop pages once done with
+            madvise(_bytes, (size_t)_length, MADV_SEQUENTIAL);
+        }
+    }
+
+    return self;
+}
+
+- (void)dealloc;
+{
+    if (_bytes) munmap(_bytes, (size_t)_length);
+    if (_fileDescriptor != -1) close(_fileDescriptor);
+    [_URL release];
+
+    [super dealloc];
+}
+
+#pragma mark Properties
+
+@synthesize URL = _URL;
+@synthesize length = _length;
+
+#pragma mark Data
+
+- (NSData *)data;
+{
+    return [self dataWithRange:NSMakeRange(0, (NSUInteger)_length)];
+}
+
+- (NSData *)dataWithRange:(NSRange)range;
+{
+    NSParameterAssert(NSMaxRange(range) <= _length);
+
+    // Touching pages of the mapping past the end of a truncated file raises SIGBUS, so don't hand out any that are already gone
+    struct stat info;
+    if (range.length && (fstat(_fileDescriptor, &info) != 0 || (unsigned long long)info.st_size < NSMaxRange(range))) return nil;
+
+    const void *bytes = (_bytes ? (const char *)_bytes + range.location : NULL);
+    return [[[CK2LocalFileSourceData alloc] initWithSource:self bytes:bytes length:range.length] autorelease];
+}
+
++ (CK2LocalFileSource *)sourceOfData:(NSData *)data;
+{
+    return ([data isKindOfClass:[CK2LocalFileSourceData class]] ? [(CK2LocalFileSourceData *)data source] : nil);
+}
+
+#pragma mark Writing
+
+- (BOOL)writeToFileDescriptor:(int)fileDescriptor error:(NSError **)outError;
+{
+    // Let the kernel do the copying if it can. It happily copies a file that's been truncated, though, so check it was all there
+    if (fcopyfile(_fileDescriptor, fileDescriptor, NULL, COPYFILE_DATA) == 0)
+    {
+        struct stat info;
+        if (fstat(_fileDescriptor, &info) == 0 && (unsigned long long)info.st_size >= _length) return YES;
+
+        if (outError) *outError = [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:@{ NSURLErrorKey : _URL }];
+        return NO;
+    }
+
+    return [self copyToFileDescriptor:fileDescriptor error:outError];
+}
+
+// Copies through a buffer. pread() rather than the mapping, so the file being truncated in the meantime is an error, not a crash
+- (BOOL)copyToFileDescriptor:(int)fileDescriptor error:(NSError **)outError;
+{
+    if (ftruncate(fileDescriptor, 0) != 0 || lseek(fileDescriptor, 0, SEEK_SET) != 0)
+    {
+        if (outError) *outError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        return NO;
+    }
+
+    size_t bufferLength = (size_t)MIN(_length, kCopyBufferLength);
+    char *buffer = malloc(bufferLength);
+    if (!buffer && bufferLength)
+    {
+        if (outError) *outError = [NSError errorWithDomain:NSPOSIXErrorDomain code:ENOMEM userInfo:nil];
+        return NO;
+    }
+
+    int errorCode = 0;
+    unsigned long long offset = 0;
+    while (offset < _length && !errorCode)
+    {
+        ssize_t bytesRead = pread(_fileDescriptor, buffer, (size_t)MIN(_length - offset, bufferLength), (off_t)offset);
+        if (bytesRead < 0)
+        {
+            if (errno != EINTR) errorCode = errno;
+            continue;
+        }
+        if (bytesRead == 0)
+        {
+            errorCode = EIO;    // shrunk since opened
+            continue;
+        }
+
+        ssize_t written = 0;
+        while (written < bytesRead)
+        {
+            ssize_t result = write(fileDescriptor, buffer + written, bytesRead - written);
+            if (result < 0 && errno == EINTR) continue;
+            if (result <= 0)
+            {
+                errorCode = (result < 0 ? errno : EIO);     // writing nothing would otherwise go round forever
+                break;
+            }
+
+            written += result;
+        }
+
+        offset += written;
+    }
+
+    free(buffer);
+
+    if (errorCode)
+    {
+        if (outError) *outError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errorCode userInfo:@{ NSURLErrorKey : _URL }];
+        return NO;
+    }
+
+    return YES;
+}
+
+@end
+
+
+#pragma mark -
+
+
+@implementation CK2LocalFileSourceData
+
+- (id)initWithSource:(CK2LocalFileSource *)source bytes:(const void *)bytes length:(NSUInteger)length;
+{
+    if (self = [self init])
+    {
+        _source = [source retain];
+        _bytes = bytes;
+        _length = length;
+    }
+    return self;
+}
+
+- (void)dealloc;
+{
+    [_source release];
+    [super dealloc];
+}
+
+@synthesize source = _source;
+
+- (const void *)bytes; { return _bytes; }
+- (NSUInteger)length; { return _length; }
+
+// Immutable, and the whole point is to avoid copying the bytes
+- (id)copyWithZone:(NSZone *)zone; { return [self retain]; }
+
+@end
@@ -23,7 +23,8 @@
 
 #pragma mark For Subclasses to Implement
 
-// Generally, subclasses check the URL's scheme to see if they support it
+// Generally, subclasses check the URL's scheme to see if they support it, but are free to look at the rest of the URL too. Protocols are asked newest first, for every URL
+// Called on an arbitrary thread
 + (BOOL)canHandleURL:(NSURL *)url;
 
 // Override these methods to get setup ready for performing the operation. The request is used to indicate the URL to operate on, and the timeout to apply
@@ -53,6 +54,37 @@
                  ofItemWithRequest:(NSURLRequest *)request
                             client:(id <CK2ProtocolClient>)client;
 
+// The destination is always on the same server as the request's URL, so the operation can be performed server-side
+// Moving should replace any existing file at the destination, atomically if the server can manage it. Copying should fail if there's an existing item
+// Optional. The default implementations return nil, and the client reports NSFeatureUnsupportedError
+- (id)initForMovingItemWithRequest:(NSURLRequest *)request
+                             toURL:(NSURL *)destinationURL
+                            client:(id <CK2ProtocolClient>)client;
+
+- (id)initForCopyingItemWithRequest:(NSURLRequest *)request
+                              toURL:(NSURL *)destinationURL
+                             client:(id <CK2ProtocolClient>)client;
+
+// Batch variants of the above. All the requests refer to items in the same directory, so that they can be performed over a single connection
+// Report the outcome of each item to the client with -protocol:didCompleteItemAtURL:error:, then -protocolDidFinish: once the batch is done. Only fail the protocol for problems affecting the batch as a whole (e.g. can't connect)
+// Optional. The default implementations return nil, and the client falls back to creating a protocol instance per-item
+- (id)initForCreatingDirectoriesWithRequests:(NSArray *)requests
+                 withIntermediateDirectories:(BOOL)createIntermediates
+                           openingAttributes:(NSDictionary *)attributes
+                                      client:(id <CK2ProtocolClient>)client;
+
+- (id)initForRemovingFilesWithRequests:(NSArray *)requests
+                                client:(id <CK2ProtocolClient>)client;
+
+- (id)initForSettingAttributes:(NSDictionary *)keyedValues
+                ofItemsWithRequests:(NSArray *)requests
+                             client:(id <CK2ProtocolClient>)client;
+
+// Destination URLs correspond to the requests, and are on the same server. Items are reported by their request's URL
+- (id)initForMovingItemsWithRequests:(NSArray *)requests
+                              toURLs:(NSArray *)destinationURLs
+                              client:(id <CK2ProtocolClient>)client;
+
 // Override to kick off the requested operation
 - (void)start;
 
@@ -128,8 +160,22 @@
 // URL should be pre-populated with properties requested by client
 - (void)protocol:(CK2Protocol *)protocol didDiscoverItemAtURL:(NSURL *)url;
 
+// Batch operations report each item as it is dealt with. nil error indicates success
+- (void)protocol:(CK2Protocol *)protocol didCompleteItemAtURL:(NSURL *)url error:(NSError *)error;
+
 // Call if reading from a stream needs to be retried. The client will provide you with a fresh, unopened stream to read from
 - (NSInputStream *)protocol:(CK2Protocol *)protocol needNewBodyStream:(NSURLRequest *)request;
 
 
+#pragma mark Metrics
+// Purely informational, feeding the client's metrics for the operation. Report whatever you're able to, from any thread
+
+// Once a connection is ready to use. Let the client know if it came out of a pool, rather than being freshly opened
+- (void)protocol:(CK2Protocol *)protocol didConnectReusingConnection:(BOOL)reused;
+- (void)protocolDidAuthenticate:(CK2Protocol *)protocol;
+
+// Bytes actually going over the wire, including any protocol chatter you're aware of
+- (void)protocol:(CK2Protocol *)protocol didSendBytes:(unsigned long long)sent receivedBytes:(unsigned long long)received;
+
+
 @end
\ No newline at end of file
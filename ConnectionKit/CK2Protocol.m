@@ -13,6 +13,8 @@
 #import "CK2FileProtocol.h"
 #import "CK2WebDAVProtocol.h"
 
+#include <libkern/OSAtomic.h>
+
 @implementation CK2Protocol
 
 #pragma mark Serialization
@@ -23,9 +25,6 @@
     static dispatch_once_t onceToken;
     dispatch_once(&onceToken, ^{
         queue = dispatch_queue_create("CK2FileTransferSystem", NULL);
-        
-        // Register built-in protocols too
-        sRegisteredProtocols = [[NSMutableArray alloc] initWithObjects:[CK2FileProtocol class], [CK2SFTPProtocol class], [CK2FTPProtocol class], [CK2WebDAVProtocol class], nil];
     });
     
     return queue;
@@ -69,6 +68,44 @@
     return nil;
 }
 
+- (id)initForMovingItemWithRequest:(NSURLRequest *)request toURL:(NSURL *)destinationURL client:(id<CK2ProtocolClient>)client;
+{
+    // Client will report the operation as unsupported
+    [self release];
+    return nil;
+}
+
+- (id)initForCopyingItemWithRequest:(NSURLRequest *)request toURL:(NSURL *)destinationURL client:(id<CK2ProtocolClient>)client;
+{
+    [self release];
+    return nil;
+}
+
+- (id)initForCreatingDirectoriesWithRequests:(NSArray *)requests withIntermediateDirectories:(BOOL)createIntermediates openingAttributes:(NSDictionary *)attributes client:(id<CK2ProtocolClient>)client;
+{
+    // Client will fall back to handling items individually
+    [self release];
+    return nil;
+}
+
+- (id)initForRemovingFilesWithRequests:(NSArray *)requests client:(id<CK2ProtocolClient>)client;
+{
+    [self release];
+    return nil;
+}
+
+- (id)initForSettingAttributes:(NSDictionary *)keyedValues ofItemsWithRequests:(NSArray *)requests client:(id<CK2ProtocolClient>)client;
+{
+    [self release];
+    return nil;
+}
+
+- (id)initForMovingItemsWithRequests:(NSArray *)requests toURLs:(NSArray *)destinationURLs client:(id<CK2ProtocolClient>)client;
+{
+    [self release];
+    return nil;
+}
+
 - (void)start;
 {
     [self doesNotRecognizeSelector:_cmd];
@@ -117,56 +154,85 @@
 
 #pragma mark Registration
 
-static NSMutableArray *sRegisteredProtocols;
+// The registry is never changed in place. Registering a protocol publishes a whole new copy with a single atomic swap. So looking up a class never waits on a lock or the queue, and can't be held up by a registration
+// There's deliberately no cache of answers by scheme. A protocol might look at more than the scheme, so a newer protocol would have to be asked before any cached one anyway, which is no quicker than asking them all in turn
+typedef struct
+{
+    NSArray         *protocols;         // newest first
+} CK2ProtocolRegistry;
+
+static CK2ProtocolRegistry * volatile sRegistry;
+
+static CK2ProtocolRegistry *CK2ProtocolRegistryCreate(NSArray *protocols)
+{
+    CK2ProtocolRegistry *result = malloc(sizeof(CK2ProtocolRegistry));
+    result->protocols = [protocols copy];
+    return result;
+}
+
+static CK2ProtocolRegistry *CK2ProtocolRegistryGet(void)
+{
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        
+        // Built-in protocols
+        NSArray *protocols = [NSArray arrayWithObjects:[CK2FileProtocol class], [CK2SFTPProtocol class], [CK2FTPProtocol class], [CK2WebDAVProtocol class], nil];
+        sRegistry = CK2ProtocolRegistryCreate(protocols);
+    });
+    
+    // Anything read through the pointer depends on it, so is ordered after it without a barrier
+    return sRegistry;
+}
+
+// Swaps in the replacement, unless another thread got in first since registry was read. The old registry is deliberately never freed, as other threads could be partway through reading it; there's only one per registration
+static BOOL CK2ProtocolRegistryReplace(CK2ProtocolRegistry *registry, CK2ProtocolRegistry *replacement)
+{
+    if (OSAtomicCompareAndSwapPtrBarrier(registry, replacement, (void * volatile *)&sRegistry)) return YES;
+    
+    [replacement->protocols release];
+    free(replacement);
+    return NO;
+}
 
 + (void)registerClass:(Class)protocolClass;
 {
     NSParameterAssert([protocolClass isSubclassOfClass:[CK2Protocol class]]);
     
-    dispatch_async([self queue], ^{ // might as well be async as queue might be blocked momentarily by a protocol
+    // Newest is consulted first
+    CK2ProtocolRegistry *registry;
+    CK2ProtocolRegistry *replacement;
+    do
+    {
+        registry = CK2ProtocolRegistryGet();
         
-        [sRegisteredProtocols insertObject:protocolClass
-                                           atIndex:0];  // so newest is consulted first
-    });
+        NSMutableArray *protocols = [registry->protocols mutableCopy];
+        [protocols insertObject:protocolClass atIndex:0];
+        replacement = CK2ProtocolRegistryCreate(protocols);
+        [protocols release];
+    }
+    while (!CK2ProtocolRegistryReplace(registry, replacement));
 }
 
 + (void)classForURL:(NSURL *)url completionHandler:(void (^)(Class protocol))block;
 {
-    // Search for correct protocol
+    Class result = [self classForURL:url];
+    
     dispatch_async([self queue], ^{
-        
-        Class result = nil;
-        for (Class aProtocol in sRegisteredProtocols)
-        {
-            if ([aProtocol canHandleURL:url])
-            {
-                result = aProtocol;
-                break;
-            }
-        }
-        
         block(result);
     });
 }
 
 + (Class)classForURL:(NSURL *)url;
 {
-    __block Class result = nil;
+    CK2ProtocolRegistry *registry = CK2ProtocolRegistryGet();
     
-    // Search for correct protocol
-    dispatch_sync([self queue], ^{
-        
-        for (Class aProtocol in sRegisteredProtocols)
-        {
-            if ([aProtocol canHandleURL:url])
-            {
-                result = aProtocol;
-                break;
-            }
-        }
-    });
+    // Search for correct protocol, newest first
+    for (Class aProtocol in registry->protocols)
+    {
+        if ([aProtocol canHandleURL:url]) return aProtocol;
+    }
     
-    return result;
+    return nil;
 }
 
 @end
@@ -57,7 +57,7 @@
     NSMutableURLRequest *mutableRequest = [request mutableCopy];
     [mutableRequest curl_setNewDirectoryPermissions:[attributes objectForKey:NSFilePosixPermissions]];
     
-    self = [self initWithCustomCommands:[NSArray arrayWithObject:[@"mkdir " stringByAppendingString:[[request URL] lastPathComponent]]]
+    self = [self initWithCustomCommands:[NSArray arrayWithObject:[@"mkdir " stringByAppendingString:[[self class] commandArgumentWithString:[[request URL] lastPathComponent]]]]
                                 request:mutableRequest
           createIntermediateDirectories:createIntermediates
                                  client:client
@@ -83,7 +83,7 @@
 
 - (id)initForRemovingFileWithRequest:(NSURLRequest *)request client:(id<CK2ProtocolClient>)client;
 {
-    return [self initWithCustomCommands:[NSArray arrayWithObject:[@"rm " stringByAppendingString:[[request URL] lastPathComponent]]]
+    return [self initWithCustomCommands:[NSArray arrayWithObject:[@"rm " stringByAppendingString:[[self class] commandArgumentWithString:[[request URL] lastPathComponent]]]]
                                 request:request
           createIntermediateDirectories:NO
                                  client:client
@@ -98,7 +98,7 @@
         NSArray *commands = [NSArray arrayWithObject:[NSString stringWithFormat:
                                                       @"chmod %lo %@",
                                                       [permissions unsignedLongValue],
-                                                      [[request URL] lastPathComponent]]];
+                                                      [[self class] commandArgumentWithString:[[request URL] lastPathComponent]]]];
         
         return [self initWithCustomCommands:commands
                                     request:request
@@ -113,6 +113,103 @@
     }
 }
 
+- (id)initForMovingItemWithRequest:(NSURLRequest *)request toURL:(NSURL *)destinationURL client:(id<CK2ProtocolClient>)client;
+{
+    // libcurl asks libssh2 for an atomic, overwriting rename. Servers without the posix-rename extension (including OpenSSH, over SFTP v3) ignore that, and fail if something's at the destination already
+    NSArray *commands = [NSArray arrayWithObject:[NSString stringWithFormat:
+                                                  @"rename %@ %@",
+                                                  [[self class] commandArgumentWithString:[[request URL] lastPathComponent]],
+                                                  [[self class] commandArgumentWithString:[[self class] pathOfURL:destinationURL relativeToDirectoryOfURL:[request URL]]]]];
+    
+    return [self initWithCustomCommands:commands
+                                request:request
+          createIntermediateDirectories:NO
+                                 client:client
+                      completionHandler:nil];
+}
+
+#pragma mark Batch Operations
+
+- (id)initForCreatingDirectoriesWithRequests:(NSArray *)requests withIntermediateDirectories:(BOOL)createIntermediates openingAttributes:(NSDictionary *)attributes client:(id<CK2ProtocolClient>)client;
+{
+    NSMutableURLRequest *mutableRequest = [[requests objectAtIndex:0] mutableCopy];
+    [mutableRequest curl_setNewDirectoryPermissions:[attributes objectForKey:NSFilePosixPermissions]];
+    
+    NSArray *urls = [requests valueForKey:@"URL"];
+    self = [self initWithBatchedCustomCommands:[[self class] commandsWithFormat:@"mkdir %@" forURLs:urls]
+                                       forURLs:urls
+                                       request:mutableRequest
+                 createIntermediateDirectories:createIntermediates
+                                        client:client
+                                   itemHandler:nil];
+    
+    [mutableRequest release];
+    return self;
+}
+
+- (id)initForRemovingFilesWithRequests:(NSArray *)requests client:(id<CK2ProtocolClient>)client;
+{
+    NSArray *urls = [requests valueForKey:@"URL"];
+    return [self initWithBatchedCustomCommands:[[self class] commandsWithFormat:@"rm %@" directoryFormat:@"rmdir %@" forURLs:urls]
+                                       forURLs:urls
+                                       request:[requests objectAtIndex:0]
+                 createIntermediateDirectories:NO
+                                        client:client
+                                   itemHandler:nil];
+}
+
+- (id)initForSettingAttributes:(NSDictionary *)keyedValues ofItemsWithRequests:(NSArray *)requests client:(id<CK2ProtocolClient>)client;
+{
+    NSNumber *permissions = [keyedValues objectForKey:NSFilePosixPermissions];
+    if (!permissions)
+    {
+        // Nothing we can do over SFTP, so the client might as well handle the items individually, which will be a no-op
+        [self release];
+        return nil;
+    }
+    
+    NSArray *urls = [requests valueForKey:@"URL"];
+    NSString *format = [NSString stringWithFormat:@"chmod %lo %%@", [permissions unsignedLongValue]];
+    
+    return [self initWithBatchedCustomCommands:[[self class] commandsWithFormat:format forURLs:urls]
+                                       forURLs:urls
+                                       request:[requests objectAtIndex:0]
+                 createIntermediateDirectories:NO
+                                        client:client
+                                   itemHandler:nil];
+}
+
+- (id)initForMovingItemsWithRequests:(NSArray *)requests toURLs:(NSArray *)destinationURLs client:(id<CK2ProtocolClient>)client;
+{
+    NSArray *urls = [requests valueForKey:@"URL"];
+    
+    NSMutableArray *commands = [NSMutableArray arrayWithCapacity:[urls count]];
+    [urls enumerateObjectsUsingBlock:^(NSURL *aURL, NSUInteger idx, BOOL *stop) {
+        [commands addObject:[NSString stringWithFormat:
+                             @"rename %@ %@",
+                             [[self class] commandArgumentWithString:[aURL lastPathComponent]],
+                             [[self class] commandArgumentWithString:[[self class] pathOfURL:[destinationURLs objectAtIndex:idx] relativeToDirectoryOfURL:aURL]]]];
+    }];
+    
+    return [self initWithBatchedCustomCommands:commands
+                                       forURLs:urls
+                                       request:[requests objectAtIndex:0]
+                 createIntermediateDirectories:NO
+                                        client:client
+                                   itemHandler:nil];
+}
+
+// libcurl doesn't report SFTP quote commands as they go out, except for pwd. It's answered locally, so costs no round trip
++ (NSString *)batchProgressCommand; { return @"pwd"; }
+
+// libcurl splits SFTP quote commands at whitespace, unless an argument is in double quotes, within which it unescapes \" and \\
++ (NSString *)commandArgumentWithString:(NSString *)string;
+{
+    NSString *result = [string stringByReplacingOccurrencesOfString:@"\\" withString:@"\\\\"];
+    result = [result stringByReplacingOccurrencesOfString:@"\"" withString:@"\\\""];
+    return [NSString stringWithFormat:@"\"%@\"", result];
+}
+
 #pragma mark Lifecycle & Auth
 
 - (void)start;
@@ -0,0 +1,39 @@
+//
+//  CK2Transcript.h
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import <Foundation/Foundation.h>
+
+#import "CKConnectionProtocol.h"
+
+
+// Fixed-size ring of the most recent transcript entries, stored as raw UTF-8 bytes. Appending never locks or allocates, so it's cheap enough to leave capturing all the time; entries are only turned back into strings when read.
+// Once full, the oldest entries are overwritten. Readers keep track of their own position with the sequence numbers handed back, and simply miss out on anything overwritten before they got to it
+@interface CK2Transcript : NSObject
+{
+  @private
+    void                *_slots;
+    NSUInteger          _slotCount;     // always a power of 2
+    volatile int64_t    _nextSequence;
+    uint64_t            _baseTime;      // mach_absolute_time() corresponding to…
+    CFAbsoluteTime      _baseDate;      // …this
+}
+
+// Capacity is in bytes, and rounded up to a whole number of entries
+- (id)initWithCapacity:(NSUInteger)capacity;
+
+// Threadsafe, and lock-free. Very long strings are truncated
+- (void)appendString:(NSString *)string ofType:(CKTranscriptType)type;
+
+// Calls the block for each entry still in the buffer, starting at the given sequence number. Pass 0 to start with the oldest available.
+// Returns the sequence number to pass next time to pick up where this left off. Stops short at any entry which is still being written, so it can be picked up next time
+- (int64_t)enumerateEntriesFromSequence:(int64_t)sequence usingBlock:(void (^)(NSDate *date, CKTranscriptType type, NSString *string))block;
+
+// Everything still in the buffer, formatted one entry per line
+- (NSString *)stringRepresentation;
+
+@end
@@ -0,0 +1,224 @@
+//
+//  CK2Transcript.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CK2Transcript.h"
+
+#include <libkern/OSAtomic.h>
+#include <mach/mach_time.h>
+
+
+// Entries longer than this get truncated. Keeps a single huge entry (e.g. a directory listing) from flushing out everything else, and lets the bytes live on the stack while being copied in and out
+#define kMaximumEntryLength 4096
+
+#define kSlotSize 128
+
+enum {
+    kSlotContinuation   = 1 << 0,   // carries on from the previous slot
+    kSlotContinues      = 1 << 1,   // carries on into the next slot
+};
+
+typedef struct {
+    volatile int64_t    sequence;   // of the entry the slot currently holds; -1 while it's being written
+    uint64_t            time;
+    uint16_t            length;
+    uint8_t             type;
+    uint8_t             flags;
+    char                bytes[kSlotSize - 2 * sizeof(uint64_t) - 4];
+} CK2TranscriptSlot;
+
+#define kSlotPayloadLength (sizeof(((CK2TranscriptSlot *)NULL)->bytes))
+
+
+@implementation CK2Transcript
+
+#pragma mark Lifecycle
+
+- (id)initWithCapacity:(NSUInteger)capacity;
+{
+    if (self = [super init])
+    {
+        // Must be able to hold the longest entry, and a power of 2 lets sequence numbers be masked down to an index
+        _slotCount = (kMaximumEntryLength / kSlotPayloadLength) + 1;
+        while (_slotCount * kSlotSize < capacity || (_slotCount & (_slotCount - 1)))
+        {
+            _slotCount++;
+        }
+
+        _slots = calloc(_slotCount, sizeof(CK2TranscriptSlot));
+        _baseTime = mach_absolute_time();
+        _baseDate = CFAbsoluteTimeGetCurrent();
+    }
+
+    return self;
+}
+
+- (id)init;
+{
+    return [self initWithCapacity:512 * 1024];
+}
+
+- (void)dealloc;
+{
+    free(_slots);
+    [super dealloc];
+}
+
+#pragma mark Writing
+
+- (void)appendString:(NSString *)string ofType:(CKTranscriptType)type;
+{
+    char buffer[kMaximumEntryLength];
+    NSUInteger length = 0;
+    [string getBytes:buffer maxLength:sizeof(buffer) usedLength:&length encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, [string length]) remainingRange:NULL];
+
+    // Claim all the slots needed in one go, so an entry is never interleaved with another
+    NSUInteger count = MAX((length + kSlotPayloadLength - 1) / kSlotPayloadLength, 1U);
+    int64_t first = OSAtomicAdd64Barrier(count, &_nextSequence) - count;
+    uint64_t time = mach_absolute_time();
+
+    for (NSUInteger i = 0; i < count; i++)
+    {
+        int64_t sequence = first + i;
+        CK2TranscriptSlot *slot = (CK2TranscriptSlot *)_slots + (sequence & (_slotCount - 1));
+
+        // Mark the slot as in flux while filling it in, so readers can tell a torn copy
+        slot->sequence = -1;
+        OSMemoryBarrier();
+
+        NSUInteger offset = i * kSlotPayloadLength;
+        slot->length = MIN(length - offset, kSlotPayloadLength);
+        memcpy(slot->bytes, buffer + offset, slot->length);
+        slot->time = time;
+        slot->type = type;
+        slot->flags = (i > 0 ? kSlotContinuation : 0) | (i + 1 < count ? kSlotContinues : 0);
+
+        OSMemoryBarrier();
+        slot->sequence = sequence;
+    }
+}
+
+#pragma mark Reading
+
+// Returns NO if the slot doesn't hold the requested sequence intact; the copy's sequence is then -1 if it's still being written, or else has been overwritten
+- (BOOL)copySlotWithSequence:(int64_t)sequence into:(CK2TranscriptSlot *)copy;
+{
+    CK2TranscriptSlot *slot = (CK2TranscriptSlot *)_slots + (sequence & (_slotCount - 1));
+
+    int64_t before = slot->sequence;
+    OSMemoryBarrier();
+    memcpy(copy, slot, sizeof(CK2TranscriptSlot));
+    OSMemoryBarrier();
+    int64_t after = slot->sequence;
+
+    if (before == sequence && after == sequence) return YES;
+
+    // Writers have moved on a whole lap if they've claimed this slot's sequence again
+    copy->sequence = (sequence + (int64_t)_slotCount <= _nextSequence ? INT64_MAX : -1);
+    return NO;
+}
+
+- (int64_t)enumerateEntriesFromSequence:(int64_t)sequence usingBlock:(void (^)(NSDate *date, CKTranscriptType type, NSString *string))block;
+{
+    int64_t end = _nextSequence;
+    OSMemoryBarrier();
+
+    // Skip over anything already overwritten
+    sequence = MAX(sequence, end - (int64_t)_slotCount);
+    sequence = MAX(sequence, 0);
+
+    char entry[kMaximumEntryLength];
+    NSUInteger entryLength = 0;
+    int64_t entryStart = sequence;
+    BOOL inEntry = NO;
+
+    while (sequence < end)
+    {
+        CK2TranscriptSlot slot;
+        if (![self copySlotWithSequence:sequence into:&slot])
+        {
+            if (slot.sequence == -1) break; // still being written; pick it up next time
+
+            // Overwritten since we started, so drop whatever of the entry we had
+            inEntry = NO;
+            entryStart = ++sequence;
+            continue;
+        }
+
+        sequence++;
+
+        if (slot.flags & kSlotContinuation)
+        {
+            // Tail end of an entry whose start has already been overwritten
+            if (!inEntry)
+            {
+                entryStart = sequence;
+                continue;
+            }
+        }
+        else
+        {
+            inEntry = YES;
+            entryLength = 0;
+        }
+
+        if (entryLength + slot.length <= sizeof(entry))
+        {
+            memcpy(entry + entryLength, slot.bytes, slot.length);
+            entryLength += slot.length;
+        }
+
+        if (!(slot.flags & kSlotContinues))
+        {
+            inEntry = NO;
+            entryStart = sequence;
+
+            NSString *string = [[NSString alloc] initWithBytes:entry length:entryLength encoding:NSUTF8StringEncoding];
+            if (string)
+            {
+                double seconds = 0.0;
+                if (slot.time > _baseTime)
+                {
+                    static mach_timebase_info_data_t timebase;
+                    if (timebase.denom == 0) mach_timebase_info(&timebase);
+                    seconds = (double)(slot.time - _baseTime) * timebase.numer / timebase.denom / NSEC_PER_SEC;
+                }
+
+                NSDate *date = [[NSDate alloc] initWithTimeIntervalSinceReferenceDate:_baseDate + seconds];
+                block(date, slot.type, string);
+                [date release];
+                [string release];
+            }
+        }
+    }
+
+    return entryStart;
+}
+
+- (NSString *)stringRepresentation;
+{
+    NSMutableString *result = [NSMutableString string];
+
+    [self enumerateEntriesFromSequence:0 usingBlock:^(NSDate *date, CKTranscriptType type, NSString *string) {
+
+        NSString *prefix;
+        switch (type)
+        {
+            case CKTranscriptSent:      prefix = @"-->"; break;
+            case CKTranscriptReceived:  prefix = @"<--"; break;
+            case CKTranscriptData:      prefix = @"(d)"; break;
+            default:                    prefix = @"(i)"; break;
+        }
+
+        [result appendFormat:@"%@ %@", prefix, string];
+        if (![string hasSuffix:@"\n"]) [result appendString:@"\n"];
+    }];
+
+    return result;
+}
+
+@end
@@ -251,6 +251,48 @@
     return self;
 }
 
+- (id)initForMovingItemWithRequest:(NSURLRequest *)request toURL:(NSURL *)destinationURL client:(id<CK2ProtocolClient>)client;
+{
+    CK2WebDAVLog(@"moving item");
+
+    if ((self = [self initWithRequest:request client:client]) != nil)
+    {
+        DAVMoveRequest* davRequest = [[DAVMoveRequest alloc] initWithPath:[self pathForRequest:request] session:_session delegate:self];
+        davRequest.destinationPath = [self pathForRequest:[NSURLRequest requestWithURL:destinationURL]];
+        davRequest.overwrite = YES;
+        [_queue addOperation:davRequest];
+        [davRequest release];
+
+        self.completionHandler = ^(id result) {
+            CK2WebDAVLog(@"moving item done");
+            [self reportFinished];
+        };
+    }
+
+    return self;
+}
+
+- (id)initForCopyingItemWithRequest:(NSURLRequest *)request toURL:(NSURL *)destinationURL client:(id<CK2ProtocolClient>)client;
+{
+    CK2WebDAVLog(@"copying item");
+
+    if ((self = [self initWithRequest:request client:client]) != nil)
+    {
+        DAVCopyRequest* davRequest = [[DAVCopyRequest alloc] initWithPath:[self pathForRequest:request] session:_session delegate:self];
+        davRequest.destinationPath = [self pathForRequest:[NSURLRequest requestWithURL:destinationURL]];
+        davRequest.overwrite = NO;
+        [_queue addOperation:davRequest];
+        [davRequest release];
+
+        self.completionHandler = ^(id result) {
+            CK2WebDAVLog(@"copying item done");
+            [self reportFinished];
+        };
+    }
+
+    return self;
+}
+
 - (void)start;
 {
     CK2WebDAVLog(@"started");
@@ -316,6 +358,8 @@
 {
     CK2WebDAVLog(@"webdav sent data");
 
+    [[self client] protocol:self didSendBytes:bytesWritten receivedBytes:0];
+
     if (self.expectedLength != totalBytesExpectedToWrite)
     {
         ++self.attempts;
@@ -359,6 +403,10 @@
 {
     CK2WebDAVLog(sent ? @"<-- %@ " : @"--> %@", string);
 
+    // The transcript is the only sight we get of the headers going back and forth. NSURLConnection keeps its connection pooling to itself, so that goes unreported
+    unsigned long long length = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    [[self client] protocol:self didSendBytes:(sent ? length : 0) receivedBytes:(sent ? 0 : length)];
+
     [[self client] protocol:self appendString:string toTranscript:(sent ? CKTranscriptSent : CKTranscriptReceived)];
 }
 
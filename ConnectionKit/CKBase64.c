@@ -0,0 +1,357 @@
+//
+//  CKBase64.c
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#include "CKBase64.h"
+
+#include <stdint.h>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define CKBASE64_SSSE3 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CKBASE64_NEON 1
+#endif
+
+
+static const char CKBase64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// -1 for anything outside the alphabet
+static const signed char CKBase64Values[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+
+size_t CKBase64EncodedLength(size_t length)
+{
+    return ((length + 2) / 3) * 4;
+}
+
+size_t CKBase64DecodedMaximumLength(size_t length)
+{
+    return ((length + 3) / 4) * 3;
+}
+
+
+// Blocks
+
+// Each of these takes as many whole blocks as it can from the start of the input, returning how many bytes or characters it consumed. The scalar loops carry on from there
+
+#if CKBASE64_SSSE3
+
+// 12 bytes at a time, though 16 are loaded
+static size_t CKBase64EncodeBlocks(const unsigned char *bytes, size_t length, char *output)
+{
+    size_t result = 0;
+
+    while (length - result >= 16)
+    {
+        __m128i input = _mm_loadu_si128((const __m128i *)(bytes + result));
+
+        // Spread each 3 bytes over 4, then shift each 6 bits down into a byte of its own
+        input = _mm_shuffle_epi8(input, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+        __m128i high = _mm_mulhi_epu16(_mm_and_si128(input, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        __m128i low = _mm_mullo_epi16(_mm_and_si128(input, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        __m128i indices = _mm_or_si128(high, low);
+
+        // Map 0-63 onto the alphabet by working out which range each falls in, and the offset to add for that range
+        __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        __m128i lessThan26 = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        range = _mm_or_si128(range, _mm_and_si128(lessThan26, _mm_set1_epi8(13)));
+
+        const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                              '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        __m128i characters = _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+
+        _mm_storeu_si128((__m128i *)output, characters);
+        output += 16;
+        result += 12;
+    }
+
+    return result;
+}
+
+// 16 characters at a time, stopping at the first block with anything outside the alphabet in it. 16 bytes are stored for each 12 decoded, so stops short of the end to stay inside the output
+static size_t CKBase64DecodeBlocks(const unsigned char *string, size_t length, unsigned char *output, size_t *outputLength)
+{
+    size_t result = 0;
+    *outputLength = 0;
+
+    while (length - result >= 24)
+    {
+        __m128i input = _mm_loadu_si128((const __m128i *)(string + result));
+
+        // A character's valid if the bit for its high nibble is set in the mask for its low nibble
+        __m128i highNibbles = _mm_and_si128(_mm_srli_epi32(input, 4), _mm_set1_epi8(0x0f));
+        __m128i lowNibbles = _mm_and_si128(input, _mm_set1_epi8(0x0f));
+
+        const __m128i masks = _mm_setr_epi8((char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+                                            (char)0xf8, (char)0xf8, (char)0xf0, 0x54, 0x50, 0x50, 0x50, 0x54);
+        const __m128i bits = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+
+        __m128i valid = _mm_and_si128(_mm_shuffle_epi8(masks, lowNibbles), _mm_shuffle_epi8(bits, highNibbles));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(valid, _mm_setzero_si128()))) break;
+
+        // Then the value is an offset from the character, again by high nibble. '/' is the odd one out, sharing its nibble with '+'
+        const __m128i offsets = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        __m128i isSlash = _mm_cmpeq_epi8(input, _mm_set1_epi8('/'));
+        __m128i offset = _mm_or_si128(_mm_andnot_si128(isSlash, _mm_shuffle_epi8(offsets, highNibbles)), _mm_and_si128(isSlash, _mm_set1_epi8(16)));
+        __m128i values = _mm_add_epi8(input, offset);
+
+        // Pack each 4 6-bit values into 3 bytes
+        __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+        __m128i bytes = _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+        _mm_storeu_si128((__m128i *)(output + *outputLength), bytes);
+        *outputLength += 12;
+        result += 16;
+    }
+
+    return result;
+}
+
+#elif CKBASE64_NEON
+
+// 48 bytes at a time, de-interleaved into three vectors by the load, and the four results interleaved again by the store
+static size_t CKBase64EncodeBlocks(const unsigned char *bytes, size_t length, char *output)
+{
+    const uint8x16x4_t alphabet = { { vld1q_u8((const uint8_t *)CKBase64Alphabet), vld1q_u8((const uint8_t *)CKBase64Alphabet + 16),
+                                      vld1q_u8((const uint8_t *)CKBase64Alphabet + 32), vld1q_u8((const uint8_t *)CKBase64Alphabet + 48) } };
+    const uint8x16_t mask = vdupq_n_u8(0x3f);
+    size_t result = 0;
+
+    while (length - result >= 48)
+    {
+        uint8x16x3_t input = vld3q_u8(bytes + result);
+
+        uint8x16x4_t indices;
+        indices.val[0] = vshrq_n_u8(input.val[0], 2);
+        indices.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(input.val[0], 4), vshrq_n_u8(input.val[1], 4)), mask);
+        indices.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(input.val[1], 2), vshrq_n_u8(input.val[2], 6)), mask);
+        indices.val[3] = vandq_u8(input.val[2], mask);
+
+        uint8x16x4_t characters;
+        characters.val[0] = vqtbl4q_u8(alphabet, indices.val[0]);
+        characters.val[1] = vqtbl4q_u8(alphabet, indices.val[1]);
+        characters.val[2] = vqtbl4q_u8(alphabet, indices.val[2]);
+        characters.val[3] = vqtbl4q_u8(alphabet, indices.val[3]);
+
+        vst4q_u8((uint8_t *)output, characters);
+        output += 64;
+        result += 48;
+    }
+
+    return result;
+}
+
+// Table lookups only reach 64 entries, so the ASCII half of the value table is looked up in two goes. Anything out of range comes back as 0
+static inline uint8x16_t CKBase64LookUpValues(uint8x16_t characters, uint8x16x4_t low, uint8x16x4_t high)
+{
+    return vorrq_u8(vqtbl4q_u8(low, characters), vqtbl4q_u8(high, vsubq_u8(characters, vdupq_n_u8(64))));
+}
+
+// 64 characters at a time, stopping at the first block with anything outside the alphabet in it
+static size_t CKBase64DecodeBlocks(const unsigned char *string, size_t length, unsigned char *output, size_t *outputLength)
+{
+    const uint8_t *values = (const uint8_t *)CKBase64Values;    // -1 reads as 0xff, so stands out by its top bit
+    const uint8x16x4_t low = { { vld1q_u8(values), vld1q_u8(values + 16), vld1q_u8(values + 32), vld1q_u8(values + 48) } };
+    const uint8x16x4_t high = { { vld1q_u8(values + 64), vld1q_u8(values + 80), vld1q_u8(values + 96), vld1q_u8(values + 112) } };
+
+    size_t result = 0;
+    *outputLength = 0;
+
+    while (length - result >= 64)
+    {
+        uint8x16x4_t input = vld4q_u8(string + result);
+
+        uint8x16_t a = CKBase64LookUpValues(input.val[0], low, high);
+        uint8x16_t b = CKBase64LookUpValues(input.val[1], low, high);
+        uint8x16_t c = CKBase64LookUpValues(input.val[2], low, high);
+        uint8x16_t d = CKBase64LookUpValues(input.val[3], low, high);
+
+        // Characters past ASCII have their top bit set too
+        uint8x16_t invalid = vorrq_u8(vorrq_u8(vorrq_u8(a, b), vorrq_u8(c, d)),
+                                      vorrq_u8(vorrq_u8(input.val[0], input.val[1]), vorrq_u8(input.val[2], input.val[3])));
+        if (vmaxvq_u8(invalid) & 0x80) break;
+
+        uint8x16x3_t bytes;
+        bytes.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+        bytes.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+        bytes.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+
+        vst3q_u8(output + *outputLength, bytes);
+        *outputLength += 48;
+        result += 64;
+    }
+
+    return result;
+}
+
+#else
+
+static size_t CKBase64EncodeBlocks(const unsigned char *bytes, size_t length, char *output)
+{
+    (void)bytes; (void)length; (void)output;
+    return 0;
+}
+
+static size_t CKBase64DecodeBlocks(const unsigned char *string, size_t length, unsigned char *output, size_t *outputLength)
+{
+    (void)string; (void)length; (void)output;
+    *outputLength = 0;
+    return 0;
+}
+
+#endif
+
+
+// Encoding
+
+size_t CKBase64EncodeScalar(const void *bytes, size_t length, char *output)
+{
+    const unsigned char *input = bytes;
+    char *start = output;
+    size_t i = 0;
+
+    for (; length - i >= 3; i += 3)
+    {
+        uint32_t value = ((uint32_t)input[i] << 16) | ((uint32_t)input[i + 1] << 8) | input[i + 2];
+        output[0] = CKBase64Alphabet[value >> 18];
+        output[1] = CKBase64Alphabet[(value >> 12) & 0x3f];
+        output[2] = CKBase64Alphabet[(value >> 6) & 0x3f];
+        output[3] = CKBase64Alphabet[value & 0x3f];
+        output += 4;
+    }
+
+    if (length - i == 1)
+    {
+        uint32_t value = (uint32_t)input[i] << 16;
+        output[0] = CKBase64Alphabet[value >> 18];
+        output[1] = CKBase64Alphabet[(value >> 12) & 0x3f];
+        output[2] = '=';
+        output[3] = '=';
+        output += 4;
+    }
+    else if (length - i == 2)
+    {
+        uint32_t value = ((uint32_t)input[i] << 16) | ((uint32_t)input[i + 1] << 8);
+        output[0] = CKBase64Alphabet[value >> 18];
+        output[1] = CKBase64Alphabet[(value >> 12) & 0x3f];
+        output[2] = CKBase64Alphabet[(value >> 6) & 0x3f];
+        output[3] = '=';
+        output += 4;
+    }
+
+    return output - start;
+}
+
+size_t CKBase64Encode(const void *bytes, size_t length, char *output)
+{
+    size_t consumed = CKBase64EncodeBlocks(bytes, length, output);
+    size_t written = (consumed / 3) * 4;
+
+    return written + CKBase64EncodeScalar((const unsigned char *)bytes + consumed, length - consumed, output + written);
+}
+
+
+// Decoding
+
+static bool CKBase64DecodeWithBlocks(const char *string, size_t length, void *output, size_t *outputLength, bool useBlocks)
+{
+    const unsigned char *input = (const unsigned char *)string;
+    const unsigned char *end = input + length;
+    unsigned char *start = output;
+    unsigned char *bytes = output;
+
+    uint32_t accumulator = 0;
+    unsigned int count = 0;     // characters in the accumulator
+
+    while (input < end)
+    {
+        // Whole blocks can only be taken between groups of 4 characters. Should one hold something to skip, the loop below steps past it
+        if (count == 0 && useBlocks)
+        {
+            size_t decoded;
+            input += CKBase64DecodeBlocks(input, end - input, bytes, &decoded);
+            bytes += decoded;
+            if (input == end) break;
+        }
+
+        // Usually the next 4 characters are all valid, and can go straight through
+        if (count == 0 && end - input >= 4)
+        {
+            int a = CKBase64Values[input[0]], b = CKBase64Values[input[1]], c = CKBase64Values[input[2]], d = CKBase64Values[input[3]];
+            if ((a | b | c | d) >= 0)
+            {
+                uint32_t value = ((uint32_t)a << 18) | ((uint32_t)b << 12) | ((uint32_t)c << 6) | (uint32_t)d;
+                bytes[0] = value >> 16;
+                bytes[1] = value >> 8;
+                bytes[2] = value;
+                bytes += 3;
+                input += 4;
+                continue;
+            }
+        }
+
+        int value = CKBase64Values[*input++];
+        if (value < 0) continue;
+
+        accumulator = (accumulator << 6) | value;
+        if (++count == 4)
+        {
+            bytes[0] = accumulator >> 16;
+            bytes[1] = accumulator >> 8;
+            bytes[2] = accumulator;
+            bytes += 3;
+            accumulator = 0;
+            count = 0;
+        }
+    }
+
+    switch (count)
+    {
+        case 1:
+            return false;
+        case 2:
+            *bytes++ = accumulator >> 4;
+            break;
+        case 3:
+            *bytes++ = accumulator >> 10;
+            *bytes++ = accumulator >> 2;
+            break;
+    }
+
+    if (outputLength) *outputLength = bytes - start;
+    return true;
+}
+
+bool CKBase64Decode(const char *string, size_t length, void *output, size_t *outputLength)
+{
+    return CKBase64DecodeWithBlocks(string, length, output, outputLength, true);
+}
+
+bool CKBase64DecodeScalar(const char *string, size_t length, void *output, size_t *outputLength)
+{
+    return CKBase64DecodeWithBlocks(string, length, output, outputLength, false);
+}
@@ -0,0 +1,49 @@
+//
+//  CKBase64.h
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//  Base64 encoding and decoding, straight into buffers the caller provides, so nothing need be allocated or copied along the way. Plain C, so the bundled libssh2 can share it.
+//
+//  Long runs are handled 12 or 48 bytes at a time with SSSE3 on Intel, or NEON on 64-bit ARM; anything else, and the ends of the input, go through a table-driven loop.
+//
+
+#ifndef CKBase64_h
+#define CKBase64_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Exactly how many characters encoding length bytes produces, padding included
+size_t CKBase64EncodedLength(size_t length);
+
+// Enough room to decode length characters into
+size_t CKBase64DecodedMaximumLength(size_t length);
+
+
+// Encodes into output, which must have room for CKBase64EncodedLength(length) characters. No NUL is added. Returns the number of characters written
+size_t CKBase64Encode(const void *bytes, size_t length, char *output);
+
+// Decodes into output, which must have room for CKBase64DecodedMaximumLength(length) bytes. Anything outside the alphabet, such as line breaks in PEM files or padding, is skipped over
+// Returns false if the input ends partway through a byte, i.e. a lone character is left over
+bool CKBase64Decode(const char *string, size_t length, void *output, size_t *outputLength);
+
+
+// Support
+
+// Without the SIMD paths, for comparison
+size_t CKBase64EncodeScalar(const void *bytes, size_t length, char *output);
+bool CKBase64DecodeScalar(const char *string, size_t length, void *output, size_t *outputLength);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
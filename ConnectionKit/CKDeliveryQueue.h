@@ -0,0 +1,34 @@
+//
+//  CKDeliveryQueue.h
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//  Gets callbacks from background threads over to a dispatch queue -- generally the main queue -- in the order they were sent.
+//  Delivering is lock-free: blocks are pushed onto a list, and only the first to arrive after the last batch was run wakes up the target queue. That then runs everything which has built up in the meantime, so a busy transfer costs one hop per batch, rather than one per message as with -performSelectorOnMainThread:
+//
+//  Blocks only stay in order relative to other blocks delivered through the same instance. So if a class uses this for some of its callbacks, it wants to use it for all of them
+//
+
+#import <Foundation/Foundation.h>
+
+
+@interface CKDeliveryQueue : NSObject
+{
+  @private
+    dispatch_queue_t    _queue;
+    void * volatile     _pending;
+}
+
+// Shared instance delivering to the main queue
++ (CKDeliveryQueue *)mainQueue;
+
+- (id)initWithTargetQueue:(dispatch_queue_t)queue;
+
+// Threadsafe. The block is copied, and later run on the target queue. Returns straight away, unlike -performSelectorOnMainThread:withObject:waitUntilDone:YES, so the caller mustn't rely on the block having run yet
+- (void)deliver:(void (^)(void))block;
+
+// Threadsafe. Delivers the block in order behind everything else, then blocks until it's been run. Called from the target queue, runs the block straight away, as waitUntilDone:YES does on the main thread
+- (void)deliverAndWait:(void (^)(void))block;
+
+@end
@@ -0,0 +1,132 @@
+//
+//  CKDeliveryQueue.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CKDeliveryQueue.h"
+
+#include <libkern/OSAtomic.h>
+
+
+typedef struct CKDelivery {
+    struct CKDelivery   *next;
+    void                (^block)(void);
+} CKDelivery;
+
+
+@implementation CKDeliveryQueue
+
++ (CKDeliveryQueue *)mainQueue;
+{
+    static CKDeliveryQueue *result;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        result = [[self alloc] initWithTargetQueue:dispatch_get_main_queue()];
+    });
+    return result;
+}
+
+- (id)initWithTargetQueue:(dispatch_queue_t)queue;
+{
+    NSParameterAssert(queue);
+    
+    if (self = [self init])
+    {
+        _queue = queue;
+        dispatch_retain(_queue);
+        dispatch_queue_set_specific(_queue, self, self, NULL);  // so -deliverAndWait: can tell when it's already there
+    }
+    return self;
+}
+
+- (void)dealloc;
+{
+    // Any scheduled batch retains the receiver, so nothing can be left pending by now
+    NSAssert(_pending == NULL, @"Deallocating with blocks still to be delivered");
+    dispatch_queue_set_specific(_queue, self, NULL, NULL);
+    dispatch_release(_queue);
+    [super dealloc];
+}
+
+- (void)deliver:(void (^)(void))block;
+{
+    NSParameterAssert(block);
+    
+    CKDelivery *delivery = malloc(sizeof(CKDelivery));
+    delivery->block = Block_copy(block);
+    
+    CKDelivery *head;
+    do
+    {
+        head = _pending;
+        delivery->next = head;
+    }
+    while (!OSAtomicCompareAndSwapPtrBarrier(head, delivery, &_pending));
+    
+    // Anything already pending means a batch is on its way, and will pick this up too
+    if (!head)
+    {
+        dispatch_async(_queue, ^{
+            [self runPendingBlocks];
+        });
+    }
+}
+
+- (void)deliverAndWait:(void (^)(void))block;
+{
+    NSParameterAssert(block);
+    
+    // Waiting on ourselves would never return
+    if (dispatch_get_specific(self) == self)
+    {
+        block();
+        return;
+    }
+    
+    dispatch_semaphore_t done = dispatch_semaphore_create(0);
+    [self deliver:^{
+        block();
+        dispatch_semaphore_signal(done);
+    }];
+    
+    dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+    dispatch_release(done);
+}
+
+- (void)runPendingBlocks;
+{
+    // Take the whole list. It was built newest first, so reverse it back into order
+    CKDelivery *list;
+    do
+    {
+        list = _pending;
+    }
+    while (!OSAtomicCompareAndSwapPtrBarrier(list, NULL, &_pending));
+    
+    CKDelivery *delivery = NULL;
+    while (list)
+    {
+        CKDelivery *next = list->next;
+        list->next = delivery;
+        delivery = list;
+        list = next;
+    }
+    
+    // Blocks delivered while this is running go in the next batch
+    while (delivery)
+    {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        delivery->block();
+        [pool release];
+        
+        CKDelivery *next = delivery->next;
+        Block_release(delivery->block);
+        free(delivery);
+        delivery = next;
+    }
+}
+
+@end
@@ -0,0 +1,107 @@
+//
+//  CKFolderPublisher.h
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//  Keeps a remote folder in step with a local one. Rather than re-publishing the whole tree whenever something changes, watches the local folder and turns each batch of changes into the minimum CKUploader operations: uploading changed files, removing deleted items, and creating new directories.
+//
+//  Changes are gathered up until things have been quiet for the settle interval, so a burst of saves goes out together. Files modified more recently than that are assumed to still be being written, and held back until they settle. Temporary and partially downloaded files are skipped altogether; override -shouldPublishItemAtPath: to change what counts.
+//
+//  One uploader, and so one connection, is kept open while there's work to do, and for the idle interval after, ready for the next batch.
+//
+//  The whole folder is watched through a single FSEvents stream on the Mac, or inotify on Linux, so there's no file descriptor per item.
+//  Folders that turn up whole (e.g. moved into the watched folder), or that the watcher lost track of, are walked for their contents. Deleted folders are removed contents first, from what's been seen of them since starting: anything never seen locally, such as hidden files, is left for the server to refuse.
+//
+//  Existing content isn't published up front; only changes made once started.
+//  Must be used from the main thread.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "CKUploader.h"
+
+
+@protocol CKFolderPublisherDelegate;
+@protocol UKFileWatcher;
+
+
+@interface CKFolderPublisher : NSObject <CKUploaderDelegate>
+{
+  @private
+    NSString            *_folderPath;
+    NSURLRequest        *_request;
+    NSNumber            *_permissions;
+    CKUploadingOptions  _options;
+
+    id <UKFileWatcher>  _watcher;
+    NSMutableDictionary *_knownItems;           // relative path -> NSNumber of whether it's a folder, so deleted folders can be removed along with their contents
+    NSMutableSet        *_pathsToRescan;        // folders the watcher lost track of
+
+    NSMutableSet            *_pendingPaths;     // relative to the folder
+    NSTimeInterval          _firstPendingTime;
+    NSTimeInterval          _rescanSince;
+    NSDirectoryEnumerator   *_rescanEnumerator;
+
+    CKUploader              *_uploader;
+    NSMutableArray          *_finishingUploaders;
+    CFMutableDictionaryRef  _uploadsInFlight;   // transfer record -> relative path
+    BOOL                    _waitingForUploads;
+    BOOL                    _stopping;
+
+    NSTimeInterval  _settleInterval;
+    NSTimeInterval  _idleInterval;
+    NSUInteger      _maximumPendingChanges;
+    NSUInteger      _maximumUploadsInFlight;
+
+    id <CKFolderPublisherDelegate>  _delegate;
+}
+
+// Permissions and options are passed on to each CKUploader created
+- (id)initWithFolderURL:(NSURL *)folderURL request:(NSURLRequest *)request filePosixPermissions:(NSNumber *)permissions options:(CKUploadingOptions)options;
+
+- (void)start;
+- (void)stop;   // stops watching, but anything already noticed is still published before the connection is let go
+- (void)cancel; // bails out as quickly as possible
+
+@property(nonatomic, readonly) NSURL *folderURL;
+@property(nonatomic, readonly) NSURLRequest *request;
+@property(nonatomic, assign) id <CKFolderPublisherDelegate> delegate;
+
+// Defaults to 1 second
+@property(nonatomic) NSTimeInterval settleInterval;
+
+// How long to hang on to the connection once there's nothing left to do. Defaults to 30 seconds
+@property(nonatomic) NSTimeInterval idleInterval;
+
+// Bounds the changes remembered between batches. Defaults to 10,000. Beyond that, individual paths are forgotten, and the next batch instead walks the folder for anything modified since the earliest of them; deletions in the meantime are missed
+@property(nonatomic) NSUInteger maximumPendingChanges;
+
+// Uploads queued up on the connection at once. Defaults to 32; further changes wait their turn
+@property(nonatomic) NSUInteger maximumUploadsInFlight;
+
+// Path is relative to the folder. By default, skips hidden items, and names that editors and browsers use for temporary or partial files
+- (BOOL)shouldPublishItemAtPath:(NSString *)path;
+
+// Creates the uploader for each run of changes. Override to configure or substitute it
+- (CKUploader *)newUploader;
+
+@end
+
+
+@protocol CKFolderPublisherDelegate <NSObject>
+
+- (void)folderPublisher:(CKFolderPublisher *)publisher didReceiveAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge;
+
+@optional
+- (void)folderPublisher:(CKFolderPublisher *)publisher didCancelAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge;
+
+// Errors for individual files are reported here too, and don't stop publishing
+- (void)folderPublisher:(CKFolderPublisher *)publisher didFailWithError:(NSError *)error;
+
+// Sent once everything so far has been published and the connection let go
+- (void)folderPublisherDidBecomeIdle:(CKFolderPublisher *)publisher;
+
+- (void)folderPublisher:(CKFolderPublisher *)publisher appendString:(NSString *)string toTranscript:(CKTranscriptType)transcript;
+
+@end
@@ -0,0 +1,602 @@
+//
+//  CKFolderPublisher.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CKFolderPublisher.h"
+
+#if defined(__linux__)
+#import "UKINotifyWatcher.h"
+#else
+#import "UKFSEventsWatcher.h"
+#endif
+
+#include <sys/stat.h>
+
+
+// However busy the folder, don't hold changes back for longer than this many settle intervals
+#define CKFolderPublisherMaximumSettles 10
+
+
+@interface CKFolderPublisher ()
+- (void)noteChangeAtPath:(NSString *)path;
+- (void)noteContentsOfDirectoryAtPath:(NSString *)path;
+- (void)schedulePublishing;
+- (void)publishPendingChanges;
+- (void)scheduleFinishingIfIdle;
+- (void)becomeIdle;
+- (void)stopTrackingUploads;
+@end
+
+
+@implementation CKFolderPublisher
+
+#pragma mark Lifecycle
+
+- (id)initWithFolderURL:(NSURL *)folderURL request:(NSURLRequest *)request filePosixPermissions:(NSNumber *)permissions options:(CKUploadingOptions)options;
+{
+    NSParameterAssert([folderURL isFileURL]);
+    NSParameterAssert(request);
+
+    if (self = [self init])
+    {
+        _folderPath = [[[folderURL path] stringByStandardizingPath] copy];
+        _request = [request copy];
+        _permissions = [permissions copy];
+        _options = options;
+
+        _pendingPaths = [[NSMutableSet alloc] init];
+        _knownItems = [[NSMutableDictionary alloc] init];
+        _pathsToRescan = [[NSMutableSet alloc] init];
+        _finishingUploaders = [[NSMutableArray alloc] init];
+        _uploadsInFlight = CFDictionaryCreateMutable(NULL, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+        _settleInterval = 1.0;
+        _idleInterval = 30.0;
+        _maximumPendingChanges = 10000;
+        _maximumUploadsInFlight = 32;
+    }
+    return self;
+}
+
+- (void)dealloc;
+{
+    [self cancel];
+
+    [_folderPath release];
+    [_request release];
+    [_permissions release];
+    [_knownItems release];
+    [_pathsToRescan release];
+    [_pendingPaths release];
+    [_rescanEnumerator release];
+    [_finishingUploaders release];
+    CFRelease(_uploadsInFlight);
+
+    [super dealloc];
+}
+
+#pragma mark Properties
+
+- (NSURL *)folderURL; { return [NSURL fileURLWithPath:_folderPath isDirectory:YES]; }
+@synthesize request = _request;
+@synthesize delegate = _delegate;
+
+@synthesize settleInterval = _settleInterval;
+@synthesize idleInterval = _idleInterval;
+@synthesize maximumPendingChanges = _maximumPendingChanges;
+@synthesize maximumUploadsInFlight = _maximumUploadsInFlight;
+
+#pragma mark Starting and Stopping
+
+- (void)start;
+{
+    NSAssert([NSThread isMainThread], @"CKFolderPublisher can only be used on main thread");
+    if (_watcher) return;
+
+    _stopping = NO;
+
+    // Both watchers cover the whole tree, including folders created later
+#if defined(__linux__)
+    UKINotifyWatcher *watcher = [[UKINotifyWatcher alloc] init];
+    [watcher setDelegate:self];
+    [watcher addPath:_folderPath recursive:YES];
+#else
+    UKFSEventsWatcher *watcher = [[UKFSEventsWatcher alloc] init];
+    [watcher setDelegate:self];
+    [watcher addPath:_folderPath];
+#endif
+
+    _watcher = watcher;
+
+    // Watchers don't say whether a deleted item was a folder, nor what was inside it, so keep track of the existing items
+    NSDirectoryEnumerator *enumerator = [[NSFileManager defaultManager] enumeratorAtPath:_folderPath];
+    NSString *aPath;
+    while ((aPath = [enumerator nextObject]))
+    {
+        if (![self shouldPublishItemAtPath:aPath])
+        {
+            [enumerator skipDescendants];
+        }
+        else
+        {
+            BOOL isDirectory = [[[enumerator fileAttributes] fileType] isEqualToString:NSFileTypeDirectory];
+            [_knownItems setObject:[NSNumber numberWithBool:isDirectory] forKey:aPath];
+        }
+    }
+}
+
+- (void)stop;
+{
+    [_watcher setDelegate:nil];
+    [(NSObject *)_watcher release]; _watcher = nil;
+
+    // Carry on with what's already been noticed, but let the connection go straight after
+    _stopping = YES;
+    if ([_pendingPaths count] || _rescanSince > 0)
+    {
+        [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(publishPendingChanges) object:nil];
+        [self publishPendingChanges];
+    }
+    else if (_uploader || [_finishingUploaders count])
+    {
+        [self scheduleFinishingIfIdle];
+    }
+    else
+    {
+        // Nothing to wait for, but still report back as the delegate would expect, once out of the way of the caller
+        [self performSelector:@selector(becomeIdle) withObject:nil afterDelay:0.0];
+    }
+}
+
+- (void)cancel;
+{
+    [NSObject cancelPreviousPerformRequestsWithTarget:self];
+
+    [_watcher setDelegate:nil];
+    [(NSObject *)_watcher release]; _watcher = nil;
+
+    [_pendingPaths removeAllObjects];
+    [_pathsToRescan removeAllObjects];
+    _firstPendingTime = 0;
+    _rescanSince = 0;
+    [_rescanEnumerator release]; _rescanEnumerator = nil;
+
+    [self stopTrackingUploads];
+    [_uploader setDelegate:nil];
+    [_uploader cancel];
+    [_uploader release]; _uploader = nil;
+
+    // Those already finishing can be left to it, but mustn't report back
+    [_finishingUploaders makeObjectsPerformSelector:@selector(setDelegate:) withObject:nil];
+    [_finishingUploaders removeAllObjects];
+}
+
+#pragma mark Paths
+
+- (NSString *)localPathForPath:(NSString *)path;
+{
+    return [_folderPath stringByAppendingPathComponent:path];
+}
+
+- (NSString *)remotePathForPath:(NSString *)path;
+{
+    return [[[_request URL] path] stringByAppendingPathComponent:path];
+}
+
+// nil for anything outside the folder
+- (NSString *)pathForLocalPath:(NSString *)localPath;
+{
+    if ([localPath isEqualToString:_folderPath]) return @"";
+
+    NSUInteger length = [_folderPath length];
+    if ([localPath length] <= length + 1 || ![localPath hasPrefix:_folderPath] || [localPath characterAtIndex:length] != '/') return nil;
+
+    return [localPath substringFromIndex:length + 1];
+}
+
+- (BOOL)shouldPublishItemAtPath:(NSString *)path;
+{
+    static NSSet *extensions;
+    if (!extensions) extensions = [[NSSet alloc] initWithObjects:@"tmp", @"temp", @"part", @"partial", @"crdownload", @"download", @"swp", @"swx", nil];
+
+    // Anything inside a hidden or temporary folder counts too
+    for (NSString *aComponent in [path pathComponents])
+    {
+        if ([aComponent hasPrefix:@"."] || [aComponent hasPrefix:@"#"] || [aComponent hasPrefix:@"~$"] || [aComponent hasSuffix:@"~"]) return NO;
+        if ([extensions containsObject:[[aComponent pathExtension] lowercaseString]]) return NO;
+    }
+
+    return YES;
+}
+
+#pragma mark Gathering Changes
+
+- (void)watcher:(id <UKFileWatcher>)watcher receivedNotification:(NSString *)notification forPath:(NSString *)localPath;
+{
+    NSString *path = [self pathForLocalPath:localPath];
+    if (!path) return;
+
+    if ([notification isEqualToString:UKFileWatcherRescanNotification] && [self shouldPublishItemAtPath:path]) [_pathsToRescan addObject:path];
+
+    [self noteChangeAtPath:path];
+    [self schedulePublishing];
+}
+
+- (void)watcher:(id <UKFileWatcher>)watcher receivedNotifications:(NSDictionary *)changes;
+{
+    for (NSString *aLocalPath in changes)
+    {
+        NSString *path = [self pathForLocalPath:aLocalPath];
+        if (!path) continue;
+
+        // The watcher couldn't tell what changed inside, so the whole folder needs looking at
+        if ([[changes objectForKey:aLocalPath] containsObject:UKFileWatcherRescanNotification] && [self shouldPublishItemAtPath:path])
+        {
+            [_pathsToRescan addObject:path];
+        }
+
+        [self noteChangeAtPath:path];
+    }
+
+    [self schedulePublishing];
+}
+
+- (void)noteChangeAtPath:(NSString *)path;
+{
+    if (![self shouldPublishItemAtPath:path]) return;
+
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    if (!_firstPendingTime) _firstPendingTime = now;
+
+    if ([_pendingPaths count] >= _maximumPendingChanges && ![_pendingPaths containsObject:path])
+    {
+        // Too many to keep track of individually, so walk the folder for them instead. Anything deferred as still being written was modified within a settle interval of being noted
+        NSTimeInterval since = _firstPendingTime - _settleInterval;
+        if (!_rescanSince || since < _rescanSince) _rescanSince = since;
+
+        [_pendingPaths removeAllObjects];
+        return;
+    }
+
+    [_pendingPaths addObject:path];
+}
+
+// Folders that turn up whole, say moved in from elsewhere, only report themselves, not their contents
+- (void)noteContentsOfDirectoryAtPath:(NSString *)path;
+{
+    NSDirectoryEnumerator *enumerator = [[NSFileManager defaultManager] enumeratorAtPath:[self localPathForPath:path]];
+    NSString *aPath;
+    while ((aPath = [enumerator nextObject]))
+    {
+        NSString *itemPath = [path stringByAppendingPathComponent:aPath];
+        if (![self shouldPublishItemAtPath:itemPath])
+        {
+            [enumerator skipDescendants];
+            continue;
+        }
+
+        // Folders inside are covered by this walk, so mustn't be walked again when published
+        if ([[[enumerator fileAttributes] fileType] isEqualToString:NSFileTypeDirectory])
+        {
+            [_knownItems setObject:[NSNumber numberWithBool:YES] forKey:itemPath];
+            [_pathsToRescan removeObject:itemPath];
+        }
+
+        [self noteChangeAtPath:itemPath];
+    }
+}
+
+// Waits for changes to stop arriving for the settle interval, but doesn't let a steady trickle hold everything back forever
+- (void)schedulePublishing;
+{
+    if (![_pendingPaths count] && !_rescanSince) return;
+
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(finishUploadingIfIdle) object:nil];
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(publishPendingChanges) object:nil];
+    if (_waitingForUploads) return; // there'll be another batch as soon as there's room
+
+    NSTimeInterval waited = [NSDate timeIntervalSinceReferenceDate] - _firstPendingTime;
+    NSTimeInterval delay = MIN(_settleInterval, CKFolderPublisherMaximumSettles * _settleInterval - waited);
+
+    [self performSelector:@selector(publishPendingChanges) withObject:nil afterDelay:MAX(delay, 0.0)];
+}
+
+#pragma mark Publishing
+
+- (CKUploader *)newUploader;
+{
+    return [[CKUploader uploaderWithRequest:_request filePosixPermissions:_permissions options:_options] retain];
+}
+
+- (CKUploader *)uploader;
+{
+    if (!_uploader)
+    {
+        _uploader = [self newUploader];
+        [_uploader setDelegate:self];
+    }
+    return _uploader;
+}
+
+- (void)publishPendingChanges;
+{
+    NSAssert([NSThread isMainThread], @"CKFolderPublisher can only be used on main thread");
+
+    _firstPendingTime = 0;
+    _waitingForUploads = NO;
+
+    // Start a walk of the folder if changes overflowed. It's carried on with as there's room
+    if (_rescanSince && !_rescanEnumerator)
+    {
+        _rescanEnumerator = [[[NSFileManager defaultManager] enumeratorAtPath:_folderPath] retain];
+    }
+
+    // Parents sort before their contents, so directories get created first. Removals go the other way round
+    NSArray *paths = [[_pendingPaths allObjects] sortedArrayUsingSelector:@selector(compare:)];
+    NSMutableDictionary *removals = [NSMutableDictionary dictionary];   // path -> whether it was a folder
+
+    for (NSString *aPath in paths)
+    {
+        if ((NSUInteger)CFDictionaryGetCount(_uploadsInFlight) >= _maximumUploadsInFlight)
+        {
+            _waitingForUploads = YES;
+            break;
+        }
+
+        [_pendingPaths removeObject:aPath];
+        [self publishItemAtPath:aPath removals:removals];
+    }
+
+    while (_rescanEnumerator && !_waitingForUploads)
+    {
+        if ((NSUInteger)CFDictionaryGetCount(_uploadsInFlight) >= _maximumUploadsInFlight)
+        {
+            _waitingForUploads = YES;
+            break;
+        }
+
+        NSString *path = [_rescanEnumerator nextObject];
+        if (!path)
+        {
+            [_rescanEnumerator release]; _rescanEnumerator = nil;
+            _rescanSince = 0;
+            break;
+        }
+
+        if (![self shouldPublishItemAtPath:path])
+        {
+            [_rescanEnumerator skipDescendants];
+            continue;
+        }
+
+        // This walk takes in the contents of any new folders already
+        if ([[[_rescanEnumerator fileAttributes] fileType] isEqualToString:NSFileTypeDirectory])
+        {
+            [_knownItems setObject:[NSNumber numberWithBool:YES] forKey:path];
+        }
+
+        NSDate *modified = [[_rescanEnumerator fileAttributes] fileModificationDate];
+        if ([modified timeIntervalSinceReferenceDate] >= _rescanSince) [self publishItemAtPath:path removals:removals];
+    }
+
+    NSArray *removedPaths = [[removals allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    for (NSString *aPath in [removedPaths reverseObjectEnumerator])
+    {
+        if ([[removals objectForKey:aPath] boolValue])
+        {
+            [[self uploader] removeDirectoryAtPath:[self remotePathForPath:aPath]];
+        }
+        else
+        {
+            [[self uploader] removeFileAtPath:[self remotePathForPath:aPath]];
+        }
+    }
+
+    // Anything left over was still being written, and has been noted again
+    if ([_pendingPaths count] && !_waitingForUploads)
+    {
+        [self schedulePublishing];
+    }
+    else
+    {
+        [self scheduleFinishingIfIdle];
+    }
+}
+
+- (void)publishItemAtPath:(NSString *)path removals:(NSMutableDictionary *)removals;
+{
+    NSString *localPath = [self localPathForPath:path];
+
+    struct stat info;
+    if (lstat([localPath fileSystemRepresentation], &info) != 0)
+    {
+        if ((errno == ENOENT || errno == ENOTDIR) && [path length])
+        {
+            BOOL isDirectory = [[_knownItems objectForKey:path] boolValue];
+            [removals setObject:[NSNumber numberWithBool:isDirectory] forKey:path];
+            [_knownItems removeObjectForKey:path];
+            [_pathsToRescan removeObject:path];
+
+            // Everything known to be inside went with it, e.g. when the folder was moved or renamed wholesale, and needs removing first
+            if (isDirectory)
+            {
+                NSString *prefix = [path stringByAppendingString:@"/"];
+                for (NSString *anItem in [_knownItems allKeys])
+                {
+                    if (![anItem hasPrefix:prefix]) continue;
+
+                    [removals setObject:[_knownItems objectForKey:anItem] forKey:anItem];
+                    [_knownItems removeObjectForKey:anItem];
+                }
+            }
+        }
+        return;
+    }
+
+    if (S_ISDIR(info.st_mode))
+    {
+        // New folders need walking for their contents, as do ones the watcher lost track of. The folder itself is always known
+        BOOL walk = ([_pathsToRescan containsObject:path] || ([path length] && ![[_knownItems objectForKey:path] boolValue]));
+        [_pathsToRescan removeObject:path];
+
+        if ([path length])
+        {
+            [_knownItems setObject:[NSNumber numberWithBool:YES] forKey:path];
+            [[self uploader] createDirectoryAtPath:[self remotePathForPath:path]];
+        }
+
+        if (walk) [self noteContentsOfDirectoryAtPath:path];
+    }
+    else if (S_ISREG(info.st_mode))
+    {
+        [_knownItems setObject:[NSNumber numberWithBool:NO] forKey:path];   // also covers a folder being replaced by a file of the same name
+
+        // Recently modified files may well still be being written, so come back to them once they've settled
+        NSTimeInterval age = [NSDate timeIntervalSinceReferenceDate] + kCFAbsoluteTimeIntervalSince1970 - info.st_mtime;
+        if (age < _settleInterval && !_stopping)
+        {
+            [self noteChangeAtPath:path];
+            return;
+        }
+
+        CKTransferRecord *record = [[self uploader] uploadFileAtURL:[NSURL fileURLWithPath:localPath] toPath:[self remotePathForPath:path]];
+        if (record)
+        {
+            CFDictionarySetValue(_uploadsInFlight, record, path);
+            [[NSNotificationCenter defaultCenter] addObserver:self
+                                                     selector:@selector(transferRecordDidFinish:)
+                                                         name:CKTransferRecordTransferDidFinishNotification
+                                                       object:record];
+        }
+    }
+}
+
+- (void)transferRecordDidFinish:(NSNotification *)notification;
+{
+    CKTransferRecord *record = [notification object];
+    if (!CFDictionaryContainsKey(_uploadsInFlight, record)) return;
+
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:CKTransferRecordTransferDidFinishNotification object:record];
+    CFDictionaryRemoveValue(_uploadsInFlight, record);
+
+    if (_waitingForUploads)
+    {
+        [self publishPendingChanges];
+    }
+    else
+    {
+        [self scheduleFinishingIfIdle];
+    }
+}
+
+- (void)stopTrackingUploads;
+{
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:CKTransferRecordTransferDidFinishNotification object:nil];
+    CFDictionaryRemoveAllValues(_uploadsInFlight);
+    _waitingForUploads = NO;
+}
+
+#pragma mark Finishing
+
+- (void)scheduleFinishingIfIdle;
+{
+    if (!_uploader)
+    {
+        // Stopped with nothing that needed publishing after all, but the delegate still expects to hear back
+        if (_stopping && ![_finishingUploaders count] && ![_pendingPaths count])
+        {
+            [self performSelector:@selector(becomeIdle) withObject:nil afterDelay:0.0];
+        }
+        return;
+    }
+
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(finishUploadingIfIdle) object:nil];
+    [self performSelector:@selector(finishUploadingIfIdle) withObject:nil afterDelay:(_stopping ? 0.0 : _idleInterval)];
+}
+
+- (void)finishUploadingIfIdle;
+{
+    if ([_pendingPaths count] || _rescanSince || CFDictionaryGetCount(_uploadsInFlight)) return;
+
+    // Hang on to it until it reports back, which might be straight away
+    CKUploader *uploader = _uploader;
+    [_finishingUploaders addObject:uploader];
+    [_uploader release]; _uploader = nil;
+    [uploader finishUploading];
+}
+
+- (void)becomeIdle;
+{
+    if ([_delegate respondsToSelector:@selector(folderPublisherDidBecomeIdle:)])
+    {
+        [_delegate folderPublisherDidBecomeIdle:self];
+    }
+}
+
+#pragma mark Uploader Delegate
+
+- (void)uploaderDidFinishUploading:(CKUploader *)uploader;
+{
+    [[uploader retain] autorelease];
+    [uploader setDelegate:nil];
+
+    if (uploader == _uploader)
+    {
+        // Finished of its own accord, most likely because the server dropped the connection. Anything it hadn't got round to needs trying again with a fresh one
+        CFIndex count = CFDictionaryGetCount(_uploadsInFlight);
+        if (count)
+        {
+            const void *paths[count];
+            CFDictionaryGetKeysAndValues(_uploadsInFlight, NULL, paths);
+            for (CFIndex i = 0; i < count; i++)
+            {
+                [self noteChangeAtPath:(NSString *)paths[i]];
+            }
+        }
+
+        [self stopTrackingUploads];
+        [_uploader release]; _uploader = nil;
+        [self schedulePublishing];
+        return;
+    }
+
+    [_finishingUploaders removeObjectIdenticalTo:uploader];
+    if (!_uploader && ![_finishingUploaders count]) [self becomeIdle];
+}
+
+- (void)uploader:(CKUploader *)uploader didFailWithError:(NSError *)error;
+{
+    if ([_delegate respondsToSelector:@selector(folderPublisher:didFailWithError:)])
+    {
+        [_delegate folderPublisher:self didFailWithError:error];
+    }
+}
+
+- (void)uploader:(CKUploader *)uploader didReceiveAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge;
+{
+    [_delegate folderPublisher:self didReceiveAuthenticationChallenge:challenge];
+}
+
+- (void)uploader:(CKUploader *)uploader didCancelAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge;
+{
+    if ([_delegate respondsToSelector:@selector(folderPublisher:didCancelAuthenticationChallenge:)])
+    {
+        [_delegate folderPublisher:self didCancelAuthenticationChallenge:challenge];
+    }
+}
+
+- (void)uploader:(CKUploader *)uploader didBeginUploadToPath:(NSString *)path; { }
+
+- (void)uploader:(CKUploader *)uploader appendString:(NSString *)string toTranscript:(CKTranscriptType)transcript;
+{
+    if ([_delegate respondsToSelector:@selector(folderPublisher:appendString:toTranscript:)])
+    {
+        [_delegate folderPublisher:self appendString:string toTranscript:transcript];
+    }
+}
+
+@end
@@ -28,15 +28,12 @@
  */
 #import <Foundation/Foundation.h>
 
-@class RunLoopForwarder;
-
 @interface CKInternalTransferRecord : NSObject <NSCopying>
 {
 	NSString	*myLocalPath;
 	NSString	*myRemotePath;
 	NSData		*myData;
 	unsigned long long myOffset;
-	RunLoopForwarder *myForwarder;
 	id			myDelegate;   // retained; see .m for why
 	id			myUserInfo;
 	NSMutableDictionary *myProperties;
@@ -81,6 +78,12 @@
 - (BOOL)delegateRespondsToTransferDidFinish;
 - (BOOL)delegateRespondsToError;
 
+// Callable from any thread. Passed on to the delegate on the main thread, if it implements them
+- (void)deliverTransferDidBegin:(id)transfer;
+- (void)deliverTransfer:(id)transfer transferredDataOfLength:(unsigned long long)length;
+- (void)deliverTransfer:(id)transfer progressedTo:(NSNumber *)percent;
+- (void)deliverTransferDidFinish:(id)transfer error:(NSError *)error;
+
 - (void)setObject:(id)object forKey:(id)key;
 - (id)objectForKey:(id)key;
 
@@ -28,7 +28,8 @@
  */
 
 #import "CKInternalTransferRecord.h"
-#import "RunLoopForwarder.h"
+#import "CKDeliveryQueue.h"
+#import "CKTransferRecord.h"
 
 @implementation CKInternalTransferRecord
 
@@ -63,10 +64,6 @@
 		myDelegate = [delegate retain];
 		/* Why retain this delegate?  If an app only uses the original upload/download methods that don't take a delegate, then internally the delegate will be created which is a CKTR. If the internal transfer record doesn't retain it then you can see that when the transfer starts up, the delegate will be a dangling pointer and will crash. Because the internal transfer record is a private class, convention doesn't have to apply.
 		*/
-
-		myForwarder = [[RunLoopForwarder alloc] init];
-		[myForwarder setUseMainThread:YES];
-		[myForwarder setDelegate:myDelegate];
 		myUserInfo = [ui retain];
 		
 		myFlags.didBegin = [myDelegate respondsToSelector:@selector(transferDidBegin:)];
@@ -87,7 +84,6 @@
 	[myRemotePath release];
 	[myData release];
 	[myUserInfo release];
-	[myForwarder release];
 	[myProperties release];
 	
 	[super dealloc];
@@ -132,7 +128,7 @@
 
 - (id)delegate
 {
-	return myForwarder;
+	return myDelegate;
 }
 
 - (void)setUserInfo:(id)ui
@@ -171,6 +167,50 @@
 	return myFlags.error;
 }
 
+#pragma mark Delivering to the Delegate
+
+- (void)deliverTransferDidBegin:(id)transfer
+{
+	if (!myFlags.didBegin) return;
+	
+	id delegate = myDelegate;
+	[[CKDeliveryQueue mainQueue] deliver:^{
+		[delegate transferDidBegin:transfer];
+	}];
+}
+
+- (void)deliverTransfer:(id)transfer transferredDataOfLength:(unsigned long long)length
+{
+	if (!myFlags.progressed) return;
+	
+	id delegate = myDelegate;
+	[[CKDeliveryQueue mainQueue] deliver:^{
+		[delegate transfer:transfer transferredDataOfLength:length];
+	}];
+}
+
+- (void)deliverTransfer:(id)transfer progressedTo:(NSNumber *)percent
+{
+	if (!myFlags.percent) return;
+	
+	id delegate = myDelegate;
+	[[CKDeliveryQueue mainQueue] deliver:^{
+		[delegate transfer:transfer progressedTo:percent];
+	}];
+}
+
+- (void)deliverTransferDidFinish:(id)transfer error:(NSError *)error
+{
+	if (!myFlags.didFinish) return;
+	
+	id delegate = myDelegate;
+	[[CKDeliveryQueue mainQueue] deliver:^{
+		[delegate transferDidFinish:transfer error:error];
+	}];
+}
+
+#pragma mark -
+
 - (NSString *)description
 {
 	NSMutableString *str = [NSMutableString stringWithFormat:@"%@ <%p>\n", [self className], self];
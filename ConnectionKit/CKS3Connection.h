@@ -30,23 +30,24 @@
 #import "CKHTTPConnection.h"
 
 
+@class CKS3MultipartUpload, CKS3Download, CKS3Listing;
+
 @interface CKS3Connection : CKHTTPConnection 
 {
-	//When we receive a directory listing that is truncated, we keep around the contents in here until we've received all the directory's contents to return the delegate.
-	NSMutableArray *incompleteDirectoryContents; 
-	NSMutableArray *incompleteKeyNames;
-	
 	NSString *myCurrentDirectory;
 	unsigned long long	bytesTransferred;
 	unsigned long long	bytesToTransfer;
 	unsigned long long	transferHeaderLength;
 	unsigned int myLastPercent;
-	NSFileHandle *myDownloadHandle;
     
 @private
     // Authentication
     NSURLCredential                 *_credential;
     //NSURLAuthenticationChallenge    *_currentAuthenticationChallenge;
+    
+    CKS3MultipartUpload             *_multipartUpload;
+    CKS3Download                    *_download;
+    CKS3Listing                     *_listing;
 }
 
 @end
@@ -55,4 +56,7 @@ extern NSString *S3StorageClassKey; // file attribute extension keys
 
 extern NSString *S3ErrorDomain;
 
+// Files at least this many bytes are uploaded in parts, several at once. Defaults to 16MB. Part size and concurrency can be tuned with the CKS3MultipartPartSize and CKS3MultipartConcurrency defaults
+extern NSString *CKS3MultipartUploadThresholdKey;
+
 enum { S3DownloadFileExists = 100 };
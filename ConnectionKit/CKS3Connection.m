@@ -33,17 +33,21 @@
 #import "NSString+Connection.h"
 #import "NSCalendarDate+Connection.h"
 #import "CKHTTPPutRequest.h"
-#import "CKHTTPFileDownloadRequest.h"
 #import "CKHTTPResponse.h"
 #import "CKInternalTransferRecord.h"
 #import "CKTransferRecord.h"
 #import "NSFileManager+Connection.h"
 #import "CKConnectionProtocol.h"
+#import "CKS3MultipartUpload.h"
+#import "CKS3Download.h"
+#import "CKS3Listing.h"
+#import "CKS3Signer.h"
+#import "CKDeliveryQueue.h"
 
 
-NSString *S3ErrorDomain = @"S3ErrorDomain";
 NSString *S3StorageClassKey = @"S3StorageClassKey";
 NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
+NSString *CKS3MultipartUploadThresholdKey = @"CKS3MultipartUploadThreshold";
 
 
 @implementation CKS3Connection
@@ -66,8 +70,20 @@ NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
 
 - (id)initWithRequest:(NSURLRequest *)request delegate:(id)delegate
 {     
-    // allow for subdomains of s3
-	if ([[[request URL] host] rangeOfString:@"s3.amazonaws.com"].location == NSNotFound)
+    // allow for subdomains of s3, and S3-compatible servers on a port of their own, e.g. a local MinIO
+	NSURL *requestURL = [request URL];
+	if ([requestURL port] && [[requestURL host] length])
+	{
+		NSString *host = [NSString stringWithFormat:@"%@:%@", [requestURL host], [requestURL port]];
+		NSURL *URL = [[NSURL alloc] initWithScheme:@"http" host:host path:@"/"];
+        NSMutableURLRequest *newRequest = [request mutableCopy];
+        [newRequest setURL:URL];
+        [URL release];
+        
+        self = [super initWithRequest:newRequest];
+        [newRequest release];
+	}
+	else if ([[requestURL host] rangeOfString:@"s3.amazonaws.com"].location == NSNotFound)
 	{
 		NSURL *URL = [[NSURL alloc] initWithScheme:@"http" host:@"s3.amazonaws.com" path:nil];
         NSMutableURLRequest *newRequest = [request mutableCopy];
@@ -85,8 +101,6 @@ NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
     
 	if (self)
 	{
-		incompleteDirectoryContents = [[NSMutableArray array] retain];
-		incompleteKeyNames = [[NSMutableArray array] retain];
 		myCurrentDirectory = @"/";
 	}
     
@@ -96,11 +110,14 @@ NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
 
 - (void)dealloc
 {
-	[incompleteDirectoryContents release];
-	[incompleteKeyNames release];
 	[myCurrentDirectory release];
-	[myDownloadHandle release];
     [_credential release];
+    [_multipartUpload cancel];
+    [_multipartUpload release];
+    [_download cancel];
+    [_download release];
+    [_listing cancel];
+    [_listing release];
 	[_currentAuthenticationChallenge release];
     
 	[super dealloc];
@@ -137,33 +154,28 @@ NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
     NSAssert([_credential password], @"S3 connection has no secret key");
     
     
-    NSString *method = [request method];
-	NSString *md5 = @""; //[[request content] length] > 0 ? [[[request content] md5Digest] base64Encoding] : @"";
-	NSString *ct = [request headerForKey:@"Content-Type"];
-	NSString *date = [request headerForKey:@"Date"];
-		[request setHeader:date forKey:@"Date"];
-	
-	NSMutableString *auth = [NSMutableString stringWithFormat:@"%@\n%@\n%@\n%@\n", method, md5, ct ? ct : @"", date];
-	NSEnumerator *e = [[[[request headers] allKeys] sortedArrayUsingSelector:@selector(compare:)] objectEnumerator];
-	NSString *key;
-	
-	while ((key = [e nextObject]))
-	{
-		if ([[key lowercaseString] hasPrefix:@"x-amz"])
-		{
-			[auth appendFormat:@"%@:%@\n", [key lowercaseString], [request headerForKey:key]];
-		}
-	}
-	NSString *uri = [request uri];
-	NSRange r = [uri rangeOfString:@"?"];
-	if (r.location != NSNotFound)
-	{
-		uri = [uri substringToIndex:r.location];
-	}
-	[auth appendString:[uri encodeLegally]];
-	
-	NSString *sha1 = [[[auth dataUsingEncoding:NSUTF8StringEncoding] sha1HMacWithKey:[_credential password]] base64Encoding];
-	[request setHeader:[NSString stringWithFormat:@"AWS %@:%@", [_credential user], sha1] forKey:@"Authorization"];
+    // Signature Version 4, as for the transfers handed off elsewhere. Signed as the NSURLRequest it amounts to, then the headers carrying the signature copied back
+    NSURL *URL = [NSURL URLWithString:[request uri] relativeToURL:[[self request] URL]];
+    NSMutableURLRequest *signable = [[NSMutableURLRequest alloc] initWithURL:URL];
+    [signable setHTTPMethod:[request method]];
+    [signable setHTTPBody:[request content]];
+    
+    for (NSString *aKey in [request headers])
+    {
+        [signable setValue:[[request headerForKey:aKey] description] forHTTPHeaderField:aKey];    // some are numbers, e.g. Content-Length
+    }
+    
+    // Signers share their derived keys, so one per request is cheap
+    CKS3Signer *signer = [[CKS3Signer alloc] initWithCredential:_credential region:[CKS3Signer regionForHost:[URL host]]];
+    [signer signRequest:signable];
+    [signer release];
+    
+    for (NSString *aField in [NSArray arrayWithObjects:@"x-amz-date", @"x-amz-content-sha256", @"Authorization", nil])
+    {
+        [request setHeader:[signable valueForHTTPHeaderField:aField] forKey:aField];
+    }
+    
+    [signable release];
 }
 
 - (void)processResponse:(CKHTTPResponse *)response
@@ -195,6 +207,7 @@ NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
 	{
 		case CKConnectionAwaitingDirectoryContentsState: 
 		{
+			// Only the list of buckets comes through here. Listing inside a bucket is left to CKS3Listing
 			if ([response code] / 100 == 2)
 			{
 				NSError *error = nil;
@@ -203,136 +216,26 @@ NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
 																   error:&error] autorelease];
 				KTLog(CKProtocolDomain, KTLogDebug, @"\n%@", [doc XMLStringWithOptions:NSXMLNodePrettyPrint]);
 				
-				//do the buckets first
 				NSXMLElement *cur;
-				NSEnumerator *e;
 				NSMutableArray *contents = [NSMutableArray array];
 				
-				BOOL isTruncated = NO;
-				NSArray *isTruncatedNodes = [[doc rootElement] nodesForXPath:@"//IsTruncated" error:&error];
-				if ([isTruncatedNodes count] > 0)
-				{
-					NSXMLNode *isTruncatedNode = [isTruncatedNodes objectAtIndex:0];
-					NSString *isTruncatedValue = [isTruncatedNode stringValue];
-					isTruncated = [isTruncatedValue isEqualToString:@"true"];
-				}
-								
-				if ([myCurrentDirectory isEqualToString:@"/"])
-				{
-					NSArray *buckets = [[doc rootElement] nodesForXPath:@"//Bucket" error:&error];
-					e = [buckets objectEnumerator];
-					
-					while ((cur = [e nextObject]))
-					{
-						NSString *name = [[[cur elementsForName:@"Name"] objectAtIndex:0] stringValue];
-						NSString *date = [[[cur elementsForName:@"CreationDate"] objectAtIndex:0] stringValue];
-						
-						NSMutableDictionary *d = [NSMutableDictionary dictionary];
-						[d setObject:name forKey:cxFilenameKey];
-						[d setObject:[NSCalendarDate calendarDateWithZuluFormat:date] forKey:NSFileCreationDate];
-						[d setObject:NSFileTypeDirectory forKey:NSFileType];
-						[contents addObject:d];
-					}
-				}
-				
-				// contents inside a bucket
-				NSArray *bucketContents = [[doc rootElement] nodesForXPath:@"//Contents" error:&error];
-				e = [bucketContents objectEnumerator];
-				
-				NSString *currentPath = [myCurrentDirectory stringByDeletingFirstPathComponent];
+				NSArray *buckets = [[doc rootElement] nodesForXPath:@"//Bucket" error:&error];
+				NSEnumerator *e = [buckets objectEnumerator];
 				
-				NSMutableArray *keyNames = [NSMutableArray arrayWithArray:incompleteKeyNames];
 				while ((cur = [e nextObject]))
 				{
-					NSString *rawKeyName = [[[cur elementsForName:@"Key"] objectAtIndex:0] stringValue];
-					NSString *name = [self standardizePath:rawKeyName];
-
-					if ([name length] < [currentPath length]) continue; // this is a record from a parent folder
-					if ([name rangeOfString:currentPath].location == NSNotFound) continue; // this is an element in a different folder
-					
-					if ([name hasPrefix:currentPath])
-						name = [name substringFromIndex:[currentPath length]];
-					
-					/*We receive _all_ directory contents at once, so even when we ask for /brianamerige, we get /brianamerige/wp-admin/page.php, for example. Consequently, when currentpath is /wp-admin, we are only looking for things immediately inside /wp-admin. To achieve this, we only keep _one_ of each of the same first path components.
-					 */
-					if ([keyNames containsObject:[name firstPathComponent]])
-						continue;
-					[keyNames addObject:[name firstPathComponent]];
-					
-					if (![[name firstPathComponent] isEqualToString:[name lastPathComponent]])
-					{
-						//We have /wp-admin/page.php while we're only trying to list /wp-admin
-						name = [[name firstPathComponent] stringByAppendingString:@"/"];
-					}
-					
-					NSString *date = [[[cur elementsForName:@"LastModified"] objectAtIndex:0] stringValue];
-					NSString *size = [[[cur elementsForName:@"Size"] objectAtIndex:0] stringValue];
-					NSString *class = [[[cur elementsForName:@"StorageClass"] objectAtIndex:0] stringValue];
-					
-					NSMutableDictionary *d = [NSMutableDictionary dictionary];				
-					
-					if ([name hasSuffix:@"/"])
-					{
-						name = [name substringToIndex:[name length] - 1];
-						[d setObject:NSFileTypeDirectory forKey:NSFileType];
-					}
-					else
-					{
-						[d setObject:NSFileTypeRegular forKey:NSFileType];
-					}
-					
-					if ([name isEqualToString:@""]) continue; // skip current path name that is returned in results
+					NSString *name = [[[cur elementsForName:@"Name"] objectAtIndex:0] stringValue];
+					NSString *date = [[[cur elementsForName:@"CreationDate"] objectAtIndex:0] stringValue];
 					
+					NSMutableDictionary *d = [NSMutableDictionary dictionary];
 					[d setObject:name forKey:cxFilenameKey];
-					[d setObject:[NSCalendarDate calendarDateWithZuluFormat:date] forKey:NSFileModificationDate];
-					[d setObject:class forKey:S3StorageClassKey];
-					NSScanner *scanner = [NSScanner scannerWithString:size];
-					long long filesize;
-					[scanner scanLongLong:&filesize];
-					[d setObject:[NSNumber numberWithLongLong:filesize] forKey:NSFileSize];
+					[d setObject:[NSCalendarDate calendarDateWithZuluFormat:date] forKey:NSFileCreationDate];
+					[d setObject:NSFileTypeDirectory forKey:NSFileType];
 					[contents addObject:d];
 				}
 				
-				if (isTruncated)
-				{
-					//Keep the contents for the next time around
-					[incompleteDirectoryContents addObjectsFromArray:contents];
-					[incompleteKeyNames addObjectsFromArray:keyNames];
-					
-					//We aren't done yet. There are more keys to be listed in this 'directory'
-					NSString *bucketName = [myCurrentDirectory firstPathComponent];
-					NSString *prefixString = @"";
-					if ([bucketName length] > 1)
-					{
-						NSString *subpath = [myCurrentDirectory substringFromIndex:[bucketName length] + 2];
-						if ([subpath length] > 0)
-							prefixString = [NSString stringWithFormat:@"?prefix=%@", subpath];
-					}
-					
-					if ([prefixString length] == 0)
-						prefixString = @"?"; //If we have no prefix, we need the ? to be /brianamerige?marker=bleh
-					else
-						prefixString = [prefixString stringByAppendingString:@"&"]; //If we do have a prefix, we need the & to be /brianameige?prefix=dir/&marker=bleh
-					
-					NSString *lastKeyName = [[[[bucketContents lastObject] elementsForName:@"Key"] objectAtIndex:0] stringValue];
-					NSString *markerString = [NSString stringWithFormat:@"marker=%@", lastKeyName];
-					
-					NSString *uri = [NSString stringWithFormat:@"/%@%@%@", bucketName, prefixString, markerString];
-					CKHTTPRequest *request = [[CKHTTPRequest alloc] initWithMethod:@"GET" uri:[uri encodeLegallyForS3]];
-					[myCurrentRequest autorelease];
-					myCurrentRequest = request;
-					[self sendCommand:request];					
-					return; //Don't break. We are not idle yet, so we can't set CKConnectionIdleState as we do at the bottom of the method.
-				}
-				
-				[contents addObjectsFromArray:incompleteDirectoryContents];
-				[incompleteDirectoryContents removeAllObjects];
-				[incompleteKeyNames removeAllObjects];
-				
-				[self cacheDirectory:myCurrentDirectory withContents:contents];
-				
-				//We use fixPathToBeFilePath to strip the / from the end –– we don't traditionally have this in the last path component externally.
-				[[self client] connectionDidReceiveContents:contents ofDirectory:[self fixPathToBeFilePath:myCurrentDirectory] error:error];
+				[self cacheDirectory:@"/" withContents:contents];
+				[[self client] connectionDidReceiveContents:contents ofDirectory:@"/" error:error];
 			}
 			break;
 		}
@@ -343,8 +246,7 @@ NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
 			
 			[[self client] uploadDidFinish:[upload remotePath] error:error];
             
-			if ([upload delegateRespondsToTransferDidFinish])
-				[[upload delegate] transferDidFinish:[upload delegate] error:error];
+			[upload deliverTransferDidFinish:[upload delegate] error:error];
 			
 			[upload release];
 			
@@ -385,110 +287,6 @@ NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
 	[self setState:CKConnectionIdleState];
 }
 
-- (BOOL)processBufferWithNewData:(NSData *)data
-{
-	if (GET_STATE == CKConnectionDownloadingFileState)
-	{
-		if (bytesToTransfer == 0)
-		{
-			NSDictionary *headers = [CKHTTPResponse headersWithData:myResponseBuffer];
-			NSString *length = [headers objectForKey:@"Content-Length"];
-			if (length > 0)
-			{
-				NSScanner *scanner = [NSScanner scannerWithString:length];
-				long long daBytes = 0;
-				[scanner scanLongLong:&daBytes];
-				bytesToTransfer = daBytes;
-				
-				CKTransferRecord *record = (CKTransferRecord *)[[self currentDownload] userInfo];
-				NSFileManager *fm = [NSFileManager defaultManager];
-				BOOL isDir;
-				if ([fm fileExistsAtPath:[record propertyForKey:CKQueueDownloadDestinationFileKey] isDirectory:&isDir] && !isDir)
-				{
-					[fm removeFileAtPath:[record propertyForKey:CKQueueDownloadDestinationFileKey] handler:nil];
-				}
-				[fm createFileAtPath:[record propertyForKey:CKQueueDownloadDestinationFileKey]
-							contents:nil
-						  attributes:nil];
-				[myDownloadHandle release];
-				myDownloadHandle = [[NSFileHandle fileHandleForWritingAtPath:[record propertyForKey:CKQueueDownloadDestinationFileKey]] retain];
-				
-				// file data starts after the header
-				NSRange headerRange = [myResponseBuffer rangeOfData:[[NSString stringWithString:@"\r\n\r\n"] dataUsingEncoding:NSUTF8StringEncoding]];
-				NSString *header = [[myResponseBuffer subdataWithRange:NSMakeRange(0, headerRange.location)] descriptionAsUTF8String];
-				
-				[[self client] appendString:header toTranscript:CKTranscriptReceived];
-				
-				
-				unsigned start = headerRange.location + headerRange.length;
-				unsigned len = [myResponseBuffer length] - start;
-				NSData *fileData = [myResponseBuffer subdataWithRange:NSMakeRange(start,len)];
-				[myDownloadHandle writeData:fileData];
-				[myResponseBuffer setLength:0];
-				
-				bytesTransferred += [fileData length];
-				
-				[[self client] download:[record propertyForKey:CKQueueDownloadRemoteFileKey] didReceiveDataOfLength:[fileData length]];
-				
-				
-				NSInteger percent = (bytesToTransfer == 0) ? 0 : (100 * bytesTransferred) / bytesToTransfer;
-				[[self client] download:[record propertyForKey:CKQueueDownloadRemoteFileKey] didProgressToPercent:[NSNumber numberWithInteger:percent]];
-			}
-		}
-		else  //add the data at the end of the file
-		{
-			[myDownloadHandle writeData:data];
-			[myResponseBuffer setLength:0]; 
-			bytesTransferred += [data length];
-			
-			CKInternalTransferRecord *downloadInfo = [self currentDownload];
-			CKTransferRecord *record = (CKTransferRecord *)[downloadInfo userInfo];
-			
-			[[self client] download:[record propertyForKey:CKQueueDownloadRemoteFileKey] didReceiveDataOfLength:[data length]];
-			
-			if ([downloadInfo delegateRespondsToTransferTransferredData])
-			{
-				[[downloadInfo delegate] transfer:record transferredDataOfLength:[data length]];
-			}
-			
-            NSInteger percent = (100 * bytesTransferred) / bytesToTransfer;
-			[[self client] download:[record propertyForKey:CKQueueDownloadRemoteFileKey] didProgressToPercent:[NSNumber numberWithInteger:percent]];
-			
-			if ([downloadInfo delegateRespondsToTransferProgressedTo])
-			{
-				NSInteger percent = (100 * bytesTransferred) / bytesToTransfer;
-				[[downloadInfo delegate] transfer:record progressedTo:[NSNumber numberWithInteger:percent]];
-			}
-		}
-		
-		//check for completion, if the file is really small, then the transfer might be complete on the first pass
-		//through this method, so check for completion everytime
-		//
-		if (bytesTransferred >= bytesToTransfer)  //sometimes more data is received than required (i assume on small size file)
-		{
-			[myDownloadHandle closeFile];
-			[myDownloadHandle release];
-			myDownloadHandle = nil;
-			
-			CKInternalTransferRecord *downloadInfo = [[self currentDownload] retain];
-			[self dequeueDownload];
-			
-			CKTransferRecord *record = (CKTransferRecord *)[downloadInfo userInfo];
-			[[self client] downloadDidFinish:[record propertyForKey:CKQueueDownloadRemoteFileKey] error:nil];
-			
-			if ([downloadInfo delegateRespondsToTransferDidFinish])
-				[[downloadInfo delegate] transferDidFinish:[downloadInfo userInfo] error:nil];
-			
-			[myCurrentRequest release];
-			myCurrentRequest = nil;
-			[downloadInfo release];
-			[self setState:CKConnectionIdleState];
-		}
-		return NO;
-	}
-	return YES;
-}
-
 - (void)initiatingNewRequest:(CKHTTPRequest *)req withPacket:(NSData *)packet
 {
 	// if we are uploading or downloading set up the transfer sizes
@@ -502,24 +300,7 @@ NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
 		
 		[[self client] uploadDidBegin:[upload remotePath]];
 		
-		if ([upload delegateRespondsToTransferDidBegin])
-		{
-			[[upload delegate] transferDidBegin:[upload delegate]];
-		}
-	}
-	if (GET_STATE == CKConnectionDownloadingFileState)
-	{
-		bytesToTransfer = 0;
-		bytesTransferred = 0;
-		
-		CKInternalTransferRecord *download = [self currentDownload];
-		
-		[[self client] downloadDidBegin:[download remotePath]];
-		
-		if ([download delegateRespondsToTransferDidBegin])
-		{
-			[[download delegate] transferDidBegin:[download delegate]];
-		}
+		[upload deliverTransferDidBegin:[upload delegate]];
 	}
 }
 
@@ -557,20 +338,14 @@ NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
 			{
 				[[self client] upload:[upload remotePath] didProgressToPercent:[NSNumber numberWithInteger:percent]];
                 
-				if ([upload delegateRespondsToTransferProgressedTo])
-				{
-					[[upload delegate] transfer:[upload delegate] progressedTo:[NSNumber numberWithInteger:percent]];
-				}
+				[upload deliverTransfer:[upload delegate] progressedTo:[NSNumber numberWithInteger:percent]];
 				myLastPercent = percent;
 			}
 		}
 		
         [[self client] upload:[upload remotePath] didSendDataOfLength:length];
 		
-		if ([upload delegateRespondsToTransferTransferredData])
-		{
-			[[upload delegate] transfer:[upload delegate] transferredDataOfLength:length];
-		}
+		[upload deliverTransfer:[upload delegate] transferredDataOfLength:length];
 	}
 }
 
@@ -709,21 +484,220 @@ NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
 	[self queueCommand:cmd];
 }
 
+#pragma mark Multipart Uploads
+
+- (unsigned long long)multipartUploadThreshold
+{
+	NSNumber *threshold = [[NSUserDefaults standardUserDefaults] objectForKey:CKS3MultipartUploadThresholdKey];
+	return (threshold ? [threshold unsignedLongLongValue] : 16ULL * 1024 * 1024);
+}
+
+- (void)s3UploadMultipart
+{
+	CKInternalTransferRecord *upload = [self currentUpload];
+	
+	NSString *uri = [[self fixPathToBeFilePath:[upload remotePath]] encodeLegallyForS3];
+	NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[[NSURL URLWithString:uri relativeToURL:[[self request] URL]] absoluteURL]];
+	[request setValue:@"public-read" forHTTPHeaderField:@"x-amz-acl"];
+	
+	_multipartUpload = [[CKS3MultipartUpload alloc] initWithRequest:request
+															fileURL:[NSURL fileURLWithPath:[upload localPath]]
+														 credential:_credential];
+	
+	NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+	NSNumber *partSize = [defaults objectForKey:@"CKS3MultipartPartSize"];
+	if (partSize) [_multipartUpload setPartSize:[partSize unsignedLongLongValue]];
+	NSInteger concurrency = [defaults integerForKey:@"CKS3MultipartConcurrency"];
+	if (concurrency > 0) [_multipartUpload setMaximumConcurrentParts:concurrency];
+	
+	myLastPercent = 0;
+	[[self client] uploadDidBegin:[upload remotePath]];
+	[upload deliverTransferDidBegin:[upload delegate]];
+	
+	CKS3MultipartUpload *transfer = _multipartUpload;
+	[_multipartUpload startWithProgressBlock:^(unsigned long long bytesWritten, unsigned long long totalBytesWritten, unsigned long long totalBytesExpectedToWrite) {
+		
+		// Through the same queue as completion, so progress can't overtake it
+		[[CKDeliveryQueue mainQueue] deliver:^{
+			
+			if (_multipartUpload != transfer) return;	// cancelled in the meantime
+			
+			[[self client] upload:[upload remotePath] didSendDataOfLength:bytesWritten];
+			[upload deliverTransfer:[upload delegate] transferredDataOfLength:bytesWritten];
+			
+			if (totalBytesExpectedToWrite > 0)
+			{
+				NSInteger percent = (100 * totalBytesWritten) / totalBytesExpectedToWrite;
+				if (percent != myLastPercent)
+				{
+					[[self client] upload:[upload remotePath] didProgressToPercent:[NSNumber numberWithInteger:percent]];
+					[upload deliverTransfer:[upload delegate] progressedTo:[NSNumber numberWithInteger:percent]];
+					myLastPercent = percent;
+				}
+			}
+		}];
+		
+	} completionHandler:^(NSError *error) {
+		
+		// The upload calls back on its own private queue, so over to the main queue, where the rest of the connection's S3 callbacks are delivered
+		[[CKDeliveryQueue mainQueue] deliver:^{
+			[self s3MultipartUploadDidFinishWithError:error];
+		}];
+	}];
+}
+
+- (void)s3MultipartUploadDidFinishWithError:(NSError *)error
+{
+	if (!_multipartUpload) return;	// cancelled in the meantime
+	[_multipartUpload release]; _multipartUpload = nil;
+	
+	CKInternalTransferRecord *upload = [[self currentUpload] retain];
+	[self dequeueUpload];
+	
+	[[self client] uploadDidFinish:[upload remotePath] error:error];
+	[upload deliverTransferDidFinish:[upload delegate] error:error];
+	
+	[upload release];
+	[self setState:CKConnectionIdleState];
+}
+
+#pragma mark Downloads
+
+- (void)s3Download
+{
+	CKInternalTransferRecord *download = [self currentDownload];
+	CKTransferRecord *record = (CKTransferRecord *)[download userInfo];
+	
+	NSString *uri = [[download remotePath] encodeLegallyForS3];
+	NSURLRequest *request = [NSURLRequest requestWithURL:[[NSURL URLWithString:uri relativeToURL:[[self request] URL]] absoluteURL]];
+	
+	_download = [[CKS3Download alloc] initWithRequest:request
+									   destinationURL:[NSURL fileURLWithPath:[download localPath]]
+										   credential:_credential];
+	
+	NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+	NSNumber *rangeSize = [defaults objectForKey:@"CKS3DownloadRangeSize"];
+	if (rangeSize) [_download setRangeSize:[rangeSize unsignedLongLongValue]];
+	NSInteger concurrency = [defaults integerForKey:@"CKS3DownloadConcurrency"];
+	if (concurrency > 0) [_download setMaximumConcurrentRanges:concurrency];
+	
+	myLastPercent = 0;
+	[[self client] downloadDidBegin:[download remotePath]];
+	[download deliverTransferDidBegin:[download delegate]];
+	
+	CKS3Download *transfer = _download;
+	[_download startWithProgressBlock:^(unsigned long long bytesWritten, unsigned long long totalBytesWritten, unsigned long long totalBytesExpectedToWrite) {
+		
+		// Through the same queue as completion, so progress can't overtake it
+		[[CKDeliveryQueue mainQueue] deliver:^{
+			
+			if (_download != transfer) return;	// cancelled in the meantime
+			
+			[[self client] download:[download remotePath] didReceiveDataOfLength:bytesWritten];
+			[download deliverTransfer:record transferredDataOfLength:bytesWritten];
+			
+			// Only pass on progress when it amounts to a new percentage
+			if (totalBytesExpectedToWrite > 0)
+			{
+				NSInteger percent = (100 * totalBytesWritten) / totalBytesExpectedToWrite;
+				if (percent != myLastPercent)
+				{
+					[[self client] download:[download remotePath] didProgressToPercent:[NSNumber numberWithInteger:percent]];
+					[download deliverTransfer:record progressedTo:[NSNumber numberWithInteger:percent]];
+					myLastPercent = percent;
+				}
+			}
+		}];
+		
+	} completionHandler:^(NSError *error) {
+		
+		[[CKDeliveryQueue mainQueue] deliver:^{
+			[self s3DownloadDidFinishWithError:error];
+		}];
+	}];
+}
+
+- (void)s3DownloadDidFinishWithError:(NSError *)error
+{
+	if (!_download) return;	// cancelled in the meantime
+	[_download release]; _download = nil;
+	
+	CKInternalTransferRecord *download = [[self currentDownload] retain];
+	[self dequeueDownload];
+	
+	[[self client] downloadDidFinish:[download remotePath] error:error];
+	[download deliverTransferDidFinish:[download userInfo] error:error];
+	
+	[download release];
+	[self setState:CKConnectionIdleState];
+}
+
+#pragma mark -
+
+- (void)cancelTransfer
+{
+	NSError *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil];
+	
+	// The S3 transfers tidy up after themselves on the server and disk, but leave us to tidy up here
+	if (_multipartUpload)
+	{
+		[_multipartUpload cancel];
+		[self s3MultipartUploadDidFinishWithError:error];
+		return;
+	}
+	if (_download)
+	{
+		[_download cancel];
+		[self s3DownloadDidFinishWithError:error];
+		return;
+	}
+	
+	[super cancelTransfer];
+}
+
+- (void)forceDisconnect
+{
+	[_multipartUpload cancel];
+	[_download cancel];
+	[_listing cancel];
+	[super forceDisconnect];
+}
+
+#pragma mark -
+
 - (CKTransferRecord *)uploadFile:(NSString *)localPath 
 						  toFile:(NSString *)remotePath 
 			checkRemoteExistence:(BOOL)flag 
 						delegate:(id)delegate
 {
-	CKTransferRecord *rec = [CKTransferRecord recordWithName:remotePath size:[[NSFileManager defaultManager] sizeOfPath:localPath]];
-	CKHTTPPutRequest *req = [CKHTTPPutRequest putRequestWithContentsOfFile:localPath 
-																	   uri:[[self fixPathToBeFilePath:remotePath] encodeLegallyForS3]];
-	[req setHeader:@"public-read" forKey:@"x-amz-acl"];
+	unsigned long long size = [[NSFileManager defaultManager] sizeOfPath:localPath];
+	CKTransferRecord *rec = [CKTransferRecord recordWithName:remotePath size:size];
 	
-	CKConnectionCommand *cmd = [CKConnectionCommand command:req
-											 awaitState:CKConnectionIdleState
-											  sentState:CKConnectionUploadingFileState
-											  dependant:nil
-											   userInfo:nil];
+	CKConnectionCommand *cmd;
+	if (size >= [self multipartUploadThreshold])
+	{
+		// Big files go up in parts, several at once, rather than as one enormous PUT. The request is only built once it's our turn, when the credential is known
+		NSInvocation *inv = [NSInvocation invocationWithSelector:@selector(s3UploadMultipart)
+														  target:self
+													   arguments:[NSArray array]];
+		cmd = [CKConnectionCommand command:inv
+							awaitState:CKConnectionIdleState
+							 sentState:CKConnectionUploadingFileState
+							 dependant:nil
+							  userInfo:nil];
+	}
+	else
+	{
+		CKHTTPPutRequest *req = [CKHTTPPutRequest putRequestWithContentsOfFile:localPath 
+																		   uri:[[self fixPathToBeFilePath:remotePath] encodeLegallyForS3]];
+		[req setHeader:@"public-read" forKey:@"x-amz-acl"];
+		
+		cmd = [CKConnectionCommand command:req
+							awaitState:CKConnectionIdleState
+							 sentState:CKConnectionUploadingFileState
+							 dependant:nil
+							  userInfo:nil];
+	}
 	
 	CKInternalTransferRecord *upload = [CKInternalTransferRecord recordWithLocal:localPath
 																			data:nil
@@ -791,8 +765,11 @@ NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
 	[record setProperty:[NSNumber numberWithInt:0] forKey:CKQueueDownloadTransferPercentReceived];
 	[self queueDownload:download];
 	
-	CKHTTPFileDownloadRequest *r = [CKHTTPFileDownloadRequest downloadRemotePath:fixedRemotePath to:dirPath];
-	CKConnectionCommand *cmd = [CKConnectionCommand command:r
+	// Streamed straight to disk, in several ranges at once for big objects. The request is only built once it's our turn, when the credential is known
+	NSInvocation *inv = [NSInvocation invocationWithSelector:@selector(s3Download)
+													  target:self
+												   arguments:[NSArray array]];
+	CKConnectionCommand *cmd = [CKConnectionCommand command:inv
 											 awaitState:CKConnectionIdleState
 											  sentState:CKConnectionDownloadingFileState
 											  dependant:nil
@@ -806,19 +783,77 @@ NSString *S3PathSeparator = @":"; //@"0xKhTmLbOuNdArY";
 	NSString *theDir = dir != nil ? dir : myCurrentDirectory;
 	
 	NSString *bucketName = [theDir firstPathComponent];
-	NSString *prefixString = @"";
-	if ([bucketName length] > 1)
+	if ([bucketName length] == 0)
 	{
-		NSString *subpath = [theDir substringFromIndex:[bucketName length] + 2];
-		if ([subpath length] > 0)
-			prefixString = [NSString stringWithFormat:@"?prefix=%@", subpath];
+		// The list of buckets
+		CKHTTPRequest *r = [[CKHTTPRequest alloc] initWithMethod:@"GET" uri:@"/"];
+		[myCurrentRequest autorelease];
+		myCurrentRequest = r;
+		[self sendCommand:r];
+		return;
 	}
+	
+	
+	// Listing with a delimiter gives just the immediate contents, with folders as common prefixes. Pages are passed over as they're parsed, so only the contents themselves build up in memory
+	NSString *subpath = [theDir substringFromIndex:[bucketName length] + 2];
+	NSString *bucketURI = [[@"/" stringByAppendingString:bucketName] encodeLegallyForS3];
+	NSURLRequest *request = [NSURLRequest requestWithURL:[[NSURL URLWithString:bucketURI relativeToURL:[[self request] URL]] absoluteURL]];
+	
+	_listing = [[CKS3Listing alloc] initWithRequest:request prefix:subpath credential:_credential];
+	[_listing setDelimiter:@"/"];
+	
+	NSMutableArray *contents = [NSMutableArray array];
+	NSUInteger prefixLength = [subpath length];
+	
+	[_listing startWithItemsHandler:^(NSArray *objects, NSArray *commonPrefixes) {
+		
+		for (NSDictionary *anObject in objects)
+		{
+			NSString *name = [[anObject objectForKey:CKS3ListingKeyKey] substringFromIndex:prefixLength];
+			if ([name length] == 0) continue; // the folder itself
+			
+			NSDate *date = [anObject objectForKey:CKS3ListingLastModifiedKey];
+			
+			NSMutableDictionary *d = [NSMutableDictionary dictionary];
+			[d setObject:name forKey:cxFilenameKey];
+			[d setObject:NSFileTypeRegular forKey:NSFileType];
+			if (date) [d setObject:[NSCalendarDate dateWithTimeIntervalSinceReferenceDate:[date timeIntervalSinceReferenceDate]] forKey:NSFileModificationDate];
+			if ([anObject objectForKey:CKS3ListingStorageClassKey]) [d setObject:[anObject objectForKey:CKS3ListingStorageClassKey] forKey:S3StorageClassKey];
+			if ([anObject objectForKey:CKS3ListingSizeKey]) [d setObject:[anObject objectForKey:CKS3ListingSizeKey] forKey:NSFileSize];
+			[contents addObject:d];
+		}
+		
+		for (NSString *aPrefix in commonPrefixes)
+		{
+			NSString *name = [aPrefix substringFromIndex:prefixLength];
+			if ([name hasSuffix:@"/"]) name = [name substringToIndex:[name length] - 1];
+			if ([name length] == 0) continue;
+			
+			NSMutableDictionary *d = [NSMutableDictionary dictionary];
+			[d setObject:name forKey:cxFilenameKey];
+			[d setObject:NSFileTypeDirectory forKey:NSFileType];
+			[contents addObject:d];
+		}
+		
+	} completionHandler:^(NSError *error) {
+		
+		[[CKDeliveryQueue mainQueue] deliver:^{
+			[self s3DidReceiveContents:contents ofDirectory:theDir error:error];
+		}];
+	}];
+}
 
-	NSString *uri = [NSString stringWithFormat:@"/%@%@", bucketName, prefixString];
-	CKHTTPRequest *r = [[CKHTTPRequest alloc] initWithMethod:@"GET" uri:[uri encodeLegallyForS3]];
-	[myCurrentRequest autorelease];
-	myCurrentRequest = r;
-	[self sendCommand:r];
+- (void)s3DidReceiveContents:(NSArray *)contents ofDirectory:(NSString *)dirPath error:(NSError *)error
+{
+	if (!_listing) return;	// disconnected in the meantime
+	[_listing release]; _listing = nil;
+	
+	if (!error) [self cacheDirectory:dirPath withContents:contents];
+	
+	//We use fixPathToBeFilePath to strip the / from the end –– we don't traditionally have this in the last path component externally.
+	[[self client] connectionDidReceiveContents:contents ofDirectory:[self fixPathToBeFilePath:dirPath] error:error];
+	
+	[self setState:CKConnectionIdleState];
 }
 
 - (void)directoryContents
@@ -0,0 +1,69 @@
+//
+//  CKS3Download.h
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//  Downloads an object from S3 straight into a file, without holding more than a buffer's worth in memory. Data is written to the file descriptor as it arrives, in large writes.
+//
+//  The first request asks for just the first range of the object, which also tells us how big it is. Anything beyond that is then fetched as further ranges, several at once, each written into place in the file. A range that fails partway is picked up again from where it left off.
+//
+//  Servers that ignore Range get the whole object in a single response instead.
+//
+
+#import <Foundation/Foundation.h>
+
+
+@class CKS3Signer;
+
+
+@interface CKS3Download : NSObject
+{
+  @private
+    NSURLRequest        *_request;
+    NSURL               *_destinationURL;
+    CKS3Signer          *_signer;
+    unsigned long long  _rangeSize;
+    NSUInteger          _maximumConcurrentRanges;
+
+    NSOperationQueue    *_queue;
+    int                 _fileDescriptor;
+    NSString            *_temporaryPath;    // renamed to the destination once complete
+    BOOL                _sizeKnown;
+    unsigned long long  _totalBytes;
+    unsigned long long  _nextOffset;
+    NSString            *_ETag;
+    NSMutableSet        *_ranges;           // in flight
+    unsigned long long  _totalBytesWritten;
+    BOOL                _finished;
+
+    void    (^_progressBlock)(unsigned long long bytesWritten, unsigned long long totalBytesWritten, unsigned long long totalBytesExpectedToWrite);
+    void    (^_completionHandler)(NSError *error);
+}
+
+// The request's URL and timeout are used. Any existing file at the destination is only replaced once the download has succeeded
+// Credential's user is the access key ID, and password the secret key
+- (id)initWithRequest:(NSURLRequest *)request destinationURL:(NSURL *)destinationURL credential:(NSURLCredential *)credential;
+
+@property(nonatomic, readonly, copy) NSURLRequest *request;
+@property(nonatomic, readonly, copy) NSURL *destinationURL;
+
+// Defaults to 8MB
+@property(nonatomic) unsigned long long rangeSize;
+
+// Defaults to 4. Set to 1 to download one range at a time
+@property(nonatomic) NSUInteger maximumConcurrentRanges;
+
+// Both blocks are called on a private serial queue. totalBytesExpectedToWrite is 0 until the size is known. The completion handler is called exactly once, unless cancelled. The object is downloaded to a temporary file in the same folder as the destination, then renamed into place. If the download fails, the temporary file is removed and the destination left untouched
+- (void)startWithProgressBlock:(void (^)(unsigned long long bytesWritten, unsigned long long totalBytesWritten, unsigned long long totalBytesExpectedToWrite))progressBlock
+             completionHandler:(void (^)(NSError *error))handler;
+
+- (void)cancel;
+
+
+#pragma mark Support
+
+// Parses the total size from a header like "bytes 0-8388607/123456789". Returns NO if the size isn't given
++ (BOOL)getTotalLength:(unsigned long long *)length fromContentRange:(NSString *)contentRange;
+
+@end
@@ -0,0 +1,548 @@
+//
+//  CKS3Download.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CKS3Download.h"
+
+#import "CKS3MultipartUpload.h"
+#import "CKS3Signer.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define CKS3DownloadBufferSize (256 * 1024)
+#define CKS3MaximumRangeAttempts 3
+
+
+@class CKS3DownloadRange;
+
+@interface CKS3Download ()
+- (BOOL)range:(CKS3DownloadRange *)range shouldWriteResponse:(NSHTTPURLResponse *)response;
+- (void)range:(CKS3DownloadRange *)range didWriteBytes:(NSUInteger)length;
+- (void)range:(CKS3DownloadRange *)range didFinishWithError:(NSError *)error;
+@end
+
+
+#pragma mark -
+
+
+// A single GET of part of the object, writing into place in the file. The connection keeps hold of us until it's done
+@interface CKS3DownloadRange : NSObject <NSURLConnectionDataDelegate>
+{
+  @private
+    CKS3Download        *_download;     // weak
+    NSURLConnection     *_connection;
+    int                 _fileDescriptor;
+    unsigned long long  _offset;
+    unsigned long long  _length;
+    NSUInteger          _attempt;
+
+    NSHTTPURLResponse   *_response;
+    BOOL                _writesToFile;
+    NSMutableData       *_errorData;
+    unsigned long long  _bytesReceived;
+    unsigned long long  _bytesWritten;
+    char                *_buffer;
+    NSUInteger          _bufferLength;
+}
+
+// Delegate messages are all received on the queue
+- (id)initWithRequest:(NSURLRequest *)request download:(CKS3Download *)download queue:(NSOperationQueue *)queue fileDescriptor:(int)fd offset:(unsigned long long)offset length:(unsigned long long)length attempt:(NSUInteger)attempt;
+
+@property(nonatomic, readonly) unsigned long long offset;
+@property(nonatomic) unsigned long long length;
+@property(nonatomic, readonly) NSUInteger attempt;
+@property(nonatomic, readonly) NSHTTPURLResponse *response;
+@property(nonatomic, readonly) NSData *errorData;       // body of a response that wasn't written to the file
+@property(nonatomic, readonly) unsigned long long bytesReceived;
+
+// Must be called on the queue. The download won't hear any more from the receiver
+- (void)cancel;
+
+@end
+
+
+#pragma mark -
+
+
+static NSString *CKS3HeaderField(NSHTTPURLResponse *response, NSString *name)
+{
+    // Header names aren't reliably cased
+    NSDictionary *headers = [response allHeaderFields];
+    for (NSString *aField in headers)
+    {
+        if ([aField caseInsensitiveCompare:name] == NSOrderedSame) return [headers objectForKey:aField];
+    }
+    return nil;
+}
+
+
+@implementation CKS3Download
+
+- (id)initWithRequest:(NSURLRequest *)request destinationURL:(NSURL *)destinationURL credential:(NSURLCredential *)credential;
+{
+    NSParameterAssert(request);
+    NSParameterAssert(destinationURL);
+    NSParameterAssert(credential);
+
+    if (self = [self init])
+    {
+        _request = [request copy];
+        _destinationURL = [destinationURL copy];
+        _signer = [[CKS3Signer alloc] initWithCredential:credential region:[CKS3Signer regionForHost:[[request URL] host]]];
+        _rangeSize = 8 * 1024 * 1024;
+        _maximumConcurrentRanges = 4;
+
+        _queue = [[NSOperationQueue alloc] init];
+        [_queue setMaxConcurrentOperationCount:1];
+        _fileDescriptor = -1;
+        _ranges = [[NSMutableSet alloc] init];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_fileDescriptor >= 0)
+    {
+        close(_fileDescriptor);
+        unlink([_temporaryPath fileSystemRepresentation]);
+    }
+
+    [_request release];
+    [_destinationURL release];
+    [_temporaryPath release];
+    [_signer release];
+    [_queue release];
+    [_ETag release];
+    [_ranges release];
+    [_progressBlock release];
+    [_completionHandler release];
+
+    [super dealloc];
+}
+
+@synthesize request = _request;
+@synthesize destinationURL = _destinationURL;
+@synthesize rangeSize = _rangeSize;
+@synthesize maximumConcurrentRanges = _maximumConcurrentRanges;
+
+#pragma mark Downloading
+
+- (void)startWithProgressBlock:(void (^)(unsigned long long, unsigned long long, unsigned long long))progressBlock completionHandler:(void (^)(NSError *))handler;
+{
+    NSParameterAssert(handler);
+    NSAssert(!_completionHandler, @"Download already started");
+
+    _progressBlock = [progressBlock copy];
+    _completionHandler = [handler copy];
+
+    [_queue addOperationWithBlock:^{
+
+        // Download alongside the destination, so any existing file is left alone until there's a complete one to rename over it
+        NSString *destination = [_destinationURL path];
+        NSString *template = [[destination stringByDeletingLastPathComponent] stringByAppendingPathComponent:
+                              [NSString stringWithFormat:@".%@.XXXXXX", [destination lastPathComponent]]];
+
+        char *path = strdup([template fileSystemRepresentation]);
+        _fileDescriptor = mkstemp(path);
+        if (_fileDescriptor < 0)
+        {
+            int code = errno;
+            free(path);
+
+            NSDictionary *userInfo = [NSDictionary dictionaryWithObject:destination forKey:NSFilePathErrorKey];
+            [self finishWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:userInfo]];
+            return;
+        }
+
+        _temporaryPath = [[[NSFileManager defaultManager] stringWithFileSystemRepresentation:path length:strlen(path)] copy];
+        free(path);
+        fchmod(_fileDescriptor, 0644);  // mkstemp() creates files only we can read
+
+        // The first range doubles as finding out how big the object is
+        if (_rangeSize < CKS3DownloadBufferSize) _rangeSize = CKS3DownloadBufferSize;
+        [self sendRangeFromOffset:0 length:_rangeSize attempt:1];
+    }];
+}
+
+- (void)sendRangeFromOffset:(unsigned long long)offset length:(unsigned long long)length attempt:(NSUInteger)attempt;
+{
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[_request URL]
+                                                           cachePolicy:NSURLRequestReloadIgnoringLocalCacheData
+                                                       timeoutInterval:[_request timeoutInterval]];
+
+    [request setValue:[NSString stringWithFormat:@"bytes=%llu-%llu", offset, offset + length - 1] forHTTPHeaderField:@"Range"];
+    [request setValue:@"identity" forHTTPHeaderField:@"Accept-Encoding"];  // ranges are of the stored bytes
+
+    // Should the object be replaced partway through, don't stitch together bits of each
+    if (_ETag) [request setValue:_ETag forHTTPHeaderField:@"If-Match"];
+
+    [_signer signRequest:request];
+
+    CKS3DownloadRange *range = [[CKS3DownloadRange alloc] initWithRequest:request
+                                                                 download:self
+                                                                    queue:_queue
+                                                           fileDescriptor:_fileDescriptor
+                                                                   offset:offset
+                                                                   length:length
+                                                                  attempt:attempt];
+    [_ranges addObject:range];
+    [range release];
+}
+
+// Keeps up to the maximum number of ranges going, and finishes once they're all done
+- (void)sendRanges;
+{
+    if (!_sizeKnown) return;
+
+    while (!_finished && [_ranges count] < _maximumConcurrentRanges && _nextOffset < _totalBytes)
+    {
+        unsigned long long length = MIN(_rangeSize, _totalBytes - _nextOffset);
+        [self sendRangeFromOffset:_nextOffset length:length attempt:1];
+        _nextOffset += length;
+    }
+
+    if (!_finished && [_ranges count] == 0 && _nextOffset >= _totalBytes)
+    {
+        [self finishWithError:nil];
+    }
+}
+
+- (BOOL)range:(CKS3DownloadRange *)range shouldWriteResponse:(NSHTTPURLResponse *)response;
+{
+    NSInteger status = [response statusCode];
+
+    if (_sizeKnown) return (status == 206);
+
+
+    // First response tells us what we're dealing with
+    if (status == 206)
+    {
+        unsigned long long total;
+        if (![[self class] getTotalLength:&total fromContentRange:CKS3HeaderField(response, @"Content-Range")]) return NO;
+
+        _sizeKnown = YES;
+        _totalBytes = total;
+        _nextOffset = MIN(_rangeSize, total);
+        [range setLength:_nextOffset];
+
+        _ETag = [CKS3HeaderField(response, @"ETag") copy];
+
+        [self sendRanges];
+        return YES;
+    }
+    else if (status == 200)
+    {
+        // Server doesn't do ranges, so here comes the whole thing
+        long long expected = [response expectedContentLength];
+
+        _sizeKnown = YES;
+        _totalBytes = (expected >= 0 ? expected : 0);
+        _nextOffset = _totalBytes;
+        [range setLength:(expected >= 0 ? expected : ULLONG_MAX)];
+        return YES;
+    }
+    else if (status == 416)
+    {
+        // Nothing can satisfy a range of an empty object
+        _sizeKnown = YES;
+        _totalBytes = 0;
+        _nextOffset = 0;
+        return NO;
+    }
+
+    return NO;
+}
+
+- (void)range:(CKS3DownloadRange *)range didWriteBytes:(NSUInteger)length;
+{
+    _totalBytesWritten += length;
+    if (_progressBlock) _progressBlock(length, _totalBytesWritten, _totalBytes);
+}
+
+- (void)range:(CKS3DownloadRange *)range didFinishWithError:(NSError *)error;
+{
+    [[range retain] autorelease];
+    [_ranges removeObject:range];
+    if (_finished) return;
+
+    NSHTTPURLResponse *response = [range response];
+    if (!error && [range errorData])
+    {
+        if ([response statusCode] == 416 && [range offset] == 0 && _totalBytes == 0)
+        {
+            // Empty object; nothing to do
+        }
+        else
+        {
+            error = [CKS3MultipartUpload errorWithResponse:response data:[range errorData] error:nil document:NULL];
+            if (!error) error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:nil];
+        }
+    }
+    else if (!error && [range length] != ULLONG_MAX && [range bytesReceived] < [range length])
+    {
+        error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil];
+    }
+
+    if (error)
+    {
+        // Pick up from where the range left off; progress was already reported for what it did receive. Not possible if we never found out how much there was to come
+        if ([range length] != ULLONG_MAX && [range attempt] < CKS3MaximumRangeAttempts && [CKS3MultipartUpload shouldRetryAfterError:error])
+        {
+            [self sendRangeFromOffset:[range offset] + [range bytesReceived]
+                               length:[range length] - [range bytesReceived]
+                              attempt:[range attempt] + 1];
+        }
+        else
+        {
+            [self finishWithError:error];
+        }
+        return;
+    }
+
+    [self sendRanges];
+}
+
+#pragma mark Finishing
+
+- (void)finishWithError:(NSError *)error;
+{
+    _finished = YES;
+
+    [_ranges makeObjectsPerformSelector:@selector(cancel)];
+    [_ranges removeAllObjects];
+
+    if (_fileDescriptor >= 0)
+    {
+        close(_fileDescriptor);
+        _fileDescriptor = -1;
+
+        if (!error && rename([_temporaryPath fileSystemRepresentation], [[_destinationURL path] fileSystemRepresentation]) != 0)
+        {
+            NSDictionary *userInfo = [NSDictionary dictionaryWithObject:[_destinationURL path] forKey:NSFilePathErrorKey];
+            error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:userInfo];
+        }
+
+        if (error) unlink([_temporaryPath fileSystemRepresentation]);
+        [_temporaryPath release]; _temporaryPath = nil;
+    }
+
+    [_progressBlock release]; _progressBlock = nil;
+
+    void (^handler)(NSError *) = _completionHandler;
+    _completionHandler = nil;
+
+    if (handler)
+    {
+        handler(error);
+        [handler release];
+    }
+}
+
+- (void)cancel;
+{
+    [_queue addOperationWithBlock:^{
+
+        if (_finished) return;
+
+        [_completionHandler release]; _completionHandler = nil;
+        [self finishWithError:[NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil]];
+    }];
+}
+
+#pragma mark Support
+
++ (BOOL)getTotalLength:(unsigned long long *)length fromContentRange:(NSString *)contentRange;
+{
+    NSRange slash = [contentRange rangeOfString:@"/" options:NSBackwardsSearch];
+    if (slash.location == NSNotFound) return NO;
+
+    NSScanner *scanner = [NSScanner scannerWithString:[contentRange substringFromIndex:NSMaxRange(slash)]];
+    long long result;
+    if (![scanner scanLongLong:&result] || ![scanner isAtEnd] || result < 0) return NO;   // "*" means unknown
+
+    if (length) *length = result;
+    return YES;
+}
+
+@end
+
+
+#pragma mark -
+
+
+@implementation CKS3DownloadRange
+
+- (id)initWithRequest:(NSURLRequest *)request download:(CKS3Download *)download queue:(NSOperationQueue *)queue fileDescriptor:(int)fd offset:(unsigned long long)offset length:(unsigned long long)length attempt:(NSUInteger)attempt;
+{
+    if (self = [self init])
+    {
+        _download = download;
+        _fileDescriptor = fd;
+        _offset = offset;
+        _length = length;
+        _attempt = attempt;
+
+        _connection = [[NSURLConnection alloc] initWithRequest:request delegate:self startImmediately:NO];
+        [_connection setDelegateQueue:queue];
+        [_connection start];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [_connection release];
+    [_response release];
+    [_errorData release];
+    free(_buffer);
+
+    [super dealloc];
+}
+
+@synthesize offset = _offset;
+@synthesize length = _length;
+@synthesize attempt = _attempt;
+@synthesize response = _response;
+@synthesize errorData = _errorData;
+@synthesize bytesReceived = _bytesReceived;
+
+- (BOOL)writeBytes:(const char *)bytes length:(NSUInteger)length error:(NSError **)error;
+{
+    while (length > 0)
+    {
+        ssize_t written = pwrite(_fileDescriptor, bytes, length, _offset + _bytesWritten);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+            return NO;
+        }
+
+        bytes += written;
+        length -= written;
+        _bytesWritten += written;
+    }
+
+    return YES;
+}
+
+- (BOOL)flush:(NSError **)error;
+{
+    BOOL result = [self writeBytes:_buffer length:_bufferLength error:error];
+    _bufferLength = 0;
+    return result;
+}
+
+- (void)finishWithError:(NSError *)error;
+{
+    if (_writesToFile)
+    {
+        NSError *writeError;
+        if (![self flush:&writeError] && !error) error = writeError;
+    }
+
+    // Still inside one of the connection's delegate methods, so don't pull it out from underneath itself
+    [_connection autorelease]; _connection = nil;
+
+    CKS3Download *download = _download;
+    _download = nil;
+    [download range:self didFinishWithError:error];
+}
+
+- (void)cancel;
+{
+    _download = nil;
+    [_connection cancel];
+    [_connection release]; _connection = nil;
+}
+
+#pragma mark NSURLConnectionDataDelegate
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response;
+{
+    [_response release]; _response = [response retain];
+
+    _writesToFile = [_download range:self shouldWriteResponse:_response];
+    if (_writesToFile)
+    {
+        if (!_buffer) _buffer = malloc(CKS3DownloadBufferSize);
+    }
+    else
+    {
+        [_errorData release]; _errorData = [[NSMutableData alloc] init];
+    }
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data;
+{
+    if (!_writesToFile)
+    {
+        [_errorData appendData:data];
+        return;
+    }
+
+    // Never write beyond the range asked for
+    NSUInteger length = [data length];
+    if (_bytesReceived + length > _length) length = (NSUInteger)(_length - _bytesReceived);
+    const char *bytes = [data bytes];
+
+    // Gather up small chunks into a large write. Chunks big enough on their own go straight to the file, rather than being copied
+    NSError *error = nil;
+    BOOL ok = YES;
+    if (_bufferLength + length > CKS3DownloadBufferSize)
+    {
+        ok = [self flush:&error];
+    }
+
+    if (ok)
+    {
+        if (length >= CKS3DownloadBufferSize)
+        {
+            ok = [self writeBytes:bytes length:length error:&error];
+        }
+        else
+        {
+            memcpy(_buffer + _bufferLength, bytes, length);
+            _bufferLength += length;
+        }
+    }
+
+    if (!ok)
+    {
+        [_connection cancel];
+        [self finishWithError:error];
+        return;
+    }
+
+    _bytesReceived += length;
+    [_download range:self didWriteBytes:length];
+}
+
+- (NSCachedURLResponse *)connection:(NSURLConnection *)connection willCacheResponse:(NSCachedURLResponse *)cachedResponse;
+{
+    return nil;
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection;
+{
+    [self finishWithError:nil];
+}
+
+- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error;
+{
+    [self finishWithError:error];
+}
+
+@end
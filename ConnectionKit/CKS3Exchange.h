@@ -0,0 +1,32 @@
+//
+//  CKS3Exchange.h
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//  A single request to S3, and its response, gathered up in memory. Only for requests whose responses are small, such as those of multipart uploads, or listings. The connection keeps hold of the exchange until it's done.
+//
+
+#import <Foundation/Foundation.h>
+
+
+@interface CKS3Exchange : NSObject <NSURLConnectionDataDelegate>
+{
+  @private
+    NSURLConnection     *_connection;
+    NSHTTPURLResponse   *_response;
+    NSMutableData       *_data;
+    void    (^_progressBlock)(NSInteger bytesWritten);
+    void    (^_completionHandler)(NSHTTPURLResponse *response, NSData *data, NSError *error);
+}
+
+// Delegate messages are all received on the queue
+- (id)initWithRequest:(NSURLRequest *)request
+                queue:(NSOperationQueue *)queue
+        progressBlock:(void (^)(NSInteger bytesWritten))progressBlock
+    completionHandler:(void (^)(NSHTTPURLResponse *response, NSData *data, NSError *error))handler;
+
+// Must be called on the queue. The completion handler won't be called
+- (void)cancel;
+
+@end
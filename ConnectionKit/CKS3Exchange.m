@@ -0,0 +1,108 @@
+//
+//  CKS3Exchange.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CKS3Exchange.h"
+
+
+@implementation CKS3Exchange
+
+- (id)initWithRequest:(NSURLRequest *)request queue:(NSOperationQueue *)queue progressBlock:(void (^)(NSInteger))progressBlock completionHandler:(void (^)(NSHTTPURLResponse *, NSData *, NSError *))handler;
+{
+    if (self = [self init])
+    {
+        _progressBlock = [progressBlock copy];
+        _completionHandler = [handler copy];
+        _data = [[NSMutableData alloc] init];
+
+        _connection = [[NSURLConnection alloc] initWithRequest:request delegate:self startImmediately:NO];
+        [_connection setDelegateQueue:queue];
+        [_connection start];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [_connection release];
+    [_response release];
+    [_data release];
+    [_progressBlock release];
+    [_completionHandler release];
+
+    [super dealloc];
+}
+
+- (void)finishWithError:(NSError *)error;
+{
+    void (^handler)(NSHTTPURLResponse *, NSData *, NSError *) = _completionHandler;
+    _completionHandler = nil;
+    [_progressBlock release]; _progressBlock = nil;
+
+    // Still inside one of the connection's delegate methods, so don't pull it out from underneath itself
+    [_connection autorelease]; _connection = nil;
+
+    if (handler)
+    {
+        handler(_response, _data, error);
+        [handler release];
+    }
+}
+
+- (void)cancel;
+{
+    [_completionHandler release]; _completionHandler = nil;
+    [_progressBlock release]; _progressBlock = nil;
+
+    [_connection cancel];
+    [_connection release]; _connection = nil;
+}
+
+#pragma mark NSURLConnectionDataDelegate
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response;
+{
+    [_response release]; _response = [response retain];
+    [_data setLength:0];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data;
+{
+    [_data appendData:data];
+}
+
+- (void)connection:(NSURLConnection *)connection didSendBodyData:(NSInteger)bytesWritten totalBytesWritten:(NSInteger)totalBytesWritten totalBytesExpectedToWrite:(NSInteger)totalBytesExpectedToWrite;
+{
+    if (_progressBlock) _progressBlock(bytesWritten);
+}
+
+// Streamed bodies can be sent again so long as they know how to start over
+- (NSInputStream *)connection:(NSURLConnection *)connection needNewBodyStream:(NSURLRequest *)request;
+{
+    NSInputStream *stream = [request HTTPBodyStream];
+    if (![stream conformsToProtocol:@protocol(NSCopying)]) return nil;
+
+    return [[stream copy] autorelease];
+}
+
+- (NSCachedURLResponse *)connection:(NSURLConnection *)connection willCacheResponse:(NSCachedURLResponse *)cachedResponse;
+{
+    return nil;
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection;
+{
+    [self finishWithError:nil];
+}
+
+- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error;
+{
+    [self finishWithError:error];
+}
+
+@end
@@ -0,0 +1,80 @@
+//
+//  CKS3Listing.h
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//  Lists the keys in an S3 bucket, handing them over a page at a time as they arrive, rather than gathering up the whole listing first. Pages are parsed as a stream of events, so no document is ever built.
+//
+//  Pages of a single prefix can only be requested one after another, as each says where the next starts. So to list a big tree quickly, give a delimiter and set descendsIntoCommonPrefixes: each common prefix found is listed in turn, several at once.
+//
+
+#import <Foundation/Foundation.h>
+
+
+@class CKS3Signer;
+
+
+// Keys of the dictionaries describing each object
+extern NSString * const CKS3ListingKeyKey;              // NSString
+extern NSString * const CKS3ListingLastModifiedKey;     // NSDate
+extern NSString * const CKS3ListingETagKey;             // NSString
+extern NSString * const CKS3ListingSizeKey;             // NSNumber
+extern NSString * const CKS3ListingStorageClassKey;     // NSString
+
+
+@interface CKS3Listing : NSObject
+{
+  @private
+    NSURLRequest    *_request;
+    NSString        *_prefix;
+    CKS3Signer      *_signer;
+    NSString        *_delimiter;
+    BOOL            _descendsIntoCommonPrefixes;
+    NSUInteger      _maximumConcurrentRequests;
+
+    NSOperationQueue    *_queue;
+    NSMutableArray      *_pendingPages;
+    NSMutableSet        *_exchanges;        // requests in flight
+    BOOL                _finished;
+
+    void    (^_itemsHandler)(NSArray *objects, NSArray *commonPrefixes);
+    void    (^_completionHandler)(NSError *error);
+}
+
+// The request's URL is the bucket, e.g. http://s3.amazonaws.com/bucket or http://localhost:9000/bucket for a local MinIO. Its timeout is used too
+// Credential's user is the access key ID, and password the secret key
+- (id)initWithRequest:(NSURLRequest *)request prefix:(NSString *)prefix credential:(NSURLCredential *)credential;
+
+@property(nonatomic, readonly, copy) NSURLRequest *request;
+@property(nonatomic, readonly, copy) NSString *prefix;
+
+// Generally @"/". If nil, the default, every key beginning with the prefix is listed
+@property(nonatomic, copy) NSString *delimiter;
+
+// Lists the contents of each common prefix too, in parallel. They're still reported as common prefixes. Ignored without a delimiter
+@property(nonatomic) BOOL descendsIntoCommonPrefixes;
+
+// Defaults to 8
+@property(nonatomic) NSUInteger maximumConcurrentRequests;
+
+// Both blocks are called on a private serial queue. The items handler is called with each page: dictionaries describing the objects, and strings of the common prefixes. When descending, pages from different prefixes arrive in no particular order
+// The completion handler is called exactly once, unless cancelled
+- (void)startWithItemsHandler:(void (^)(NSArray *objects, NSArray *commonPrefixes))itemsHandler
+            completionHandler:(void (^)(NSError *error))handler;
+
+- (void)cancel;
+
+
+#pragma mark Support
+
++ (NSURL *)URLForListingBucketURL:(NSURL *)bucketURL prefix:(NSString *)prefix delimiter:(NSString *)delimiter continuationToken:(NSString *)token;
+
+// Parses a page of ListObjectsV2 results. The continuation token is nil for the last page. Returns NO if it's an error document, or not XML at all
++ (BOOL)parseListBucketResult:(NSData *)data
+                      objects:(NSArray **)objects
+               commonPrefixes:(NSArray **)commonPrefixes
+        nextContinuationToken:(NSString **)token
+                        error:(NSError **)error;
+
+@end
@@ -0,0 +1,474 @@
+//
+//  CKS3Listing.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CKS3Listing.h"
+
+#import "CKS3Exchange.h"
+#import "CKS3MultipartUpload.h"
+#import "CKS3Signer.h"
+
+
+NSString * const CKS3ListingKeyKey = @"Key";
+NSString * const CKS3ListingLastModifiedKey = @"LastModified";
+NSString * const CKS3ListingETagKey = @"ETag";
+NSString * const CKS3ListingSizeKey = @"Size";
+NSString * const CKS3ListingStorageClassKey = @"StorageClass";
+
+#define CKS3MaximumPageAttempts 3
+
+
+// Picks out what we want from a ListBucketResult as the parser goes
+@interface CKS3ListingParser : NSObject <NSXMLParserDelegate>
+{
+  @private
+    NSUInteger          _depth;
+    NSString            *_rootName;
+    NSMutableString     *_text;
+    NSMutableDictionary *_object;           // while inside <Contents>
+    BOOL                _inCommonPrefixes;
+    NSDateFormatter     *_dateFormatter;
+
+    NSMutableArray  *_objects;
+    NSMutableArray  *_commonPrefixes;
+    BOOL            _truncated;
+    NSString        *_nextContinuationToken;
+    NSString        *_encodingType;
+    NSString        *_errorCode;
+    NSString        *_errorMessage;
+}
+
+@property(nonatomic, readonly) NSString *rootName;
+@property(nonatomic, readonly) NSArray *objects;
+@property(nonatomic, readonly) NSArray *commonPrefixes;
+@property(nonatomic, readonly, getter=isTruncated) BOOL truncated;
+@property(nonatomic, readonly) NSString *nextContinuationToken;
+@property(nonatomic, readonly) NSString *errorCode;
+@property(nonatomic, readonly) NSString *errorMessage;
+
+@end
+
+
+#pragma mark -
+
+
+@implementation CKS3Listing
+
+- (id)initWithRequest:(NSURLRequest *)request prefix:(NSString *)prefix credential:(NSURLCredential *)credential;
+{
+    NSParameterAssert(request);
+    NSParameterAssert(credential);
+
+    if (self = [self init])
+    {
+        _request = [request copy];
+        _prefix = [(prefix ? prefix : @"") copy];
+        _signer = [[CKS3Signer alloc] initWithCredential:credential region:[CKS3Signer regionForHost:[[request URL] host]]];
+        _maximumConcurrentRequests = 8;
+
+        _queue = [[NSOperationQueue alloc] init];
+        [_queue setMaxConcurrentOperationCount:1];
+        _pendingPages = [[NSMutableArray alloc] init];
+        _exchanges = [[NSMutableSet alloc] init];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [_request release];
+    [_prefix release];
+    [_signer release];
+    [_delimiter release];
+    [_queue release];
+    [_pendingPages release];
+    [_exchanges release];
+    [_itemsHandler release];
+    [_completionHandler release];
+
+    [super dealloc];
+}
+
+@synthesize request = _request;
+@synthesize prefix = _prefix;
+@synthesize delimiter = _delimiter;
+@synthesize descendsIntoCommonPrefixes = _descendsIntoCommonPrefixes;
+@synthesize maximumConcurrentRequests = _maximumConcurrentRequests;
+
+#pragma mark Listing
+
+- (void)startWithItemsHandler:(void (^)(NSArray *, NSArray *))itemsHandler completionHandler:(void (^)(NSError *))handler;
+{
+    NSParameterAssert(itemsHandler);
+    NSParameterAssert(handler);
+    NSAssert(!_completionHandler, @"Listing already started");
+
+    _itemsHandler = [itemsHandler copy];
+    _completionHandler = [handler copy];
+
+    [_queue addOperationWithBlock:^{
+        [_pendingPages addObject:[NSDictionary dictionaryWithObject:_prefix forKey:@"prefix"]];
+        [self sendPages];
+    }];
+}
+
+// Pages are described by their prefix, and continuation token if not the first
+- (void)sendPage:(NSDictionary *)page attempt:(NSUInteger)attempt;
+{
+    NSString *prefix = [page objectForKey:@"prefix"];
+    NSURL *URL = [[self class] URLForListingBucketURL:[_request URL]
+                                               prefix:prefix
+                                            delimiter:_delimiter
+                                    continuationToken:[page objectForKey:@"token"]];
+
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:URL
+                                                           cachePolicy:NSURLRequestReloadIgnoringLocalCacheData
+                                                       timeoutInterval:[_request timeoutInterval]];
+    [_signer signRequest:request];
+
+    // Callbacks arrive on our serial queue, which we're already on, so exchange is assigned before they can be
+    __block CKS3Exchange *exchange = [[CKS3Exchange alloc] initWithRequest:request queue:_queue progressBlock:nil completionHandler:^(NSHTTPURLResponse *response, NSData *data, NSError *error) {
+
+        [[exchange retain] autorelease];
+        [_exchanges removeObject:exchange];
+        if (_finished) return;
+
+        NSArray *objects = nil;
+        NSArray *commonPrefixes = nil;
+        NSString *token = nil;
+
+        if (!error && [response statusCode] >= 300)
+        {
+            error = [CKS3MultipartUpload errorWithResponse:response data:data error:nil document:NULL];
+        }
+        if (!error)
+        {
+            [[self class] parseListBucketResult:data objects:&objects commonPrefixes:&commonPrefixes nextContinuationToken:&token error:&error];
+        }
+
+        if (error)
+        {
+            if (attempt < CKS3MaximumPageAttempts && [CKS3MultipartUpload shouldRetryAfterError:error])
+            {
+                [self sendPage:page attempt:attempt + 1];
+            }
+            else
+            {
+                [self finishWithError:error];
+            }
+            return;
+        }
+
+
+        _itemsHandler(objects, commonPrefixes);
+
+        // Carry on with this prefix before starting any more
+        if (token)
+        {
+            [_pendingPages insertObject:[NSDictionary dictionaryWithObjectsAndKeys:prefix, @"prefix", token, @"token", nil] atIndex:0];
+        }
+
+        if (_descendsIntoCommonPrefixes && _delimiter)
+        {
+            for (NSString *aPrefix in commonPrefixes)
+            {
+                [_pendingPages addObject:[NSDictionary dictionaryWithObject:aPrefix forKey:@"prefix"]];
+            }
+        }
+
+        [self sendPages];
+    }];
+
+    [_exchanges addObject:exchange];
+    [exchange release];
+}
+
+// Keeps up to the maximum number of requests going, and finishes once there are no more pages
+- (void)sendPages;
+{
+    while (!_finished && [_exchanges count] < _maximumConcurrentRequests && [_pendingPages count])
+    {
+        NSDictionary *page = [[_pendingPages objectAtIndex:0] retain];
+        [_pendingPages removeObjectAtIndex:0];
+        [self sendPage:page attempt:1];
+        [page release];
+    }
+
+    if (!_finished && [_exchanges count] == 0 && [_pendingPages count] == 0)
+    {
+        [self finishWithError:nil];
+    }
+}
+
+- (void)finishWithError:(NSError *)error;
+{
+    _finished = YES;
+
+    [_exchanges makeObjectsPerformSelector:@selector(cancel)];
+    [_exchanges removeAllObjects];
+    [_pendingPages removeAllObjects];
+
+    [_itemsHandler release]; _itemsHandler = nil;
+
+    void (^handler)(NSError *) = _completionHandler;
+    _completionHandler = nil;
+
+    if (handler)
+    {
+        handler(error);
+        [handler release];
+    }
+}
+
+- (void)cancel;
+{
+    [_queue addOperationWithBlock:^{
+
+        if (_finished) return;
+
+        [_completionHandler release]; _completionHandler = nil;
+        [self finishWithError:nil];
+    }];
+}
+
+#pragma mark Support
+
+static NSString *CKS3QueryEncode(NSString *string)
+{
+    NSString *result = (NSString *)CFURLCreateStringByAddingPercentEscapes(NULL,
+                                                                           (CFStringRef)string,
+                                                                           NULL,
+                                                                           CFSTR("!*'();:@&=+$,/?%#[]"),
+                                                                           kCFStringEncodingUTF8);
+    return [result autorelease];
+}
+
++ (NSURL *)URLForListingBucketURL:(NSURL *)bucketURL prefix:(NSString *)prefix delimiter:(NSString *)delimiter continuationToken:(NSString *)token;
+{
+    // Keys are asked for URL-encoded, as they can contain characters XML can't
+    NSMutableString *query = [NSMutableString stringWithString:@"list-type=2&encoding-type=url"];
+    if ([prefix length]) [query appendFormat:@"&prefix=%@", CKS3QueryEncode(prefix)];
+    if (delimiter) [query appendFormat:@"&delimiter=%@", CKS3QueryEncode(delimiter)];
+    if (token) [query appendFormat:@"&continuation-token=%@", CKS3QueryEncode(token)];
+
+    NSString *base = [bucketURL absoluteString];
+    NSRange queryRange = [base rangeOfString:@"?"];
+    if (queryRange.location != NSNotFound) base = [base substringToIndex:queryRange.location];
+
+    return [NSURL URLWithString:[base stringByAppendingFormat:@"?%@", query]];
+}
+
++ (BOOL)parseListBucketResult:(NSData *)data objects:(NSArray **)objects commonPrefixes:(NSArray **)commonPrefixes nextContinuationToken:(NSString **)token error:(NSError **)error;
+{
+    NSXMLParser *parser = [[NSXMLParser alloc] initWithData:data];
+    CKS3ListingParser *delegate = [[[CKS3ListingParser alloc] init] autorelease];   // outlives this method, as it holds the results
+    [parser setDelegate:delegate];
+
+    BOOL result = [parser parse];
+    if (!result)
+    {
+        NSError *parserError = [parser parserError];
+        if (error) *error = [NSError errorWithDomain:NSURLErrorDomain
+                                                code:NSURLErrorCannotParseResponse
+                                            userInfo:(parserError ? [NSDictionary dictionaryWithObject:parserError forKey:NSUnderlyingErrorKey] : nil)];
+    }
+    else if (![[delegate rootName] isEqualToString:@"ListBucketResult"])
+    {
+        // Error documents can come with a 200 status
+        NSMutableDictionary *userInfo = [NSMutableDictionary dictionary];
+        if ([delegate errorMessage]) [userInfo setObject:[delegate errorMessage] forKey:NSLocalizedDescriptionKey];
+        if ([delegate errorCode]) [userInfo setObject:[delegate errorCode] forKey:@"S3ErrorCode"];
+
+        if (error) *error = [NSError errorWithDomain:S3ErrorDomain code:500 userInfo:userInfo];
+        result = NO;
+    }
+    else
+    {
+        if (objects) *objects = [delegate objects];
+        if (commonPrefixes) *commonPrefixes = [delegate commonPrefixes];
+
+        // Should a server claim there's more, but not say where, stop rather than start over
+        if (token) *token = ([delegate isTruncated] ? [delegate nextContinuationToken] : nil);
+    }
+
+    [parser release];
+    return result;
+}
+
+@end
+
+
+#pragma mark -
+
+
+@implementation CKS3ListingParser
+
+- (id)init;
+{
+    if (self = [super init])
+    {
+        _text = [[NSMutableString alloc] init];
+        _objects = [[NSMutableArray alloc] init];
+        _commonPrefixes = [[NSMutableArray alloc] init];
+
+        _dateFormatter = [[NSDateFormatter alloc] init];
+        [_dateFormatter setLocale:[[[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"] autorelease]];
+        [_dateFormatter setTimeZone:[NSTimeZone timeZoneWithAbbreviation:@"GMT"]];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [_rootName release];
+    [_text release];
+    [_object release];
+    [_dateFormatter release];
+    [_objects release];
+    [_commonPrefixes release];
+    [_nextContinuationToken release];
+    [_encodingType release];
+    [_errorCode release];
+    [_errorMessage release];
+
+    [super dealloc];
+}
+
+@synthesize rootName = _rootName;
+@synthesize objects = _objects;
+@synthesize commonPrefixes = _commonPrefixes;
+@synthesize truncated = _truncated;
+@synthesize nextContinuationToken = _nextContinuationToken;
+@synthesize errorCode = _errorCode;
+@synthesize errorMessage = _errorMessage;
+
+- (NSDate *)dateFromString:(NSString *)string;
+{
+    // e.g. 2009-10-12T17:50:30.000Z, but not all servers give the milliseconds
+    [_dateFormatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ss.SSS'Z'"];
+    NSDate *result = [_dateFormatter dateFromString:string];
+    if (!result)
+    {
+        [_dateFormatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ss'Z'"];
+        result = [_dateFormatter dateFromString:string];
+    }
+    return result;
+}
+
+- (void)parser:(NSXMLParser *)parser didStartElement:(NSString *)elementName namespaceURI:(NSString *)namespaceURI qualifiedName:(NSString *)qName attributes:(NSDictionary *)attributeDict;
+{
+    _depth++;
+    [_text setString:@""];
+
+    if (_depth == 1)
+    {
+        _rootName = [elementName copy];
+    }
+    else if (_depth == 2 && [elementName isEqualToString:@"Contents"])
+    {
+        _object = [[NSMutableDictionary alloc] initWithCapacity:5];
+    }
+    else if (_depth == 2 && [elementName isEqualToString:@"CommonPrefixes"])
+    {
+        _inCommonPrefixes = YES;
+    }
+}
+
+- (void)parser:(NSXMLParser *)parser foundCharacters:(NSString *)string;
+{
+    [_text appendString:string];
+}
+
+- (void)parser:(NSXMLParser *)parser didEndElement:(NSString *)elementName namespaceURI:(NSString *)namespaceURI qualifiedName:(NSString *)qName;
+{
+    NSString *text = [[_text copy] autorelease];
+    _depth--;
+
+    if (_object)
+    {
+        if (_depth == 1)    // </Contents>
+        {
+            [_objects addObject:_object];
+            [_object release]; _object = nil;
+        }
+        else if ([elementName isEqualToString:@"Key"] || [elementName isEqualToString:@"ETag"] || [elementName isEqualToString:@"StorageClass"])
+        {
+            [_object setObject:text forKey:elementName];
+        }
+        else if ([elementName isEqualToString:@"Size"])
+        {
+            [_object setObject:[NSNumber numberWithLongLong:[text longLongValue]] forKey:CKS3ListingSizeKey];
+        }
+        else if ([elementName isEqualToString:@"LastModified"])
+        {
+            NSDate *date = [self dateFromString:text];
+            if (date) [_object setObject:date forKey:CKS3ListingLastModifiedKey];
+        }
+    }
+    else if (_inCommonPrefixes)
+    {
+        if (_depth == 1)
+        {
+            _inCommonPrefixes = NO;
+        }
+        else if ([elementName isEqualToString:@"Prefix"])
+        {
+            [_commonPrefixes addObject:text];
+        }
+    }
+    else if (_depth == 1)
+    {
+        if ([elementName isEqualToString:@"IsTruncated"])
+        {
+            _truncated = [text isEqualToString:@"true"];
+        }
+        else if ([elementName isEqualToString:@"NextContinuationToken"])
+        {
+            [_nextContinuationToken release]; _nextContinuationToken = [text copy];
+        }
+        else if ([elementName isEqualToString:@"EncodingType"])
+        {
+            [_encodingType release]; _encodingType = [text copy];
+        }
+        else if ([elementName isEqualToString:@"Code"])
+        {
+            [_errorCode release]; _errorCode = [text copy];
+        }
+        else if ([elementName isEqualToString:@"Message"])
+        {
+            [_errorMessage release]; _errorMessage = [text copy];
+        }
+    }
+}
+
+static NSString *CKS3URLDecode(NSString *string)
+{
+    NSString *result = [[string stringByReplacingOccurrencesOfString:@"+" withString:@" "] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+    return (result ? result : string);
+}
+
+- (void)parserDidEndDocument:(NSXMLParser *)parser;
+{
+    // Only decode if the server did as asked; it might not support encoding
+    if (![_encodingType isEqualToString:@"url"]) return;
+
+    for (NSMutableDictionary *anObject in _objects)
+    {
+        NSString *key = [anObject objectForKey:CKS3ListingKeyKey];
+        if (key) [anObject setObject:CKS3URLDecode(key) forKey:CKS3ListingKeyKey];
+    }
+
+    NSUInteger count = [_commonPrefixes count];
+    for (NSUInteger i = 0; i < count; i++)
+    {
+        [_commonPrefixes replaceObjectAtIndex:i withObject:CKS3URLDecode([_commonPrefixes objectAtIndex:i])];
+    }
+}
+
+@end
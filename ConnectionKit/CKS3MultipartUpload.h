@@ -0,0 +1,79 @@
+//
+//  CKS3MultipartUpload.h
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//  Uploads a file to S3 in parts, rather than as one enormous PUT: initiates a multipart upload, sends slices of the file as parts, several at once, then asks the server to stitch them together. Should anything go wrong, the upload is aborted so the server can throw away the parts it's holding onto.
+//
+//  Parts are streamed from the file in signed chunks, so only a little of each is ever in memory, and the file can be any size. Each failed part is retried on its own, without starting over.
+//
+//  Talks to any S3-compatible server, using path-style URLs, e.g. http://s3.amazonaws.com/bucket/key or http://localhost:9000/bucket/key for a local MinIO
+//
+
+#import <Foundation/Foundation.h>
+
+
+@class CKS3Signer;
+
+
+extern NSString *S3ErrorDomain;
+
+
+@interface CKS3MultipartUpload : NSObject
+{
+  @private
+    NSURLRequest        *_request;
+    NSURL               *_fileURL;
+    CKS3Signer          *_signer;
+    unsigned long long  _partSize;
+    NSUInteger          _maximumConcurrentParts;
+
+    NSOperationQueue    *_queue;
+    unsigned long long  _fileSize;
+    NSString            *_uploadID;
+    NSMutableArray      *_ETags;            // NSNull until each part is done
+    NSUInteger          _nextPart;
+    NSMutableSet        *_exchanges;        // requests in flight
+    unsigned long long  _totalBytesWritten;
+    BOOL                _finished;
+
+    void    (^_progressBlock)(unsigned long long bytesWritten, unsigned long long totalBytesWritten, unsigned long long totalBytesExpectedToWrite);
+    void    (^_completionHandler)(NSError *error);
+}
+
+// The request is a PUT of the finished object. Its URL, timeout, and any headers (e.g. x-amz-acl, Content-Type) are used; its body is not
+// Credential's user is the access key ID, and password the secret key
+- (id)initWithRequest:(NSURLRequest *)request fileURL:(NSURL *)fileURL credential:(NSURLCredential *)credential;
+
+@property(nonatomic, readonly, copy) NSURLRequest *request;
+@property(nonatomic, readonly, copy) NSURL *fileURL;
+
+// Defaults to 8MB. S3 insists on at least 5MB for all but the last part, and no more than 10,000 parts, so is grown to fit if needed
+@property(nonatomic) unsigned long long partSize;
+
+// Defaults to 4
+@property(nonatomic) NSUInteger maximumConcurrentParts;
+
+// Both blocks are called on a private serial queue. The completion handler is called exactly once, unless cancelled
+- (void)startWithProgressBlock:(void (^)(unsigned long long bytesWritten, unsigned long long totalBytesWritten, unsigned long long totalBytesExpectedToWrite))progressBlock
+             completionHandler:(void (^)(NSError *error))handler;
+
+// Aborts the upload on the server too
+- (void)cancel;
+
+
+#pragma mark Support
+
++ (unsigned long long)partSizeForFileOfSize:(unsigned long long)size preferredPartSize:(unsigned long long)partSize;
+
+// <CompleteMultipartUpload> document listing each part's ETag in order
++ (NSData *)completeMultipartUploadBodyWithETags:(NSArray *)ETags;
+
+// Turns an error response into an NSError in S3ErrorDomain, its code being the HTTP status. S3 can report failure in the body of a 200 response, so that's checked for too. If successful, the response body is parsed into document, should there be one
++ (NSError *)errorWithResponse:(NSHTTPURLResponse *)response data:(NSData *)data error:(NSError *)error document:(NSXMLDocument **)document;
+
+// Connection trouble, or the server having a moment, are worth another go. Anything else will just fail again
++ (BOOL)shouldRetryAfterError:(NSError *)error;
+
+@end
@@ -0,0 +1,390 @@
+//
+//  CKS3MultipartUpload.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CKS3MultipartUpload.h"
+
+#import "CKS3Exchange.h"
+#import "CKS3Signer.h"
+
+
+NSString *S3ErrorDomain = @"S3ErrorDomain";
+
+
+@interface CKS3MultipartUpload ()
+- (void)sendParts;
+- (void)failWithError:(NSError *)error;
+@end
+
+
+@implementation CKS3MultipartUpload
+
+#define CKS3MinimumPartSize (5ULL * 1024 * 1024)
+#define CKS3MaximumPartCount 10000
+#define CKS3MaximumPartAttempts 3
+
+- (id)initWithRequest:(NSURLRequest *)request fileURL:(NSURL *)fileURL credential:(NSURLCredential *)credential;
+{
+    NSParameterAssert(request);
+    NSParameterAssert(fileURL);
+    NSParameterAssert(credential);
+
+    if (self = [self init])
+    {
+        _request = [request copy];
+        _fileURL = [fileURL copy];
+        _signer = [[CKS3Signer alloc] initWithCredential:credential region:[CKS3Signer regionForHost:[[request URL] host]]];
+        _partSize = 8 * 1024 * 1024;
+        _maximumConcurrentParts = 4;
+
+        _queue = [[NSOperationQueue alloc] init];
+        [_queue setMaxConcurrentOperationCount:1];
+        _exchanges = [[NSMutableSet alloc] init];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [_request release];
+    [_fileURL release];
+    [_signer release];
+    [_queue release];
+    [_uploadID release];
+    [_ETags release];
+    [_exchanges release];
+    [_progressBlock release];
+    [_completionHandler release];
+
+    [super dealloc];
+}
+
+@synthesize request = _request;
+@synthesize fileURL = _fileURL;
+@synthesize partSize = _partSize;
+@synthesize maximumConcurrentParts = _maximumConcurrentParts;
+
+#pragma mark Requests
+
+- (NSMutableURLRequest *)requestWithMethod:(NSString *)method query:(NSString *)query;
+{
+    NSURL *URL = [NSURL URLWithString:[[[_request URL] absoluteString] stringByAppendingFormat:@"?%@", query]];
+
+    NSMutableURLRequest *result = [NSMutableURLRequest requestWithURL:URL
+                                                          cachePolicy:NSURLRequestReloadIgnoringLocalCacheData
+                                                      timeoutInterval:[_request timeoutInterval]];
+    [result setHTTPMethod:method];
+    return result;
+}
+
+- (NSString *)encodedUploadID;
+{
+    NSString *result = (NSString *)CFURLCreateStringByAddingPercentEscapes(NULL,
+                                                                           (CFStringRef)_uploadID,
+                                                                           NULL,
+                                                                           CFSTR("!*'();:@&=+$,/?%#[]"),
+                                                                           kCFStringEncodingUTF8);
+    return [result autorelease];
+}
+
+- (void)sendRequest:(NSMutableURLRequest *)request
+      progressBlock:(void (^)(NSInteger bytesWritten))progressBlock
+  completionHandler:(void (^)(NSHTTPURLResponse *response, NSData *data, NSError *error))handler;
+{
+    if (![request HTTPBodyStream]) [_signer signRequest:request];    // parts are signed as their body stream is set up
+
+    // Callbacks arrive on our serial queue, which we're already on, so exchange is assigned before they can be
+    __block CKS3Exchange *exchange = [[CKS3Exchange alloc] initWithRequest:request queue:_queue progressBlock:progressBlock completionHandler:^(NSHTTPURLResponse *response, NSData *data, NSError *error) {
+
+        [exchange retain];
+        [_exchanges removeObject:exchange];
+        handler(response, data, error);
+        [exchange release];
+    }];
+
+    [_exchanges addObject:exchange];
+    [exchange release];
+}
+
++ (NSError *)errorWithResponse:(NSHTTPURLResponse *)response data:(NSData *)data error:(NSError *)error document:(NSXMLDocument **)document;
+{
+    if (!response) return error;
+
+    NSXMLDocument *doc = nil;
+    if ([data length]) doc = [[[NSXMLDocument alloc] initWithData:data options:0 error:NULL] autorelease];
+
+    NSXMLElement *root = [doc rootElement];
+    NSInteger status = [response statusCode];
+
+    if (status >= 300 || [[root name] isEqualToString:@"Error"])
+    {
+        NSString *code = [[[root elementsForName:@"Code"] lastObject] stringValue];
+        NSString *message = [[[root elementsForName:@"Message"] lastObject] stringValue];
+        if (!message) message = [NSHTTPURLResponse localizedStringForStatusCode:status];
+
+        NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                         message, NSLocalizedDescriptionKey,
+                                         [response URL], NSURLErrorFailingURLErrorKey,
+                                         nil];
+        if (code) [userInfo setObject:code forKey:@"S3ErrorCode"];
+
+        return [NSError errorWithDomain:S3ErrorDomain code:(status >= 300 ? status : 500) userInfo:userInfo];
+    }
+
+    if (document) *document = doc;
+    return nil;
+}
+
++ (BOOL)shouldRetryAfterError:(NSError *)error;
+{
+    if ([[error domain] isEqualToString:NSURLErrorDomain]) return [error code] != NSURLErrorCancelled;
+    if ([[error domain] isEqualToString:S3ErrorDomain]) return [error code] >= 500 || [[[error userInfo] objectForKey:@"S3ErrorCode"] isEqualToString:@"RequestTimeout"];
+    return NO;
+}
+
+#pragma mark Uploading
+
+- (void)startWithProgressBlock:(void (^)(unsigned long long, unsigned long long, unsigned long long))progressBlock completionHandler:(void (^)(NSError *))handler;
+{
+    NSParameterAssert(handler);
+    NSAssert(!_completionHandler, @"Multipart upload already started");
+
+    _progressBlock = [progressBlock copy];
+    _completionHandler = [handler copy];
+
+    [_queue addOperationWithBlock:^{
+
+        NSError *error;
+        NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:[_fileURL path] error:&error];
+        if (!attributes)
+        {
+            [self failWithError:error];
+            return;
+        }
+
+        _fileSize = [attributes fileSize];
+        _partSize = [[self class] partSizeForFileOfSize:_fileSize preferredPartSize:_partSize];
+
+        // An empty file still makes one (empty) part
+        NSUInteger count = MAX((_fileSize + _partSize - 1) / _partSize, 1);
+        _ETags = [[NSMutableArray alloc] initWithCapacity:count];
+        for (NSUInteger i = 0; i < count; i++) [_ETags addObject:[NSNull null]];
+
+
+        // Headers describing the finished object go with initiation; the parts are just data
+        NSMutableURLRequest *request = [self requestWithMethod:@"POST" query:@"uploads"];
+
+        NSDictionary *headers = [_request allHTTPHeaderFields];
+        for (NSString *aField in headers)
+        {
+            if ([aField caseInsensitiveCompare:@"Content-Length"] == NSOrderedSame) continue;
+            [request setValue:[headers objectForKey:aField] forHTTPHeaderField:aField];
+        }
+
+        [self sendRequest:request progressBlock:nil completionHandler:^(NSHTTPURLResponse *response, NSData *data, NSError *error) {
+
+            NSXMLDocument *doc = nil;
+            error = [[self class] errorWithResponse:response data:data error:error document:&doc];
+            if (error)
+            {
+                [self failWithError:error];
+                return;
+            }
+
+            _uploadID = [[[[[doc rootElement] elementsForName:@"UploadId"] lastObject] stringValue] copy];
+            if (!_uploadID)
+            {
+                [self failWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCannotParseResponse userInfo:nil]];
+                return;
+            }
+
+            [self sendParts];
+        }];
+    }];
+}
+
+- (void)didWriteBytes:(unsigned long long)bytesWritten;
+{
+    _totalBytesWritten += bytesWritten;
+    if (_progressBlock) _progressBlock(bytesWritten, _totalBytesWritten, _fileSize);
+}
+
+// Retries only report progress once they get past what earlier attempts managed, so the total never counts a byte twice
+- (void)sendPart:(NSUInteger)index attempt:(NSUInteger)attempt bytesReported:(unsigned long long)bytesReported;
+{
+    unsigned long long offset = index * _partSize;
+    NSUInteger length = (NSUInteger)MIN(_partSize, _fileSize - offset);
+
+    // Each chunk is hashed as it's sent, so the part's never read ahead of time. Should the file have been truncated since we started, the stream fails
+    NSMutableURLRequest *request = [self requestWithMethod:@"PUT"
+                                                     query:[NSString stringWithFormat:@"partNumber=%lu&uploadId=%@", (unsigned long)index + 1, [self encodedUploadID]]];
+    [_signer signRequest:request withBodyFromFileURL:_fileURL offset:offset length:length];
+
+    // Chunk headers and signatures make the body a little longer than the part, so progress is scaled back down
+    unsigned long long encodedLength = [[request valueForHTTPHeaderField:@"Content-Length"] longLongValue];
+
+
+    __block unsigned long long bytesSent = 0;
+    __block unsigned long long reported = bytesReported;
+
+    [self sendRequest:request progressBlock:^(NSInteger bytesWritten) {
+
+        bytesSent += bytesWritten;
+        unsigned long long partBytesSent = (encodedLength ? bytesSent * length / encodedLength : bytesSent);
+        if (partBytesSent > reported)
+        {
+            [self didWriteBytes:partBytesSent - reported];
+            reported = partBytesSent;
+        }
+
+    } completionHandler:^(NSHTTPURLResponse *response, NSData *data, NSError *error) {
+
+        if (_finished) return;
+
+        error = [[self class] errorWithResponse:response data:data error:error document:NULL];
+
+        // Header names aren't reliably cased
+        NSString *ETag = nil;
+        NSDictionary *headers = [response allHeaderFields];
+        for (NSString *aField in headers)
+        {
+            if ([aField caseInsensitiveCompare:@"ETag"] == NSOrderedSame) ETag = [headers objectForKey:aField];
+        }
+
+        if (!error && !ETag) error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:nil];
+
+        if (error)
+        {
+            if (attempt < CKS3MaximumPartAttempts && [[self class] shouldRetryAfterError:error])
+            {
+                [self sendPart:index attempt:attempt + 1 bytesReported:reported];
+            }
+            else
+            {
+                [self failWithError:error];
+            }
+            return;
+        }
+
+        [_ETags replaceObjectAtIndex:index withObject:ETag];
+        [self sendParts];
+    }];
+}
+
+- (void)complete;
+{
+    NSMutableURLRequest *request = [self requestWithMethod:@"POST" query:[@"uploadId=" stringByAppendingString:[self encodedUploadID]]];
+    [request setHTTPBody:[[self class] completeMultipartUploadBodyWithETags:_ETags]];
+    [request setValue:@"application/xml" forHTTPHeaderField:@"Content-Type"];
+
+    [self sendRequest:request progressBlock:nil completionHandler:^(NSHTTPURLResponse *response, NSData *data, NSError *error) {
+
+        if (_finished) return;
+
+        error = [[self class] errorWithResponse:response data:data error:error document:NULL];
+        if (error)
+        {
+            [self failWithError:error];
+            return;
+        }
+
+        [self finishWithError:nil];
+    }];
+}
+
+// Keeps up to the maximum number of parts going, and completes once they're all done
+- (void)sendParts;
+{
+    NSUInteger count = [_ETags count];
+
+    while (!_finished && [_exchanges count] < _maximumConcurrentParts && _nextPart < count)
+    {
+        [self sendPart:_nextPart++ attempt:1 bytesReported:0];
+    }
+
+    if (!_finished && [_exchanges count] == 0 && _nextPart == count)
+    {
+        [self complete];
+    }
+}
+
+#pragma mark Finishing
+
+- (void)finishWithError:(NSError *)error;
+{
+    _finished = YES;
+
+    [_exchanges makeObjectsPerformSelector:@selector(cancel)];
+    [_exchanges removeAllObjects];
+
+    [_progressBlock release]; _progressBlock = nil;
+
+    void (^handler)(NSError *) = _completionHandler;
+    _completionHandler = nil;
+
+    if (handler)
+    {
+        handler(error);
+        [handler release];
+    }
+}
+
+- (void)failWithError:(NSError *)error;
+{
+    if (_finished) return;
+    [self finishWithError:error];
+
+    // Let the server throw away any parts it has. Nothing more can be done should that fail; S3 can be set to clean up after a while itself
+    if (_uploadID)
+    {
+        NSMutableURLRequest *request = [self requestWithMethod:@"DELETE" query:[@"uploadId=" stringByAppendingString:[self encodedUploadID]]];
+        [self sendRequest:request progressBlock:nil completionHandler:^(NSHTTPURLResponse *response, NSData *data, NSError *error) { }];
+    }
+}
+
+- (void)cancel;
+{
+    [_queue addOperationWithBlock:^{
+
+        if (_finished) return;
+
+        [_completionHandler release]; _completionHandler = nil;
+        [self failWithError:nil];
+    }];
+}
+
+#pragma mark Support
+
++ (unsigned long long)partSizeForFileOfSize:(unsigned long long)size preferredPartSize:(unsigned long long)partSize;
+{
+    if (partSize < CKS3MinimumPartSize) partSize = CKS3MinimumPartSize;
+
+    unsigned long long smallest = (size + CKS3MaximumPartCount - 1) / CKS3MaximumPartCount;
+    if (partSize < smallest) partSize = smallest;
+
+    return partSize;
+}
+
++ (NSData *)completeMultipartUploadBodyWithETags:(NSArray *)ETags;
+{
+    NSMutableString *result = [NSMutableString stringWithString:@"<CompleteMultipartUpload>"];
+
+    [ETags enumerateObjectsUsingBlock:^(NSString *ETag, NSUInteger idx, BOOL *stop) {
+
+        NSString *escaped = [[[ETag stringByReplacingOccurrencesOfString:@"&" withString:@"&amp;"]
+                              stringByReplacingOccurrencesOfString:@"<" withString:@"&lt;"]
+                             stringByReplacingOccurrencesOfString:@">" withString:@"&gt;"];
+
+        [result appendFormat:@"<Part><PartNumber>%lu</PartNumber><ETag>%@</ETag></Part>", (unsigned long)idx + 1, escaped];
+    }];
+
+    [result appendString:@"</CompleteMultipartUpload>"];
+    return [result dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+@end
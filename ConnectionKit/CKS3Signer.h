@@ -0,0 +1,59 @@
+//
+//  CKS3Signer.h
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//  Signs requests to S3 using Signature Version 4. The signing key is derived from the secret key through a chain of HMACs over the day, region and service; it's cached, and shared between signers for the same access key, region and service, so signing each request costs a single HMAC after the first of the day.
+//
+//  Bodies read from a file are sent in aws-chunked encoding, each chunk signed in turn. A chunk is hashed as it's read to be sent, so the file is only ever read once, and never needs to be in memory all at once.
+//
+
+#import <Foundation/Foundation.h>
+
+
+@interface CKS3Signer : NSObject
+{
+  @private
+    NSURLCredential *_credential;
+    NSString        *_region;
+    NSString        *_service;
+    NSUInteger      _chunkSize;
+}
+
+// Credential's user is the access key ID, and password the secret key. Region is e.g. us-east-1; see +regionForHost:
+- (id)initWithCredential:(NSURLCredential *)credential region:(NSString *)region;
+
+@property(nonatomic, readonly, retain) NSURLCredential *credential;
+@property(nonatomic, readonly, copy) NSString *region;
+@property(nonatomic, readonly, copy) NSString *service;     // s3
+
+// Size of each signed chunk of a streamed body. Defaults to 64KB; S3 won't take less than 8KB
+@property(nonatomic) NSUInteger chunkSize;
+
+// Signs the request in place, setting its x-amz-date, x-amz-content-sha256 and Authorization headers. Any body must be HTTPBody, which is hashed
+- (void)signRequest:(NSMutableURLRequest *)request;
+
+// Signs the request to send a slice of the file as its body, in signed chunks. Sets the request's body stream, and Content-Encoding and Content-Length headers to suit
+- (void)signRequest:(NSMutableURLRequest *)request withBodyFromFileURL:(NSURL *)fileURL offset:(unsigned long long)offset length:(unsigned long long)length;
+
+
+#pragma mark Support
+
+// As above, but as if at a given time
+- (void)signRequest:(NSMutableURLRequest *)request date:(NSDate *)date;
+- (void)signRequest:(NSMutableURLRequest *)request withBodyFromFileURL:(NSURL *)fileURL offset:(unsigned long long)offset length:(unsigned long long)length date:(NSDate *)date;
+
+// The derived key for the day containing date, in UTC
+- (NSData *)signingKeyForDate:(NSDate *)date;
+
+// Works out the region from Amazon's host names, e.g. s3.eu-west-1.amazonaws.com or bucket.s3-eu-west-1.amazonaws.com. Anything else, such as a local MinIO, gets the CKS3Region user default, or us-east-1
++ (NSString *)regionForHost:(NSString *)host;
+
+// The request boiled down into the form that's hashed and signed
++ (NSString *)canonicalRequestForRequest:(NSURLRequest *)request payloadHash:(NSString *)payloadHash signedHeaders:(NSString **)signedHeaders;
+
+// How long a body becomes once split into signed chunks, including the empty one that ends it
++ (unsigned long long)encodedLengthOfChunkedBodyOfLength:(unsigned long long)length chunkSize:(NSUInteger)chunkSize;
+
+@end
@@ -0,0 +1,630 @@
+//
+//  CKS3Signer.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CKS3Signer.h"
+
+#import <CommonCrypto/CommonDigest.h>
+#import <CommonCrypto/CommonHMAC.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define CKS3EmptyPayloadHash @"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+#define CKS3StreamingPayload @"STREAMING-AWS4-HMAC-SHA256-PAYLOAD"
+#define CKS3MinimumChunkSize (8 * 1024)
+
+// Room before each chunk's data for its "<hex size>;chunk-signature=<64 hex>\r\n" line
+#define CKS3ChunkHeaderSpace 128
+
+
+static void CKS3HexEncode(const unsigned char *bytes, size_t length, char *hex)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < length; i++)
+    {
+        hex[2 * i] = digits[bytes[i] >> 4];
+        hex[2 * i + 1] = digits[bytes[i] & 0x0F];
+    }
+    hex[2 * length] = '\0';
+}
+
+static NSString *CKS3SHA256String(NSData *data)
+{
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256([data bytes], (CC_LONG)[data length], digest);
+
+    char hex[2 * CC_SHA256_DIGEST_LENGTH + 1];
+    CKS3HexEncode(digest, sizeof(digest), hex);
+    return [NSString stringWithUTF8String:hex];
+}
+
+static NSData *CKS3HMAC(NSData *key, NSString *string)
+{
+    NSData *data = [string dataUsingEncoding:NSUTF8StringEncoding];
+
+    unsigned char result[CC_SHA256_DIGEST_LENGTH];
+    CCHmac(kCCHmacAlgSHA256, [key bytes], [key length], [data bytes], [data length], result);
+    return [NSData dataWithBytes:result length:sizeof(result)];
+}
+
+// yyyyMMdd'T'HHmmss'Z' in UTC. Formatted by hand as it's needed for every request
+static NSString *CKS3Timestamp(NSDate *date)
+{
+    time_t time = (time_t)floor([date timeIntervalSince1970]);
+    struct tm components;
+    gmtime_r(&time, &components);
+
+    char result[17];
+    strftime(result, sizeof(result), "%Y%m%dT%H%M%SZ", &components);
+    return [NSString stringWithUTF8String:result];
+}
+
+// Percent-encodes everything but the unreserved characters, as S3 does when working out what to expect
+static NSString *CKS3URIEncode(NSString *string, BOOL encodeSlash)
+{
+    NSData *data = [string dataUsingEncoding:NSUTF8StringEncoding];
+    const unsigned char *bytes = [data bytes];
+    NSMutableString *result = [NSMutableString stringWithCapacity:[data length]];
+
+    for (NSUInteger i = 0; i < [data length]; i++)
+    {
+        unsigned char c = bytes[i];
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+            c == '-' || c == '_' || c == '.' || c == '~' || (c == '/' && !encodeSlash))
+        {
+            [result appendFormat:@"%c", c];
+        }
+        else
+        {
+            [result appendFormat:@"%%%02X", c];
+        }
+    }
+
+    return result;
+}
+
+static NSString *CKS3URIDecode(NSString *string)
+{
+    NSString *result = [string stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+    return (result ? result : string);  // malformed escapes are taken literally
+}
+
+
+#pragma mark -
+
+
+// Reads a slice of a file, sending it in aws-chunked encoding. Each chunk is hashed and signed only as it's read, chained on from the signature of the one before, the first from the request's own
+@interface CKS3ChunkedBodyStream : NSInputStream <NSCopying>
+{
+  @private
+    NSURL               *_fileURL;
+    unsigned long long  _offset;
+    unsigned long long  _length;
+    NSUInteger          _chunkSize;
+    NSData              *_signingKey;
+    NSData              *_stringToSignPrefix;   // algorithm, date and scope
+    NSString            *_seedSignature;
+
+    int                 _fileDescriptor;
+    uint8_t             *_buffer;
+    uint8_t             *_pending;              // encoded bytes not yet read
+    NSUInteger          _pendingLength;
+    unsigned long long  _position;              // in the slice
+    BOOL                _sentFinalChunk;
+    char                _previousSignature[2 * CC_SHA256_DIGEST_LENGTH + 1];
+
+    NSStreamStatus          _status;
+    NSError                 *_error;
+    id <NSStreamDelegate>   _delegate;
+}
+
+- (id)initWithFileURL:(NSURL *)fileURL
+               offset:(unsigned long long)offset
+               length:(unsigned long long)length
+            chunkSize:(NSUInteger)chunkSize
+           signingKey:(NSData *)signingKey
+   stringToSignPrefix:(NSData *)prefix
+        seedSignature:(NSString *)seedSignature;
+
+@end
+
+
+#pragma mark -
+
+
+@implementation CKS3Signer
+
+- (id)initWithCredential:(NSURLCredential *)credential region:(NSString *)region;
+{
+    NSParameterAssert([credential user]);
+    NSParameterAssert([credential password]);
+    NSParameterAssert(region);
+
+    if (self = [self init])
+    {
+        _credential = [credential retain];
+        _region = [region copy];
+        _service = @"s3";
+        _chunkSize = 64 * 1024;
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [_credential release];
+    [_region release];
+
+    [super dealloc];
+}
+
+@synthesize credential = _credential;
+@synthesize region = _region;
+@synthesize service = _service;
+@synthesize chunkSize = _chunkSize;
+
+#pragma mark Signing
+
+// Signers tend to be short-lived, one per transfer or request, so derived keys are shared between them. Only the current day's are kept
+static NSMutableDictionary  *sSigningKeys;      // "access key/day/region/service" -> (secret key, derived key)
+static NSString             *sSigningKeysDay;
+
+- (NSData *)signingKeyForDate:(NSDate *)date;
+{
+    NSString *day = [CKS3Timestamp(date) substringToIndex:8];
+    NSString *cacheKey = [NSString stringWithFormat:@"%@/%@/%@/%@", [_credential user], day, _region, _service];
+    NSString *secret = [_credential password];
+
+    @synchronized([CKS3Signer class])
+    {
+        if (![day isEqualToString:sSigningKeysDay])
+        {
+            if (!sSigningKeys) sSigningKeys = [[NSMutableDictionary alloc] init];
+            [sSigningKeys removeAllObjects];
+            [sSigningKeysDay release]; sSigningKeysDay = [day copy];
+        }
+
+        // The secret's checked too, so a corrected one for the same access key isn't given a stale key
+        NSArray *cached = [sSigningKeys objectForKey:cacheKey];
+        if (cached && [[cached objectAtIndex:0] isEqualToString:secret])
+        {
+            return [[[cached objectAtIndex:1] retain] autorelease];
+        }
+
+        NSData *key = [[@"AWS4" stringByAppendingString:secret] dataUsingEncoding:NSUTF8StringEncoding];
+        key = CKS3HMAC(key, day);
+        key = CKS3HMAC(key, _region);
+        key = CKS3HMAC(key, _service);
+        key = CKS3HMAC(key, @"aws4_request");
+
+        [sSigningKeys setObject:[NSArray arrayWithObjects:secret, key, nil] forKey:cacheKey];
+        return key;
+    }
+}
+
+- (NSString *)scopeForTimestamp:(NSString *)timestamp;
+{
+    return [NSString stringWithFormat:@"%@/%@/%@/aws4_request", [timestamp substringToIndex:8], _region, _service];
+}
+
+// Returns the signature, which chunked bodies carry on from
+- (NSString *)signRequest:(NSMutableURLRequest *)request payloadHash:(NSString *)payloadHash date:(NSDate *)date;
+{
+    NSString *timestamp = CKS3Timestamp(date);
+    [request setValue:nil forHTTPHeaderField:@"Authorization"];     // in case it's being signed again
+    [request setValue:timestamp forHTTPHeaderField:@"x-amz-date"];
+    [request setValue:payloadHash forHTTPHeaderField:@"x-amz-content-sha256"];
+
+    NSString *signedHeaders;
+    NSString *canonicalRequest = [[self class] canonicalRequestForRequest:request payloadHash:payloadHash signedHeaders:&signedHeaders];
+
+    NSString *scope = [self scopeForTimestamp:timestamp];
+    NSString *stringToSign = [NSString stringWithFormat:@"AWS4-HMAC-SHA256\n%@\n%@\n%@",
+                              timestamp,
+                              scope,
+                              CKS3SHA256String([canonicalRequest dataUsingEncoding:NSUTF8StringEncoding])];
+
+    NSData *digest = CKS3HMAC([self signingKeyForDate:date], stringToSign);
+    char signature[2 * CC_SHA256_DIGEST_LENGTH + 1];
+    CKS3HexEncode([digest bytes], [digest length], signature);
+
+    NSString *result = [NSString stringWithUTF8String:signature];
+    [request setValue:[NSString stringWithFormat:@"AWS4-HMAC-SHA256 Credential=%@/%@, SignedHeaders=%@, Signature=%@", [_credential user], scope, signedHeaders, result]
+   forHTTPHeaderField:@"Authorization"];
+
+    return result;
+}
+
+- (void)signRequest:(NSMutableURLRequest *)request date:(NSDate *)date;
+{
+    NSData *body = [request HTTPBody];
+    [self signRequest:request payloadHash:([body length] ? CKS3SHA256String(body) : CKS3EmptyPayloadHash) date:date];
+}
+
+- (void)signRequest:(NSMutableURLRequest *)request;
+{
+    [self signRequest:request date:[NSDate date]];
+}
+
+- (void)signRequest:(NSMutableURLRequest *)request withBodyFromFileURL:(NSURL *)fileURL offset:(unsigned long long)offset length:(unsigned long long)length date:(NSDate *)date;
+{
+    NSParameterAssert(fileURL);
+
+    NSUInteger chunkSize = MAX(_chunkSize, CKS3MinimumChunkSize);
+
+    // S3 wants to know the length up front, rather than the body being sent with chunked transfer encoding
+    NSString *encoding = [request valueForHTTPHeaderField:@"Content-Encoding"];
+    if (![encoding hasPrefix:@"aws-chunked"])
+    {
+        [request setValue:(encoding ? [@"aws-chunked," stringByAppendingString:encoding] : @"aws-chunked") forHTTPHeaderField:@"Content-Encoding"];
+    }
+    [request setValue:[NSString stringWithFormat:@"%llu", length] forHTTPHeaderField:@"x-amz-decoded-content-length"];
+    [request setValue:[NSString stringWithFormat:@"%llu", [[self class] encodedLengthOfChunkedBodyOfLength:length chunkSize:chunkSize]]
+   forHTTPHeaderField:@"Content-Length"];
+    [request setHTTPBody:nil];
+
+    NSString *seedSignature = [self signRequest:request payloadHash:CKS3StreamingPayload date:date];
+
+    NSString *timestamp = [request valueForHTTPHeaderField:@"x-amz-date"];
+    NSString *prefix = [NSString stringWithFormat:@"AWS4-HMAC-SHA256-PAYLOAD\n%@\n%@\n", timestamp, [self scopeForTimestamp:timestamp]];
+
+    CKS3ChunkedBodyStream *stream = [[CKS3ChunkedBodyStream alloc] initWithFileURL:fileURL
+                                                                            offset:offset
+                                                                            length:length
+                                                                         chunkSize:chunkSize
+                                                                        signingKey:[self signingKeyForDate:date]
+                                                                stringToSignPrefix:[prefix dataUsingEncoding:NSUTF8StringEncoding]
+                                                                     seedSignature:seedSignature];
+    [request setHTTPBodyStream:stream];
+    [stream release];
+}
+
+- (void)signRequest:(NSMutableURLRequest *)request withBodyFromFileURL:(NSURL *)fileURL offset:(unsigned long long)offset length:(unsigned long long)length;
+{
+    [self signRequest:request withBodyFromFileURL:fileURL offset:offset length:length date:[NSDate date]];
+}
+
+#pragma mark Support
+
++ (NSString *)regionForHost:(NSString *)host;
+{
+    NSArray *labels = [[host lowercaseString] componentsSeparatedByString:@"."];
+    NSInteger count = [labels count];
+
+    if (count >= 3 && [[labels objectAtIndex:count - 1] isEqualToString:@"com"] && [[labels objectAtIndex:count - 2] isEqualToString:@"amazonaws"])
+    {
+        // Work back from the end, as a virtual-hosted bucket's name could look like anything
+        NSString *region = nil;
+        for (NSInteger i = count - 3; i >= 0; i--)
+        {
+            NSString *label = [labels objectAtIndex:i];
+
+            if ([label hasPrefix:@"s3-"])                   // s3-eu-west-1.amazonaws.com
+            {
+                region = [label substringFromIndex:3];
+                break;
+            }
+            if ([label isEqualToString:@"s3"]) break;      // s3.eu-west-1.amazonaws.com, or the original s3.amazonaws.com
+
+            if (![label isEqualToString:@"dualstack"]) region = label;
+            if (i == 0) region = nil;                       // no s3 label at all
+        }
+
+        if (!region || [region isEqualToString:@"external-1"]) region = @"us-east-1";
+        return region;
+    }
+
+    NSString *result = [[NSUserDefaults standardUserDefaults] stringForKey:@"CKS3Region"];
+    return ([result length] ? result : @"us-east-1");
+}
+
++ (NSString *)canonicalRequestForRequest:(NSURLRequest *)request payloadHash:(NSString *)payloadHash signedHeaders:(NSString **)signedHeaders;
+{
+    NSURL *URL = [[request URL] absoluteURL];
+
+    // S3 decodes the path it's sent, and encodes it again its own way
+    NSString *path = [(NSString *)CFURLCopyPath((CFURLRef)URL) autorelease];
+    if (![path length]) path = @"/";
+
+
+    // Parameters are sorted by name, then value, once encoded
+    NSMutableArray *parameters = [NSMutableArray array];
+    for (NSString *aParameter in [[URL query] componentsSeparatedByString:@"&"])
+    {
+        if (![aParameter length]) continue;
+
+        NSRange equals = [aParameter rangeOfString:@"="];
+        NSString *name = (equals.location == NSNotFound ? aParameter : [aParameter substringToIndex:equals.location]);
+        NSString *value = (equals.location == NSNotFound ? @"" : [aParameter substringFromIndex:NSMaxRange(equals)]);
+
+        [parameters addObject:[NSArray arrayWithObjects:CKS3URIEncode(CKS3URIDecode(name), YES), CKS3URIEncode(CKS3URIDecode(value), YES), nil]];
+    }
+
+    [parameters sortUsingComparator:^NSComparisonResult(NSArray *parameter1, NSArray *parameter2) {
+        NSComparisonResult result = [[parameter1 objectAtIndex:0] compare:[parameter2 objectAtIndex:0] options:NSLiteralSearch];
+        if (result == NSOrderedSame) result = [[parameter1 objectAtIndex:1] compare:[parameter2 objectAtIndex:1] options:NSLiteralSearch];
+        return result;
+    }];
+
+    NSMutableArray *query = [NSMutableArray arrayWithCapacity:[parameters count]];
+    for (NSArray *aParameter in parameters)
+    {
+        [query addObject:[aParameter componentsJoinedByString:@"="]];
+    }
+
+
+    // Every header we've set is signed. The URL loading system adds Host itself
+    NSMutableDictionary *headers = [NSMutableDictionary dictionary];
+    NSDictionary *fields = [request allHTTPHeaderFields];
+    for (NSString *aField in fields)
+    {
+        NSString *name = [aField lowercaseString];
+        if ([name isEqualToString:@"authorization"]) continue;
+
+        NSString *value = [[fields objectForKey:aField] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        while ([value rangeOfString:@"  "].location != NSNotFound)
+        {
+            value = [value stringByReplacingOccurrencesOfString:@"  " withString:@" "];
+        }
+
+        [headers setObject:value forKey:name];
+    }
+
+    if (![headers objectForKey:@"host"])
+    {
+        NSString *host = [[URL host] lowercaseString];
+        if ([URL port]) host = [host stringByAppendingFormat:@":%@", [URL port]];
+        [headers setObject:host forKey:@"host"];
+    }
+
+    NSArray *names = [[headers allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    NSMutableString *canonicalHeaders = [NSMutableString string];
+    for (NSString *aName in names)
+    {
+        [canonicalHeaders appendFormat:@"%@:%@\n", aName, [headers objectForKey:aName]];
+    }
+
+    NSString *signedNames = [names componentsJoinedByString:@";"];
+    if (signedHeaders) *signedHeaders = signedNames;
+
+
+    return [NSString stringWithFormat:@"%@\n%@\n%@\n%@\n%@\n%@",
+            [request HTTPMethod],
+            CKS3URIEncode(CKS3URIDecode(path), NO),
+            [query componentsJoinedByString:@"&"],
+            canonicalHeaders,
+            signedNames,
+            payloadHash];
+}
+
+static unsigned long long CKS3EncodedChunkLength(unsigned long long length)
+{
+    // <hex size>;chunk-signature=<64 hex>\r\n<data>\r\n
+    NSUInteger digits = 1;
+    for (unsigned long long remainder = length >> 4; remainder; remainder >>= 4) digits++;
+
+    return digits + strlen(";chunk-signature=") + 2 * CC_SHA256_DIGEST_LENGTH + 2 + length + 2;
+}
+
++ (unsigned long long)encodedLengthOfChunkedBodyOfLength:(unsigned long long)length chunkSize:(NSUInteger)chunkSize;
+{
+    unsigned long long result = (length / chunkSize) * CKS3EncodedChunkLength(chunkSize);
+    if (length % chunkSize) result += CKS3EncodedChunkLength(length % chunkSize);
+    return result + CKS3EncodedChunkLength(0);
+}
+
+@end
+
+
+#pragma mark -
+
+
+@implementation CKS3ChunkedBodyStream
+
+- (id)initWithFileURL:(NSURL *)fileURL offset:(unsigned long long)offset length:(unsigned long long)length chunkSize:(NSUInteger)chunkSize signingKey:(NSData *)signingKey stringToSignPrefix:(NSData *)prefix seedSignature:(NSString *)seedSignature;
+{
+    if (self = [super init])
+    {
+        _fileURL = [fileURL copy];
+        _offset = offset;
+        _length = length;
+        _chunkSize = chunkSize;
+        _signingKey = [signingKey copy];
+        _stringToSignPrefix = [prefix copy];
+        _seedSignature = [seedSignature copy];
+
+        _fileDescriptor = -1;
+        _status = NSStreamStatusNotOpen;
+        strlcpy(_previousSignature, [seedSignature UTF8String], sizeof(_previousSignature));
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_fileDescriptor >= 0) close(_fileDescriptor);
+    free(_buffer);
+
+    [_fileURL release];
+    [_signingKey release];
+    [_stringToSignPrefix release];
+    [_seedSignature release];
+    [_error release];
+
+    [super dealloc];
+}
+
+// The URL loading system asks for a fresh copy should it need to send the body again
+- (id)copyWithZone:(NSZone *)zone;
+{
+    return [[[self class] allocWithZone:zone] initWithFileURL:_fileURL
+                                                       offset:_offset
+                                                       length:_length
+                                                    chunkSize:_chunkSize
+                                                   signingKey:_signingKey
+                                           stringToSignPrefix:_stringToSignPrefix
+                                                seedSignature:_seedSignature];
+}
+
+- (void)failWithError:(NSError *)error;
+{
+    [_error release]; _error = [error retain];
+    _status = NSStreamStatusError;
+}
+
+- (void)failWithPOSIXError:(int)code;
+{
+    NSDictionary *userInfo = [NSDictionary dictionaryWithObject:[_fileURL path] forKey:NSFilePathErrorKey];
+    [self failWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:userInfo]];
+}
+
+#pragma mark Chunks
+
+// Reads the next chunk straight into place after room for its header, so the data is never copied about before being handed over
+- (BOOL)readChunk;
+{
+    if (_sentFinalChunk) return NO;
+
+    NSUInteger size = (NSUInteger)MIN(_chunkSize, _length - _position);
+    uint8_t *data = _buffer + CKS3ChunkHeaderSpace;
+
+    NSUInteger done = 0;
+    while (done < size)
+    {
+        ssize_t count = pread(_fileDescriptor, data + done, size - done, (off_t)(_offset + _position + done));
+        if (count < 0 && errno == EINTR) continue;
+
+        if (count <= 0)
+        {
+            [self failWithPOSIXError:(count < 0 ? errno : EIO)];  // nothing read means the file's been truncated since we started
+            return NO;
+        }
+
+        done += count;
+    }
+
+
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(data, (CC_LONG)size, digest);
+    char hash[2 * CC_SHA256_DIGEST_LENGTH + 1];
+    CKS3HexEncode(digest, sizeof(digest), hash);
+
+    CCHmacContext context;
+    CCHmacInit(&context, kCCHmacAlgSHA256, [_signingKey bytes], [_signingKey length]);
+    CCHmacUpdate(&context, [_stringToSignPrefix bytes], [_stringToSignPrefix length]);
+    CCHmacUpdate(&context, _previousSignature, strlen(_previousSignature));
+    CCHmacUpdate(&context, "\n" "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" "\n", 66);
+    CCHmacUpdate(&context, hash, strlen(hash));
+
+    unsigned char signature[CC_SHA256_DIGEST_LENGTH];
+    CCHmacFinal(&context, signature);
+    CKS3HexEncode(signature, sizeof(signature), _previousSignature);
+
+
+    char header[CKS3ChunkHeaderSpace];
+    int headerLength = snprintf(header, sizeof(header), "%lx;chunk-signature=%s\r\n", (unsigned long)size, _previousSignature);
+
+    _pending = data - headerLength;
+    memcpy(_pending, header, headerLength);
+    data[size] = '\r';
+    data[size + 1] = '\n';
+    _pendingLength = headerLength + size + 2;
+
+    _position += size;
+    if (size == 0) _sentFinalChunk = YES;
+
+    return YES;
+}
+
+#pragma mark NSInputStream
+
+- (void)open;
+{
+    if (_status != NSStreamStatusNotOpen) return;
+
+    _fileDescriptor = open([[_fileURL path] fileSystemRepresentation], O_RDONLY);
+    if (_fileDescriptor < 0)
+    {
+        [self failWithPOSIXError:errno];
+        return;
+    }
+
+    _buffer = malloc(CKS3ChunkHeaderSpace + _chunkSize + 2);
+    _status = NSStreamStatusOpen;
+}
+
+- (void)close;
+{
+    if (_fileDescriptor >= 0)
+    {
+        close(_fileDescriptor);
+        _fileDescriptor = -1;
+    }
+
+    _status = NSStreamStatusClosed;
+}
+
+- (NSInteger)read:(uint8_t *)buffer maxLength:(NSUInteger)length;
+{
+    if (_status == NSStreamStatusAtEnd) return 0;
+    if (_status != NSStreamStatusOpen) return -1;
+
+    NSUInteger result = 0;
+    while (result < length)
+    {
+        if (_pendingLength == 0 && ![self readChunk]) break;
+
+        NSUInteger count = MIN(length - result, _pendingLength);
+        memcpy(buffer + result, _pending, count);
+        _pending += count;
+        _pendingLength -= count;
+        result += count;
+    }
+
+    if (_status == NSStreamStatusError) return -1;
+    if (_sentFinalChunk && _pendingLength == 0) _status = NSStreamStatusAtEnd;
+
+    return result;
+}
+
+- (BOOL)getBuffer:(uint8_t **)buffer length:(NSUInteger *)length; { return NO; }
+
+// Reading never blocks for long, so the stream's always ready whenever it's open
+- (BOOL)hasBytesAvailable; { return _status == NSStreamStatusOpen; }
+
+- (NSStreamStatus)streamStatus; { return _status; }
+
+- (NSError *)streamError; { return _error; }
+
+- (id <NSStreamDelegate>)delegate; { return (_delegate ? _delegate : (id <NSStreamDelegate>)self); }
+
+- (void)setDelegate:(id <NSStreamDelegate>)delegate; { _delegate = delegate; }
+
+- (id)propertyForKey:(NSString *)key; { return nil; }
+
+- (BOOL)setProperty:(id)property forKey:(NSString *)key; { return NO; }
+
+- (void)scheduleInRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode; { }
+
+- (void)removeFromRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode; { }
+
+#pragma mark CFReadStream
+
+// CFNetwork drives body streams through these rather than the public API. There are no events worth reporting since reading is synchronous
+- (void)_scheduleInCFRunLoop:(CFRunLoopRef)aRunLoop forMode:(CFStringRef)aMode; { }
+
+- (void)_unscheduleFromCFRunLoop:(CFRunLoopRef)aRunLoop forMode:(CFStringRef)aMode; { }
+
+- (BOOL)_setCFClientFlags:(CFOptionFlags)inFlags callback:(CFReadStreamClientCallBack)inCallback context:(CFStreamClientContext *)inContext; { return NO; }
+
+@end
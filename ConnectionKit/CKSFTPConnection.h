@@ -12,6 +12,7 @@
 @class CK2SFTPSession;
 
 
+// Delegate messages arrive on the main thread. The connection's background queue waits for each to be handled before carrying on, except for transcript messages, which are delivered asynchronously (in the same order)
 @interface CKSFTPConnection : NSObject <CKPublishingConnection>
 {
  @private
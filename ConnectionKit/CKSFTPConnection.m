@@ -9,7 +9,7 @@
 #import "CKSFTPConnection.h"
 #import "CK2SFTPSession.h"
 
-#import "UKMainThreadProxy.h"
+#import "CKDeliveryQueue.h"
 #import "NSInvocation+Connection.h"
 
 
@@ -62,6 +62,8 @@
 
 #pragma mark Queue
 
+// Requests are worked through one at a time on the queue. Each waits for the delegate to hear how it went on the main thread before the next starts, as with UKMainThreadProxy before
+
 - (void)enqueueOperation:(NSOperation *)operation;
 {
     // Assume that only _session targeted invocations are async
@@ -113,9 +115,11 @@
 {
     if ([[self delegate] respondsToSelector:@selector(connection:didDisconnectFromHost:)])
     {
-        id proxy = [[UKMainThreadProxy alloc] initWithTarget:[self delegate]];
-        [proxy connection:self didDisconnectFromHost:[_url host]];
-        [proxy release];
+        id delegate = [self delegate];
+        NSString *host = [_url host];
+        [[CKDeliveryQueue mainQueue] deliverAndWait:^{
+            [delegate connection:self didDisconnectFromHost:host];
+        }];
     }
 }
 
@@ -123,9 +127,10 @@
 {
     if ([self delegate])
     {
-        id proxy = [[UKMainThreadProxy alloc] initWithTarget:[self delegate]];
-        [proxy connection:self didReceiveError:error];
-        [proxy release];
+        id delegate = [self delegate];
+        [[CKDeliveryQueue mainQueue] deliverAndWait:^{
+            [delegate connection:self didReceiveError:error];
+        }];
     }
 }
 
@@ -143,9 +148,11 @@
 {
     if (![self delegate]) return;
     
-    id proxy = [[UKMainThreadProxy alloc] initWithTarget:[self delegate]];
-    [proxy connection:self appendString:string toTranscript:(received ? CKTranscriptReceived : CKTranscriptSent)];
-    [proxy release];
+    // The only message that doesn't wait, as there's so many of them. It still can't overtake the others
+    id delegate = [self delegate];
+    [[CKDeliveryQueue mainQueue] deliver:^{
+        [delegate connection:self appendString:string toTranscript:(received ? CKTranscriptReceived : CKTranscriptSent)];
+    }];
 }
 
 #pragma mark Requests
@@ -221,9 +228,10 @@
     if (handle) error = nil;    // don't confuse CK!
     
     
-    id proxy = [[UKMainThreadProxy alloc] initWithTarget:[self delegate]];
-    [proxy connection:self uploadDidFinish:path error:error];
-    [proxy release];
+    id delegate = [self delegate];
+    [[CKDeliveryQueue mainQueue] deliverAndWait:^{
+        [delegate connection:self uploadDidFinish:path error:error];
+    }];
 }
 
 - (void)createDirectoryAtPath:(NSString *)path posixPermissions:(NSNumber *)permissions;
@@ -256,9 +264,10 @@
     id delegate = [self delegate];
     if ([delegate respondsToSelector:@selector(connection:didCreateDirectory:error:)])
     {
-        id proxy = [[UKMainThreadProxy alloc] initWithTarget:delegate];
-        [proxy connection:self didCreateDirectory:path error:(ok ? nil : error)];
-        [proxy release];
+        if (ok) error = nil;    // blocks retain what they capture, so mustn't be left dangling
+        [[CKDeliveryQueue mainQueue] deliverAndWait:^{
+            [delegate connection:self didCreateDirectory:path error:error];
+        }];
     }
 }
 
@@ -272,9 +281,10 @@
         id delegate = [self delegate];
         if ([delegate respondsToSelector:@selector(connection:didSetPermissionsForFile:error:)])
         {
-            id proxy = [[UKMainThreadProxy alloc] initWithTarget:delegate];
-            [proxy connection:self didSetPermissionsForFile:path error:(result ? nil : error)];
-            [proxy release];
+            if (result) error = nil;
+            [[CKDeliveryQueue mainQueue] deliverAndWait:^{
+                [delegate connection:self didSetPermissionsForFile:path error:error];
+            }];
         }
     }];
     
@@ -296,9 +306,10 @@
     BOOL result = [[self SFTPSession] removeFileAtPath:path error:&error];
     if (result) error = nil;
     
-    id proxy = [[UKMainThreadProxy alloc] initWithTarget:[self delegate]];
-    [proxy connection:self didDeleteFile:path error:error];
-    [proxy release];
+    id delegate = [self delegate];
+    [[CKDeliveryQueue mainQueue] deliverAndWait:^{
+        [delegate connection:self didDeleteFile:path error:error];
+    }];
 }
 
 - (void)directoryContents
@@ -316,9 +327,10 @@
     NSArray *result = [[self SFTPSession] attributesOfContentsOfDirectoryAtPath:path error:&error];
     if (result) error = nil;    // cause CK handles errors in a crazy way
     
-    id proxy = [[UKMainThreadProxy alloc] initWithTarget:[self delegate]];
-    [proxy connection:self didReceiveContents:result ofDirectory:path error:error];
-    [proxy release];
+    id delegate = [self delegate];
+    [[CKDeliveryQueue mainQueue] deliverAndWait:^{
+        [delegate connection:self didReceiveContents:result ofDirectory:path error:error];
+    }];
 }
 
 #pragma mark Current Directory
@@ -338,9 +350,10 @@
 {
     if ([[self delegate] respondsToSelector:@selector(connection:didChangeToDirectory:error:)])
     {
-        id proxy = [[UKMainThreadProxy alloc] initWithTarget:[self delegate]];
-        [proxy connection:self didChangeToDirectory:dirPath error:nil];
-        [proxy release];
+        id delegate = [self delegate];
+        [[CKDeliveryQueue mainQueue] deliverAndWait:^{
+            [delegate connection:self didChangeToDirectory:dirPath error:nil];
+        }];
     }
 }
 
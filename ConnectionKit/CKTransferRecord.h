@@ -31,12 +31,27 @@
 @protocol CKConnection;
 
 
+// Running totals for a record and everything below it. Kept up to date as records change, so reading them is cheap however big the tree
+typedef struct {
+	unsigned long long	size;
+	unsigned long long	transferred;
+	NSUInteger			transfers;	// leaf records
+	NSUInteger			errors;
+	NSUInteger			completed;
+} CKTransferRecordTotals;
+
+
 @interface CKTransferRecord : NSObject
 {
 	NSString *_name;
 	unsigned long long _size;
-	unsigned long long _sizeWithChildren;
 	unsigned long long _transferred;
+	CKTransferRecordTotals _childTotals;	// sum of the children's totals
+	BOOL _finished;
+	
+	// Progress reported from other threads, waiting to be passed on to the main thread
+	volatile int64_t _pendingTransferred;
+	volatile int32_t _progressFlushScheduled;
 	unsigned long long _intermediateTransferred;
 	NSTimeInterval _lastTransferTime;
 	NSTimeInterval _transferStartTime;
@@ -44,6 +59,8 @@
 	CGFloat _speed;
 	NSUInteger _progress;
 	NSMutableArray *_contents;
+	NSMutableDictionary *_childrenByName;	// first child added with each name
+	NSMutableDictionary *_pathIndex;		// roots only; paths looked up so far
 	CKTransferRecord *_parent; //not retained
 	NSMutableDictionary *_properties;
 	
@@ -80,6 +97,7 @@
 
 - (void)addContent:(CKTransferRecord *)record;
 - (NSArray *)contents;
+- (CKTransferRecord *)childWithName:(NSString *)name;	// the first added, should there be several
 
 - (BOOL)hasError;
 
@@ -100,10 +118,21 @@
 + (void)mergeTextPathRecord:(CKTransferRecord *)record withRoot:(CKTransferRecord *)root;
 
 // If the path is absolute, searches from root of tree, otherwise searches from receiver
+// Each component is a dictionary lookup, and roots remember the paths they've been asked for, so is cheap enough to call for every item of a big tree
 - (CKTransferRecord *)recordForPath:(NSString *)path;
 
 - (BOOL)problemsTransferringCountingErrors:(NSInteger *)outErrors successes:(NSInteger *)outSuccesses;
 
+// For reporting a transfer from a background thread. Everything is passed on to the main thread, in order, but byte counts are gathered up in between: progress is published every so often, or as soon as another percent is reached, rather than for every chunk
+- (void)threaded_transferDidBegin;
+- (void)threaded_transferredDataOfLength:(unsigned long long)length;
+- (void)threaded_transferDidFinishWithError:(NSError *)error;
+
+// Counts of the leaf records at or below the receiver
+- (NSUInteger)numberOfTransfers;
+- (NSUInteger)numberOfErrors;
+- (NSUInteger)numberOfCompletedTransfers;
+
 @end
 
 extern NSString *CKTransferRecordProgressChangedNotification;
@@ -117,5 +146,5 @@ extern NSString *CKTransferRecordTransferDidFinishNotification;
 - (void)setUpload:(BOOL)flag;
 - (void)setSize:(unsigned long long)size;
 - (BOOL)isLeaf;
-- (void)_sizeWithChildrenChangedBy:(unsigned long long)sizeDelta;
+- (CKTransferRecordTotals)_totals;
 @end
\ No newline at end of file
@@ -30,11 +30,23 @@
 #import "CKConnectionProtocol.h"
 #import "CKTransferRecord.h"
 #import "NSString+Connection.h"
+#import "CKDeliveryQueue.h"
+
+#include <libkern/OSAtomic.h>
 
 NSString *CKTransferRecordProgressChangedNotification = @"CKTransferRecordProgressChangedNotification";
 NSString *CKTransferRecordTransferDidBeginNotification = @"CKTransferRecordTransferDidBeginNotification";
 NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTransferDidFinishNotification";
 
+// Longest progress reported from other threads is held back for
+static const NSTimeInterval CKTransferRecordProgressInterval = 0.1;
+
+enum {
+	CKProgressFlushNotScheduled = 0,
+	CKProgressFlushDelayed,
+	CKProgressFlushImmediate,
+};
+
 @implementation CKTransferRecord
 
 - (NSString *)name { return _name; }
@@ -45,6 +57,7 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
 	{
 		[self willChangeValueForKey:@"name"];
 		name = [name copy];
+		if (_parent) [_parent _child:self willChangeNameTo:name];
 		[_name release];
 		_name = name;
 		[self didChangeValueForKey:@"name"];
@@ -71,6 +84,7 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
 		_name = [name copy];
 		_size = size;
 		_contents = [[NSMutableArray array] retain];
+		_childrenByName = [[NSMutableDictionary alloc] init];
 		_properties = [[NSMutableDictionary dictionary] retain];
 		_error = nil;
 		_progress = 0;
@@ -83,6 +97,8 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
 	[_name release];
 	[_contents makeObjectsPerformSelector:@selector(setParent:) withObject:nil];
 	[_contents release];
+	[_childrenByName release];
+	[_pathIndex release];
 	[_properties release];
 	[_error release];
 	[super dealloc];
@@ -96,71 +112,80 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
 	}
 }
 
-- (unsigned long long)size
+#pragma mark -
+#pragma mark Totals
+
+// Directories are the sum of their children, plus their own size. Leaves speak for themselves
+- (CKTransferRecordTotals)_totals
 {
-	//Have we already calculated our size with children?
-	if (_sizeWithChildren != 0)
-		return _sizeWithChildren;
-	
-	//Calculate our size including our children
-	unsigned long long size = _size;
-	NSEnumerator *e = [[self contents] objectEnumerator];
-	CKTransferRecord *cur;
+	CKTransferRecordTotals result = _childTotals;
 	
-	while ((cur = [e nextObject]))
+	if ([self isLeaf])
 	{
-		if ([cur respondsToSelector:@selector(size)])
-		{
-			size += [cur size];
-		}
-		else
-		{
-			NSLog(@"CKTransferRecord content object does not have 'size'");		// work around bogus children?
-		}
+		result.transferred = (_progress == -1 ? _size : _transferred);	//if we have an error return it as if we transferred the lot of it
+		result.transfers = 1;
+		result.errors = (_error ? 1 : 0);
+		result.completed = (_finished ? 1 : 0);
 	}
-	_sizeWithChildren = size;
 	
-	return size;
+	result.size += _size;
+	return result;
+}
+
+// Call after changing anything which feeds into the totals, with the totals from beforehand. Passes the difference up the tree, so the cost is the depth of the tree, not its size
+- (void)_totalsChangedFrom:(CKTransferRecordTotals)before
+{
+	if (!_parent) return;
+	
+	CKTransferRecordTotals after = [self _totals];
+	CKTransferRecordTotals parentBefore = [_parent _totals];
+	
+	// Unsigned arithmetic wraps, so shrinking works out too
+	_parent->_childTotals.size += after.size - before.size;
+	_parent->_childTotals.transferred += after.transferred - before.transferred;
+	_parent->_childTotals.transfers += after.transfers - before.transfers;
+	_parent->_childTotals.errors += after.errors - before.errors;
+	_parent->_childTotals.completed += after.completed - before.completed;
+	
+	[_parent _totalsChangedFrom:parentBefore];
+}
+
+- (unsigned long long)size
+{
+	return [self _totals].size;
 }
 
 - (void)setSize:(unsigned long long)size
 {
 	[self willChangeValueForKey:@"progress"];
-	if (_size != 0)
-	{
-		//We're updating our size. We need to update our parents' sizes too.
-		unsigned long long sizeDelta = size - _size;
-		[self _sizeWithChildrenChangedBy:sizeDelta];
-	}
+	CKTransferRecordTotals before = [self _totals];
 	_size = size;
+	[self _totalsChangedFrom:before];
 	[self didChangeValueForKey:@"progress"];
 }
 
-- (void)_sizeWithChildrenChangedBy:(unsigned long long)sizeDelta
+- (unsigned long long)transferred
 {
-	_sizeWithChildren += sizeDelta;
-	if ([self parent])
-		[[self parent] _sizeWithChildrenChangedBy:sizeDelta];
+	return [self _totals].transferred;
 }
 
-- (unsigned long long)transferred
+- (NSUInteger)numberOfTransfers
 {
-	if ([self isDirectory]) 
-	{
-		unsigned long long rem = 0;
-        for (CKTransferRecord *aRecord in _contents)    // -contents is too slow as copies the internal storage
-		{
-			rem += [aRecord transferred];
-		}
-		return rem;
-	}
-	if (_progress == -1) //if we have an error return it as if we transferred the lot of it
-	{
-		return _size;
-	}
-	return _transferred;
+	return [self _totals].transfers;
+}
+
+- (NSUInteger)numberOfErrors
+{
+	return [self _totals].errors;
+}
+
+- (NSUInteger)numberOfCompletedTransfers
+{
+	return [self _totals].completed;
 }
 
+#pragma mark -
+
 - (CGFloat)speed
 {
 	if ([self isDirectory]) 
@@ -226,7 +251,9 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
 		}
 		
 		[self willChangeValueForKey:@"progress"];
+		CKTransferRecordTotals before = [self _totals];
 		_progress = progress;
+		[self _totalsChangedFrom:before];
 		[self didChangeValueForKey:@"progress"];
 		
 		
@@ -256,28 +283,10 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
 
 - (BOOL)problemsTransferringCountingErrors:(NSInteger *)outErrors successes:(NSInteger *)outSuccesses
 {
-	if ([self isLeaf])
-	{
-		if (_error != nil)
-		{
-			(*outErrors)++;
-		}
-		else
-		{
-			(*outSuccesses)++;
-		}
-	}
-	else
-	{
-		// check children for errors
-		NSEnumerator *e = [[self contents] objectEnumerator];
-		CKTransferRecord *cur;
-		
-		while ((cur = [e nextObject]))
-		{
-			(void) [cur problemsTransferringCountingErrors:outErrors successes:outSuccesses];
-		}
-	}
+	CKTransferRecordTotals totals = [self _totals];
+	*outErrors += totals.errors;
+	*outSuccesses += totals.transfers - totals.errors;
+	
 	return (*outErrors > 0);	// return if there were any problems
 }
 
@@ -293,8 +302,10 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
     if (error != _error)
 	{
 		[self willChangeValueForKey:@"progress"]; // we use this because we return -1 on an error
+		CKTransferRecordTotals before = [self _totals];
 		[_error autorelease];
 		_error = [error retain];
+		[self _totalsChangedFrom:before];
 		[self didChangeValueForKey:@"progress"];
 		[[NSNotificationCenter defaultCenter] postNotificationName:CKTransferRecordProgressChangedNotification object:self];
 	}
@@ -308,9 +319,7 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
 
 - (void)setParent:(CKTransferRecord *)parent
 {
-	_parent = parent;
-	if (_parent)
-		[_parent _sizeWithChildrenChangedBy:_size];
+	_parent = parent;	// -addContent: takes care of adding to the parent's totals
 }
 
 - (BOOL)isDirectory
@@ -364,8 +373,23 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
     NSIndexSet *indexes = [NSIndexSet indexSetWithIndex:[_contents count]];
     [self willChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"contents"];
     {{
+        CKTransferRecordTotals before = [self _totals];
         [_contents addObject:record];
         [record setParent:self];
+        
+        NSString *name = [record name];
+        if (name && ![_childrenByName objectForKey:name]) [_childrenByName setObject:record forKey:name];
+        
+        // No longer a root, so any paths it's remembered are relative to the wrong place
+        [record->_pathIndex release]; record->_pathIndex = nil;
+        
+        CKTransferRecordTotals added = [record _totals];
+        _childTotals.size += added.size;
+        _childTotals.transferred += added.transferred;
+        _childTotals.transfers += added.transfers;
+        _childTotals.errors += added.errors;
+        _childTotals.completed += added.completed;
+        [self _totalsChangedFrom:before];
     }}
 	[self didChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"contents"];
 }
@@ -375,6 +399,36 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
 	return [[_contents copy] autorelease];
 }
 
+- (CKTransferRecord *)childWithName:(NSString *)name
+{
+	return [_childrenByName objectForKey:name];
+}
+
+- (void)_child:(CKTransferRecord *)child willChangeNameTo:(NSString *)name
+{
+	NSString *oldName = [child name];
+	if (oldName && [_childrenByName objectForKey:oldName] == child)
+	{
+		[_childrenByName removeObjectForKey:oldName];
+		
+		// Should there be another child by the old name, it takes over
+		for (CKTransferRecord *aRecord in _contents)
+		{
+			if (aRecord != child && [[aRecord name] isEqualToString:oldName])
+			{
+				[_childrenByName setObject:aRecord forKey:oldName];
+				break;
+			}
+		}
+	}
+	
+	if (name && ![_childrenByName objectForKey:name]) [_childrenByName setObject:child forKey:name];
+	
+	// Paths below the child are changing
+	CKTransferRecord *root = [self root];
+	[root->_pathIndex release]; root->_pathIndex = nil;
+}
+
 - (void)appendToDescription:(NSMutableString *)str indentation:(unsigned)indent
 {
 	NSInteger i;
@@ -438,7 +492,11 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
 
 - (void)transferDidBegin:(CKTransferRecord *)transfer
 {
+	CKTransferRecordTotals before = [self _totals];
 	_transferred = 0;
+	_finished = NO;
+	[self _totalsChangedFrom:before];
+	
 	_intermediateTransferred = 0;
 	_lastTransferTime = [NSDate timeIntervalSinceReferenceDate];
 	[self setProgress:0];
@@ -447,7 +505,10 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
 
 - (void)transfer:(CKTransferRecord *)transfer transferredDataOfLength:(unsigned long long)length
 {
+	CKTransferRecordTotals before = [self _totals];
 	_transferred += length;
+	[self _totalsChangedFrom:before];
+	
 	_intermediateTransferred += length;
 	
 	NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
@@ -487,7 +548,12 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
 {
 	[self setError:error];
 	_intermediateTransferred = (_size - _transferred);
+	
+	CKTransferRecordTotals before = [self _totals];
 	_transferred = _size;
+	_finished = YES;
+	[self _totalsChangedFrom:before];
+	
 	_lastTransferTime = [NSDate timeIntervalSinceReferenceDate];
 	[self setProgress:100];
 
@@ -499,6 +565,72 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
 		[parent transferDidFinish:parent error:error];
 }
 
+#pragma mark -
+#pragma mark Reporting From Other Threads
+
+// Everything goes via the same delivery queue, so begin, progress and finish can't overtake one another
+
+- (void)threaded_transferDidBegin
+{
+	[[CKDeliveryQueue mainQueue] deliver:^{
+		[self transferDidBegin:self];
+	}];
+}
+
+- (void)threaded_transferredDataOfLength:(unsigned long long)length
+{
+	int64_t pending = OSAtomicAdd64Barrier(length, &_pendingTransferred);
+	
+	// Reaching another percent is worth showing straight away. Otherwise, give more bytes a chance to pile up first
+	unsigned long long size = _size;
+	unsigned long long transferred = _transferred;
+	BOOL nextPercent = (size > 0 && (transferred + pending) * 100 / size > transferred * 100 / size);
+	
+	if (nextPercent)
+	{
+		if (OSAtomicCompareAndSwap32Barrier(CKProgressFlushNotScheduled, CKProgressFlushImmediate, &_progressFlushScheduled) ||
+			OSAtomicCompareAndSwap32Barrier(CKProgressFlushDelayed, CKProgressFlushImmediate, &_progressFlushScheduled))
+		{
+			[[CKDeliveryQueue mainQueue] deliver:^{
+				[self flushProgress];
+			}];
+		}
+	}
+	else if (OSAtomicCompareAndSwap32Barrier(CKProgressFlushNotScheduled, CKProgressFlushDelayed, &_progressFlushScheduled))
+	{
+		dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(CKTransferRecordProgressInterval * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+			[[CKDeliveryQueue mainQueue] deliver:^{
+				[self flushProgress];
+			}];
+		});
+	}
+}
+
+- (void)threaded_transferDidFinishWithError:(NSError *)error
+{
+	[[CKDeliveryQueue mainQueue] deliver:^{
+		[self flushProgress];	// anything still pending happened before finishing
+		[self transferDidFinish:self error:error];
+	}];
+}
+
+// Main thread only. Passes on whatever's piled up as a single chunk
+- (void)flushProgress
+{
+	// Clear the flag first, so bytes arriving from here on schedule another flush
+	_progressFlushScheduled = CKProgressFlushNotScheduled;
+	OSMemoryBarrier();
+	
+	int64_t bytes;
+	do
+	{
+		bytes = _pendingTransferred;
+	}
+	while (!OSAtomicCompareAndSwap64Barrier(bytes, 0, &_pendingTransferred));
+	
+	if (bytes > 0) [self transfer:self transferredDataOfLength:bytes];
+}
+
 #pragma mark -
 #pragma mark Recursive File Transfer Methods
 
@@ -523,27 +655,28 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
 	return result;
 }
 
+// The components of a path whose first component should name the record itself. Empty components are skipped
++ (NSArray *)_fullPathComponents:(NSString *)path
+{
+	NSMutableArray *result = [NSMutableArray array];
+	for (NSString *aComponent in [path componentsSeparatedByString:@"/"])
+	{
+		if ([aComponent length]) [result addObject:aComponent];
+	}
+	return result;
+}
+
 + (CKTransferRecord *)recursiveRecord:(CKTransferRecord *)record forFullPath:(NSString *)path
 {
-	if ([[record name] isEqualToString:[path firstPathComponent]]) 
+	NSArray *components = [self _fullPathComponents:path];
+	if ([components count] == 0 || ![[record name] isEqualToString:[components objectAtIndex:0]]) return nil;
+	
+	NSUInteger i;
+	for (i = 1; record && i < [components count]; i++)
 	{
-		NSEnumerator *e = [[record contents] objectEnumerator];
-		CKTransferRecord *cur;
-		CKTransferRecord *child;
-		
-		NSString *newPath = [path stringByDeletingFirstPathComponent2];
-		if ([newPath isEqualToString:@""]) return record; //we have our match
-		
-		while ((cur = [e nextObject])) 
-		{
-			child = [CKTransferRecord recursiveRecord:cur forFullPath:newPath];
-			if (child)
-			{
-				return child;
-			}
-		}
+		record = [record childWithName:[components objectAtIndex:i]];
 	}
-	return nil;
+	return record;
 }
 
 - (CKTransferRecord *)recordForPath:(NSString *)path;
@@ -559,64 +692,56 @@ NSString *CKTransferRecordTransferDidFinishNotification = @"CKTransferRecordTran
     }
     
     
-    NSArray *components = [path pathComponents];
-    NSString *name = [components objectAtIndex:0];
+    // Roots remember what they've found before
+    CKTransferRecord *result = (_parent ? nil : [_pathIndex objectForKey:path]);
+    if (result) return result;
     
-    for (CKTransferRecord *aRecord in [self contents]) 
+    result = self;
+    for (NSString *aComponent in [path pathComponents])
     {
-        if ([[aRecord name] isEqualToString:name])
-        {
-            NSString *newPath = [NSString pathWithComponents:
-                                 [components subarrayWithRange:NSMakeRange(1, [components count]-1)]];
-            
-            return [aRecord recordForPath:newPath];
-        }
+        result = [result childWithName:aComponent];
+        if (!result) return nil;
     }
-	
-    return nil;
+    
+    if (!_parent)
+    {
+        if (!_pathIndex) _pathIndex = [[NSMutableDictionary alloc] init];
+        [_pathIndex setObject:result forKey:path];
+    }
+    
+    return result;
 }
 
 + (CKTransferRecord *)recursiveMergeRecordWithPath:(NSString *)path root:(CKTransferRecord *)root
 {
-	NSString *first = [path firstPathComponent];
+	NSArray *components = [self _fullPathComponents:path];
+	if ([components count] == 0 || ![[root name] isEqualToString:[components objectAtIndex:0]]) return nil;
 	
-	if ([[root name] isEqualToString:first])
+	// Create any records missing along the way
+	CKTransferRecord *result = root;
+	NSUInteger i;
+	for (i = 1; i < [components count]; i++)
 	{
-		CKTransferRecord *child = nil;
-		NSEnumerator *e = [[root contents] objectEnumerator];
-		CKTransferRecord *cur;
-		path = [path stringByDeletingFirstPathComponent];
-		
-		if ([path isEqualToString:@"/"])
-			return root;
-		
-		while ((cur = [e nextObject]))
-		{
-			child = [self recursiveMergeRecordWithPath:path root:cur];
-			if (child)
-				return child;
-		}
-		
-		// if we get here we need to create the record		
-		CKTransferRecord *tmp = root;
-		while (![path isEqualToString:@"/"])
+		NSString *name = [components objectAtIndex:i];
+		CKTransferRecord *child = [result childWithName:name];
+		if (!child)
 		{
-			cur = [CKTransferRecord recordWithName:[path firstPathComponent] size:0];
-			[tmp addContent:cur];
-			tmp = cur;
-			path = [path stringByDeletingFirstPathComponent];
+			child = [CKTransferRecord recordWithName:name size:0];
+			[result addContent:child];
 		}
-		return cur;
+		result = child;
 	}
-	return nil;
+	return result;
 }
 
 + (void)mergeTextPathRecord:(CKTransferRecord *)rec withRoot:(CKTransferRecord *)root
 {
 	CKTransferRecord *parent = [CKTransferRecord recursiveMergeRecordWithPath:[[rec name] stringByDeletingLastPathComponent]
 																		 root:root];
-	[parent addContent:rec];
+	
+	// Rename before adding, so the parent files it under the right name straight off
 	[rec setName:[[rec name] lastPathComponent]];
+	[parent addContent:rec];
 }
 
 #pragma mark -
@@ -15,10 +15,12 @@
 enum {
     CKUploadingDeleteExistingFileFirst = 1 << 0,
     CKUploadingDryRun = 1 << 1,
+    CKUploadingAtomic = 1 << 2,     // stage uploads under temporary names, then rename them into place once all have succeeded
 };
 typedef NSUInteger CKUploadingOptions;
 
 
+@class CK2FileManager;
 @protocol CKUploaderDelegate;
 
 
@@ -34,6 +36,9 @@ typedef NSUInteger CKUploadingOptions;
     CKTransferRecord            *_baseRecord;
     BOOL                        _hasUploads;
     
+    NSMutableArray  *_stagedUploads;
+    CK2FileManager  *_fileManager;
+    
     id <CKUploaderDelegate> _delegate;
 }
 
@@ -48,6 +53,8 @@ typedef NSUInteger CKUploadingOptions;
 - (CKTransferRecord *)uploadFileAtURL:(NSURL *)url toPath:(NSString *)path;
 - (CKTransferRecord *)uploadData:(NSData *)data toPath:(NSString *)path;
 - (void)removeFileAtPath:(NSString *)path;
+- (void)removeDirectoryAtPath:(NSString *)path;    // should be empty by the time the removal's carried out, apart from over WebDAV, where the contents go too
+- (CKTransferRecord *)createDirectoryAtPath:(NSString *)path;  // and any parents not already created. Uploading does this for you
 
 @property (nonatomic, retain, readonly) CKTransferRecord *rootTransferRecord;
 @property (nonatomic, retain, readonly) CKTransferRecord *baseTransferRecord;
@@ -55,6 +62,12 @@ typedef NSUInteger CKUploadingOptions;
 - (void)finishUploading;    // will disconnect once all files are uploaded
 - (void)cancel;             // bails out as quickly as possible
 
+// With CKUploadingAtomic, each file is uploaded alongside its destination under a hidden temporary name. Once -finishUploading has seen them all through, they're renamed into place server-side (sent as one batch per directory where the protocol allows), so visitors never see a half-written file, and the window in which old and new files are mixed shrinks to however long the renames take
+// If any upload fails, nothing is swapped into place and the staged files are removed
+// Where the server won't rename over an existing file (FTP with CKUploadingDeleteExistingFileFirst, SFTP servers without posix-rename), a failed rename is retried by removing the existing file first, but only once a listing shows both it and the staged file are still there; any other failure is reported as is. For a moment then there's nothing at that path. Should the rename then fail, the error reported says the old version's gone, and the new version is left staged
+// Subclasses upload to -stagingPathForPath: rather than the final path
+- (NSString *)stagingPathForPath:(NSString *)path;
+
 // The permissions given to uploaded files
 - (unsigned long)posixPermissionsForPath:(NSString *)path isDirectory:(BOOL)directory;
 + (unsigned long)posixPermissionsForDirectoryFromFilePermissions:(unsigned long)filePermissions;
@@ -64,6 +77,7 @@ typedef NSUInteger CKUploadingOptions;
 @end
 
 
+// All sent on the main thread. Those arising from work in the background are delivered asynchronously, so the background work doesn't wait for them to be handled; they still arrive in the order they happened
 @protocol CKUploaderDelegate <NSObject>
 
 - (void)uploaderDidFinishUploading:(CKUploader *)uploader;
@@ -9,7 +9,9 @@
 #import "CKUploader.h"
 
 #import "CKConnectionRegistry.h"
-#import "UKMainThreadProxy.h"
+#import "CK2FileManager.h"
+#import "CK2LocalFileSource.h"
+#import "CKDeliveryQueue.h"
 
 #import "CK2SFTPSession.h"
 #import "CKWebDAVConnection.h"
@@ -17,6 +19,15 @@
 #import "NSInvocation+Connection.h"
 
 
+@interface CKUploader () <CK2FileManagerDelegate>
+- (void)uploadsDidFinish;
+- (void)cancelStagedUploads;
+@end
+
+
+#pragma mark -
+
+
 @interface CKSFTPUploader : CKUploader <CK2SFTPSessionDelegate, NSURLAuthenticationChallengeSender>
 {
 @private
@@ -119,6 +130,9 @@
     [_connection release];
     [_rootRecord release];
     [_baseRecord release];
+    [_stagedUploads release];
+    [_fileManager setDelegate:nil];
+    [_fileManager release];
     
     [super dealloc];
 }
@@ -171,15 +185,7 @@
     
     
     // Create the directory if it hasn't been already
-    CKTransferRecord *result = nil;
-    for (CKTransferRecord *aRecord in [parent contents])
-    {
-        if ([[aRecord name] isEqualToString:[path lastPathComponent]])
-        {
-            result = aRecord;
-            break;
-        }
-    }
+    CKTransferRecord *result = [parent childWithName:[path lastPathComponent]];
     
     if (!result)
     {
@@ -199,7 +205,8 @@
 {
     [self createDirectoryAtPath:[path stringByDeletingLastPathComponent]];
     
-    if (_options & CKUploadingDeleteExistingFileFirst)
+    // When staging, the existing file has to stay put until it's swapped out
+    if ((_options & CKUploadingDeleteExistingFileFirst) && !(_options & CKUploadingAtomic))
 	{
         [self removeFileAtPath:path];
 	}
@@ -210,6 +217,19 @@
     [_connection deleteFile:path];
 }
 
+- (void)removeDirectoryAtPath:(NSString *)path;
+{
+    // WebDAV deletes collections, contents and all, with the same request as a file
+    if ([(NSObject *)_connection respondsToSelector:@selector(deleteDirectory:)])
+    {
+        [(id <CKConnection>)_connection deleteDirectory:path];
+    }
+    else
+    {
+        [_connection deleteFile:[path stringByAppendingString:@"/"]];
+    }
+}
+
 - (void)didEnqueueUpload:(CKTransferRecord *)record toPath:(NSString *)path
 {
     _hasUploads = YES;
@@ -219,6 +239,12 @@
     
     CKTransferRecord *parent = [self createDirectoryAtPath:[path stringByDeletingLastPathComponent]];
     [parent addContent:record];
+    
+    if (_options & CKUploadingAtomic)
+    {
+        if (!_stagedUploads) _stagedUploads = [[NSMutableArray alloc] init];
+        [_stagedUploads addObject:[NSDictionary dictionaryWithObjectsAndKeys:path, @"path", record, @"record", nil]];
+    }
 }
 
 - (CKTransferRecord *)uploadData:(NSData *)data toPath:(NSString *)path;
@@ -226,7 +252,7 @@
     [self willUploadToPath:path];
     
     CKTransferRecord *result = [_connection uploadData:data
-                                                toPath:path
+                                                toPath:[self stagingPathForPath:path]
                                openingPosixPermissions:[self posixPermissionsForPath:path isDirectory:NO]];
     
     [self didEnqueueUpload:result toPath:path];
@@ -238,7 +264,7 @@
     [self willUploadToPath:path];
     
     CKTransferRecord *result = [_connection uploadFileAtURL:url
-                                                toPath:path
+                                                toPath:[self stagingPathForPath:path]
                                     openingPosixPermissions:[self posixPermissionsForPath:path isDirectory:NO]];
     
     [self didEnqueueUpload:result toPath:path];
@@ -249,7 +275,7 @@
 {
     if (!_hasUploads)   // tell the delegate right away since there's nothing to do
     {
-        [[self delegate] uploaderDidFinishUploading:self];
+        [self uploadsDidFinish];
     }
     
     [_connection disconnect];   // will inform delegate once disconnected
@@ -259,6 +285,242 @@
 {
     [_connection forceDisconnect];
     [_connection setDelegate:nil];
+    [self cancelStagedUploads];
+}
+
+#pragma mark Staging
+
+static NSString * const CKUploaderStagingSuffix = @".ckupload";
+
+- (NSString *)stagingPathForPath:(NSString *)path;
+{
+    if (!(_options & CKUploadingAtomic)) return path;
+    
+    // Stay in the same directory so the rename is cheap and atomic for any sane server, and hidden so the file isn't served up in the meantime
+    NSString *name = [NSString stringWithFormat:@".%@%@", [path lastPathComponent], CKUploaderStagingSuffix];
+    return [[path stringByDeletingLastPathComponent] stringByAppendingPathComponent:name];
+}
+
+- (NSString *)pathForStagingPath:(NSString *)stagingPath;
+{
+    NSString *name = [stagingPath lastPathComponent];
+    if (!(_options & CKUploadingAtomic) || ![name hasPrefix:@"."] || ![name hasSuffix:CKUploaderStagingSuffix]) return stagingPath;
+    
+    name = [name substringWithRange:NSMakeRange(1, [name length] - 1 - [CKUploaderStagingSuffix length])];
+    return [[stagingPath stringByDeletingLastPathComponent] stringByAppendingPathComponent:name];
+}
+
+- (NSURL *)URLForPath:(NSString *)path;
+{
+    return [CK2FileManager URLWithPath:path relativeToURL:[_request URL]];
+}
+
+// Called on the main thread once all uploads are done
+- (void)uploadsDidFinish;
+{
+    NSAssert([NSThread isMainThread], @"CKUploader can only be used on main thread");
+    
+    NSArray *staged = [_stagedUploads autorelease];
+    _stagedUploads = nil;
+    
+    if (![staged count] || (_options & CKUploadingDryRun))
+    {
+        [[self delegate] uploaderDidFinishUploading:self];
+        return;
+    }
+    
+    
+    // Only swap anything in if everything made it up
+    NSError *uploadError = nil;
+    for (NSDictionary *anUpload in staged)
+    {
+        CKTransferRecord *record = [anUpload objectForKey:@"record"];
+        if ([record hasError])
+        {
+            uploadError = [record error];
+            break;
+        }
+    }
+    
+    _fileManager = [[CK2FileManager alloc] init];
+    [_fileManager setDelegate:self];
+    CK2FileManager *fileManager = _fileManager;
+    
+    NSMutableArray *stagingURLs = [NSMutableArray arrayWithCapacity:[staged count]];
+    NSMutableArray *URLs = [NSMutableArray arrayWithCapacity:[staged count]];
+    for (NSDictionary *anUpload in staged)
+    {
+        NSString *path = [anUpload objectForKey:@"path"];
+        [stagingURLs addObject:[self URLForPath:[self stagingPathForPath:path]]];
+        [URLs addObject:[self URLForPath:path]];
+    }
+    
+    // Only call on the main thread
+    void (^finishBlock)(NSError *) = ^(NSError *error) {
+        
+        if (_fileManager != fileManager) return;    // cancelled
+        
+        [_fileManager setDelegate:nil];
+        [_fileManager release]; _fileManager = nil;
+        
+        if (error) [[self delegate] uploader:self didFailWithError:error];
+        [[self delegate] uploaderDidFinishUploading:self];
+    };
+    
+    if (uploadError)
+    {
+        [fileManager removeItemsAtURLs:stagingURLs itemHandler:nil completionHandler:^(NSError *error) {
+            // Cleaning up is best effort
+            dispatch_async(dispatch_get_main_queue(), ^{
+                finishBlock(uploadError);
+            });
+        }];
+        return;
+    }
+    
+    
+    __block NSUInteger outstanding = 0;
+    __block NSError *firstError = nil;
+    
+    void (^itemCompletionBlock)(NSError *) = ^(NSError *error) {
+        
+        // Gather up results on the main thread
+        dispatch_async(dispatch_get_main_queue(), ^{
+            
+            if (error && !firstError) firstError = [error retain];
+            if (--outstanding) return;
+            
+            finishBlock([firstError autorelease]);
+        });
+    };
+    
+    // For servers which won't rename over an existing file. In between the removal and the rename there's nothing at the path, and should the rename then fail the old version is gone; the error says as much, and the new version is left staged
+    void (^replaceBlock)(NSURL *, NSURL *) = ^(NSURL *stagingURL, NSURL *URL) {
+        [fileManager removeItemAtURL:URL completionHandler:^(NSError *removalError) {
+            [fileManager moveItemAtURL:stagingURL toURL:URL completionHandler:^(NSError *error) {
+                
+                if (error && !removalError)
+                {
+                    NSString *description = [NSString stringWithFormat:NSLocalizedString(@"The existing file at %@ was removed, but the new version couldn't be moved into its place. It was left at %@", "error description"),
+                                             [URL path], [stagingURL path]];
+                    
+                    error = [NSError errorWithDomain:NSCocoaErrorDomain
+                                                code:NSFileWriteUnknownError
+                                            userInfo:[NSDictionary dictionaryWithObjectsAndKeys:
+                                                      description, NSLocalizedDescriptionKey,
+                                                      URL, NSURLErrorKey,
+                                                      error, NSUnderlyingErrorKey,
+                                                      nil]];
+                }
+                
+                itemCompletionBlock(error);
+            }];
+        }];
+    };
+    
+    // Not all FTP servers will rename over an existing file. Nor will SFTP servers without the posix-rename extension, including OpenSSH; libcurl has no way to ask for it directly
+    NSString *scheme = [[_request URL] scheme];
+    BOOL canReplace = ((_options & CKUploadingDeleteExistingFileFirst && [scheme hasPrefix:@"ftp"]) ||
+                       [scheme isEqualToString:@"sftp"] ||
+                       [scheme isEqualToString:@"ssh"]);
+    
+    NSDictionary *destinations = [NSDictionary dictionaryWithObjects:URLs forKeys:stagingURLs];
+    NSMutableDictionary *failures = [NSMutableDictionary dictionary];
+    
+    // The renames all go out together, batched up by directory
+    [fileManager moveItemsAtURLs:stagingURLs toURLs:URLs itemHandler:^(NSURL *url, NSError *error) {
+        
+        if (error) [failures setObject:error forKey:url];
+        
+    } completionHandler:^(NSError *error) {
+        
+        // Items have all been reported by now, so failures won't change any more
+        dispatch_async(dispatch_get_main_queue(), ^{
+            
+            if (error || ![failures count])
+            {
+                finishBlock(error);
+                return;
+            }
+            
+            // Group failures by directory, so each only needs listing the once
+            NSMutableArray *directories = [NSMutableArray array];
+            NSMutableDictionary *failedByDirectory = [NSMutableDictionary dictionary];
+            for (NSURL *aURL in stagingURLs)
+            {
+                NSError *itemError = [failures objectForKey:aURL];
+                if (!itemError) continue;
+                
+                if (!canReplace)
+                {
+                    finishBlock(itemError);
+                    return;
+                }
+                
+                NSURL *directory = [aURL URLByDeletingLastPathComponent];
+                NSMutableArray *failed = [failedByDirectory objectForKey:directory];
+                if (!failed)
+                {
+                    failed = [NSMutableArray array];
+                    [failedByDirectory setObject:failed forKey:directory];
+                    [directories addObject:directory];
+                }
+                [failed addObject:aURL];
+            }
+            
+            outstanding = [failures count];
+            
+            for (NSURL *aDirectory in directories)
+            {
+                NSArray *failed = [failedByDirectory objectForKey:aDirectory];
+                
+                [fileManager contentsOfDirectoryAtURL:aDirectory includingPropertiesForKeys:[NSArray array] options:0 completionHandler:^(NSArray *contents, NSError *listingError) {
+                    
+                    NSSet *names = [NSSet setWithArray:[contents valueForKey:@"lastPathComponent"]];
+                    
+                    for (NSURL *aStagingURL in failed)
+                    {
+                        // Only remove the existing file if it's what stopped the rename, i.e. both it and the staged file are still there. Should the rename have failed for some other reason, the live file is best left alone
+                        NSURL *URL = [destinations objectForKey:aStagingURL];
+                        if ([names containsObject:[aStagingURL lastPathComponent]] && [names containsObject:[URL lastPathComponent]])
+                        {
+                            replaceBlock(aStagingURL, URL);
+                        }
+                        else
+                        {
+                            itemCompletionBlock([failures objectForKey:aStagingURL]);
+                        }
+                    }
+                }];
+            }
+        });
+    }];
+}
+
+- (void)cancelStagedUploads;
+{
+    [_stagedUploads release]; _stagedUploads = nil;
+    
+    // Any renames already sent off will run their course, but won't be reported
+    [_fileManager setDelegate:nil];
+    [_fileManager release]; _fileManager = nil;
+}
+
+#pragma mark File Manager Delegate
+
+- (void)fileManager:(CK2FileManager *)manager didReceiveAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge;
+{
+    [[CKDeliveryQueue mainQueue] deliver:^{
+        [self connection:nil didReceiveAuthenticationChallenge:challenge];
+    }];
+}
+
+- (void)fileManager:(CK2FileManager *)manager appendString:(NSString *)info toTranscript:(CKTranscriptType)transcript;
+{
+    id <CKUploaderDelegate> delegate = [self delegate];
+    [[CKDeliveryQueue mainQueue] deliver:^{
+        [delegate uploader:self appendString:info toTranscript:transcript];
+    }];
 }
 
 #pragma mark Connection Delegate
@@ -289,7 +551,7 @@
     // If no uploads, delegate has already been informed. And if so, the connection is unlikely to need to disconnect. But you never know, it might have been connected accidentally
     if (_hasUploads)    
     {
-        [[self delegate] uploaderDidFinishUploading:self];
+        [self uploadsDidFinish];
     }
 }
 
@@ -357,7 +619,7 @@
 
 - (void)connection:(id <CKPublishingConnection>)con uploadDidBegin:(NSString *)remotePath;
 {
-    [[self delegate] uploader:self didBeginUploadToPath:remotePath];
+    [[self delegate] uploader:self didBeginUploadToPath:[self pathForStagingPath:remotePath]];
 }
 
 - (void)connection:(id <CKPublishingConnection>)connection appendString:(NSString *)string toTranscript:(CKTranscriptType)transcript;
@@ -432,7 +694,10 @@
 
 - (void)threaded_finish;
 {
-    [[(id)[self delegate] mainThreadProxy] uploaderDidFinishUploading:self];
+    // Same route as the transfer records report by, so it can't overtake them finishing
+    [[CKDeliveryQueue mainQueue] deliver:^{
+        [self uploadsDidFinish];
+    }];
     
     [_session cancel];
     [_session release]; _session = nil;
@@ -455,6 +720,8 @@
     // Clear out ivars, the actual objects will get torn down as the queue finishes its work
     [_queue release]; _queue = nil;
     [_session release]; _session = nil;
+    
+    [self cancelStagedUploads];
 }
 
 - (void)dealloc;
@@ -492,7 +759,7 @@
         
         NSInvocation *invocation = [NSInvocation invocationWithSelector:@selector(threaded_writeData:toPath:transferRecord:)
                                                                  target:self
-                                                              arguments:[NSArray arrayWithObjects:data, path, result, nil]];
+                                                              arguments:[NSArray arrayWithObjects:data, [self stagingPathForPath:path], result, nil]];
         
         NSInvocationOperation *op = [[NSInvocationOperation alloc] initWithInvocation:invocation];
         [_queue addOperation:op];
@@ -525,7 +792,7 @@
             
             
             NSOperation *op = [[CKWriteContentsOfURLToSFTPHandleOperation alloc] initWithURL:localURL
-                                                                                        path:path
+                                                                                        path:[self stagingPathForPath:path]
                                                                                     uploader:self
                                                                               transferRecord:result];
             [_queue addOperation:op];
@@ -546,6 +813,13 @@
     }];
 }
 
+- (void)removeDirectoryAtPath:(NSString *)path;
+{
+    [_queue addOperationWithBlock:^{
+        [[self SFTPSession] removeDirectoryAtPath:path error:NULL];
+    }];
+}
+
 - (BOOL)threaded_createDirectoryAtPath:(NSString *)path error:(NSError **)outError;
 {
     CK2SFTPSession *sftpSession = [self SFTPSession];
@@ -632,7 +906,11 @@
     
     if (result)
     {
-        [[(id)[self delegate] mainThreadProxy] uploader:self didBeginUploadToPath:path];
+        id <CKUploaderDelegate> delegate = [self delegate];
+        NSString *publishedPath = [self pathForStagingPath:path];
+        [[CKDeliveryQueue mainQueue] deliver:^{
+            [delegate uploader:self didBeginUploadToPath:publishedPath];
+        }];
     }
     
     return result;
@@ -648,7 +926,7 @@
     
     if (handle)
     {
-        [[self mainThreadProxy] transferDidBegin:record];
+        [record threaded_transferDidBegin];
         
         BOOL result = [handle writeData:data error:&error];
         [handle closeFile];         // don't really care if this fails
@@ -662,14 +940,7 @@
         if (!result) handle = nil;  // so error gets sent
     }
     
-    [[record mainThreadProxy] transferDidFinish:record
-                                                                error:(handle ? nil : error)];
-}
-
-- (void)transferDidBegin:(CKTransferRecord *)record;
-{
-    [record transferDidBegin:record];
-    //[[self delegate] publishingEngine:self didBeginUploadToPath:[record path]];
+    [record threaded_transferDidFinishWithError:(handle ? nil : error)];
 }
 
 #pragma mark SFTP session
@@ -683,7 +954,9 @@
 
 - (void)SFTPSession:(CK2SFTPSession *)session didFailWithError:(NSError *)error;
 {
-    [[self mainThreadProxy] connection:nil didReceiveError:error];
+    [[CKDeliveryQueue mainQueue] deliver:^{
+        [self connection:nil didReceiveError:error];
+    }];
 }
 
 - (void)SFTPSession:(CK2SFTPSession *)session didReceiveAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge;
@@ -701,20 +974,27 @@
     _challenge = [challenge retain];
     
     _mainThreadChallenge = [[NSURLAuthenticationChallenge alloc] initWithAuthenticationChallenge:challenge sender:self];
-    [[self mainThreadProxy] connection:nil didReceiveAuthenticationChallenge:_mainThreadChallenge];
+    NSURLAuthenticationChallenge *mainThreadChallenge = _mainThreadChallenge;
+    [[CKDeliveryQueue mainQueue] deliver:^{
+        [self connection:nil didReceiveAuthenticationChallenge:mainThreadChallenge];
+    }];
     [_mainThreadChallenge release]; // delegate will hold onto it we hope!
 }
 
 - (void)SFTPSession:(CK2SFTPSession *)session didCancelAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge;
 {
-    [[self mainThreadProxy] connection:nil didCancelAuthenticationChallenge:_mainThreadChallenge];
+    NSURLAuthenticationChallenge *mainThreadChallenge = _mainThreadChallenge;
+    [[CKDeliveryQueue mainQueue] deliver:^{
+        [self connection:nil didCancelAuthenticationChallenge:mainThreadChallenge];
+    }];
 }
 
 - (void)SFTPSession:(CK2SFTPSession *)session appendStringToTranscript:(NSString *)string received:(BOOL)received;
 {
-    [[(NSObject *)[self delegate] mainThreadProxy] uploader:self
-                                               appendString:string
-                                               toTranscript:(received ? CKTranscriptReceived : CKTranscriptSent)];
+    id <CKUploaderDelegate> delegate = [self delegate];
+    [[CKDeliveryQueue mainQueue] deliver:^{
+        [delegate uploader:self appendString:string toTranscript:(received ? CKTranscriptReceived : CKTranscriptSent)];
+    }];
 }
 
 #pragma mark NSURLAuthenticationChallengeSender
@@ -790,24 +1070,49 @@
 
 - (void)main
 {
-    NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath:[_URL path]];
+    // Map the file so each chunk written is a slice of the mapping, rather than freshly read into a new buffer
+    CK2LocalFileSource *source = [[CK2LocalFileSource alloc] initWithURL:_URL error:NULL];
+    NSFileHandle *handle = (source ? nil : [NSFileHandle fileHandleForReadingAtPath:[_URL path]]);
     
-    if (handle)
+    if (source || handle)
     {
         NSError *error;
         CK2SFTPFileHandle *sftpHandle = [_engine threaded_openHandleAtPath:_path error:&error];
         
         if (sftpHandle)
         {
-            [[_engine mainThreadProxy] transferDidBegin:_record];
+            [_record threaded_transferDidBegin];
             
+            unsigned long long offset = 0;
             while (YES)
             {
                 NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
                 {{
                     if ([self isCancelled]) break;
                     
-                    NSData *data = [handle readDataOfLength:CK2SFTPPreferredChunkSize];
+                    NSData *data;
+                    if (source)
+                    {
+                        NSUInteger length = (NSUInteger)MIN([source length] - offset, CK2SFTPPreferredChunkSize);
+                        data = [source dataWithRange:NSMakeRange((NSUInteger)offset, length)];
+                        offset += length;
+                        
+                        // The file's been truncated since it was mapped
+                        if (!data)
+                        {
+                            [sftpHandle closeFile];
+                            sftpHandle = nil;   // so error gets sent
+                            error = [[NSError alloc] initWithDomain:NSPOSIXErrorDomain code:EIO userInfo:@{ NSURLErrorKey : _URL }];
+                            [pool release];
+                            [error autorelease];
+                            break;
+                        }
+                    }
+                    else
+                    {
+                        data = [handle readDataOfLength:CK2SFTPPreferredChunkSize];
+                    }
+                    
                     if (![data length]) break;
                     if ([self isCancelled]) break;
                     
@@ -823,7 +1128,7 @@
                         break;
                     }
                     
-                    [[_record mainThreadProxy] transfer:_record transferredDataOfLength:[data length]];
+                    [_record threaded_transferredDataOfLength:[data length]];
                 }}
                 [pool release];
             }
@@ -844,12 +1149,14 @@
             if (!result) sftpHandle = nil;
         }
         
-        [[_record mainThreadProxy] transferDidFinish:_record error:(sftpHandle ? nil : error)];
+        [_record threaded_transferDidFinishWithError:(sftpHandle ? nil : error)];
     }
     else
     {
-        [[_record mainThreadProxy] transferDidFinish:_record error:nil];
+        [_record threaded_transferDidFinishWithError:nil];
     }
+    
+    [source release];
 }
 
 @end
@@ -879,7 +1186,7 @@
 - (void)finishUploading;
 {
     [self addOperation:[NSBlockOperation blockOperationWithBlock:^{
-        [[self delegate] uploaderDidFinishUploading:self];
+        [self uploadsDidFinish];
     }]];
 }
 
@@ -897,6 +1204,7 @@
 {
     [self cancelCurrentOperation];
     [_queue release]; _queue = nil;
+    [self cancelStagedUploads];
 }
 
 - (void)dealloc;
@@ -941,7 +1249,7 @@
         [_inputStream scheduleInRunLoop:[NSRunLoop currentRunLoop] forMode:NSRunLoopCommonModes];
         [_inputStream open];
         
-        NSURL *outputURL = [CK2FileManager URLWithPath:path relativeToURL:_baseURL];
+        NSURL *outputURL = [CK2FileManager URLWithPath:[self stagingPathForPath:path] relativeToURL:_baseURL];
         [_URLForWritingTo release]; _URLForWritingTo = [outputURL copy];
         [self setupOutputStream];
         
@@ -49,6 +49,8 @@ typedef unsigned int   NSUInteger;
 
 #import <Connection/CK2FileManager.h>
 #import <Connection/CK2Authentication.h>
+#import <Connection/CK2FileOperationMetrics.h>
+#import <Connection/CK2Transcript.h>
 
 #import <Cocoa/Cocoa.h>
 
@@ -61,12 +63,15 @@ typedef unsigned int   NSUInteger;
 
 #import <Connection/CKConnectionOpenPanel.h>
 #import <Connection/RunLoopForwarder.h>
+#import <Connection/CKDeliveryQueue.h>
 #import <Connection/NSData+Connection.h>
+#import <Connection/CKBase64.h>
 #import <Connection/NSString+Connection.h>
 #import <Connection/NSPopUpButton+Connection.h>
 #import <Connection/NSTabView+Connection.h>
 
 #import <Connection/CKUploader.h>
+#import <Connection/CKFolderPublisher.h>
 #import <Connection/CKTransferRecord.h>
 #import <Connection/CKTransferProgressCell.h>
 
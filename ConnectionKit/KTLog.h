@@ -34,9 +34,13 @@
 extern NSString *KTLogKeyPrefix;
 extern NSString *KTLogWildcardDomain;
 
+// The chattiest level switched on for any domain. Kept up to date by the logger
+extern NSInteger KTLogHighestEnabledLevel;
+
 // This is the main logging function / macro
+// Checks the level inline first, so a statement chattier than anything switched on costs a comparison, and doesn't even evaluate its arguments
 
-#define KTLog(d, l, s, args...) [KTLogger logFile:__FILE__ lineNumber:__LINE__ loggingDomain:(d) loggingLevel:(l) format:(s) , ##args];
+#define KTLog(d, l, s, args...) do { if ((l) <= KTLogHighestEnabledLevel) [KTLogger logFile:__FILE__ lineNumber:__LINE__ loggingDomain:(d) loggingLevel:(l) format:(s) , ##args]; } while (0)
 
 /*
 	KTLog writes the log information to ~/Library/Logs/processName.ktlog
@@ -67,8 +71,15 @@ typedef enum {
 
 @interface KTLogger : NSObject <NSTableViewDataSource>
 {
-	NSLock			*myLock;
-	NSFileHandle	*myLog;
+	NSLock			*myLock;	// guards the logging levels; logging itself never takes it
+	
+	// Entries are pushed onto a lock-free list by the logging threads, and picked up in batches by a writer on a background queue
+	void * volatile		myPendingRecords;
+	dispatch_queue_t	myWriterQueue;
+	dispatch_source_t	myWriterSource;
+	int					myLogDescriptor;
+	unsigned long long	myLogSize;
+	NSMutableDictionary	*myInternedStrings;	// numbers of the domains and filenames already written to the current log
 	
 	NSMutableArray *myLoggingLevels;
 	
@@ -86,10 +97,14 @@ typedef enum {
 
 + (void)logFile:(char *)file lineNumber:(NSInteger)line loggingDomain:(NSString *)domain loggingLevel:(NSInteger)level format:(NSString *)log, ... NS_FORMAT_FUNCTION(5, 6);
 
+// Entries come back as dictionaries, the same as passed to the delegate. Decoded lazily as the array is accessed, so even big logs are quick to open
 + (NSArray *)entriesWithLogFile:(NSString *)file;
 
+// Entries are written out in the background. Blocks until everything logged so far has been written. Does nothing when called from the delegate
++ (void)flush;
+
 // Allow to be called back when something is logged - useful for in application display of the log in real time
-// we do retain the delegate
+// we do retain the delegate. It is called on the logger's background writer queue, not the thread that logged the entry nor the main thread, one entry at a time in the order they were logged. Anything touching the UI has to hop over to the main thread itself
 + (void)setDelegate:(id)delegate;
 
 + (void)configure:(id)sender;
@@ -101,6 +116,44 @@ typedef enum {
 
 @end
 
+
+// Random access to a log file. The file is mapped into memory, and opening it only steps over each record's fixed-size header, noting down where every so many entries start. Entries are decoded as they're asked for.
+// Should the log be cut short while open, the reader starts over with what's left, so the count can go down.
+// Not threadsafe; use a reader from one thread at a time
+@interface KTLogReader : NSObject
+{
+	int					myDescriptor;		// kept open to check the file is still as long as the mapping
+	const char			*myBytes;
+	size_t				myLength;
+	size_t				myValidLength;
+	
+	NSUInteger			myCount;
+	NSMutableData		*myIndex;			// KTLogIndexBlock per so many entries
+	NSMutableData		*myStringOffsets;	// by string number
+	NSMutableDictionary	*myStrings;			// decoded so far
+	NSMutableDictionary	*myStringNumbers;	// the reverse, built the first time a string is looked up
+	
+	NSUInteger			myCursorIndex;		// where the last lookup ended up, so stepping through in order is cheap
+	size_t				myCursorOffset;
+}
+
+// Returns nil if the file isn't a log, or was written by an older version of KTLog
+- (id)initWithContentsOfFile:(NSString *)path;
+
+- (NSUInteger)count;
+- (NSDictionary *)entryAtIndex:(NSUInteger)index;	// same keys as the delegate gets
+
+// Entries are in the order they were logged, which is as good as chronological. NSNotFound if everything is earlier
+- (NSUInteger)indexOfFirstEntryOnOrAfterDate:(NSDate *)date;
+
+// Entries at the level or lower (i.e. as or more important). Pass nil for any domain
+- (NSIndexSet *)indexesOfEntriesWithLevelAtMost:(NSInteger)level domain:(NSString *)domain;
+
+// Array wrapping the reader, decoding each entry on access
+- (NSArray *)entries;
+
+@end
+
 @interface NSObject (KTLogDelegate)
 - (void)logger:(KTLogger *)logger logged:(NSDictionary *)entry;
 @end
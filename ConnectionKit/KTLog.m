@@ -29,16 +29,130 @@
 
 #import "KTLog.h"
 #import <stdarg.h>
+#include <fcntl.h>
+#include <libkern/OSAtomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// An entry on its way to the writer
+typedef struct KTLogRecord {
+	struct KTLogRecord	*next;
+	CFAbsoluteTime		time;
+	NSInteger			line;
+	NSInteger			level;
+	NSString			*domain;
+	NSString			*message;
+	void				*thread;
+	char				file[];
+} KTLogRecord;
+
+// Most batches are a handful of entries, but it's worth having room up front for a busy spell
+#define kKTLogBatchCapacity (64 * 1024)
+
+/*
+	Log files are a short header followed by a run of records, all little-endian. Every record starts with its length
+	and kind, so readers can step over kinds they don't know about, and is padded out to a multiple of 8 bytes, so the
+	fixed part of each can be read straight out of a mapped file.
+ 
+	Domains and filenames are interned: the first time one crops up in a file, it's written out as a string record, and
+	entries then refer to it by number. Numbers count up from 1, so 0 means none.
+ */
+
+#define KTLogFileMagic		"KTLG"
+#define KTLogFileVersion	1
+#define KTLogFileAlignment	8
+
+typedef struct {
+	char		magic[4];
+	uint16_t	version;
+	uint16_t	headerLength;	// the first record follows this many bytes in, leaving room for the header to grow
+	int64_t		created;		// microseconds since the reference date
+} KTLogFileHeader;
+
+enum {
+	KTLogFileStringKind = 1,
+	KTLogFileEntryKind = 2,
+};
+
+typedef struct {
+	uint32_t	length;			// of the whole record, including this header and padding
+	uint8_t		kind;
+	uint8_t		level;			// entries only
+	uint16_t	reserved;
+} KTLogFileRecordHeader;
+
+typedef struct {
+	KTLogFileRecordHeader	header;
+	uint32_t				number;
+	uint32_t				length;		// of the UTF-8 following
+} KTLogFileString;
+
+typedef struct {
+	KTLogFileRecordHeader	header;
+	int64_t					time;		// microseconds since the reference date
+	uint64_t				thread;
+	uint32_t				line;
+	uint32_t				domain;
+	uint32_t				file;
+	uint32_t				messageLength;	// of the UTF-8 following
+} KTLogFileEntry;
+
+// Readers keep one of these for every so many entries, which is enough to get to any entry quickly, and to skip over whole stretches of the file when searching
+#define KTLogIndexSpacing 64
+
+typedef struct {
+	uint64_t	offset;		// of the first entry
+	int64_t		latest;		// time of the latest entry
+	uint64_t	domains;	// bit (number % 64) set for each domain with an entry
+	uint32_t	levels;		// bit set for each level with an entry
+	uint32_t	reserved;
+} KTLogIndexBlock;
+
+static int64_t KTLogFileTime(CFAbsoluteTime time)
+{
+	return (int64_t)llround(time * USEC_PER_SEC);
+}
+
+static NSDate *KTLogFileDate(int64_t time)
+{
+	return [NSDate dateWithTimeIntervalSinceReferenceDate:(double)CFSwapInt64LittleToHost(time) / USEC_PER_SEC];
+}
+
+// Fills in the record's length, and appends it to the data followed by the variable-length bytes and padding
+static void KTLogAppendRecord(NSMutableData *data, void *record, size_t recordLength, const void *bytes, size_t length)
+{
+	size_t total = (recordLength + length + KTLogFileAlignment - 1) & ~(size_t)(KTLogFileAlignment - 1);
+	((KTLogFileRecordHeader *)record)->length = CFSwapInt32HostToLittle((uint32_t)total);
+	
+	[data appendBytes:record length:recordLength];
+	[data appendBytes:bytes length:length];
+	[data increaseLengthBy:total - recordLength - length];
+}
 
 @interface KTLogger (Private)
 
 - (id)init;
 + (instancetype)sharedLogger;
 - (void)logFile:(char *)file lineNumber:(NSInteger)line loggingDomain:(NSString *)domain loggingLevel:(NSInteger)level message:(NSString *)log;
+- (void)writePendingRecords;
+- (BOOL)openLog;
 - (void)setLoggingLevel:(KTLoggingLevel)level forDomain:(NSString *)domain;
 
 @end
 
+@interface KTLogReader (Private)
+- (size_t)validLength;
+- (NSArray *)internedStrings;
+@end
+
+// Hands out the reader's entries on demand
+@interface KTLogEntries : NSArray
+{
+	KTLogReader	*myReader;
+}
+- (id)initWithReader:(KTLogReader *)reader;
+@end
+
 NSString *KTLogKeyPrefix = @"KTLoggingLevel.";
 NSString *KTLogWildcardDomain = @"*";
 
@@ -47,6 +161,23 @@ static unsigned long long KTLogMaximumLogSize = 5242880; // 5MB
 static BOOL KTLogToConsole = YES;
 static id _loggingDelegate = nil;
 
+static void KTLogFlushAtExit(void);
+
+// Set on the writer queue, so the logger can tell when it's being called from there
+static char KTLogWriterQueueKey;
+
+// How long to wait for the writer at exit. It may be stuck behind something the exiting thread was meant to do, such as a delegate waiting on the main thread
+#define KTLogExitFlushTimeout (2 * NSEC_PER_SEC)
+
+// Until the logger has loaded the levels, let everything through to the full check
+NSInteger KTLogHighestEnabledLevel = KTLogDebug;
+
+// Levels as configured in the user defaults, and the resulting threshold for each domain that's been logged to. Rebuilt whenever the defaults change
+static OSSpinLock KTLogLevelsLock = OS_SPINLOCK_INIT;
+static NSDictionary *KTLogConfiguredLevels = nil;
+static NSInteger KTLogWildcardLevel = KTLogOff;
+static CFMutableDictionaryRef KTLogThresholds = NULL;
+
 static NSString *KTLevelMap[] = {
 	@"Off",
 	@"FATAL",
@@ -61,10 +192,11 @@ static NSString *KTLevelMap[] = {
 
 + (instancetype)sharedLogger
 {
-	if (nil == _sharedLogger)
-	{
+	// Logging happens on all sorts of threads, so make sure only one logger ever gets created
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
 		_sharedLogger = [[KTLogger alloc] init];
-	}
+	});
 	return _sharedLogger;
 }
 
@@ -73,6 +205,7 @@ static NSString *KTLevelMap[] = {
 	if ((self = [super init]))
 	{
 		myLock = [[NSLock alloc] init];
+		myInternedStrings = [[NSMutableDictionary alloc] init];
 		myLoggingLevels = [[NSMutableArray array] retain];
 		// load in from user defaults
 		NSUserDefaults *ud = [NSUserDefaults standardUserDefaults];
@@ -101,6 +234,25 @@ static NSString *KTLevelMap[] = {
 		{
 			KTLogMaximumLogSize = [size unsignedLongLongValue];
 		}
+		
+		KTLogThresholds = CFDictionaryCreateMutable(NULL, 0, &kCFCopyStringDictionaryKeyCallBacks, NULL);
+		[self reloadLoggingLevels];
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(userDefaultsDidChange:)
+													 name:NSUserDefaultsDidChangeNotification
+												   object:nil];
+		
+		myLogDescriptor = -1;
+		myWriterQueue = dispatch_queue_create("com.karelia.ktlog.writer", NULL);
+		dispatch_queue_set_specific(myWriterQueue, &KTLogWriterQueueKey, &KTLogWriterQueueKey, NULL);
+		myWriterSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_OR, 0, 0, myWriterQueue);
+		dispatch_source_set_event_handler(myWriterSource, ^{
+			[self writePendingRecords];
+		});
+		dispatch_resume(myWriterSource);
+		
+		// Don't lose whatever's still queued up when the app quits
+		atexit(KTLogFlushAtExit);
 	}
 	return self;
 }
@@ -137,6 +289,73 @@ static NSString *KTLevelMap[] = {
 	[[KTLogger sharedLogger] setLoggingLevel:level forDomain:domain];
 }
 
+#pragma mark -
+#pragma mark Levels
+
+- (void)reloadLoggingLevels
+{
+	NSDictionary *defaults = [[NSUserDefaults standardUserDefaults] dictionaryRepresentation];
+	NSMutableDictionary *levels = [[NSMutableDictionary alloc] init];
+	NSInteger highest = DEFAULT_LEVEL;
+	NSEnumerator *e = [defaults keyEnumerator];
+	NSString *key;
+	
+	while ((key = [e nextObject]))
+	{
+		if ([key hasPrefix:KTLogKeyPrefix])
+		{
+			id level = [defaults objectForKey:key];
+			if ([level respondsToSelector:@selector(integerValue)])
+			{
+				[levels setObject:[NSNumber numberWithInteger:[level integerValue]]
+						   forKey:[key substringFromIndex:[KTLogKeyPrefix length]]];
+				highest = MAX(highest, [level integerValue]);
+			}
+		}
+	}
+	
+	NSNumber *wildcard = [levels objectForKey:KTLogWildcardDomain];
+	
+	OSSpinLockLock(&KTLogLevelsLock);
+	NSDictionary *oldLevels = KTLogConfiguredLevels;
+	KTLogConfiguredLevels = levels;
+	KTLogWildcardLevel = (wildcard ? [wildcard integerValue] : KTLogOff);	// wildcard defaults to off
+	CFDictionaryRemoveAllValues(KTLogThresholds);
+	KTLogHighestEnabledLevel = highest;
+	OSSpinLockUnlock(&KTLogLevelsLock);
+	
+	[oldLevels release];
+}
+
+- (void)userDefaultsDidChange:(NSNotification *)notification
+{
+	[self reloadLoggingLevels];
+}
+
+// Statements at the returned level or below are logged. Worked out the first time a domain is logged to, and looked up from then on
+static NSInteger KTLogThresholdForDomain(NSString *domain)
+{
+	NSInteger result;
+	
+	OSSpinLockLock(&KTLogLevelsLock);
+	
+	const void *value;
+	if (domain && CFDictionaryGetValueIfPresent(KTLogThresholds, domain, &value))
+	{
+		result = (NSInteger)(intptr_t)value;
+	}
+	else
+	{
+		NSNumber *level = (domain ? [KTLogConfiguredLevels objectForKey:domain] : nil);
+		result = MAX(KTLogWildcardLevel, (level ? [level integerValue] : DEFAULT_LEVEL));
+		if (domain) CFDictionarySetValue(KTLogThresholds, domain, (const void *)(intptr_t)result);
+	}
+	
+	OSSpinLockUnlock(&KTLogLevelsLock);
+	
+	return result;
+}
+
 - (NSMutableDictionary *)recordForDomain:(NSString *)domain
 {
 	NSEnumerator *e = [myLoggingLevels objectEnumerator];
@@ -217,9 +436,11 @@ static NSString *KTLevelMap[] = {
 	NSString *logPath = [[NSString stringWithFormat:@"%@", NSHomeDirectory()] stringByAppendingPathComponent:@"Library/Logs/"];
 	NSFileManager *fm = [NSFileManager defaultManager];
 
-	[myLog closeFile];
-	[myLog release];
-	myLog = nil;
+	if (myLogDescriptor != -1)
+	{
+		close(myLogDescriptor);
+		myLogDescriptor = -1;
+	}
 	
 	NSString *processName = [[NSProcessInfo processInfo] processName];
 	NSInteger i = 0;
@@ -250,81 +471,291 @@ static NSString *KTLevelMap[] = {
 }
 
 
-// Support for logFile: ... assumes that lock has been acquired.
-- (void)_logFile:(char *)file
-	  lineNumber:(NSInteger)line
-   loggingDomain:(NSString *)domain
-	loggingLevel:(NSInteger)level
-		  thread:(NSString *)thread
-		 message:(NSString *)log
-{
-	NSDate *now = [NSDate date];
-	NSString *filename = [NSString stringWithCString:file
-                                            encoding:CFStringConvertEncodingToNSStringEncoding(CFStringGetSystemEncoding())];
-	NSNumber *lineNumber = [NSNumber numberWithInt:line];
-	NSNumber *thisLevel = [NSNumber numberWithInt:level];
-
-	NSDictionary *rec = [NSDictionary dictionaryWithObjectsAndKeys:now, @"t", filename, @"f", lineNumber, @"n", thisLevel, @"l", domain, @"d", log, @"m", thread, @"th", nil];
-	NSData *recData = [NSArchiver archivedDataWithRootObject:rec];
+#pragma mark -
+#pragma mark Writing
 
-	if (!myLog)
+// Called on the logging thread. Everything beyond the level check and formatting the message is left to the writer
+- (void)enqueueRecordForFile:(char *)file
+				  lineNumber:(NSInteger)line
+			   loggingDomain:(NSString *)domain
+				loggingLevel:(NSInteger)level
+					 message:(NSString *)log
+{
+	// Copy the filename in alongside, so the whole record is a single allocation
+	size_t fileLength = strlen(file) + 1;
+	KTLogRecord *record = malloc(sizeof(KTLogRecord) + fileLength);
+	memcpy(record->file, file, fileLength);
+	
+	record->time = CFAbsoluteTimeGetCurrent();
+	record->line = line;
+	record->level = level;
+	record->domain = [domain copy];
+	record->message = [log copy];
+	record->thread = [NSThread currentThread];	// only ever formatted with %p, so no need to retain
+	
+	// Lock-free push onto the pending list
+	KTLogRecord *head;
+	do
 	{
-		// need to get the log file handle
-		myLog = [[NSFileHandle fileHandleForWritingAtPath:[self logfileName]] retain];
+		head = myPendingRecords;
+		record->next = head;
 	}
+	while (!OSAtomicCompareAndSwapPtrBarrier(head, record, &myPendingRecords));
+	
+	// Wakes the writer, coalescing with any other wake-ups that haven't been handled yet
+	dispatch_source_merge_data(myWriterSource, 1);
+}
 
-	[myLog seekToEndOfFile];
-
-	unsigned len = CFSwapInt32HostToLittle([recData length]);
-	NSMutableData *entry = [NSMutableData data];
-	[entry appendBytes:&len length:sizeof(unsigned)];
-	[entry appendData:recData];
+// Only call on the writer queue. Opens the log ready for appending, carrying on from whatever an earlier run wrote to it
+- (BOOL)openLog
+{
+	if (myLogDescriptor != -1) return YES;
+	
+	NSString *path = [self logfileName];
+	[myInternedStrings removeAllObjects];
+	
+	myLogDescriptor = open([path fileSystemRepresentation], O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if (myLogDescriptor == -1) return NO;
+	
+	// From here on the size is tracked in memory, rather than stat-ing the file after every write
+	struct stat info;
+	myLogSize = (fstat(myLogDescriptor, &info) == 0 ? info.st_size : 0);
+	
+	if (myLogSize > 0)
+	{
+		KTLogReader *reader = [[KTLogReader alloc] initWithContentsOfFile:path];
+		if (reader)
+		{
+			NSArray *strings = [reader internedStrings];
+			NSUInteger i;
+			for (i = 0; i < [strings count]; i++)
+			{
+				[myInternedStrings setObject:[NSNumber numberWithUnsignedInteger:i + 1] forKey:[strings objectAtIndex:i]];
+			}
+			
+			// Lop off anything half-written by a crash, so new entries follow straight on from the last good one
+			if ([reader validLength] < myLogSize && ftruncate(myLogDescriptor, [reader validLength]) == 0)
+			{
+				myLogSize = [reader validLength];
+			}
+			
+			[reader release];
+			return YES;
+		}
+		
+		// An older format, so move it out of the way and start afresh. Should that fail, there's little choice but to overwrite it
+		[self rotateLogs];
+		myLogDescriptor = open([path fileSystemRepresentation], O_WRONLY | O_APPEND | O_CREAT | O_TRUNC, 0644);
+		if (myLogDescriptor == -1) return NO;
+		myLogSize = 0;
+	}
+	
+	KTLogFileHeader header;
+	memcpy(header.magic, KTLogFileMagic, sizeof(header.magic));
+	header.version = CFSwapInt16HostToLittle(KTLogFileVersion);
+	header.headerLength = CFSwapInt16HostToLittle(sizeof(header));
+	header.created = CFSwapInt64HostToLittle(KTLogFileTime(CFAbsoluteTimeGetCurrent()));
+	
+	return [self writeData:[NSData dataWithBytes:&header length:sizeof(header)]];
+}
 
-	[myLog writeData:entry];
+// Only call on the writer queue, after opening the log. Adds a string record to the batch the first time a string is seen in the log
+- (uint32_t)internString:(NSString *)string intoBatch:(NSMutableData *)batch
+{
+	if (!string) return 0;
+	
+	NSNumber *number = [myInternedStrings objectForKey:string];
+	if (number) return [number unsignedIntValue];
+	
+	uint32_t result = (uint32_t)[myInternedStrings count] + 1;
+	[myInternedStrings setObject:[NSNumber numberWithUnsignedInt:result] forKey:string];
+	
+	NSData *utf8 = [string dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:YES];
+	KTLogFileString record = { { 0 } };
+	record.header.kind = KTLogFileStringKind;
+	record.number = CFSwapInt32HostToLittle(result);
+	record.length = CFSwapInt32HostToLittle((uint32_t)[utf8 length]);
+	KTLogAppendRecord(batch, &record, sizeof(record), [utf8 bytes], [utf8 length]);
+	
+	return result;
+}
 
-	if (KTLogToConsole)
+- (BOOL)writeData:(NSData *)data
+{
+	if (![self openLog]) return NO;
+	
+	const char *bytes = [data bytes];
+	NSUInteger remaining = [data length];
+	while (remaining > 0)
 	{
-		NSProcessInfo *pi = [NSProcessInfo processInfo];
-		NSString *processName = [pi processName];
-		NSString *nowDescription = [now descriptionWithCalendarFormat:@"%Y-%m-%d %H:%M:%S.%F"
-															 timeZone:nil
-															   locale:nil];
-		NSString *logLevelString = (level >= 0 && level <= 5) ? KTLevelMap[level] : @"UNKNOWN";
+		ssize_t written = write(myLogDescriptor, bytes, remaining);
+		if (written < 0)
+		{
+			if (errno == EINTR) continue;
+			
+			// Strings interned in this batch might not have made it, so later entries can't refer to them. Opening the log afresh lops off whatever part did get written, and picks up only the strings that are actually there
+			close(myLogDescriptor);
+			myLogDescriptor = -1;
+			return NO;
+		}
 		
-		NSString *console = [NSString stringWithFormat:@"%@ %@[%d][%@:%@][%@:%ld] %@\n",
-			nowDescription, processName, [pi processIdentifier], logLevelString, domain,
-			[filename lastPathComponent], (long) line, log];
-		const char *utf8String = [console UTF8String];
-		fprintf(stderr, "%s", utf8String);
+		bytes += written;
+		remaining -= written;
+		myLogSize += written;
+	}
+	
+	return YES;
+}
+
+// Only call on the writer queue
+- (void)writePendingRecords
+{
+	// Take the whole list in one go. It was built newest first, so reverse it back into order
+	KTLogRecord *list;
+	do
+	{
+		list = myPendingRecords;
 	}
+	while (!OSAtomicCompareAndSwapPtrBarrier(list, NULL, &myPendingRecords));
 	
-	if (_loggingDelegate)
+	KTLogRecord *record = NULL;
+	while (list)
 	{
-		[_loggingDelegate logger:self logged:rec];
+		KTLogRecord *next = list->next;
+		list->next = record;
+		record = list;
+		list = next;
 	}
-	NSDictionary *logAttribs = [[NSFileManager defaultManager] attributesOfItemAtPath:[self logfileName] error:NULL];
-	if ([[logAttribs objectForKey:NSFileSize] unsignedLongLongValue] > KTLogMaximumLogSize)
+	
+	if (!record) return;
+	
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	NSMutableData *batch = [[NSMutableData alloc] initWithCapacity:kKTLogBatchCapacity];
+	NSMutableString *console = (KTLogToConsole ? [[NSMutableString alloc] init] : nil);
+	NSProcessInfo *pi = [NSProcessInfo processInfo];
+	
+	// Interned strings have to go in the same file as the entry, so make sure that's ready first. Should it not open, the numbers would mean nothing, so the entries only go to the console and delegate
+	BOOL logging = [self openLog];
+	
+	while (record)
 	{
-		[self rotateLogs];
+		NSDate *time = [NSDate dateWithTimeIntervalSinceReferenceDate:record->time];
+		NSString *filename = [NSString stringWithCString:record->file
+												encoding:CFStringConvertEncodingToNSStringEncoding(CFStringGetSystemEncoding())];
+		
+		if (logging)
+		{
+			NSData *message = [record->message dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:YES];
+			KTLogFileEntry entry = { { 0 } };
+			entry.header.kind = KTLogFileEntryKind;
+			entry.header.level = (uint8_t)MIN(MAX(record->level, 0), UINT8_MAX);
+			entry.time = CFSwapInt64HostToLittle(KTLogFileTime(record->time));
+			entry.thread = CFSwapInt64HostToLittle((uint64_t)(uintptr_t)record->thread);
+			entry.line = CFSwapInt32HostToLittle((uint32_t)record->line);
+			entry.domain = CFSwapInt32HostToLittle([self internString:record->domain intoBatch:batch]);
+			entry.file = CFSwapInt32HostToLittle([self internString:filename intoBatch:batch]);
+			entry.messageLength = CFSwapInt32HostToLittle((uint32_t)[message length]);
+			KTLogAppendRecord(batch, &entry, sizeof(entry), [message bytes], [message length]);
+		}
+		
+		if (console)
+		{
+			NSString *nowDescription = [time descriptionWithCalendarFormat:@"%Y-%m-%d %H:%M:%S.%F"
+																  timeZone:nil
+																	locale:nil];
+			NSString *logLevelString = (record->level >= 0 && record->level <= 5) ? KTLevelMap[record->level] : @"UNKNOWN";
+			
+			[console appendFormat:@"%@ %@[%d][%@:%@][%@:%ld] %@\n",
+			 nowDescription, [pi processName], [pi processIdentifier], logLevelString, record->domain,
+			 [filename lastPathComponent], (long) record->line, record->message];
+		}
+		
+		if (_loggingDelegate)
+		{
+			NSDictionary *rec = [NSDictionary dictionaryWithObjectsAndKeys:
+								 time, @"t",
+								 filename, @"f",
+								 [NSNumber numberWithInteger:record->line], @"n",
+								 [NSNumber numberWithInteger:record->level], @"l",
+								 record->domain, @"d",
+								 record->message, @"m",
+								 [NSString stringWithFormat:@"%p", record->thread], @"th", nil];
+			[_loggingDelegate logger:self logged:rec];
+		}
+		
+		// Rotate at the same point as if the entries had been written one at a time
+		if (logging && myLogSize + [batch length] > KTLogMaximumLogSize)
+		{
+			[self writeData:batch];
+			[batch setLength:0];
+			[self rotateLogs];
+			logging = (record->next && [self openLog]);	// a fresh log, with its own strings
+		}
+		
+		KTLogRecord *next = record->next;
+		[record->domain release];
+		[record->message release];
+		free(record);
+		record = next;
 	}
+	
+	if (logging && [batch length]) [self writeData:batch];
+	[batch release];
+	
+	if (console)
+	{
+		fputs([console UTF8String], stderr);
+		[console release];
+	}
+	
+	[pool release];
 }
 
++ (void)flush
+{
+	// From the delegate, the writer is already busy with a batch; anything logged since goes out in the next one
+	if (dispatch_get_specific(&KTLogWriterQueueKey)) return;
+	
+	KTLogger *logger = [KTLogger sharedLogger];
+	dispatch_sync(logger->myWriterQueue, ^{
+		[logger writePendingRecords];
+	});
+}
+
+static void KTLogFlushAtExit(void)
+{
+	// Exiting from the delegate leaves the batch being written unfinished, and waiting on ourselves would never return
+	if (dispatch_get_specific(&KTLogWriterQueueKey)) return;
+	
+	KTLogger *logger = [KTLogger sharedLogger];
+	dispatch_semaphore_t flushed = dispatch_semaphore_create(0);
+	dispatch_async(logger->myWriterQueue, ^{
+		[logger writePendingRecords];
+		dispatch_semaphore_signal(flushed);
+	});
+	
+	// Better to lose the last few entries than hang on the way out
+	dispatch_semaphore_wait(flushed, dispatch_time(DISPATCH_TIME_NOW, KTLogExitFlushTimeout));
+	dispatch_release(flushed);
+}
+
+- (BOOL)shouldLogLevel:(NSInteger)level forDomain:(NSString *)domain
+{
+	// only log statement whose level is at or below my threshold, or the wildcard's
+	if (level > KTLogHighestEnabledLevel) return NO;
+	return (level <= KTLogThresholdForDomain(domain));
+}
 
 - (void)logFile:(char *)file
 	 lineNumber:(NSInteger)line
   loggingDomain:(NSString *)domain
    loggingLevel:(NSInteger)level
-		 thread:(NSString *)thread
 		message:(NSString *)log
 {
-	[myLock lock];
-	
-	if (	level <= [self loggingLevelForDomain:KTLogWildcardDomain]
-		||	level <= [self loggingLevelForDomain:domain])	// only log statement whose level is at or below my threshold
+	if ([self shouldLogLevel:level forDomain:domain])
 	{
-		[self _logFile:file lineNumber:line loggingDomain:domain loggingLevel:level thread:thread message:log];
+		[self enqueueRecordForFile:file lineNumber:line loggingDomain:domain loggingLevel:level message:log];
 	}
-	[myLock unlock];
 }
 
 // Similar to above, but with a format and arguments.  Don't construct the string unless we want to use it.
@@ -332,49 +763,18 @@ static NSString *KTLevelMap[] = {
 	 lineNumber:(NSInteger)line
   loggingDomain:(NSString *)domain
    loggingLevel:(NSInteger)level
-		 thread:(NSString *)thread
 		 format:(NSString *)log
 	  arguments:(va_list)argList
 {
-	[myLock lock];
-	
-	if (	level <= [self loggingLevelForDomain:KTLogWildcardDomain]
-		||	level <= [self loggingLevelForDomain:domain])	// only log statement whose level is at or below my threshold
+	if ([self shouldLogLevel:level forDomain:domain])
 	{
-		NSString *message = [[[NSString alloc] initWithFormat:log arguments:argList] autorelease];
-		[self _logFile:file
-			lineNumber:line
-		 loggingDomain:domain
-		  loggingLevel:level
-				thread:thread
-			   message:message];
+		NSString *message = [[NSString alloc] initWithFormat:log arguments:argList];
+		[self enqueueRecordForFile:file lineNumber:line loggingDomain:domain loggingLevel:level message:message];
+		[message release];
 	}
-	[myLock unlock];
 }	
 
-// Similar to above, but with a format
-- (void)logFile:(char *)file
-	 lineNumber:(NSInteger)line
-  loggingDomain:(NSString *)domain
-   loggingLevel:(NSInteger)level
-		 thread:(NSString *)thread
-		 format:(NSString *)log, ...
-{
-	va_list ap;
-	va_start(ap, log);
-	
-	[self logFile:file
-	   lineNumber:line
-	loggingDomain:domain
-	 loggingLevel:level
-		   thread:thread
-		   format:log
-		arguments:ap];
-	
-	va_end(ap);
-}
-
-// Class method to log.  Accepts a format.  Thread argument is generated here, not passed in.
+// Class method to log.  Accepts a format.  The thread is noted down when the record is queued.
 
 + (void)logFile:(char *)file
 	 lineNumber:(NSInteger)line
@@ -389,8 +789,7 @@ static NSString *KTLevelMap[] = {
 						  lineNumber:line
 					   loggingDomain:domain
 						loggingLevel:level
-							  thread:[NSString stringWithFormat:@"%p",[NSThread currentThread]]
-							 format:log
+							  format:log
 						   arguments:ap];
 
 	va_end(ap);
@@ -398,6 +797,15 @@ static NSString *KTLevelMap[] = {
 
 + (NSArray *)entriesWithLogFile:(NSString *)file
 {
+	KTLogReader *reader = [[KTLogReader alloc] initWithContentsOfFile:file];
+	if (reader)
+	{
+		NSArray *result = [reader entries];
+		[reader release];
+		return result;
+	}
+	
+	// Fall back to the archived records older versions wrote, all read in up front
 	NSFileHandle *log = [NSFileHandle fileHandleForReadingAtPath:file];
 	NSMutableArray *entries = [NSMutableArray array];
 	
@@ -528,3 +936,374 @@ static NSString *KTLevelMap[] = {
 }
 @end
 
+
+
+#pragma mark -
+
+
+@implementation KTLogReader
+
+- (id)initWithContentsOfFile:(NSString *)path
+{
+	if ((self = [super init]))
+	{
+		myDescriptor = open([path fileSystemRepresentation], O_RDONLY);
+		myIndex = [[NSMutableData alloc] init];
+		myStringOffsets = [[NSMutableData alloc] init];
+		myStrings = [[NSMutableDictionary alloc] init];
+		
+		if (myDescriptor == -1 || ![self mapFile])
+		{
+			[self release];
+			return nil;
+		}
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	if (myBytes) munmap((void *)myBytes, myLength);
+	if (myDescriptor != -1) close(myDescriptor);
+	[myIndex release];
+	[myStringOffsets release];
+	[myStrings release];
+	[myStringNumbers release];
+	
+	[super dealloc];
+}
+
+// Maps however much of the file there is right now, and scans it. NO if it's not a log in the current format
+- (BOOL)mapFile
+{
+	struct stat info;
+	if (fstat(myDescriptor, &info) != 0 || info.st_size < (off_t)sizeof(KTLogFileHeader)) return NO;
+	
+	myLength = info.st_size;
+	void *bytes = mmap(NULL, myLength, PROT_READ, MAP_SHARED, myDescriptor, 0);
+	if (bytes == MAP_FAILED) return NO;
+	myBytes = bytes;
+	
+	const KTLogFileHeader *header = (const KTLogFileHeader *)myBytes;
+	size_t headerLength = CFSwapInt16LittleToHost(header->headerLength);
+	if (memcmp(header->magic, KTLogFileMagic, sizeof(header->magic)) != 0 ||
+		CFSwapInt16LittleToHost(header->version) != KTLogFileVersion ||
+		headerLength < sizeof(KTLogFileHeader) ||
+		headerLength > myLength ||
+		headerLength % KTLogFileAlignment)
+	{
+		return NO;
+	}
+	
+	[self scanFromOffset:headerLength];
+	return YES;
+}
+
+// The logger only ever appends, except when lopping off whatever a crash left half-written. Touching a mapped page the file no longer reaches would crash, so this is checked before each lookup. If the file's got shorter than what was scanned, start over with what's left
+- (void)checkLength
+{
+	struct stat info;
+	if (fstat(myDescriptor, &info) == 0 && info.st_size >= (off_t)myValidLength) return;
+	
+	if (myBytes) munmap((void *)myBytes, myLength);
+	myBytes = NULL;
+	myLength = 0;
+	myValidLength = 0;
+	myCount = 0;
+	myCursorIndex = 0;
+	myCursorOffset = 0;
+	[myIndex setLength:0];
+	[myStringOffsets setLength:0];
+	[myStrings removeAllObjects];
+	[myStringNumbers release]; myStringNumbers = nil;
+	
+	[self mapFile];	// should it not be a log any more, there's simply nothing to see
+}
+
+// Steps over each record, looking no further than its fixed part. Stops at the first one which doesn't add up, which generally means the tail end of a log cut short by a crash
+- (void)scanFromOffset:(size_t)offset
+{
+	KTLogIndexBlock *block = NULL;
+	
+	while (myLength - offset >= sizeof(KTLogFileRecordHeader))
+	{
+		const KTLogFileRecordHeader *header = (const KTLogFileRecordHeader *)(myBytes + offset);
+		size_t length = CFSwapInt32LittleToHost(header->length);
+		if (length < sizeof(KTLogFileRecordHeader) || length % KTLogFileAlignment || length > myLength - offset) break;
+		
+		if (header->kind == KTLogFileStringKind)
+		{
+			const KTLogFileString *string = (const KTLogFileString *)header;
+			if (length < sizeof(*string) || CFSwapInt32LittleToHost(string->length) > length - sizeof(*string)) break;
+			
+			// Numbers are handed out in order, so they double as an index into the offsets
+			if (CFSwapInt32LittleToHost(string->number) != [myStringOffsets length] / sizeof(uint64_t) + 1) break;
+			
+			uint64_t stringOffset = offset;
+			[myStringOffsets appendBytes:&stringOffset length:sizeof(stringOffset)];
+		}
+		else if (header->kind == KTLogFileEntryKind)
+		{
+			const KTLogFileEntry *entry = (const KTLogFileEntry *)header;
+			if (length < sizeof(*entry) || CFSwapInt32LittleToHost(entry->messageLength) > length - sizeof(*entry)) break;
+			
+			if (myCount % KTLogIndexSpacing == 0)
+			{
+				[myIndex increaseLengthBy:sizeof(KTLogIndexBlock)];
+				block = (KTLogIndexBlock *)[myIndex mutableBytes] + myCount / KTLogIndexSpacing;
+				block->offset = offset;
+				block->latest = INT64_MIN;
+			}
+			
+			block->latest = MAX(block->latest, (int64_t)CFSwapInt64LittleToHost(entry->time));
+			block->domains |= 1ULL << (CFSwapInt32LittleToHost(entry->domain) % 64);
+			block->levels |= 1U << MIN(header->level, 31);
+			myCount++;
+		}
+		
+		// Any other kind is from a later version, and safe to step over
+		offset += length;
+	}
+	
+	myValidLength = offset;
+}
+
+- (size_t)validLength
+{
+	return myValidLength;
+}
+
+#pragma mark Strings
+
+- (NSUInteger)stringCount
+{
+	return [myStringOffsets length] / sizeof(uint64_t);
+}
+
+// Callers check the length first
+- (NSString *)stringWithNumber:(uint32_t)number
+{
+	if (number == 0 || number > [self stringCount]) return @"";
+	
+	NSNumber *key = [NSNumber numberWithUnsignedInt:number];
+	NSString *result = [myStrings objectForKey:key];
+	if (!result)
+	{
+		const uint64_t *offsets = [myStringOffsets bytes];
+		const KTLogFileString *record = (const KTLogFileString *)(myBytes + offsets[number - 1]);
+		
+		result = [[NSString alloc] initWithBytes:record + 1
+										  length:CFSwapInt32LittleToHost(record->length)
+										encoding:NSUTF8StringEncoding];
+		if (!result) result = [@"" retain];
+		
+		[myStrings setObject:result forKey:key];
+		[result release];
+	}
+	return result;
+}
+
+// 0 if the string doesn't appear in the log. Callers check the length first
+- (uint32_t)numberOfString:(NSString *)string
+{
+	if (!myStringNumbers)
+	{
+		NSUInteger count = [self stringCount];
+		myStringNumbers = [[NSMutableDictionary alloc] initWithCapacity:count];
+		
+		uint32_t number;
+		for (number = 1; number <= count; number++)
+		{
+			[myStringNumbers setObject:[NSNumber numberWithUnsignedInt:number] forKey:[self stringWithNumber:number]];
+		}
+	}
+	
+	return [[myStringNumbers objectForKey:string] unsignedIntValue];
+}
+
+- (NSArray *)internedStrings
+{
+	[self checkLength];
+	
+	NSMutableArray *result = [NSMutableArray arrayWithCapacity:[self stringCount]];
+	uint32_t number;
+	for (number = 1; number <= [self stringCount]; number++)
+	{
+		[result addObject:[self stringWithNumber:number]];
+	}
+	return result;
+}
+
+#pragma mark Entries
+
+- (NSUInteger)count
+{
+	[self checkLength];
+	return myCount;
+}
+
+// The index must be in range
+- (const KTLogFileEntry *)entryRecordAtIndex:(NSUInteger)index
+{
+	// Start from the first entry in the block, unless the last lookup already got part way there
+	NSUInteger current = index - index % KTLogIndexSpacing;
+	size_t offset = ((const KTLogIndexBlock *)[myIndex bytes])[index / KTLogIndexSpacing].offset;
+	
+	if (myCursorIndex > current && myCursorIndex <= index)
+	{
+		current = myCursorIndex;
+		offset = myCursorOffset;
+	}
+	
+	// Scanning has already checked every record, so it's safe to just follow the lengths
+	while (1)
+	{
+		const KTLogFileRecordHeader *header = (const KTLogFileRecordHeader *)(myBytes + offset);
+		if (header->kind == KTLogFileEntryKind)
+		{
+			if (current == index) break;
+			current++;
+		}
+		offset += CFSwapInt32LittleToHost(header->length);
+	}
+	
+	myCursorIndex = index;
+	myCursorOffset = offset;
+	return (const KTLogFileEntry *)(myBytes + offset);
+}
+
+- (NSDictionary *)entryAtIndex:(NSUInteger)index
+{
+	[self checkLength];
+	if (index >= myCount)
+	{
+		[NSException raise:NSRangeException format:@"Index %lu is beyond the %lu entries in the log", (unsigned long)index, (unsigned long)myCount];
+	}
+	
+	const KTLogFileEntry *entry = [self entryRecordAtIndex:index];
+	
+	NSString *message = [[NSString alloc] initWithBytes:entry + 1
+												 length:CFSwapInt32LittleToHost(entry->messageLength)
+											   encoding:NSUTF8StringEncoding];
+	
+	NSDictionary *result = [NSDictionary dictionaryWithObjectsAndKeys:
+							KTLogFileDate(entry->time), @"t",
+							[self stringWithNumber:CFSwapInt32LittleToHost(entry->file)], @"f",
+							[NSNumber numberWithUnsignedInt:CFSwapInt32LittleToHost(entry->line)], @"n",
+							[NSNumber numberWithInteger:entry->header.level], @"l",
+							[self stringWithNumber:CFSwapInt32LittleToHost(entry->domain)], @"d",
+							(message ? message : @""), @"m",
+							[NSString stringWithFormat:@"0x%llx", CFSwapInt64LittleToHost(entry->thread)], @"th", nil];
+	
+	[message release];
+	return result;
+}
+
+- (NSUInteger)indexOfFirstEntryOnOrAfterDate:(NSDate *)date
+{
+	[self checkLength];
+	int64_t time = KTLogFileTime([date timeIntervalSinceReferenceDate]);
+	
+	// Binary search for the first block reaching that time, then look through it
+	const KTLogIndexBlock *blocks = [myIndex bytes];
+	NSUInteger low = 0;
+	NSUInteger high = [myIndex length] / sizeof(KTLogIndexBlock);
+	
+	while (low < high)
+	{
+		NSUInteger middle = low + (high - low) / 2;
+		if (blocks[middle].latest < time)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	
+	NSUInteger i;
+	for (i = low * KTLogIndexSpacing; i < myCount; i++)
+	{
+		if ((int64_t)CFSwapInt64LittleToHost([self entryRecordAtIndex:i]->time) >= time) return i;
+	}
+	
+	return NSNotFound;
+}
+
+- (NSIndexSet *)indexesOfEntriesWithLevelAtMost:(NSInteger)level domain:(NSString *)domain
+{
+	[self checkLength];
+	NSMutableIndexSet *result = [NSMutableIndexSet indexSet];
+	if (level < 0) return result;
+	
+	uint32_t domainNumber = 0;
+	if (domain)
+	{
+		domainNumber = [self numberOfString:domain];
+		if (domainNumber == 0) return result;
+	}
+	
+	uint32_t levels = (level >= 31 ? UINT32_MAX : (2U << level) - 1);
+	uint64_t domainBit = 1ULL << (domainNumber % 64);
+	
+	// Blocks without a matching level or domain can be skipped without looking at their entries
+	const KTLogIndexBlock *blocks = [myIndex bytes];
+	NSUInteger blockCount = [myIndex length] / sizeof(KTLogIndexBlock);
+	NSUInteger b;
+	for (b = 0; b < blockCount; b++)
+	{
+		if (!(blocks[b].levels & levels)) continue;
+		if (domain && !(blocks[b].domains & domainBit)) continue;
+		
+		NSUInteger i;
+		NSUInteger end = MIN((b + 1) * KTLogIndexSpacing, myCount);
+		for (i = b * KTLogIndexSpacing; i < end; i++)
+		{
+			const KTLogFileEntry *entry = [self entryRecordAtIndex:i];
+			if (entry->header.level > level) continue;
+			if (domain && CFSwapInt32LittleToHost(entry->domain) != domainNumber) continue;
+			
+			[result addIndex:i];
+		}
+	}
+	
+	return result;
+}
+
+- (NSArray *)entries
+{
+	return [[[KTLogEntries alloc] initWithReader:self] autorelease];
+}
+
+@end
+
+
+@implementation KTLogEntries
+
+- (id)initWithReader:(KTLogReader *)reader
+{
+	if ((self = [super init]))
+	{
+		myReader = [reader retain];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	[myReader release];
+	[super dealloc];
+}
+
+- (NSUInteger)count
+{
+	return [myReader count];
+}
+
+- (id)objectAtIndex:(NSUInteger)index
+{
+	return [myReader entryAtIndex:index];
+}
+
+@end
@@ -28,38 +28,20 @@
  
  */
 #import "NSData+Connection.h"
+#import "CKBase64.h"
 #import <zlib.h>
-#include <sasl/saslutil.h>
 
 @implementation NSData (Connection)
 
 - (NSString *)base64Encoding
 {
-	NSString* retVal = nil;
-	/* base64 encode
-	 *  in      -- input data
-	 *  inlen   -- input data length
-	 *  out     -- output buffer (will be NUL terminated)
-	 *  outmax  -- max size of output buffer
-	 * result:
-	 *  outlen  -- gets actual length of output buffer (optional)
-	 * 
-	 * Returns SASL_OK on success, SASL_BUFOVER if result won't fit
-	 */
+	// Encoded straight into the buffer the string ends up owning, so it's never copied
+	NSUInteger length = CKBase64EncodedLength([self length]);
+	char *buffer = malloc(MAX(length, 1));
+	if (!buffer) return nil;
 	
-	NSUInteger bufSize = 4 * [self length] / 3 + 100;
-	char *buffer = malloc(bufSize);
-	unsigned actualLength = 0;
-	int status = sasl_encode64([self bytes], [self length], buffer, bufSize, &actualLength); 	
-	
-	if (SASL_OK == status)
-	{
-		retVal = [[[NSString alloc] initWithBytes: buffer length: actualLength encoding: NSASCIIStringEncoding] autorelease];
-		
-	}
-    // Clean up
-    free(buffer);
-    return retVal;	
+	CKBase64Encode([self bytes], [self length], buffer);
+	return [[[NSString alloc] initWithBytesNoCopy:buffer length:length encoding:NSASCIIStringEncoding freeWhenDone:YES] autorelease];
 }
 
 - (NSString *)descriptionAsUTF8String
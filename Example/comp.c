@@ -239,6 +239,10 @@ static int libssh2_comp_method_zlib_comp(LIBSSH2_SESSION *session,
 			} else {
 				status = inflate(strm, Z_PARTIAL_FLUSH);
 			}
+			if (status == Z_BUF_ERROR && !compress) {
+				/* The output had filled the buffer exactly; there was nothing more to come */
+				break;
+			}
 			if (status != Z_OK) {
 				libssh2_error(session, LIBSSH2_ERROR_ZLIB, "compress/decompression failure", 0);
 				LIBSSH2_FREE(session, out);
@@ -36,6 +36,7 @@
  */
 
 #include "libssh2_priv.h"
+#include "../ConnectionKit/CKBase64.h"
 
 /* {{{ libssh2_ntohu32
  */
@@ -89,39 +90,9 @@ void libssh2_htonu64(unsigned char *buf, libssh2_uint64_t value)
 }
 /* }}} */
 
-/* Base64 Conversion */
-
-/* {{{ */
-static const char libssh2_base64_table[] =
-    { 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M',
-      'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z',
-      'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm',
-      'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z',
-      '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '/', '\0'
-    };
-
-static const char libssh2_base64_pad = '=';
-
-static const short libssh2_base64_reverse_table[256] = {
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
-    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
-    -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
-    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
-    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
-    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
-};
-/* }}} */
-
+/* Base64 Conversion
+ * Shares ConnectionKit's codec, which handles long runs with SIMD
+ */
 
 /* {{{ libssh2_base64_decode
  * Decode a base64 chunk and store it into a newly alloc'd buffer
@@ -129,37 +100,14 @@ static const short libssh2_base64_reverse_table[256] = {
 LIBSSH2_API int libssh2_base64_decode(LIBSSH2_SESSION *session, char **data, unsigned int *datalen,
 																char *src, unsigned int src_len)
 {
-	unsigned char *s, *d;
-	short v;
-	int i = 0, len = 0;
+	size_t len;
 
-	*data = LIBSSH2_ALLOC(session, (3 * src_len / 4) + 1);
-	d = (unsigned char *)*data;
-	if (!d) {
+	*data = LIBSSH2_ALLOC(session, CKBase64DecodedMaximumLength(src_len) + 1);
+	if (!*data) {
 		return -1;
 	}
 
-	for(s = (unsigned char *)src; ((char*)s) < (src + src_len); s++) {
-		if ((v = libssh2_base64_reverse_table[*s]) < 0) continue;
-		switch (i % 4) {
-			case 0:
-				d[len] = v << 2;
-				break;
-			case 1:
-				d[len++] |= v >> 4;
-				d[len] = v << 4;
-				break;
-			case 2:
-				d[len++] |= v >> 2;
-				d[len] = v << 6;
-				break;
-			case 3:
-				d[len++] |= v;
-				break;
-		}
-		i++;
-	}
-	if ((i % 4) == 1) {
+	if (!CKBase64Decode(src, src_len, *data, &len)) {
 		/* Invalid -- We have a byte which belongs exclusively to a partial octet */
 		LIBSSH2_FREE(session, *data);
 		return -1;
@@ -59,6 +59,17 @@ int _libssh2_rsa_new(libssh2_rsa_ctx **rsa,
 {
 	*rsa = RSA_new();
 
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	/* RSA is opaque from 1.1 on */
+	RSA_set0_key(*rsa, BN_bin2bn(ndata, nlen, NULL), BN_bin2bn(edata, elen, NULL),
+		     ddata ? BN_bin2bn(ddata, dlen, NULL) : NULL);
+	if (ddata)
+	  {
+	    RSA_set0_factors(*rsa, BN_bin2bn(pdata, plen, NULL), BN_bin2bn(qdata, qlen, NULL));
+	    RSA_set0_crt_params(*rsa, BN_bin2bn(e1data, e1len, NULL), BN_bin2bn(e2data, e2len, NULL),
+				BN_bin2bn(coeffdata, coefflen, NULL));
+	  }
+#else
 	(*rsa)->e = BN_new();
 	BN_bin2bn(edata, elen, (*rsa)->e);
 
@@ -85,6 +96,7 @@ int _libssh2_rsa_new(libssh2_rsa_ctx **rsa,
 	    (*rsa)->iqmp = BN_new();
 	    BN_bin2bn(coeffdata, coefflen, (*rsa)->iqmp);
 	  }
+#endif
 	return 0;
 }
 
@@ -117,6 +129,10 @@ int _libssh2_dsa_new(libssh2_dsa_ctx **dsactx,
 {
 	*dsactx = DSA_new();
 
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	DSA_set0_pqg(*dsactx, BN_bin2bn(p, p_len, NULL), BN_bin2bn(q, q_len, NULL), BN_bin2bn(g, g_len, NULL));
+	DSA_set0_key(*dsactx, BN_bin2bn(y, y_len, NULL), x_len ? BN_bin2bn(x, x_len, NULL) : NULL);
+#else
 	(*dsactx)->p = BN_new();
 	BN_bin2bn(p, p_len, (*dsactx)->p);
 
@@ -133,6 +149,7 @@ int _libssh2_dsa_new(libssh2_dsa_ctx **dsactx,
 		(*dsactx)->priv_key = BN_new();
 		BN_bin2bn(x, x_len, (*dsactx)->priv_key);
 	}
+#endif
 
 	return 0;
 }
@@ -143,8 +160,17 @@ int _libssh2_dsa_sha1_verify(libssh2_dsa_ctx *dsactx,
 			     unsigned long m_len)
 {
 	unsigned char hash[SHA_DIGEST_LENGTH];
-	DSA_SIG dsasig;
 	int ret;
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	DSA_SIG *dsasig = DSA_SIG_new();
+
+	DSA_SIG_set0(dsasig, BN_bin2bn(sig, 20, NULL), BN_bin2bn(sig + 20, 20, NULL));
+
+	libssh2_sha1(m, m_len, hash);
+	ret = DSA_do_verify(hash, SHA_DIGEST_LENGTH, dsasig, dsactx);
+	DSA_SIG_free(dsasig);
+#else
+	DSA_SIG dsasig;
 
 	dsasig.r = BN_new();
 	BN_bin2bn(sig, 20, dsasig.r);
@@ -153,6 +179,7 @@ int _libssh2_dsa_sha1_verify(libssh2_dsa_ctx *dsactx,
 
 	libssh2_sha1(m, m_len, hash);
 	ret = DSA_do_verify(hash, SHA_DIGEST_LENGTH, &dsasig, dsactx);
+#endif
 
 	return (ret == 1) ? 0 : -1;
 }
@@ -163,8 +190,18 @@ int _libssh2_cipher_init (_libssh2_cipher_ctx *h,
 			  unsigned char *secret,
 			  int encrypt)
 {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	/* EVP_CIPHER_CTX is opaque from 1.1 on, so _libssh2_cipher_ctx is a pointer to one */
+	*h = EVP_CIPHER_CTX_new();
+	if (!*h || EVP_CipherInit(*h, algo(), secret, iv, encrypt) != 1) {
+		EVP_CIPHER_CTX_free(*h);
+		*h = NULL;
+		return -1;
+	}
+#else
 	EVP_CIPHER_CTX_init(h);
 	EVP_CipherInit(h, algo(), secret, iv, encrypt);
+#endif
 	return 0;
 }
 
@@ -173,7 +210,11 @@ int _libssh2_cipher_crypt(_libssh2_cipher_ctx *ctx,
 			  int encrypt,
 			  unsigned char *block)
 {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	int blocksize = EVP_CIPHER_CTX_block_size(*ctx);
+#else
 	int blocksize = ctx->cipher->block_size;
+#endif
 	unsigned char buf[EVP_MAX_BLOCK_LENGTH];
 	int ret;
 	(void)algo;
@@ -183,7 +224,17 @@ int _libssh2_cipher_crypt(_libssh2_cipher_ctx *ctx,
 /* Hack for arcfour. */
 		blocksize = 8;
 	}
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	ret = EVP_Cipher(*ctx, buf, block, blocksize);
+#else
 	ret = EVP_Cipher(ctx, buf, block, blocksize);
+#endif
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	/* Provider-based ciphers return the number of bytes processed */
+	if (ret > 0) {
+		ret = 1;
+	}
+#endif
 	if (ret == 1) {
 		memcpy(block, buf, blocksize);
 	}
@@ -288,6 +339,7 @@ int _libssh2_dsa_sha1_sign(libssh2_dsa_ctx *dsactx,
 			   unsigned char *signature)
 {
 	DSA_SIG *sig;
+	const BIGNUM *r, *s;
 	int r_len, s_len, rs_pad;
 	(void)hash_len;
 
@@ -296,16 +348,23 @@ int _libssh2_dsa_sha1_sign(libssh2_dsa_ctx *dsactx,
 		return -1;
 	}
 
-	r_len = BN_num_bytes(sig->r);
-	s_len = BN_num_bytes(sig->s);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	DSA_SIG_get0(sig, &r, &s);
+#else
+	r = sig->r;
+	s = sig->s;
+#endif
+
+	r_len = BN_num_bytes(r);
+	s_len = BN_num_bytes(s);
 	rs_pad = (2 * SHA_DIGEST_LENGTH) - (r_len + s_len);
 	if (rs_pad < 0) {
 		DSA_SIG_free(sig);
 		return -1;
 	}
 
-	BN_bn2bin(sig->r, signature + rs_pad);
-	BN_bn2bin(sig->s, signature + rs_pad + r_len);
+	BN_bn2bin(r, signature + rs_pad);
+	BN_bn2bin(s, signature + rs_pad + r_len);
 
 	DSA_SIG_free(sig);
 
@@ -115,6 +115,20 @@
 #define libssh2_md5_final(ctx, out) MD5_Final(out, &(ctx))
 #define libssh2_md5(message, len, out) MD5(message, len, out)
 
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+/* HMAC_CTX is opaque from 1.1 on, so libssh2_hmac_ctx is a pointer to one */
+#define libssh2_hmac_ctx HMAC_CTX *
+#define libssh2_hmac_sha1_init(ctx, key, keylen) \
+  (*(ctx) = HMAC_CTX_new(), HMAC_Init_ex(*(ctx), key, keylen, EVP_sha1(), NULL))
+#define libssh2_hmac_md5_init(ctx, key, keylen) \
+  (*(ctx) = HMAC_CTX_new(), HMAC_Init_ex(*(ctx), key, keylen, EVP_md5(), NULL))
+#define libssh2_hmac_ripemd160_init(ctx, key, keylen) \
+  (*(ctx) = HMAC_CTX_new(), HMAC_Init_ex(*(ctx), key, keylen, EVP_ripemd160(), NULL))
+#define libssh2_hmac_update(ctx, data, datalen) \
+  HMAC_Update(ctx, data, datalen)
+#define libssh2_hmac_final(ctx, data) HMAC_Final(ctx, data, NULL)
+#define libssh2_hmac_cleanup(ctx) HMAC_CTX_free(*(ctx))
+#else
 #define libssh2_hmac_ctx HMAC_CTX
 #define libssh2_hmac_sha1_init(ctx, key, keylen) \
   HMAC_Init(ctx, key, keylen, EVP_sha1())
@@ -126,6 +140,7 @@
   HMAC_Update(&(ctx), data, datalen)
 #define libssh2_hmac_final(ctx, data) HMAC_Final(&(ctx), data, NULL)
 #define libssh2_hmac_cleanup(ctx) HMAC_cleanup(ctx)
+#endif
 
 #define libssh2_crypto_init()
 
@@ -195,7 +210,11 @@ int _libssh2_dsa_sha1_sign(libssh2_dsa_ctx *dsactx,
 #define _libssh2_dsa_free(dsactx) DSA_free(dsactx)
 
 #define _libssh2_cipher_type(name) const EVP_CIPHER *(*name)(void)
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+#define _libssh2_cipher_ctx EVP_CIPHER_CTX *
+#else
 #define _libssh2_cipher_ctx EVP_CIPHER_CTX
+#endif
 
 #define _libssh2_cipher_aes256 EVP_aes_256_cbc
 #define _libssh2_cipher_aes192 EVP_aes_192_cbc
@@ -216,7 +235,11 @@ int _libssh2_cipher_crypt(_libssh2_cipher_ctx *ctx,
 			  int encrypt,
 			  unsigned char *block);
 
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+#define _libssh2_cipher_dtor(ctx) EVP_CIPHER_CTX_free(*(ctx))
+#else
 #define _libssh2_cipher_dtor(ctx) EVP_CIPHER_CTX_cleanup(ctx)
+#endif
 
 #define _libssh2_bn BIGNUM
 #define _libssh2_bn_ctx BN_CTX
@@ -258,7 +258,8 @@ static int libssh2_sftp_packet_ask(LIBSSH2_SFTP *sftp, unsigned char packet_type
 	}
 
 	while (packet) {
-		if (strncmp((const char *)packet->data, (const char *)match_buf, match_len) == 0) {
+		/* Request ids are binary, so can't be compared as strings */
+		if (packet->data_len >= match_len && memcmp(packet->data, match_buf, match_len) == 0) {
 			*data = packet->data;
 			*data_len = packet->data_len;
 
@@ -0,0 +1,517 @@
+/* ssh2bench -- microbenchmarks for the libssh2 transport in Example/
+ *
+ * Two sessions are joined by a socketpair and keyed directly with identical secrets, skipping key exchange,
+ * so every cipher/MAC/compression combination can be driven through libssh2_packet_write() and
+ * libssh2_packet_read() just as a real transfer drives them. The cipher, MAC and compression methods are also
+ * timed on their own, as is the SFTP packet brigade.
+ *
+ * usage: ssh2bench [-t seconds] [-c cipher] [-m mac] [-z compression] [-s size] [-j]
+ *
+ *	-t	how long to run each measurement for (default 0.2s)
+ *	-c/-m/-z	only benchmark the named method (may be repeated)
+ *	-s	only benchmark the given payload size (may be repeated)
+ *	-j	output one JSON object per line instead of a table
+ */
+
+/* Pulled in whole so the SFTP brigade's static functions can be reached */
+#include "sftp.c"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <openssl/opensslv.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/provider.h>
+#endif
+
+#define MAX_FILTERS 16
+
+static double duration = 0.2;
+static int json = 0;
+
+static const char *cipher_filter[MAX_FILTERS], *mac_filter[MAX_FILTERS], *comp_filter[MAX_FILTERS];
+static int cipher_filters, mac_filters, comp_filters;
+
+static unsigned long sizes[MAX_FILTERS] = { 64, 1024, 4096, 16384, 32000 };
+static int size_count = 5, sizes_given = 0;
+
+/* Packet payloads; roughly as compressible as source code, so zlib has something realistic to chew on.
+ * Much bigger than zlib's window, so successive packets can't just refer back to the previous one */
+static unsigned char source_data[4 * 1024 * 1024];
+#define MAX_PAYLOAD 32000
+
+static const unsigned char *payload_data(unsigned long count, unsigned long size)
+{
+	return source_data + (count * 40009) % (sizeof(source_data) - size);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int wanted(const char *name, const char **filter, int count)
+{
+	int i;
+
+	if (!count) return 1;
+	for (i = 0; i < count; i++) {
+		if (!strcmp(name, filter[i])) return 1;
+	}
+	return 0;
+}
+
+static void fill_source_data(void)
+{
+	static const char *words[] = { "session", "->", "packet", "(", ")", ";\n\t", "libssh2_", "return", " ", "if ", "len", "0x" };
+	unsigned long i = 0;
+
+	while (i < sizeof(source_data)) {
+		const char *word = words[rand() % (sizeof(words) / sizeof(words[0]))];
+		while (*word && i < sizeof(source_data)) source_data[i++] = *word++;
+		if (rand() % 4 == 0 && i < sizeof(source_data)) source_data[i++] = rand();
+	}
+}
+
+/* {{{ Reporting */
+
+/* size is the payload size, or the queue depth for the SFTP brigade, where there's no throughput as such */
+static void report(const char *benchmark, const char *cipher, const char *mac, const char *comp, unsigned long size,
+		   unsigned long count, double bytes, double seconds, double write_seconds, double read_seconds)
+{
+	double mbps = (seconds > 0) ? bytes / seconds / 1e6 : 0;
+	double ns = count ? seconds * 1e9 / count : 0;
+
+	if (!count) {
+		write_seconds = read_seconds = -1;
+	}
+
+	if (json) {
+		printf("{\"benchmark\":\"%s\",\"cipher\":\"%s\",\"mac\":\"%s\",\"compression\":\"%s\",\"size\":%lu,"
+		       "\"count\":%lu,\"mb_per_second\":%.2f,\"ns_per_packet\":%.0f", benchmark, cipher, mac, comp, size, count, mbps, ns);
+		if (write_seconds >= 0) {
+			printf(",\"write_ns_per_packet\":%.0f,\"read_ns_per_packet\":%.0f", write_seconds * 1e9 / count, read_seconds * 1e9 / count);
+		}
+		printf("}\n");
+	} else {
+		printf("%-10s %-28s %-28s %-6s %6lu  %9.1f MB/s  %9.0f ns/packet", benchmark, cipher, mac, comp, size, mbps, ns);
+		if (write_seconds >= 0) {
+			printf("  (write %.0f, read %.0f)", write_seconds * 1e9 / count, read_seconds * 1e9 / count);
+		}
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+/* }}} */
+
+/* {{{ Keying
+ * Sets up the writer's outbound and the reader's inbound directions as if a key exchange had agreed on these methods
+ */
+
+static int key_endpoints(LIBSSH2_SESSION *writer, LIBSSH2_SESSION *reader,
+			 LIBSSH2_CRYPT_METHOD *crypt, LIBSSH2_MAC_METHOD *mac, LIBSSH2_COMP_METHOD *comp)
+{
+	unsigned char iv[64], secret[64], key[64], scratch_iv[64], scratch_secret[64];
+	unsigned char *writer_key, *reader_key;
+	int free_iv, free_secret, free_key;
+
+	libssh2_random(iv, sizeof(iv));
+	libssh2_random(secret, sizeof(secret));
+	libssh2_random(key, sizeof(key));
+
+	/* Methods may scribble on or hang onto what they're given, so each side gets its own copy */
+	memcpy(scratch_iv, iv, sizeof(iv));
+	memcpy(scratch_secret, secret, sizeof(secret));
+	if (crypt->init && crypt->init(writer, crypt, scratch_iv, &free_iv, scratch_secret, &free_secret, 1, &writer->local.crypt_abstract)) {
+		return -1;
+	}
+	memcpy(scratch_iv, iv, sizeof(iv));
+	memcpy(scratch_secret, secret, sizeof(secret));
+	if (crypt->init && crypt->init(reader, crypt, scratch_iv, &free_iv, scratch_secret, &free_secret, 0, &reader->remote.crypt_abstract)) {
+		crypt->dtor(writer, &writer->local.crypt_abstract);
+		return -1;
+	}
+
+	/* MAC methods keep the key, and free it themselves */
+	writer_key = LIBSSH2_ALLOC(writer, mac->key_len);
+	reader_key = LIBSSH2_ALLOC(reader, mac->key_len);
+	memcpy(writer_key, key, mac->key_len);
+	memcpy(reader_key, key, mac->key_len);
+	mac->init(writer, writer_key, &free_key, &writer->local.mac_abstract);
+	mac->init(reader, reader_key, &free_key, &reader->remote.mac_abstract);
+
+	if (comp->init) {
+		comp->init(writer, 1, &writer->local.comp_abstract);
+		comp->init(reader, 0, &reader->remote.comp_abstract);
+	}
+
+	writer->local.crypt = crypt;
+	writer->local.mac = mac;
+	writer->local.comp = comp;
+	writer->local.seqno = 0;
+	reader->remote.crypt = crypt;
+	reader->remote.mac = mac;
+	reader->remote.comp = comp;
+	reader->remote.seqno = 0;
+
+	writer->state |= LIBSSH2_STATE_NEWKEYS;
+	reader->state |= LIBSSH2_STATE_NEWKEYS;
+
+	return 0;
+}
+
+static void unkey_endpoints(LIBSSH2_SESSION *writer, LIBSSH2_SESSION *reader)
+{
+	if (writer->local.crypt->dtor) writer->local.crypt->dtor(writer, &writer->local.crypt_abstract);
+	if (reader->remote.crypt->dtor) reader->remote.crypt->dtor(reader, &reader->remote.crypt_abstract);
+	if (writer->local.mac->dtor) writer->local.mac->dtor(writer, &writer->local.mac_abstract);
+	if (reader->remote.mac->dtor) reader->remote.mac->dtor(reader, &reader->remote.mac_abstract);
+	if (writer->local.comp->dtor) writer->local.comp->dtor(writer, 1, &writer->local.comp_abstract);
+	if (reader->remote.comp->dtor) reader->remote.comp->dtor(reader, 0, &reader->remote.comp_abstract);
+
+	writer->state &= ~LIBSSH2_STATE_NEWKEYS;
+	reader->state &= ~LIBSSH2_STATE_NEWKEYS;
+}
+
+/* }}} */
+
+/* {{{ Transport
+ * Channel data packets, written by one session and read back by the other, one at a time
+ */
+
+static void bench_transport(LIBSSH2_SESSION *writer, LIBSSH2_SESSION *reader, LIBSSH2_CHANNEL *channel,
+			    LIBSSH2_CRYPT_METHOD *crypt, LIBSSH2_MAC_METHOD *mac, LIBSSH2_COMP_METHOD *comp, unsigned long size)
+{
+	unsigned char *payload = malloc(size + 9);
+	double start, write_time = 0, read_time = 0;
+	unsigned long count = 0;
+
+	if (key_endpoints(writer, reader, crypt, mac, comp)) {
+		fprintf(stderr, "%s: couldn't initialise cipher, skipping\n", crypt->name);
+		free(payload);
+		return;
+	}
+
+	payload[0] = SSH_MSG_CHANNEL_DATA;
+	libssh2_htonu32(payload + 1, channel->local.id);
+	libssh2_htonu32(payload + 5, size);
+
+	start = now();
+	do {
+		unsigned char *data;
+		unsigned long data_len;
+		double t0, t1, t2;
+
+		channel->remote.window_size = channel->remote.window_size_initial;
+		memcpy(payload + 9, payload_data(count, size), size);
+
+		t0 = now();
+		if (libssh2_packet_write(writer, payload, size + 9)) {
+			fprintf(stderr, "%s/%s/%s: write failed\n", crypt->name, mac->name, comp->name);
+			break;
+		}
+		t1 = now();
+		if (libssh2_packet_read(reader, 1) != SSH_MSG_CHANNEL_DATA ||
+		    libssh2_packet_ask_ex(reader, SSH_MSG_CHANNEL_DATA, &data, &data_len, 0, NULL, 0, 0)) {
+			fprintf(stderr, "%s/%s/%s: read failed: %s\n", crypt->name, mac->name, comp->name, reader->err_msg ? reader->err_msg : "?");
+			break;
+		}
+		t2 = now();
+
+		/* Make sure the data really did make the round trip, the first time at least */
+		if (count == 0 && (data_len != size + 9 || memcmp(data, payload, data_len))) {
+			fprintf(stderr, "%s/%s/%s: data corrupted in transit\n", crypt->name, mac->name, comp->name);
+			LIBSSH2_FREE(reader, data);
+			break;
+		}
+		LIBSSH2_FREE(reader, data);
+
+		write_time += t1 - t0;
+		read_time += t2 - t1;
+		count++;
+	} while (now() - start < duration);
+
+	report("transport", crypt->name, mac->name, comp->name, size, count, (double)count * size, write_time + read_time, write_time, read_time);
+
+	unkey_endpoints(writer, reader);
+	free(payload);
+}
+
+/* }}} */
+
+/* {{{ Primitives
+ * The methods on their own, without the transport's copying and syscalls around them
+ */
+
+static void bench_cipher(LIBSSH2_SESSION *session, LIBSSH2_CRYPT_METHOD *crypt, unsigned long size)
+{
+	unsigned char iv[64], secret[64], *buffer;
+	void *abstract = NULL;
+	int free_iv, free_secret;
+	unsigned long count = 0, offset;
+	double start, elapsed;
+
+	libssh2_random(iv, sizeof(iv));
+	libssh2_random(secret, sizeof(secret));
+	if (crypt->init && crypt->init(session, crypt, iv, &free_iv, secret, &free_secret, 1, &abstract)) {
+		return;
+	}
+
+	/* Whole blocks only, as in the transport */
+	size -= size % crypt->blocksize;
+	buffer = malloc(size);
+	memcpy(buffer, source_data, size);
+
+	start = now();
+	do {
+		for (offset = 0; offset < size; offset += crypt->blocksize) {
+			crypt->crypt(session, buffer + offset, &abstract);
+		}
+		count++;
+	} while ((elapsed = now() - start) < duration);
+
+	report("cipher", crypt->name, "-", "-", size, count, (double)count * size, elapsed, -1, -1);
+
+	if (crypt->dtor) crypt->dtor(session, &abstract);
+	free(buffer);
+}
+
+static void bench_mac(LIBSSH2_SESSION *session, LIBSSH2_MAC_METHOD *mac, unsigned long size)
+{
+	unsigned char *key = LIBSSH2_ALLOC(session, mac->key_len), out[64];
+	void *abstract = NULL;
+	int free_key;
+	unsigned long count = 0;
+	double start, elapsed;
+
+	libssh2_random(key, mac->key_len);
+	mac->init(session, key, &free_key, &abstract);
+
+	start = now();
+	do {
+		mac->hash(session, out, count, payload_data(count, size), size, NULL, 0, &abstract);
+		count++;
+	} while ((elapsed = now() - start) < duration);
+
+	report("mac", "-", mac->name, "-", size, count, (double)count * size, elapsed, -1, -1);
+
+	if (mac->dtor) mac->dtor(session, &abstract);
+}
+
+static void bench_comp(LIBSSH2_SESSION *session, LIBSSH2_COMP_METHOD *comp, unsigned long size)
+{
+	void *deflater = NULL, *inflater = NULL;
+	unsigned long count = 0, compressed_total = 0;
+	double start, deflate_time = 0, inflate_time = 0;
+
+	if (comp->init) {
+		comp->init(session, 1, &deflater);
+		comp->init(session, 0, &inflater);
+	}
+
+	start = now();
+	do {
+		unsigned char *compressed, *decompressed;
+		unsigned long compressed_len, decompressed_len;
+		int free_compressed = 0, free_decompressed = 0;
+		double t0, t1, t2;
+
+		t0 = now();
+		if (comp->comp(session, 1, &compressed, &compressed_len, LIBSSH2_PACKET_MAXCOMP, &free_compressed, payload_data(count, size), size, &deflater)) {
+			break;
+		}
+		t1 = now();
+		if (comp->comp(session, 0, &decompressed, &decompressed_len, LIBSSH2_PACKET_MAXDECOMP, &free_decompressed, compressed, compressed_len, &inflater)) {
+			break;
+		}
+		t2 = now();
+
+		compressed_total += compressed_len;
+		if (free_decompressed) LIBSSH2_FREE(session, decompressed);
+		if (free_compressed) LIBSSH2_FREE(session, compressed);
+
+		deflate_time += t1 - t0;
+		inflate_time += t2 - t1;
+		count++;
+	} while (now() - start < duration);
+
+	report("comp", "-", "-", comp->name, size, count, (double)count * size, deflate_time + inflate_time, deflate_time, inflate_time);
+	if (!json && count) {
+		printf("%-10s %-28s %-28s %-6s %6lu  ratio %.2f\n", "", "", "", "", size, (double)compressed_total / (count * size));
+	}
+
+	if (comp->dtor) {
+		comp->dtor(session, 1, &deflater);
+		comp->dtor(session, 0, &inflater);
+	}
+}
+
+/* }}} */
+
+/* {{{ SFTP brigade
+ * Responses are queued up as they arrive and picked out by request id; how that scales with the number of
+ * outstanding requests bounds how far SFTP transfers can be pipelined
+ */
+
+static void bench_sftp_brigade(LIBSSH2_SESSION *session, unsigned long depth, int reverse)
+{
+	LIBSSH2_CHANNEL channel;
+	LIBSSH2_SFTP sftp;
+	unsigned long count = 0, i;
+	double start, elapsed = 0;
+
+	memset(&channel, 0, sizeof(channel));
+	memset(&sftp, 0, sizeof(sftp));
+	channel.session = session;
+	sftp.channel = &channel;
+
+	start = now();
+	do {
+		double t0;
+
+		for (i = 1; i <= depth; i++) {
+			unsigned char *packet = LIBSSH2_ALLOC(session, 9);
+			packet[0] = SSH_FXP_DATA;
+			libssh2_htonu32(packet + 1, i);
+			libssh2_htonu32(packet + 5, 0);
+			libssh2_sftp_packet_add(&sftp, packet, 9);
+		}
+
+		t0 = now();
+		for (i = 1; i <= depth; i++) {
+			unsigned long id = reverse ? depth + 1 - i : i;
+			unsigned char *data;
+			unsigned long data_len;
+
+			if (libssh2_sftp_packet_ask(&sftp, SSH_FXP_DATA, id, &data, &data_len, 0) ||
+			    libssh2_ntohu32(data + 1) != id) {
+				fprintf(stderr, "sftp brigade: wrong packet for request %lu\n", id);
+				exit(1);
+			}
+			LIBSSH2_FREE(session, data);
+		}
+		elapsed += now() - t0;
+		count += depth;
+	} while (now() - start < duration);
+
+	report(reverse ? "sftp-lifo" : "sftp-fifo", "-", "-", "-", depth, count, 0, elapsed, -1, -1);
+}
+
+/* }}} */
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-t seconds] [-c cipher] [-m mac] [-z compression] [-s size] [-j]\n", name);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	LIBSSH2_CRYPT_METHOD **crypts = libssh2_crypt_methods();
+	LIBSSH2_MAC_METHOD **macs = libssh2_mac_methods();
+	LIBSSH2_COMP_METHOD **comps = libssh2_comp_methods();
+	LIBSSH2_SESSION *writer, *reader;
+	LIBSSH2_CHANNEL *channel;
+	int fds[2], buffer_size = 1024 * 1024;
+	int i, j, k, s, opt;
+
+	while ((opt = getopt(argc, argv, "t:c:m:z:s:j")) != -1) {
+		switch (opt) {
+			case 't': duration = atof(optarg); break;
+			case 'c': if (cipher_filters < MAX_FILTERS) cipher_filter[cipher_filters++] = optarg; break;
+			case 'm': if (mac_filters < MAX_FILTERS) mac_filter[mac_filters++] = optarg; break;
+			case 'z': if (comp_filters < MAX_FILTERS) comp_filter[comp_filters++] = optarg; break;
+			case 's':
+				if (!sizes_given) size_count = 0;
+				sizes_given = 1;
+				if (size_count < MAX_FILTERS) sizes[size_count++] = strtoul(optarg, NULL, 10);
+				break;
+			case 'j': json = 1; break;
+			default: usage(argv[0]);
+		}
+	}
+	for (s = 0; s < size_count; s++) {
+		if (sizes[s] == 0 || sizes[s] > MAX_PAYLOAD) {
+			fprintf(stderr, "sizes must be between 1 and %d\n", MAX_PAYLOAD);
+			return 1;
+		}
+	}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	/* Blowfish, CAST, RC4 and DES have been moved out to the legacy provider */
+	OSSL_PROVIDER_load(NULL, "legacy");
+	OSSL_PROVIDER_load(NULL, "default");
+#endif
+
+	srand(1);
+	fill_source_data();
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+		perror("socketpair");
+		return 1;
+	}
+	/* Big enough for a whole packet, so writing one never blocks waiting on the read */
+	for (i = 0; i < 2; i++) {
+		setsockopt(fds[i], SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+		setsockopt(fds[i], SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+	}
+
+	writer = libssh2_session_init();
+	reader = libssh2_session_init();
+	writer->socket_fd = fds[0];
+	reader->socket_fd = fds[1];
+
+	/* The reader needs a channel for the data to be addressed to */
+	channel = LIBSSH2_ALLOC(reader, sizeof(LIBSSH2_CHANNEL));
+	memset(channel, 0, sizeof(LIBSSH2_CHANNEL));
+	channel->session = reader;
+	channel->remote.packet_size = LIBSSH2_PACKET_MAXPAYLOAD;
+	channel->remote.window_size_initial = LIBSSH2_PACKET_MAXPAYLOAD;
+	reader->channels.head = reader->channels.tail = channel;
+
+	if (!json) {
+		printf("%-10s %-28s %-28s %-6s %6s\n", "benchmark", "cipher", "mac", "comp", "size");
+	}
+
+	for (s = 0; s < size_count; s++) {
+		for (i = 0; crypts[i]; i++) {
+			if (wanted(crypts[i]->name, cipher_filter, cipher_filters)) bench_cipher(writer, crypts[i], sizes[s]);
+		}
+		for (j = 0; macs[j]; j++) {
+			if (wanted(macs[j]->name, mac_filter, mac_filters)) bench_mac(writer, macs[j], sizes[s]);
+		}
+		for (k = 0; comps[k]; k++) {
+			if (wanted(comps[k]->name, comp_filter, comp_filters)) bench_comp(writer, comps[k], sizes[s]);
+		}
+	}
+
+	for (s = 0; s < size_count; s++) {
+		for (i = 0; crypts[i]; i++) {
+			if (!wanted(crypts[i]->name, cipher_filter, cipher_filters)) continue;
+			for (j = 0; macs[j]; j++) {
+				if (!wanted(macs[j]->name, mac_filter, mac_filters)) continue;
+				for (k = 0; comps[k]; k++) {
+					if (!wanted(comps[k]->name, comp_filter, comp_filters)) continue;
+					bench_transport(writer, reader, channel, crypts[i], macs[j], comps[k], sizes[s]);
+				}
+			}
+		}
+	}
+
+	for (s = 1; s <= 4096; s *= 16) {
+		bench_sftp_brigade(writer, s, 0);
+		bench_sftp_brigade(writer, s, 1);
+	}
+
+	close(fds[0]);
+	close(fds[1]);
+
+	return 0;
+}
@@ -0,0 +1,68 @@
+/* =============================================================================
+	FILE:		UKFSEventsWatcher.h
+	PROJECT:	Filie
+
+	LICENSES:   MIT License
+
+	REVISIONS:
+		2026-10-19	Created.
+   ========================================================================== */
+
+/*
+    UKFileWatcher for Mac OS X, on top of FSEvents. Unlike UKKQueue this
+    doesn't need a file descriptor per watched item: one event stream covers
+    every path added, and everything inside them, however deep. Items created
+    later are covered automatically.
+
+    FSEvents gathers changes up over coalescingInterval itself, and the
+    stream is scheduled on the main run loop, so each batch reaches the
+    delegate in one go, on the main thread.
+
+    Needs 10.7 or later, for per-file events.
+*/
+
+// -----------------------------------------------------------------------------
+//  Headers:
+// -----------------------------------------------------------------------------
+
+#import <Foundation/Foundation.h>
+#import "UKFileWatcher.h"
+
+#if !defined(__linux__)
+
+#include <CoreServices/CoreServices.h>
+
+
+// -----------------------------------------------------------------------------
+//  UKFSEventsWatcher:
+// -----------------------------------------------------------------------------
+
+@interface UKFSEventsWatcher : NSObject <UKFileWatcher>
+{
+	FSEventStreamRef		stream;					// Recreated whenever the paths change, as a stream's paths are fixed.
+	NSMutableArray*			watchedPaths;			// Paths added by clients. Each covers everything inside it too.
+	NSTimeInterval			coalescingInterval;
+	id						delegate;				// Gets messages about changes instead of notification center, if specified.
+	BOOL					alwaysNotify;			// Send notifications even if we have a delegate? Defaults to NO.
+}
+
++(id)	sharedFileWatcher;
+
+// Watches the item at path, and everything inside it if it's a folder.
+-(void)	addPath: (NSString*)path;
+-(void)	removePath: (NSString*)path;
+-(void)	removeAllPaths;
+
+// How long FSEvents gathers up changes before delivering them. Defaults to 0.5 seconds.
+-(NSTimeInterval)	coalescingInterval;
+-(void)				setCoalescingInterval: (NSTimeInterval)interval;
+
+-(id)	delegate;
+-(void)	setDelegate: (id)newDelegate;
+
+-(BOOL)	alwaysNotify;
+-(void)	setAlwaysNotify: (BOOL)n;
+
+@end
+
+#endif
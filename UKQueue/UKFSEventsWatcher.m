@@ -0,0 +1,327 @@
+/* =============================================================================
+	FILE:		UKFSEventsWatcher.m
+	PROJECT:	Filie
+
+	LICENSES:   MIT License
+
+	REVISIONS:
+		2026-10-19	Created.
+   ========================================================================== */
+
+// -----------------------------------------------------------------------------
+//  Headers:
+// -----------------------------------------------------------------------------
+
+#import "UKFSEventsWatcher.h"
+
+#if !defined(__linux__)
+
+#import <Cocoa/Cocoa.h>
+
+
+// -----------------------------------------------------------------------------
+//  Constants:
+// -----------------------------------------------------------------------------
+
+// FSEvents couldn't keep track of exactly what changed, so everything at the path needs looking at again.
+#define UKFSEventsWatcherRescanFlags		(kFSEventStreamEventFlagMustScanSubDirs | kFSEventStreamEventFlagUserDropped \
+											| kFSEventStreamEventFlagKernelDropped | kFSEventStreamEventFlagRootChanged)
+
+#define UKFSEventsWatcherAttributeFlags		(kFSEventStreamEventFlagItemInodeMetaMod | kFSEventStreamEventFlagItemChangeOwner \
+											| kFSEventStreamEventFlagItemXattrMod | kFSEventStreamEventFlagItemFinderInfoMod)
+
+
+// -----------------------------------------------------------------------------
+//  Globals:
+// -----------------------------------------------------------------------------
+
+static UKFSEventsWatcher*	gUKFSEventsWatcherSharedWatcher = nil;
+
+
+@interface UKFSEventsWatcher (Private)
+
+-(void)	restartStream;
+-(void)	handleEvents: (NSArray*)paths flags: (const FSEventStreamEventFlags*)flags;
+-(void)	postChanges: (NSDictionary*)changes;
+
+@end
+
+
+static void UKFSEventsWatcherCallback( ConstFSEventStreamRef streamRef, void* info, size_t count, void* paths,
+										const FSEventStreamEventFlags flags[], const FSEventStreamEventId ids[] )
+{
+	NSAutoreleasePool*	pool = [[NSAutoreleasePool alloc] init];
+	[(UKFSEventsWatcher*)info handleEvents: (NSArray*)paths flags: flags];
+	[pool release];
+}
+
+
+@implementation UKFSEventsWatcher
+
+// -----------------------------------------------------------------------------
+//  sharedFileWatcher:
+//		Returns a singleton watcher. Feel free to create additional instances
+//		using alloc/init to use independently.
+// -----------------------------------------------------------------------------
+
++(id) sharedFileWatcher
+{
+	static dispatch_once_t	onceToken;
+	dispatch_once( &onceToken, ^{
+		gUKFSEventsWatcherSharedWatcher = [[UKFSEventsWatcher alloc] init];	// This is a singleton, and thus an intentional "leak".
+	});
+
+	return gUKFSEventsWatcherSharedWatcher;
+}
+
+
+-(id)   init
+{
+	self = [super init];
+	if( self )
+	{
+		watchedPaths = [[NSMutableArray alloc] init];
+		coalescingInterval = 0.5;
+	}
+
+	return self;
+}
+
+
+// -----------------------------------------------------------------------------
+//	* DESTRUCTOR:
+//		The stream only calls back on the main run loop, so invalidating it
+//		there guarantees nothing more gets delivered.
+// -----------------------------------------------------------------------------
+
+-(void) dealloc
+{
+	delegate = nil;
+	[watchedPaths removeAllObjects];
+	[self restartStream];
+
+	[watchedPaths release];
+
+	[super dealloc];
+}
+
+
+// -----------------------------------------------------------------------------
+//	addPath:
+//		Start watching the item at path, and everything inside it. Call on the
+//		main thread.
+// -----------------------------------------------------------------------------
+
+-(void) addPath: (NSString*)path
+{
+	path = [path stringByStandardizingPath];
+	if( [watchedPaths containsObject: path] )
+		return;
+
+	[watchedPaths addObject: path];
+	[self restartStream];
+}
+
+
+-(void) removePath: (NSString*)path
+{
+	path = [path stringByStandardizingPath];
+	if( ![watchedPaths containsObject: path] )
+		return;
+
+	[watchedPaths removeObject: path];
+	[self restartStream];
+}
+
+
+-(void) removeAllPaths
+{
+	[watchedPaths removeAllObjects];
+	[self restartStream];
+}
+
+
+-(NSTimeInterval)	coalescingInterval
+{
+	return coalescingInterval;
+}
+
+
+-(void)	setCoalescingInterval: (NSTimeInterval)interval
+{
+	coalescingInterval = interval;
+	[self restartStream];
+}
+
+
+-(id)	delegate
+{
+	return delegate;
+}
+
+
+-(void)	setDelegate: (id)newDelegate
+{
+	delegate = newDelegate;
+}
+
+
+-(BOOL)	alwaysNotify
+{
+	return alwaysNotify;
+}
+
+
+-(void)	setAlwaysNotify: (BOOL)n
+{
+	alwaysNotify = n;
+}
+
+
+-(NSString*)	description
+{
+	return [NSString stringWithFormat: @"%@ { watchedPaths = %@, alwaysNotify = %@ }", NSStringFromClass([self class]), watchedPaths, (alwaysNotify? @"YES" : @"NO") ];
+}
+
+@end
+
+
+@implementation UKFSEventsWatcher (Private)
+
+// -----------------------------------------------------------------------------
+//	restartStream:
+//		A stream's paths can't be changed, so replace it with one for the
+//		current paths. Changes in between the two go unreported.
+// -----------------------------------------------------------------------------
+
+-(void)	restartStream
+{
+	if( stream )
+	{
+		FSEventStreamStop( stream );
+		FSEventStreamInvalidate( stream );
+		FSEventStreamRelease( stream );
+		stream = NULL;
+	}
+
+	if( [watchedPaths count] == 0 )
+		return;
+
+	// The stream doesn't retain us, or we'd never be deallocated. -dealloc invalidates it instead.
+	FSEventStreamContext	context = { 0, self, NULL, NULL, NULL };
+
+	stream = FSEventStreamCreate( NULL, UKFSEventsWatcherCallback, &context, (CFArrayRef)watchedPaths,
+								kFSEventStreamEventIdSinceNow, coalescingInterval,
+								kFSEventStreamCreateFlagUseCFTypes | kFSEventStreamCreateFlagFileEvents | kFSEventStreamCreateFlagWatchRoot );
+	if( !stream )
+	{
+		NSLog(@"UKFSEventsWatcher: Couldn't create event stream for %@", watchedPaths);
+		return;
+	}
+
+	FSEventStreamScheduleWithRunLoop( stream, CFRunLoopGetMain(), kCFRunLoopCommonModes );
+	if( !FSEventStreamStart( stream ) )
+		NSLog(@"UKFSEventsWatcher: Couldn't start event stream for %@", watchedPaths);
+}
+
+
+// -----------------------------------------------------------------------------
+//	handleEvents:flags:
+//		Merges a batch of events per path, in the same terms as the other
+//		watchers. Paths come from the kernel already resolved, so standardize
+//		them to match what clients added, e.g. /private/tmp to /tmp.
+// -----------------------------------------------------------------------------
+
+-(void)	handleEvents: (NSArray*)paths flags: (const FSEventStreamEventFlags*)flags
+{
+	NSMutableDictionary*	notifications = [NSMutableDictionary dictionaryWithCapacity: [paths count]];
+	NSUInteger				i = 0;
+
+	for( NSString* path in paths )
+	{
+		FSEventStreamEventFlags	eventFlags = flags[i++];
+		NSMutableSet*			names = [NSMutableSet setWithCapacity: 2];
+
+		path = [path stringByStandardizingPath];
+
+		if( eventFlags & kFSEventStreamEventFlagItemRenamed )
+			[names addObject: UKFileWatcherRenameNotification];
+		if( eventFlags & (kFSEventStreamEventFlagItemCreated | kFSEventStreamEventFlagItemModified | UKFSEventsWatcherRescanFlags) )
+			[names addObject: UKFileWatcherWriteNotification];
+		if( eventFlags & UKFSEventsWatcherRescanFlags )
+			[names addObject: UKFileWatcherRescanNotification];
+		if( eventFlags & kFSEventStreamEventFlagItemRemoved )
+			[names addObject: UKFileWatcherDeleteNotification];
+		if( eventFlags & UKFSEventsWatcherAttributeFlags )
+			[names addObject: UKFileWatcherAttributeChangeNotification];
+		if( eventFlags & kFSEventStreamEventFlagUnmount )
+			[names addObject: UKFileWatcherAccessRevocationNotification];
+
+		if( [names count] == 0 )
+			continue;
+
+		NSMutableSet*	existing = [notifications objectForKey: path];
+		if( existing )
+			[existing unionSet: names];
+		else
+			[notifications setObject: names forKey: path];
+
+		// Like kqueue, adding or removing an item counts as writing to its folder.
+		if( eventFlags & (kFSEventStreamEventFlagItemCreated | kFSEventStreamEventFlagItemRemoved | kFSEventStreamEventFlagItemRenamed) )
+		{
+			NSString*		folder = [path stringByDeletingLastPathComponent];
+			NSMutableSet*	folderNames = [notifications objectForKey: folder];
+			if( folderNames )
+				[folderNames addObject: UKFileWatcherWriteNotification];
+			else
+				[notifications setObject: [NSMutableSet setWithObject: UKFileWatcherWriteNotification] forKey: folder];
+		}
+	}
+
+	if( [notifications count] )
+		[self postChanges: notifications];
+}
+
+
+// -----------------------------------------------------------------------------
+//	postChanges:
+//		Delegates that understand batches get the whole lot in one go; others
+//		get the same per-path messages UKKQueue sends.
+// -----------------------------------------------------------------------------
+
+-(void)	postChanges: (NSDictionary*)changes
+{
+	NSMutableDictionary*	notifications = [NSMutableDictionary dictionaryWithCapacity: [changes count]];
+	for( NSString* path in changes )
+		[notifications setObject: [[changes objectForKey: path] allObjects] forKey: path];
+
+	if( delegate )
+	{
+		if( [delegate respondsToSelector: @selector(watcher:receivedNotifications:)] )
+			[delegate watcher: self receivedNotifications: notifications];
+		else
+		{
+			for( NSString* path in notifications )
+			{
+				for( NSString* name in [notifications objectForKey: path] )
+					[delegate watcher: self receivedNotification: name forPath: path];
+			}
+		}
+	}
+
+	if( !delegate || alwaysNotify )
+	{
+		NSNotificationCenter*	center = [[NSWorkspace sharedWorkspace] notificationCenter];
+
+		for( NSString* path in notifications )
+		{
+			NSDictionary*	userInfo = [NSDictionary dictionaryWithObjectsAndKeys: path, @"path", nil];
+			for( NSString* name in [notifications objectForKey: path] )
+				[center postNotificationName: name object: self userInfo: userInfo];
+		}
+	}
+}
+
+@end
+
+#endif
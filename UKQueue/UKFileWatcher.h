@@ -9,6 +9,7 @@
     LICENSES:   MIT License
 
 	REVISIONS:
+		2026-10-19		Added batched delegate message.
 		2006-03-13	UK	Moved notification constants to .m file.
 		2005-02-25	UK	Created.
    ========================================================================== */
@@ -45,13 +46,19 @@
 
 -(void) watcher: (id<UKFileWatcher>)kq receivedNotification: (NSString*)nm forPath: (NSString*)fpath;
 
+// Watchers that gather changes up into batches send this instead, if implemented.
+//	changes maps each path to an NSArray of the notification names for it.
+-(void) watcher: (id<UKFileWatcher>)kq receivedNotifications: (NSDictionary*)changes;
+
 @end
 
 
 // Notifications this sends:
 /*  object			= the file watcher object
 	userInfo.path	= file path watched
-	These notifications are sent via the NSWorkspace notification center */
+	These notifications are sent via the NSWorkspace notification center,
+	apart from on Linux, where there isn't one, and UKINotifyWatcher uses the
+	default center instead */
 extern NSString* UKFileWatcherRenameNotification;
 extern NSString* UKFileWatcherWriteNotification;
 extern NSString* UKFileWatcherDeleteNotification;
@@ -59,4 +66,5 @@ extern NSString* UKFileWatcherAttributeChangeNotification;
 extern NSString* UKFileWatcherSizeIncreaseNotification;
 extern NSString* UKFileWatcherLinkCountChangeNotification;
 extern NSString* UKFileWatcherAccessRevocationNotification;
+extern NSString* UKFileWatcherRescanNotification;			// Sent alongside a write when the watcher lost track of what changed, so everything inside the path needs looking at again.
 
@@ -17,7 +17,7 @@
 //  Headers:
 // -----------------------------------------------------------------------------
 
-#import <Cocoa/Cocoa.h>
+#import <Foundation/Foundation.h>
 #import "UKFileWatcher.h"
 
 
@@ -35,4 +35,5 @@ NSString* UKFileWatcherAttributeChangeNotification		= @"UKKQueueFileAttributesCh
 NSString* UKFileWatcherSizeIncreaseNotification			= @"UKKQueueFileSizeIncreasedNotification";
 NSString* UKFileWatcherLinkCountChangeNotification		= @"UKKQueueFileLinkCountChangedNotification";
 NSString* UKFileWatcherAccessRevocationNotification		= @"UKKQueueFileAccessRevocationNotification";
+NSString* UKFileWatcherRescanNotification				= @"UKKQueueFileRescanNotification";
 
@@ -0,0 +1,85 @@
+/* =============================================================================
+	FILE:		UKINotifyWatcher.h
+	PROJECT:	Filie
+
+	LICENSES:   MIT License
+
+	REVISIONS:
+		2026-10-19	Created.
+   ========================================================================== */
+
+/*
+    UKFileWatcher for Linux, on top of inotify. Unlike UKKQueue this doesn't
+    need a file descriptor per watched item: one inotify descriptor covers
+    everything, and watching a folder reports changes to the files inside it.
+    Folders can be watched recursively; subfolders created later get picked
+    up as they appear.
+
+    Events are read in bulk as they arrive, then coalesced per path until
+    none have arrived for coalescingInterval, so a file being written to in
+    lots of small chunks gives one write notification rather than hundreds.
+    A steady stream of changes still goes out every ten intervals or so.
+    Each batch reaches the main thread in a single hop.
+
+    Only needs Foundation. Without a delegate, notifications go to the
+    default notification center, as there's no NSWorkspace on Linux.
+
+    fanotify would let us mark a whole mount at once, but needs
+    CAP_SYS_ADMIN, which build agents don't generally have.
+*/
+
+// -----------------------------------------------------------------------------
+//  Headers:
+// -----------------------------------------------------------------------------
+
+#import <Foundation/Foundation.h>
+#import "UKFileWatcher.h"
+
+#if defined(__linux__)
+
+
+// -----------------------------------------------------------------------------
+//  UKINotifyWatcher:
+// -----------------------------------------------------------------------------
+
+@interface UKINotifyWatcher : NSObject <UKFileWatcher>
+{
+	int						inotifyFD;				// The inotify instance. Shared by every watch.
+	dispatch_queue_t		queue;					// Serializes reading events and changes to the watches.
+	dispatch_source_t		source;					// Fires when there are events to read.
+	dispatch_source_t		timer;					// Fires once changes have stopped arriving for coalescingInterval.
+	NSTimeInterval			batchStarted;			// When the first of the pending changes arrived, since the reference date.
+	NSMutableDictionary*	watchedPaths;			// Paths added by clients -> NSNumber of whether they're recursive.
+	NSMutableDictionary*	pathsByDescriptor;		// NSNumber of inotify watch descriptor -> path it covers.
+	NSMutableDictionary*	pendingChanges;			// Path -> NSNumber of changes seen since the last batch.
+	NSTimeInterval			coalescingInterval;
+	id						delegate;				// Gets messages about changes instead of notification center, if specified.
+	BOOL					alwaysNotify;			// Send notifications even if we have a delegate? Defaults to NO.
+}
+
++(id)	sharedFileWatcher;
+
+-(int)	inotifyFD;		// Owned by the receiver. Do not close it!
+
+// Watches everything inside the folder at path, including subfolders created later.
+//	addPath: only watches the item itself, plus the immediate contents if it's a folder.
+-(void)	addPath: (NSString*)path recursive: (BOOL)recursive;
+-(void)	removeAllPaths;
+
+// Paths inside it that were added themselves carry on being watched.
+-(void)	removePath: (NSString*)path;
+
+// How long to wait for changes to stop arriving before delivering them. Defaults to 0.5 seconds.
+//	Changes to the same path in the meantime are merged.
+-(NSTimeInterval)	coalescingInterval;
+-(void)				setCoalescingInterval: (NSTimeInterval)interval;
+
+-(id)	delegate;
+-(void)	setDelegate: (id)newDelegate;
+
+-(BOOL)	alwaysNotify;
+-(void)	setAlwaysNotify: (BOOL)n;
+
+@end
+
+#endif
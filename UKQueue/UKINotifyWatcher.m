@@ -0,0 +1,592 @@
+/* =============================================================================
+	FILE:		UKINotifyWatcher.m
+	PROJECT:	Filie
+
+	LICENSES:   MIT License
+
+	REVISIONS:
+		2026-10-19	Created.
+   ========================================================================== */
+
+// -----------------------------------------------------------------------------
+//  Headers:
+// -----------------------------------------------------------------------------
+
+#import "UKINotifyWatcher.h"
+
+#if defined(__linux__)
+
+#include <sys/inotify.h>
+#include <fts.h>
+#include <unistd.h>
+#include <errno.h>
+
+
+// -----------------------------------------------------------------------------
+//  Constants:
+// -----------------------------------------------------------------------------
+
+// What's gathered up for each path until the next batch is delivered:
+enum
+{
+	UKINotifyChangeRename			= 1 << 0,
+	UKINotifyChangeWrite			= 1 << 1,
+	UKINotifyChangeDelete			= 1 << 2,
+	UKINotifyChangeAttributes		= 1 << 3,
+	UKINotifyChangeRevocation		= 1 << 4,
+	UKINotifyChangeRescan			= 1 << 5,
+};
+
+// Watching a folder reports these for the items inside it too, so files don't need watches of their own.
+#define UKINotifyWatchMask		(IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE \
+								| IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_EXCL_UNLINK | IN_DONT_FOLLOW)
+
+// Room for a few hundred events per read().
+#define UKINotifyReadBufferSize	(64 * 1024)
+
+// However busy things are, a batch isn't held back for longer than this many coalescing intervals.
+#define UKINotifyMaximumCoalescingIntervals	10
+
+
+// -----------------------------------------------------------------------------
+//  Globals:
+// -----------------------------------------------------------------------------
+
+static UKINotifyWatcher*	gUKINotifyWatcherSharedWatcher = nil;
+static char					gUKINotifyWatcherQueueKey;
+
+
+@interface UKINotifyWatcher (Private)
+
+-(void)	readEvents;
+-(void)	handleEvent: (struct inotify_event*)event;
+-(void)	noteChanges: (unsigned)changes forPath: (NSString*)path;
+-(void)	scheduleDelivery;
+-(void)	deliverPendingChanges;
+-(void)	postChanges: (NSDictionary*)changes;
+
+-(void)	watchPath: (NSString*)path recursive: (BOOL)recursive reportingContents: (BOOL)report;
+-(void)	watchItemAtPath: (NSString*)path;
+-(void)	unwatchPath: (NSString*)path recursive: (BOOL)recursive;
+-(BOOL)	isRecursivelyWatchingPath: (NSString*)path;
+
+@end
+
+
+@implementation UKINotifyWatcher
+
+// -----------------------------------------------------------------------------
+//  sharedFileWatcher:
+//		Returns a singleton watcher. Feel free to create additional instances
+//		using alloc/init to use independently.
+// -----------------------------------------------------------------------------
+
++(id) sharedFileWatcher
+{
+	static dispatch_once_t	onceToken;
+	dispatch_once( &onceToken, ^{
+		gUKINotifyWatcherSharedWatcher = [[UKINotifyWatcher alloc] init];	// This is a singleton, and thus an intentional "leak".
+	});
+
+	return gUKINotifyWatcherSharedWatcher;
+}
+
+
+// -----------------------------------------------------------------------------
+//	* CONSTRUCTOR:
+//		Creates the inotify instance, and a dispatch source to read its events
+//		whenever some arrive. No thread sits around polling.
+// -----------------------------------------------------------------------------
+
+-(id)   init
+{
+	self = [super init];
+	if( self )
+	{
+		inotifyFD = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+		if( inotifyFD == -1 )
+		{
+			NSLog(@"UKINotifyWatcher: Couldn't create inotify instance (%d)", errno);
+			[self release];
+			return nil;
+		}
+
+		watchedPaths = [[NSMutableDictionary alloc] init];
+		pathsByDescriptor = [[NSMutableDictionary alloc] init];
+		pendingChanges = [[NSMutableDictionary alloc] init];
+		coalescingInterval = 0.5;
+
+		queue = dispatch_queue_create( "UKINotifyWatcher", DISPATCH_QUEUE_SERIAL );
+		dispatch_queue_set_specific( queue, &gUKINotifyWatcherQueueKey, self, NULL );
+
+		// The source mustn't retain us, or we'd never be deallocated. -dealloc cancels it instead.
+		__block UKINotifyWatcher*	watcher = self;
+		int							fd = inotifyFD;
+
+		source = dispatch_source_create( DISPATCH_SOURCE_TYPE_READ, fd, 0, queue );
+		dispatch_source_set_event_handler( source, ^{
+			[watcher readEvents];
+		});
+		dispatch_source_set_cancel_handler( source, ^{
+			if( close( fd ) == -1 )
+				NSLog(@"UKINotifyWatcher: Couldn't close inotify instance (%d)", errno);
+		});
+		dispatch_resume( source );
+
+		// Rescheduled as each lot of events comes in.
+		timer = dispatch_source_create( DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue );
+		dispatch_source_set_event_handler( timer, ^{
+			[watcher deliverPendingChanges];
+		});
+		dispatch_source_set_timer( timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0 );
+		dispatch_resume( timer );
+	}
+
+	return self;
+}
+
+
+// -----------------------------------------------------------------------------
+//	* DESTRUCTOR:
+//		Batches in flight retain us, so there's nothing left to deliver. Just
+//		need to make sure no more events get read, which cancelling on our
+//		queue guarantees.
+// -----------------------------------------------------------------------------
+
+-(void) dealloc
+{
+	delegate = nil;
+
+	if( source )
+	{
+		if( dispatch_get_specific( &gUKINotifyWatcherQueueKey ) == self )
+		{
+			dispatch_source_cancel( source );
+			dispatch_source_cancel( timer );
+		}
+		else
+			dispatch_sync( queue, ^{ dispatch_source_cancel( source ); dispatch_source_cancel( timer ); } );
+
+		dispatch_release( source );
+		dispatch_release( timer );
+	}
+	if( queue )
+		dispatch_release( queue );
+
+	[pathsByDescriptor release];		// closing the inotify instance gets rid of the watches themselves
+	[watchedPaths release];
+	[pendingChanges release];
+
+	[super dealloc];
+}
+
+
+-(int)  inotifyFD
+{
+	return inotifyFD;
+}
+
+
+// -----------------------------------------------------------------------------
+//	addPath:recursive:
+//		Start watching the item at path. For a folder, that includes changes to
+//		the items directly inside it. If recursive, the same goes for all
+//		subfolders, including those created later on.
+// -----------------------------------------------------------------------------
+
+-(void) addPath: (NSString*)path
+{
+	[self addPath: path recursive: NO];
+}
+
+
+-(void) addPath: (NSString*)path recursive: (BOOL)recursive
+{
+	path = [path stringByStandardizingPath];
+
+	dispatch_sync( queue, ^{
+		[watchedPaths setObject: [NSNumber numberWithBool: recursive] forKey: path];
+		[self watchPath: path recursive: recursive reportingContents: NO];
+	});
+}
+
+
+-(void) removePath: (NSString*)path
+{
+	path = [path stringByStandardizingPath];
+
+	dispatch_sync( queue, ^{
+		NSNumber*	recursive = [[[watchedPaths objectForKey: path] retain] autorelease];
+		if( !recursive )
+			return;
+
+		[watchedPaths removeObjectForKey: path];
+
+		// Might well still be covered by a folder being watched recursively.
+		if( [self isRecursivelyWatchingPath: path] )
+			return;
+
+		[self unwatchPath: path recursive: [recursive boolValue]];
+
+		// That takes out the watches for anything inside which was added in its own right, so put those back.
+		if( [recursive boolValue] )
+		{
+			NSString*	prefix = [path stringByAppendingString: @"/"];
+			for( NSString* aPath in watchedPaths )
+			{
+				if( [aPath hasPrefix: prefix] )
+					[self watchPath: aPath recursive: [[watchedPaths objectForKey: aPath] boolValue] reportingContents: NO];
+			}
+		}
+	});
+}
+
+
+-(void) removeAllPaths
+{
+	dispatch_sync( queue, ^{
+		for( NSNumber* descriptor in pathsByDescriptor )
+			inotify_rm_watch( inotifyFD, [descriptor intValue] );
+
+		[pathsByDescriptor removeAllObjects];
+		[watchedPaths removeAllObjects];
+	});
+}
+
+
+-(NSTimeInterval)	coalescingInterval
+{
+	return coalescingInterval;
+}
+
+
+-(void)	setCoalescingInterval: (NSTimeInterval)interval
+{
+	coalescingInterval = interval;
+}
+
+
+-(id)	delegate
+{
+	return delegate;
+}
+
+
+-(void)	setDelegate: (id)newDelegate
+{
+	delegate = newDelegate;
+}
+
+
+-(BOOL)	alwaysNotify
+{
+	return alwaysNotify;
+}
+
+
+-(void)	setAlwaysNotify: (BOOL)n
+{
+	alwaysNotify = n;
+}
+
+
+-(NSString*)	description
+{
+	return [NSString stringWithFormat: @"%@ { watchedPaths = %@, alwaysNotify = %@ }", NSStringFromClass([self class]), watchedPaths, (alwaysNotify? @"YES" : @"NO") ];
+}
+
+@end
+
+
+@implementation UKINotifyWatcher (Private)
+
+// -----------------------------------------------------------------------------
+//	readEvents:
+//		Called on our queue whenever there are events waiting. Reads as many
+//		as will fit per read() until there are none left, rather than one at a
+//		time.
+// -----------------------------------------------------------------------------
+
+-(void)	readEvents
+{
+	char	buffer[UKINotifyReadBufferSize] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t	length;
+
+	while( (length = read( inotifyFD, buffer, sizeof(buffer) )) > 0 )
+	{
+		NSAutoreleasePool*	pool = [[NSAutoreleasePool alloc] init];
+
+		char*	ptr = buffer;
+		while( ptr < buffer + length )
+		{
+			struct inotify_event*	event = (struct inotify_event*)ptr;
+			[self handleEvent: event];
+			ptr += sizeof(struct inotify_event) + event->len;
+		}
+
+		[pool release];
+	}
+
+	if( length == -1 && errno != EAGAIN && errno != EINTR )
+		NSLog(@"UKINotifyWatcher: Couldn't read events (%d)", errno);
+
+	if( [pendingChanges count] )
+		[self scheduleDelivery];
+}
+
+
+-(void)	handleEvent: (struct inotify_event*)event
+{
+	if( event->mask & IN_Q_OVERFLOW )
+	{
+		// The kernel dropped events, so can't tell what changed. Report everything.
+		for( NSString* path in watchedPaths )
+			[self noteChanges: UKINotifyChangeWrite | UKINotifyChangeRescan forPath: path];
+		return;
+	}
+
+	NSNumber*	descriptor = [NSNumber numberWithInt: event->wd];
+	NSString*	folder = [pathsByDescriptor objectForKey: descriptor];
+	if( !folder )
+		return;		// Removed since the event was queued.
+
+	if( event->mask & IN_IGNORED )
+	{
+		[pathsByDescriptor removeObjectForKey: descriptor];
+		return;
+	}
+
+	NSString*	path = folder;
+	if( event->len > 0 )
+		path = [folder stringByAppendingPathComponent: [[NSFileManager defaultManager] stringWithFileSystemRepresentation: event->name length: strlen( event->name )]];
+
+	unsigned	changes = 0;
+	if( event->mask & (IN_MODIFY | IN_CLOSE_WRITE) )
+		changes |= UKINotifyChangeWrite;
+	if( event->mask & IN_ATTRIB )
+		changes |= UKINotifyChangeAttributes;
+	if( event->mask & (IN_DELETE | IN_DELETE_SELF) )
+		changes |= UKINotifyChangeDelete;
+	if( event->mask & (IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF) )
+		changes |= UKINotifyChangeRename;
+	if( event->mask & IN_UNMOUNT )
+		changes |= UKINotifyChangeRevocation;
+
+	if( changes )
+		[self noteChanges: changes forPath: path];
+
+	// Like kqueue, adding or removing an item counts as writing to its folder.
+	if( event->len > 0 && (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) )
+		[self noteChanges: UKINotifyChangeWrite forPath: folder];
+
+	// Keep recursive watches in step with folders coming and going.
+	if( event->len > 0 && (event->mask & IN_ISDIR) )
+	{
+		if( event->mask & IN_MOVED_FROM )
+			[self unwatchPath: path recursive: YES];
+
+		if( (event->mask & (IN_CREATE | IN_MOVED_TO)) && [self isRecursivelyWatchingPath: folder] )
+			[self watchPath: path recursive: YES reportingContents: YES];
+	}
+}
+
+
+// -----------------------------------------------------------------------------
+//	noteChanges:forPath:
+//		Merges the changes into the current batch.
+// -----------------------------------------------------------------------------
+
+-(void)	noteChanges: (unsigned)changes forPath: (NSString*)path
+{
+	if( [pendingChanges count] == 0 )
+		batchStarted = [NSDate timeIntervalSinceReferenceDate];
+
+	NSNumber*	existing = [pendingChanges objectForKey: path];
+	[pendingChanges setObject: [NSNumber numberWithUnsignedInt: [existing unsignedIntValue] | changes] forKey: path];
+}
+
+
+// -----------------------------------------------------------------------------
+//	scheduleDelivery:
+//		Pushes delivery back to coalescingInterval from now, so the batch goes
+//		out once things have gone quiet. A steady trickle of changes mustn't
+//		hold it back forever though.
+// -----------------------------------------------------------------------------
+
+-(void)	scheduleDelivery
+{
+	NSTimeInterval	waited = [NSDate timeIntervalSinceReferenceDate] - batchStarted;
+	NSTimeInterval	delay = MIN( coalescingInterval, UKINotifyMaximumCoalescingIntervals * coalescingInterval - waited );
+
+	dispatch_source_set_timer( timer, dispatch_time( DISPATCH_TIME_NOW, (int64_t)(MAX( delay, 0.0 ) * NSEC_PER_SEC) ), DISPATCH_TIME_FOREVER, NSEC_PER_SEC / 100 );
+}
+
+
+-(void)	deliverPendingChanges
+{
+	dispatch_source_set_timer( timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0 );
+
+	if( [pendingChanges count] == 0 )
+		return;
+
+	NSDictionary*	batch = pendingChanges;
+	pendingChanges = [[NSMutableDictionary alloc] init];
+
+	dispatch_async( dispatch_get_main_queue(), ^{
+		[self postChanges: batch];
+		[batch release];
+	});
+}
+
+
+// -----------------------------------------------------------------------------
+//	postChanges:
+//		Main-thread end of delivering a batch. Delegates that understand
+//		batches get the whole lot in one go; others get the same per-path
+//		messages UKKQueue sends.
+// -----------------------------------------------------------------------------
+
+-(void)	postChanges: (NSDictionary*)changes
+{
+	NSMutableDictionary*	notifications = [NSMutableDictionary dictionaryWithCapacity: [changes count]];
+
+	for( NSString* path in changes )
+	{
+		unsigned		flags = [[changes objectForKey: path] unsignedIntValue];
+		NSMutableArray*	names = [NSMutableArray arrayWithCapacity: 2];
+
+		if( flags & UKINotifyChangeRename )
+			[names addObject: UKFileWatcherRenameNotification];
+		if( flags & UKINotifyChangeWrite )
+			[names addObject: UKFileWatcherWriteNotification];
+		if( flags & UKINotifyChangeDelete )
+			[names addObject: UKFileWatcherDeleteNotification];
+		if( flags & UKINotifyChangeAttributes )
+			[names addObject: UKFileWatcherAttributeChangeNotification];
+		if( flags & UKINotifyChangeRevocation )
+			[names addObject: UKFileWatcherAccessRevocationNotification];
+		if( flags & UKINotifyChangeRescan )
+			[names addObject: UKFileWatcherRescanNotification];
+
+		[notifications setObject: names forKey: path];
+	}
+
+	if( delegate )
+	{
+		if( [delegate respondsToSelector: @selector(watcher:receivedNotifications:)] )
+			[delegate watcher: self receivedNotifications: notifications];
+		else
+		{
+			for( NSString* path in notifications )
+			{
+				for( NSString* name in [notifications objectForKey: path] )
+					[delegate watcher: self receivedNotification: name forPath: path];
+			}
+		}
+	}
+
+	if( !delegate || alwaysNotify )
+	{
+		NSNotificationCenter*	center = [NSNotificationCenter defaultCenter];
+
+		for( NSString* path in notifications )
+		{
+			NSDictionary*	userInfo = [NSDictionary dictionaryWithObjectsAndKeys: path, @"path", nil];
+			for( NSString* name in [notifications objectForKey: path] )
+				[center postNotificationName: name object: self userInfo: userInfo];
+		}
+	}
+}
+
+
+// -----------------------------------------------------------------------------
+//	watchPath:recursive:reportingContents:
+//		Adds watches for the item, and if recursive, every folder below it.
+//		Files never need watches of their own. When picking up a folder that's
+//		only just appeared, report its contents as written, since they may
+//		have arrived before the watch was in place.
+// -----------------------------------------------------------------------------
+
+-(void)	watchPath: (NSString*)path recursive: (BOOL)recursive reportingContents: (BOOL)report
+{
+	if( !recursive )
+	{
+		[self watchItemAtPath: path];
+		return;
+	}
+
+	char* const	paths[] = { (char*)[path fileSystemRepresentation], NULL };
+	FTS*		fts = fts_open( paths, FTS_PHYSICAL | FTS_NOCHDIR | FTS_NOSTAT, NULL );
+	if( !fts )
+	{
+		NSLog(@"UKINotifyWatcher: Couldn't walk %@ (%d)", path, errno);
+		return;
+	}
+
+	NSFileManager*	fileManager = [NSFileManager defaultManager];
+	FTSENT*			entry;
+	while( (entry = fts_read( fts )) )
+	{
+		if( entry->fts_info == FTS_DP || entry->fts_info == FTS_DNR || entry->fts_info == FTS_ERR )
+			continue;
+
+		NSString*	subpath = [fileManager stringWithFileSystemRepresentation: entry->fts_path length: entry->fts_pathlen];
+
+		if( entry->fts_info == FTS_D )
+			[self watchItemAtPath: subpath];
+
+		if( report && entry->fts_level > 0 )
+			[self noteChanges: UKINotifyChangeWrite forPath: subpath];
+	}
+
+	fts_close( fts );
+}
+
+
+-(void)	watchItemAtPath: (NSString*)path
+{
+	int		wd = inotify_add_watch( inotifyFD, [path fileSystemRepresentation], UKINotifyWatchMask );
+	if( wd == -1 )
+	{
+		NSLog(@"UKINotifyWatcher: Couldn't watch %@ (%d)", path, errno);
+		return;
+	}
+
+	[pathsByDescriptor setObject: path forKey: [NSNumber numberWithInt: wd]];
+}
+
+
+-(void)	unwatchPath: (NSString*)path recursive: (BOOL)recursive
+{
+	path = [[path retain] autorelease];		// In case it's one of the values about to be removed.
+
+	NSString*	prefix = [path stringByAppendingString: @"/"];
+	for( NSNumber* descriptor in [pathsByDescriptor allKeys] )	// copied, as entries are removed along the way
+	{
+		NSString*	aPath = [pathsByDescriptor objectForKey: descriptor];
+		if( [aPath isEqualToString: path] || (recursive && [aPath hasPrefix: prefix]) )
+		{
+			inotify_rm_watch( inotifyFD, [descriptor intValue] );
+			[pathsByDescriptor removeObjectForKey: descriptor];
+		}
+	}
+}
+
+
+-(BOOL)	isRecursivelyWatchingPath: (NSString*)path
+{
+	for( NSString* aPath in watchedPaths )
+	{
+		if( ![[watchedPaths objectForKey: aPath] boolValue] )
+			continue;
+
+		if( [path isEqualToString: aPath] || [path hasPrefix: [aPath stringByAppendingString: @"/"]] )
+			return YES;
+	}
+
+	return NO;
+}
+
+@end
+
+#endif
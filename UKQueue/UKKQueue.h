@@ -9,6 +9,7 @@
     LICENSES:   MIT License
 
 	REVISIONS:
+		2026-10-19		Keep watched paths in hash tables.
 		2006-03-13	UK	Clarified license, streamlined UKFileWatcher stuff,
 						Changed notifications to be useful and turned off by
 						default some deprecated stuff.
@@ -76,8 +77,8 @@
 @interface UKKQueue : NSObject <UKFileWatcher>
 {
 	int				queueFD;			// The actual queue ID (Unix file descriptor).
-	NSMutableArray* watchedPaths;		// List of NSStrings containing the paths we're watching.
-	NSMutableArray* watchedFDs;			// List of NSNumbers containing the file descriptors we're watching.
+	CFMutableDictionaryRef	watchedPaths;	// NSString path -> entry for it. The kevent's udata points at the same entry.
+	CFMutableDictionaryRef	watchedFDs;		// File descriptor -> entry, so events can be checked against removals.
 	id				delegate;			// Gets messages about changes instead of notification center, if specified.
 	id				delegateProxy;		// Proxy object to which we send messages so they reach delegate on the main thread.
 	BOOL			alwaysNotify;		// Send notifications even if we have a delegate? Defaults to NO.
@@ -9,6 +9,8 @@
     LICENSES:   MIT License
 
 	REVISIONS:
+		2026-10-19		Keep watched paths in hash tables, and point the
+						kevent's udata at a compact entry.
 		2006-03-13	UK	Clarified license, streamlined UKFileWatcher stuff,
 						Changed notifications to be useful and turned off by
 						default some deprecated stuff.
@@ -40,6 +42,37 @@
 #endif
 
 
+// -----------------------------------------------------------------------------
+//  Data Structures:
+// -----------------------------------------------------------------------------
+
+// One per watched path. Both tables and the kevent's udata refer to it, so
+//	adding, removing and handling an event never has to search.
+
+typedef struct UKKQueueEntry
+{
+	int			fd;
+	u_int		fflags;
+	NSString*	path;		// Retained.
+} UKKQueueEntry;
+
+
+static void	UKKQueueEntryFree( UKKQueueEntry* entry )
+{
+	if( close( entry->fd ) == -1 )
+		NSLog(@"UKKQueue: Couldn't close file descriptor (%d)", errno);
+	
+	[entry->path release];
+	free( entry );
+}
+
+
+static void	UKKQueueEntryFreeApplier( const void* key, const void* value, void* context )
+{
+	UKKQueueEntryFree( (UKKQueueEntry*)value );
+}
+
+
 // -----------------------------------------------------------------------------
 //  Globals:
 // -----------------------------------------------------------------------------
@@ -107,8 +140,8 @@ static UKKQueue * gUKKQueueSharedQueueSingleton = nil;
 			return nil;
 		}
 		
-		watchedPaths = [[NSMutableArray alloc] init];
-		watchedFDs = [[NSMutableArray alloc] init];
+		watchedPaths = CFDictionaryCreateMutable( NULL, 0, &kCFTypeDictionaryKeyCallBacks, NULL );
+		watchedFDs = CFDictionaryCreateMutable( NULL, 0, NULL, NULL );
 		
 		// Start new thread that fetches and processes our events:
 		keepThreadRunning = YES;
@@ -158,18 +191,17 @@ static UKKQueue * gUKKQueueSharedQueueSingleton = nil;
 		keepThreadRunning = NO;
 	
 	// Close all our file descriptors so the files can be deleted:
-	NSEnumerator*	enny = [watchedFDs objectEnumerator];
-	NSNumber*		fdNum;
-	while( (fdNum = [enny nextObject]) )
+	if( watchedFDs )
 	{
-    	if( close( [fdNum intValue] ) == -1 )
-            NSLog(@"dealloc: Couldn't close file descriptor (%d)", errno);
-    }
-	
-	[watchedPaths release];
-	watchedPaths = nil;
-	[watchedFDs release];
-	watchedFDs = nil;
+		CFDictionaryApplyFunction( watchedFDs, UKKQueueEntryFreeApplier, NULL );
+		CFRelease( watchedFDs );
+		watchedFDs = NULL;
+	}
+	if( watchedPaths )
+	{
+		CFRelease( watchedPaths );
+		watchedPaths = NULL;
+	}
 	
 	[super dealloc];
     
@@ -222,7 +254,11 @@ static UKKQueue * gUKKQueueSharedQueueSingleton = nil;
 //		Tell this queue to listen for the specified notifications sent for
 //		the object at the specified path.
 //
+//		Adding a path that's already watched just changes which notifications
+//		it gets.
+//
 //	REVISIONS:
+//		2026-10-19		Looks for an existing entry rather than adding another.
 //      2005-06-29  UK  Files are now opened using O_EVTONLY instead of O_RDONLY
 //                      which allows ejecting or deleting watched files/folders.
 //                      Thanks to Phil Hargett for finding this flag in the docs.
@@ -233,18 +269,45 @@ static UKKQueue * gUKKQueueSharedQueueSingleton = nil;
 {
 	struct timespec		nullts = { 0, 0 };
 	struct kevent		ev;
-	int					fd = open( [path fileSystemRepresentation], O_EVTONLY, 0 );
 	
+	AT_SYNCHRONIZED( self )
+	{
+		UKKQueueEntry*	entry = (UKKQueueEntry*)CFDictionaryGetValue( watchedPaths, path );
+		if( entry )
+		{
+			// Re-adding the same ident modifies the existing event:
+			entry->fflags = fflags;
+			EV_SET( &ev, entry->fd, EVFILT_VNODE, 
+					EV_ADD | EV_ENABLE | EV_CLEAR,
+					fflags, 0, entry );
+			kevent( queueFD, &ev, 1, NULL, 0, &nullts );
+			return;
+		}
+	}
+	
+	int		fd = open( [path fileSystemRepresentation], O_EVTONLY, 0 );
     if( fd >= 0 )
     {
+		UKKQueueEntry*	entry = malloc( sizeof(UKKQueueEntry) );
+		entry->fd = fd;
+		entry->fflags = fflags;
+		entry->path = [path copy];
+		
         EV_SET( &ev, fd, EVFILT_VNODE, 
 				EV_ADD | EV_ENABLE | EV_CLEAR,
-				fflags, 0, (void*)path );
+				fflags, 0, entry );
 		
         AT_SYNCHRONIZED( self )
         {
-            [watchedPaths addObject: path];
-            [watchedFDs addObject: [NSNumber numberWithInt: fd]];
+            if( CFDictionaryGetValue( watchedPaths, path ) )
+            {
+                // Another thread added it while the file was being opened:
+                UKKQueueEntryFree( entry );
+                return;
+            }
+            
+            CFDictionarySetValue( watchedPaths, entry->path, entry );
+            CFDictionarySetValue( watchedFDs, (const void*)(intptr_t)fd, entry );
             kevent( queueFD, &ev, 1, NULL, 0, &nullts );
         }
     }
@@ -269,24 +332,21 @@ static UKKQueue * gUKKQueueSharedQueueSingleton = nil;
 
 -(void) removePathFromQueue: (NSString*)path
 {
-    int		index = 0;
-    int		fd = -1;
+    UKKQueueEntry*	entry = NULL;
     
     AT_SYNCHRONIZED( self )
     {
-        index = [watchedPaths indexOfObject: path];
+        entry = (UKKQueueEntry*)CFDictionaryGetValue( watchedPaths, path );
         
-        if( index == NSNotFound )
+        if( !entry )
             return;
         
-        fd = [[watchedFDs objectAtIndex: index] intValue];
-        
-        [watchedFDs removeObjectAtIndex: index];
-        [watchedPaths removeObjectAtIndex: index];
+        CFDictionaryRemoveValue( watchedFDs, (const void*)(intptr_t)entry->fd );
+        CFDictionaryRemoveValue( watchedPaths, entry->path );
     }
 	
-	if( close( fd ) == -1 )
-        NSLog(@"removePathFromQueue: Couldn't close file descriptor (%d)", errno);
+	// Closing the file descriptor takes it out of the kqueue too:
+	UKKQueueEntryFree( entry );
 }
 
 
@@ -303,14 +363,9 @@ static UKKQueue * gUKKQueueSharedQueueSingleton = nil;
 {
     AT_SYNCHRONIZED( self )
     {
-        NSEnumerator *  fdEnumerator = [watchedFDs objectEnumerator];
-        NSNumber     *  anFD;
-        
-        while( (anFD = [fdEnumerator nextObject]) != nil )
-            close( [anFD intValue] );
-
-        [watchedFDs removeAllObjects];
-        [watchedPaths removeAllObjects];
+        CFDictionaryApplyFunction( watchedFDs, UKKQueueEntryFreeApplier, NULL );
+        CFDictionaryRemoveAllValues( watchedFDs );
+        CFDictionaryRemoveAllValues( watchedPaths );
     }
 }
 
@@ -327,6 +382,8 @@ static UKKQueue * gUKKQueueSharedQueueSingleton = nil;
 //      To terminate this method (and its thread), set keepThreadRunning to NO.
 //
 //	REVISIONS:
+//		2026-10-19		Checks the event's entry is still registered before
+//						using it.
 //		2005-08-27	UK	Changed to use keepThreadRunning instead of kqueueFD
 //						being -1 as termination criterion, and to close the
 //						queue in this thread so the main thread isn't blocked.
@@ -352,9 +409,19 @@ static UKKQueue * gUKKQueueSharedQueueSingleton = nil;
 			{
 				if( ev.filter == EVFILT_VNODE )
 				{
-					if( ev.fflags )
+					NSString*		fpath = nil;
+					
+					// The entry may have been removed and freed since the event was queued. If it's
+					//	still the one registered for the file descriptor, it's safe to use.
+					AT_SYNCHRONIZED( self )
+					{
+						UKKQueueEntry*	entry = (UKKQueueEntry*)ev.udata;
+						if( CFDictionaryGetValue( watchedFDs, (const void*)(intptr_t)ev.ident ) == entry )
+							fpath = [[entry->path retain] autorelease];    // In case one of the notified folks removes the path.
+					}
+					
+					if( ev.fflags && fpath )
 					{
-						NSString*		fpath = [[(NSString *)ev.udata retain] autorelease];    // In case one of the notified folks removes the path.
 						//NSLog(@"UKKQueue: Detected file change: %@", fpath);
 						[[NSWorkspace sharedWorkspace] noteFileSystemChanged: fpath];
 						
@@ -472,7 +539,13 @@ static UKKQueue * gUKKQueueSharedQueueSingleton = nil;
 
 -(NSString*)	description
 {
-	return [NSString stringWithFormat: @"%@ { watchedPaths = %@, alwaysNotify = %@ }", NSStringFromClass([self class]), watchedPaths, (alwaysNotify? @"YES" : @"NO") ];
+	NSArray*	paths = nil;
+	AT_SYNCHRONIZED( self )
+	{
+		paths = [[(NSDictionary*)watchedPaths allKeys] retain];
+	}
+	
+	return [NSString stringWithFormat: @"%@ { watchedPaths = %@, alwaysNotify = %@ }", NSStringFromClass([self class]), [paths autorelease], (alwaysNotify? @"YES" : @"NO") ];
 }
 
 @end
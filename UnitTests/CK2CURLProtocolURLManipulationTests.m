@@ -126,4 +126,39 @@
     STAssertFalse(isDirectory, nil);
 }
 
+- (void)testFTPBatchCommandsForDirectories;
+{
+    NSArray *urls = [NSArray arrayWithObjects:
+                     [NSURL URLWithString:@"ftp://example.com/test/file.txt"],
+                     [NSURL URLWithString:@"ftp://example.com/test/directory/"],
+                     nil];
+    
+    STAssertEqualObjects([CK2FTPProtocol commandsWithFormat:@"DELE %@" directoryFormat:@"RMD %@" forURLs:urls],
+                         ([NSArray arrayWithObjects:@"DELE file.txt", @"RMD directory", nil]),
+                         nil);
+    
+    STAssertEqualObjects([CK2FTPProtocol commandsWithFormat:@"DELE %@" forURLs:urls],
+                         ([NSArray arrayWithObjects:@"DELE file.txt", @"DELE directory", nil]),
+                         nil);
+}
+
+- (void)testSFTPCommandArgumentsAreQuoted;
+{
+    STAssertEqualObjects([CK2SFTPProtocol commandArgumentWithString:@"file name.txt"], @"\"file name.txt\"", nil);
+    STAssertEqualObjects([CK2SFTPProtocol commandArgumentWithString:@"say \"hi\".txt"], @"\"say \\\"hi\\\".txt\"", nil);
+    STAssertEqualObjects([CK2SFTPProtocol commandArgumentWithString:@"back\\slash"], @"\"back\\\\slash\"", nil);
+}
+
+- (void)testSFTPBatchCommandsAreQuoted;
+{
+    NSArray *urls = [NSArray arrayWithObjects:
+                     [NSURL URLWithString:@"sftp://example.com/test/file%20name.txt"],
+                     [NSURL URLWithString:@"sftp://example.com/test/directory/"],
+                     nil];
+    
+    STAssertEqualObjects([CK2SFTPProtocol commandsWithFormat:@"rm %@" directoryFormat:@"rmdir %@" forURLs:urls],
+                         ([NSArray arrayWithObjects:@"rm \"file name.txt\"", @"rmdir \"directory\"", nil]),
+                         nil);
+}
+
 @end
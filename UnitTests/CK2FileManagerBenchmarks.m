@@ -0,0 +1,414 @@
+//
+//  CK2FileManagerBenchmarks.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CK2FileManagerBaseTests.h"
+
+#import "CK2FileManager.h"
+#import <SenTestingKit/SenTestingKit.h>
+
+// Times CK2FileManager workloads against real servers, appending the results to a JSON file so they can be compared between builds.
+// Normally does nothing; benchmark.sh starts up local servers and sets the defaults this looks for:
+//
+//  CKBenchmarkOutput           path of the JSON file to append results to. Benchmarks are skipped if this isn't set
+//  CKFTPBenchmarkURL           }
+//  CKSFTPBenchmarkURL          } server to run against for each protocol, including credentials and port. Unset or "Off" skips that protocol
+//  CKWebDAVBenchmarkURL        }
+//  CKBenchmarkLatency          latency (in ms) that has been injected between us and the servers. Just recorded alongside the results
+//  CKBenchmarkFileCounts       array of file counts to try; defaults to 1, 1000, 100000
+//  CKBenchmarkFileSizes        array of file sizes to try; defaults to 1KB up to 4GB
+//  CKBenchmarkMaximumBytes     skip any count/size combination which would upload more than this; defaults to 4GB
+//
+// The file: copy benchmark needs only CKBenchmarkOutput, as it runs within the local temporary folder
+
+@interface CK2FileManagerBenchmarks : CK2FileManagerBaseTests
+{
+    NSMutableArray  *_results;
+}
+@end
+
+
+@implementation CK2FileManagerBenchmarks
+
+- (void)dealloc
+{
+    [_results release];
+    [super dealloc];
+}
+
+#pragma mark - Configuration
+
+- (NSString*)outputPath
+{
+    return [[NSUserDefaults standardUserDefaults] stringForKey:@"CKBenchmarkOutput"];
+}
+
+- (NSArray*)fileCounts
+{
+    return [[NSUserDefaults standardUserDefaults] arrayForKey:@"CKBenchmarkFileCounts"] ?: @[ @1, @1000, @100000 ];
+}
+
+- (NSArray*)fileSizes
+{
+    return [[NSUserDefaults standardUserDefaults] arrayForKey:@"CKBenchmarkFileSizes"] ?: @[ @1024ULL, @(1024ULL * 1024), @(64ULL * 1024 * 1024), @(4ULL * 1024 * 1024 * 1024) ];
+}
+
+- (unsigned long long)maximumBytes
+{
+    NSNumber* maximum = [[NSUserDefaults standardUserDefaults] objectForKey:@"CKBenchmarkMaximumBytes"];
+    return (maximum ? [maximum unsignedLongLongValue] : 4ULL * 1024 * 1024 * 1024);
+}
+
+- (NSInteger)latency
+{
+    return [[NSUserDefaults standardUserDefaults] integerForKey:@"CKBenchmarkLatency"];
+}
+
+- (BOOL)setupBenchmarkSessionForProtocol:(NSString*)protocol
+{
+    if (![self outputPath]) return NO;
+
+    NSString* key = [NSString stringWithFormat:@"CK%@BenchmarkURL", protocol];
+    NSString* setting = [[NSUserDefaults standardUserDefaults] stringForKey:key];
+    if (!setting || [setting isEqualToString:@"Off"])
+    {
+        NSLog(@"skipping %@ benchmarks as %@ isn't set", protocol, key);
+        return NO;
+    }
+
+    // Unlike the regular tests, local servers won't be on the standard ports
+    NSURL* url = [NSURL URLWithString:setting];
+    NSString* port = ([url port] ? [NSString stringWithFormat:@":%@", [url port]] : @"");
+    self.user = url.user;
+    self.password = url.password;
+    self.url = [NSURL URLWithString:[NSString stringWithFormat:@"%@://%@%@%@/", url.scheme, url.host, port, url.path]];
+    self.type = protocol;
+
+    self.originalUser = self.user;
+    self.originalPassword = self.password;
+
+    return [self setupSession];
+}
+
+#pragma mark - Results
+
+- (void)recordProtocol:(NSString*)protocol workload:(NSString*)workload count:(NSUInteger)count size:(unsigned long long)size time:(NSTimeInterval)time error:(NSError*)error
+{
+    NSMutableDictionary* result = [NSMutableDictionary dictionaryWithDictionary:@{
+                                   @"protocol" : protocol,
+                                   @"workload" : workload,
+                                   @"count" : @(count),
+                                   @"size" : @(size),
+                                   @"latency_ms" : @([self latency]),
+                                   @"seconds" : @(time),
+                                   @"items_per_second" : @(time > 0 ? count / time : 0),
+                                   @"bytes_per_second" : @(time > 0 ? (count * size) / time : 0),
+                                   @"date" : [[NSDate date] description],
+                                   }];
+    if (error) [result setObject:[error description] forKey:@"error"];
+
+    NSLog(@"%@ %@ %lu x %llu: %.3fs%@", protocol, workload, (unsigned long)count, size, time, (error ? @" FAILED" : @""));
+
+    if (!_results) _results = [[NSMutableArray alloc] init];
+    [_results addObject:result];
+}
+
+- (void)writeResults
+{
+    if (![_results count]) return;
+
+    // Each run appends to whatever's there already, so benchmark.sh can make several passes at different latencies
+    NSString* path = [self outputPath];
+    NSMutableArray* all = [NSMutableArray array];
+    NSData* existing = [NSData dataWithContentsOfFile:path];
+    if (existing)
+    {
+        NSArray* previous = [NSJSONSerialization JSONObjectWithData:existing options:0 error:NULL];
+        if ([previous isKindOfClass:[NSArray class]]) [all addObjectsFromArray:previous];
+    }
+    [all addObjectsFromArray:_results];
+
+    NSError* error = nil;
+    NSData* data = [NSJSONSerialization dataWithJSONObject:all options:NSJSONWritingPrettyPrinted error:&error];
+    STAssertTrue([data writeToFile:path options:NSDataWritingAtomic error:&error], @"failed to write benchmark results with error %@", error);
+
+    [_results removeAllObjects];
+}
+
+- (void)tearDown
+{
+    [self writeResults];
+    [super tearDown];
+}
+
+- (void)fileManager:(CK2FileManager *)manager appendString:(NSString *)info toTranscript:(CKTranscriptType)transcriptType
+{
+    // No point keeping a transcript of thousands of operations, and building it up would skew the timings
+}
+
+#pragma mark - Workloads
+
+- (NSURL*)sourceFileOfSize:(unsigned long long)size
+{
+    // Sparse, so even the biggest sizes don't need the space or time to write them out locally
+    NSURL* url = [[self temporaryFolder] URLByAppendingPathComponent:[NSString stringWithFormat:@"source-%llu.dat", size]];
+    if (![[NSFileManager defaultManager] fileExistsAtPath:[url path]])
+    {
+        [[NSFileManager defaultManager] createFileAtPath:[url path] contents:nil attributes:nil];
+        NSFileHandle* handle = [NSFileHandle fileHandleForWritingToURL:url error:NULL];
+        [handle truncateFileAtOffset:size];
+        [handle closeFile];
+    }
+    return url;
+}
+
+// Directories get a trailing slash, so they're removed as such
+- (NSArray*)URLsForCount:(NSUInteger)count inDirectory:(NSURL*)directory prefix:(NSString*)prefix isDirectory:(BOOL)isDirectory
+{
+    NSMutableArray* urls = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; ++i)
+    {
+        [urls addObject:[directory URLByAppendingPathComponent:[NSString stringWithFormat:@"%@%lu", prefix, (unsigned long)i] isDirectory:isDirectory]];
+    }
+    return urls;
+}
+
+- (NSURL*)makeBenchmarkDirectory
+{
+    NSURL* directory = [self URLForPath:[NSString stringWithFormat:@"ck-benchmark-%@/", [[NSProcessInfo processInfo] globallyUniqueString]]];
+
+    __block NSError* result = nil;
+    [self.session createDirectoryAtURL:directory withIntermediateDirectories:YES openingAttributes:nil completionHandler:^(NSError *error) {
+        result = [error retain];
+        [self pause];
+    }];
+    [self runUntilPaused];
+
+    STAssertNil(result, @"failed to make benchmark directory with error %@", result);
+    [result autorelease];
+    return (result ? nil : directory);
+}
+
+// Every item is expected to go; if the batch as a whole succeeds, the first item to fail is the error
+- (NSTimeInterval)removeItemsAtURLs:(NSArray*)urls error:(NSError**)outError
+{
+    __block NSError* result = nil;
+    __block NSError* itemResult = nil;
+    NSMutableSet* reported = [NSMutableSet setWithCapacity:[urls count]];
+
+    NSDate* start = [NSDate date];
+    [self.session removeItemsAtURLs:urls itemHandler:^(NSURL *url, NSError *error) {
+        STAssertNil(error, @"failed to remove %@ with error %@", url, error);
+        if (error && !itemResult) itemResult = [error retain];
+        [reported addObject:url];
+    } completionHandler:^(NSError *error) {
+        result = [error retain];
+        [self pause];
+    }];
+    [self runUntilPaused];
+    NSTimeInterval time = -[start timeIntervalSinceNow];
+
+    STAssertNil(result, @"failed to remove items with error %@", result);
+    STAssertTrue(result || [reported count] == [urls count], @"%lu of %lu items reported", (unsigned long)[reported count], (unsigned long)[urls count]);
+
+    if (!result) result = [itemResult retain];
+    [itemResult release];
+    if (outError) *outError = [result autorelease];
+    else [result release];
+    return time;
+}
+
+- (void)benchmarkMakingDirectoriesForProtocol:(NSString*)protocol count:(NSUInteger)count inDirectory:(NSURL*)directory
+{
+    NSArray* urls = [self URLsForCount:count inDirectory:directory prefix:@"directory-" isDirectory:YES];
+
+    __block NSError* result = nil;
+    NSDate* start = [NSDate date];
+    [self.session createDirectoriesAtURLs:urls withIntermediateDirectories:NO openingAttributes:nil itemHandler:nil completionHandler:^(NSError *error) {
+        result = [error retain];
+        [self pause];
+    }];
+    [self runUntilPaused];
+    [self recordProtocol:protocol workload:@"mkdir" count:count size:0 time:-[start timeIntervalSinceNow] error:[result autorelease]];
+
+    NSError* error;
+    NSTimeInterval time = [self removeItemsAtURLs:urls error:&error];
+    [self recordProtocol:protocol workload:@"rmdir" count:count size:0 time:time error:error];
+}
+
+- (void)benchmarkUploadingForProtocol:(NSString*)protocol count:(NSUInteger)count size:(unsigned long long)size inDirectory:(NSURL*)directory
+{
+    NSURL* source = [self sourceFileOfSize:size];
+    NSArray* urls = [self URLsForCount:count inDirectory:directory prefix:@"file-" isDirectory:NO];
+
+    // One at a time, the way CKUploader feeds them through
+    __block NSError* result = nil;
+    NSUInteger uploaded = 0;
+    NSDate* start = [NSDate date];
+    for (NSURL* url in urls)
+    {
+        [self.session createFileAtURL:url withContentsOfURL:source withIntermediateDirectories:NO openingAttributes:nil progressBlock:nil completionHandler:^(NSError *error) {
+            result = [error retain];
+            [self pause];
+        }];
+        [self runUntilPaused];
+        if (result) break;
+        ++uploaded;
+    }
+    [self recordProtocol:protocol workload:@"upload" count:count size:size time:-[start timeIntervalSinceNow] error:[result autorelease]];
+
+    // Listing is only interesting once, for the smallest files; the size of the files makes no difference to it
+    if (size == [[[self fileSizes] valueForKeyPath:@"@min.unsignedLongLongValue"] unsignedLongLongValue])
+    {
+        __block NSError* listingError = nil;
+        __block NSUInteger listed = 0;
+        start = [NSDate date];
+        [self.session contentsOfDirectoryAtURL:directory includingPropertiesForKeys:nil options:NSDirectoryEnumerationSkipsSubdirectoryDescendants completionHandler:^(NSArray *contents, NSError *error) {
+            listed = [contents count];
+            listingError = [error retain];
+            [self pause];
+        }];
+        [self runUntilPaused];
+        [self recordProtocol:protocol workload:@"list" count:count size:0 time:-[start timeIntervalSinceNow] error:[listingError autorelease]];
+        STAssertTrue(listingError || listed == count, @"listed %lu items, expected %lu", (unsigned long)listed, (unsigned long)count);
+    }
+
+    // Only what actually made it up there
+    if (uploaded)
+    {
+        NSError* error;
+        NSTimeInterval time = [self removeItemsAtURLs:[urls subarrayWithRange:NSMakeRange(0, uploaded)] error:&error];
+        [self recordProtocol:protocol workload:@"remove" count:uploaded size:size time:time error:error];
+    }
+}
+
+- (void)benchmarkProtocol:(NSString*)protocol
+{
+    if (![self setupBenchmarkSessionForProtocol:protocol]) return;
+
+    for (NSNumber* count in [self fileCounts])
+    {
+        NSURL* directory = [self makeBenchmarkDirectory];
+        if (!directory) return;
+
+        [self benchmarkMakingDirectoriesForProtocol:protocol count:[count unsignedIntegerValue] inDirectory:directory];
+
+        for (NSNumber* size in [self fileSizes])
+        {
+            if ([count unsignedLongLongValue] * [size unsignedLongLongValue] > [self maximumBytes])
+            {
+                NSLog(@"skipping %@ upload of %@ x %@ as it's over CKBenchmarkMaximumBytes", protocol, count, size);
+                continue;
+            }
+
+            [self benchmarkUploadingForProtocol:protocol count:[count unsignedIntegerValue] size:[size unsignedLongLongValue] inDirectory:directory];
+        }
+
+        // Empty by now, so can be removed as a directory whatever the protocol
+        [self removeItemsAtURLs:@[ directory ] error:NULL];
+    }
+}
+
+// Local to local, comparing the clone/copyfile() path file URLs as sources take with the stream loop everything else goes through
+- (void)benchmarkCopyingFilesWithCount:(NSUInteger)count size:(unsigned long long)size
+{
+    NSURL* source = [self sourceFileOfSize:size];
+    NSURL* directory = [[self temporaryFolder] URLByAppendingPathComponent:[NSString stringWithFormat:@"ck-benchmark-%@", [[NSProcessInfo processInfo] globallyUniqueString]] isDirectory:YES];
+    NSError* error = nil;
+    BOOL ok = [[NSFileManager defaultManager] createDirectoryAtURL:directory withIntermediateDirectories:YES attributes:nil error:&error];
+    STAssertTrue(ok, @"failed to make benchmark directory with error %@", error);
+    if (!ok) return;
+
+    // Mapped, but not wrapped up as a CK2LocalFileSource, so the file protocol can't tell where it came from and has to stream it
+    NSData* contents = [NSData dataWithContentsOfURL:source options:NSDataReadingMappedAlways error:&error];
+    STAssertNotNil(contents, @"failed to map %@ with error %@", source, error);
+
+    for (NSString* workload in @[ @"copy-clone", @"copy-stream" ])
+    {
+        NSArray* urls = [self URLsForCount:count inDirectory:directory prefix:[workload stringByAppendingString:@"-"] isDirectory:NO];
+        BOOL streaming = [workload isEqualToString:@"copy-stream"];
+        if (streaming && !contents) break;
+
+        __block NSError* result = nil;
+        NSDate* start = [NSDate date];
+        for (NSURL* url in urls)
+        {
+            void (^handler)(NSError*) = ^(NSError *error) {
+                result = [error retain];
+                [self pause];
+            };
+
+            if (streaming)
+            {
+                [self.session createFileAtURL:url contents:contents withIntermediateDirectories:NO openingAttributes:nil progressBlock:nil completionHandler:handler];
+            }
+            else
+            {
+                [self.session createFileAtURL:url withContentsOfURL:source withIntermediateDirectories:NO openingAttributes:nil progressBlock:nil completionHandler:handler];
+            }
+            [self runUntilPaused];
+            if (result) break;
+        }
+        [self recordProtocol:@"file" workload:workload count:count size:size time:-[start timeIntervalSinceNow] error:[result autorelease]];
+
+        // Clearing up isn't part of what's being measured
+        for (NSURL* url in urls)
+        {
+            [[NSFileManager defaultManager] removeItemAtURL:url error:NULL];
+        }
+    }
+
+    [[NSFileManager defaultManager] removeItemAtURL:directory error:NULL];
+}
+
+- (void)benchmarkCopyingFiles
+{
+    if (![self outputPath]) return;
+
+    self.type = @"CKFileBenchmark";
+    if (![self setupSession]) return;
+
+    for (NSNumber* count in [self fileCounts])
+    {
+        for (NSNumber* size in [self fileSizes])
+        {
+            if ([count unsignedLongLongValue] * [size unsignedLongLongValue] > [self maximumBytes])
+            {
+                NSLog(@"skipping file copy of %@ x %@ as it's over CKBenchmarkMaximumBytes", count, size);
+                continue;
+            }
+
+            [self benchmarkCopyingFilesWithCount:[count unsignedIntegerValue] size:[size unsignedLongLongValue]];
+        }
+    }
+
+    [[NSFileManager defaultManager] removeItemAtURL:[self temporaryFolder] error:NULL];
+}
+
+#pragma mark - Benchmarks
+
+- (void)testFileCopyBenchmarks
+{
+    [self benchmarkCopyingFiles];
+}
+
+- (void)testFTPBenchmarks
+{
+    [self benchmarkProtocol:@"FTP"];
+}
+
+- (void)testSFTPBenchmarks
+{
+    [self benchmarkProtocol:@"SFTP"];
+}
+
+- (void)testWebDAVBenchmarks
+{
+    [self benchmarkProtocol:@"WebDAV"];
+}
+
+@end
@@ -623,6 +623,102 @@ static NSString* gResponsesToUse = nil;
 
 }
 
+// The items either side of the missing file should be reported as removed, not retried and reported as missing too
+- (void)testRemoveItemsAtURLsWithMissingItem
+{
+    if (self.useMockServer) return; // the mock server answers every DELE alike
+
+    if ([self setup])
+    {
+        [self makeTestDirectoryWithFiles:YES];
+        NSURL* missing = [[self URLForTestFolder] URLByAppendingPathComponent:@"missing.txt"];
+        NSArray* urls = @[ [self URLForTestFile1], missing, [self URLForTestFile2] ];
+        NSMutableDictionary* errors = [NSMutableDictionary dictionary];
+
+        [self.session removeItemsAtURLs:urls itemHandler:^(NSURL *url, NSError *error) {
+            STAssertNil([errors objectForKey:[url lastPathComponent]], @"%@ reported twice", url);
+            [errors setObject:(error ? (id)error : [NSNull null]) forKey:[url lastPathComponent]];
+        } completionHandler:^(NSError *error) {
+            STAssertNil(error, @"got unexpected error %@", error);
+            STAssertTrue([errors count] == 3, @"every item should be reported");
+            STAssertEqualObjects([errors objectForKey:@"file1.txt"], [NSNull null], @"file before the missing one should be removed");
+            STAssertEqualObjects([errors objectForKey:@"file2.txt"], [NSNull null], @"file after the missing one should be removed");
+            STAssertTrue([[errors objectForKey:@"missing.txt"] isKindOfClass:[NSError class]], @"missing file should fail");
+            [self pause];
+        }];
+
+        [self runUntilPaused];
+    }
+}
+
+// Only the batch API treats a directory path as a request to remove a directory
+- (void)testRemoveItemsAtURLsWithDirectory
+{
+    if (self.useMockServer) return; // the mock server answers every RMD alike
+
+    if ([self setup])
+    {
+        [self makeTestDirectoryWithFiles:YES];
+        NSURL* directory = [[self URLForTestFolder] URLByAppendingPathComponent:@"directory" isDirectory:YES];
+
+        [self.session createDirectoryAtURL:directory withIntermediateDirectories:NO openingAttributes:nil completionHandler:^(NSError *error) {
+            STAssertNil(error, @"got unexpected error %@", error);
+            [self pause];
+        }];
+        [self runUntilPaused];
+
+        // Sent as DELE, which won't remove a directory
+        [self.session removeItemAtURL:directory completionHandler:^(NSError *error) {
+            STAssertNotNil(error, @"removing a single directory should fail");
+            [self pause];
+        }];
+        [self runUntilPaused];
+
+        NSArray* urls = @[ [self URLForTestFile1], directory ];
+        NSMutableDictionary* errors = [NSMutableDictionary dictionary];
+
+        [self.session removeItemsAtURLs:urls itemHandler:^(NSURL *url, NSError *error) {
+            [errors setObject:(error ? (id)error : [NSNull null]) forKey:[url lastPathComponent]];
+        } completionHandler:^(NSError *error) {
+            STAssertNil(error, @"got unexpected error %@", error);
+            STAssertEqualObjects([errors objectForKey:@"file1.txt"], [NSNull null], @"file should be removed");
+            STAssertEqualObjects([errors objectForKey:@"directory"], [NSNull null], @"directory should be removed");
+            [self pause];
+        }];
+        [self runUntilPaused];
+    }
+}
+
+// RNFR/RNTO go out as a pair per item, so a failed RNFR has to be pinned on its own item, not the one before it
+- (void)testMoveItemsAtURLsWithMissingItem
+{
+    if (self.useMockServer) return; // the mock server answers every RNFR alike
+
+    if ([self setup])
+    {
+        [self makeTestDirectoryWithFiles:YES];
+        NSURL* folder = [self URLForTestFolder];
+        NSURL* missing = [folder URLByAppendingPathComponent:@"missing.txt"];
+        NSArray* urls = @[ [self URLForTestFile1], missing, [self URLForTestFile2] ];
+        NSArray* destinations = @[ [folder URLByAppendingPathComponent:@"moved1.txt"], [folder URLByAppendingPathComponent:@"moved.txt"], [folder URLByAppendingPathComponent:@"moved2.txt"] ];
+        NSMutableDictionary* errors = [NSMutableDictionary dictionary];
+
+        [self.session moveItemsAtURLs:urls toURLs:destinations itemHandler:^(NSURL *url, NSError *error) {
+            STAssertNil([errors objectForKey:[url lastPathComponent]], @"%@ reported twice", url);
+            [errors setObject:(error ? (id)error : [NSNull null]) forKey:[url lastPathComponent]];
+        } completionHandler:^(NSError *error) {
+            STAssertNil(error, @"got unexpected error %@", error);
+            STAssertTrue([errors count] == 3, @"every item should be reported");
+            STAssertEqualObjects([errors objectForKey:@"file1.txt"], [NSNull null], @"file before the missing one should be moved");
+            STAssertEqualObjects([errors objectForKey:@"file2.txt"], [NSNull null], @"file after the missing one should be moved");
+            STAssertTrue([[errors objectForKey:@"missing.txt"] isKindOfClass:[NSError class]], @"missing file should fail");
+            [self pause];
+        }];
+
+        [self runUntilPaused];
+    }
+}
+
 - (void)testRemoveFileAtURLContainingFolderDoesnExist
 {
     if ([self setup])
@@ -7,15 +7,36 @@
 #import "KMSServer.h"
 
 #import "CK2FileManager.h"
+#import "CK2FileOperationMetrics.h"
 #import <SenTestingKit/SenTestingKit.h>
 #import <curl/curl.h>
 
 @interface CK2FileManagerFileTests : CK2FileManagerBaseTests
+{
+    BOOL                    _expectingMetrics;
+    CK2FileOperationMetrics *_metrics;
+}
 
 @end
 
 @implementation CK2FileManagerFileTests
 
+- (void)dealloc
+{
+    [_metrics release];
+    [super dealloc];
+}
+
+- (void)fileManager:(CK2FileManager *)manager didFinishOperation:(id)operation withMetrics:(CK2FileOperationMetrics *)metrics
+{
+    if (_expectingMetrics)
+    {
+        _expectingMetrics = NO;
+        _metrics = [metrics retain];
+        [self pause];
+    }
+}
+
 - (NSURL*)makeTestContents
 {
     BOOL ok;
@@ -323,6 +344,49 @@
     }
 }
 
+- (void)testCreateFileAtURLWithContentsOfLargeFile
+{
+    if ([self setupSession])
+    {
+        NSFileManager* fm = [NSFileManager defaultManager];
+        NSURL* temp = [self temporaryFolder];
+        NSURL* source = [temp URLByAppendingPathComponent:@"large.dat"];
+        NSURL* copied = [temp URLByAppendingPathComponent:@"copied.dat"];
+        NSURL* streamed = [temp URLByAppendingPathComponent:@"streamed.dat"];
+        NSError* error = nil;
+
+        // Big enough to need more than one pass of the stream loop
+        NSUInteger length = 1024 * 1024;
+        NSMutableData* data = [NSMutableData dataWithLength:length];
+        arc4random_buf([data mutableBytes], length);
+        STAssertTrue([data writeToURL:source options:0 error:&error], @"failed to write temporary file with error %@", error);
+
+        // A read-only source mustn't stop a clone of it being given the requested permissions
+        STAssertTrue([fm setAttributes:@{ NSFilePosixPermissions : @(0444) } ofItemAtPath:[source path] error:&error], @"failed to make source read-only with error %@", error);
+
+        NSDictionary* attributes = @{ NSFilePosixPermissions : @(0640) };
+
+        // local to local goes through the kernel
+        [self.session createFileAtURL:copied withContentsOfURL:source withIntermediateDirectories:NO openingAttributes:attributes progressBlock:nil completionHandler:^(NSError *error) {
+            STAssertNil(error, @"got unexpected error %@", error);
+            [self pause];
+        }];
+        [self runUntilPaused];
+
+        // in-memory data still gets pumped through the stream loop
+        [self.session createFileAtURL:streamed contents:data withIntermediateDirectories:NO openingAttributes:attributes progressBlock:nil completionHandler:^(NSError *error) {
+            STAssertNil(error, @"got unexpected error %@", error);
+            [self pause];
+        }];
+        [self runUntilPaused];
+
+        STAssertTrue([fm contentsEqualAtPath:[source path] andPath:[copied path]], @"copy should match original");
+        STAssertTrue([fm contentsEqualAtPath:[source path] andPath:[streamed path]], @"streamed file should match original");
+        STAssertEquals([[fm attributesOfItemAtPath:[copied path] error:NULL] filePosixPermissions], (NSUInteger)0640, @"copy should have the requested permissions");
+        STAssertEquals([[fm attributesOfItemAtPath:[streamed path] error:NULL] filePosixPermissions], (NSUInteger)0640, @"streamed file should have the requested permissions");
+    }
+}
+
 - (void)testCreateFileAtURLWithContentsNoPermission
 {
     if ([self setupSession])
@@ -508,5 +572,184 @@
     }
 }
 
+- (void)testRemoveItemsAtURLs
+{
+    if ([self setupSession])
+    {
+        NSURL* temp = [self makeTestContents];
+        if (temp)
+        {
+            NSFileManager* fm = [NSFileManager defaultManager];
+            NSURL* subdirectory = [temp URLByAppendingPathComponent:@"subfolder"];
+            NSURL* testFile = [temp URLByAppendingPathComponent:@"test.txt"];
+            NSURL* otherFile = [subdirectory URLByAppendingPathComponent:@"another.txt"];
+            NSURL* imaginaryFile = [temp URLByAppendingPathComponent:@"imaginary.txt"];
+
+            NSArray* urls = @[testFile, otherFile, imaginaryFile];
+            NSMutableArray* reported = [NSMutableArray array];
+            [self.session removeItemsAtURLs:urls itemHandler:^(NSURL *url, NSError *error) {
+                if ([url isEqual:imaginaryFile])
+                {
+                    STAssertNotNil(error, @"expected error");
+                    STAssertEquals([error code], (NSInteger) NSFileNoSuchFileError, @"unexpected error code %ld", [error code]);
+                }
+                else
+                {
+                    STAssertNil(error, @"got unexpected error %@", error);
+                }
+                [reported addObject:url];
+            } completionHandler:^(NSError *error) {
+                STAssertNil(error, @"got unexpected error %@", error);
+                [self pause];
+            }];
+            [self runUntilPaused];
+
+            STAssertEquals([reported count], [urls count], @"every item should have been reported");
+            STAssertFalse([fm fileExistsAtPath:[testFile path]], @"removal should have worked");
+            STAssertFalse([fm fileExistsAtPath:[otherFile path]], @"removal should have worked");
+        }
+    }
+}
+
+- (void)testCreateDirectoriesAtURLs
+{
+    if ([self setupSession])
+    {
+        NSURL* temp = [self temporaryFolder];
+        NSArray* urls = @[[temp URLByAppendingPathComponent:@"first"], [temp URLByAppendingPathComponent:@"second"], [temp URLByAppendingPathComponent:@"third/nested"]];
+
+        NSMutableArray* reported = [NSMutableArray array];
+        [self.session createDirectoriesAtURLs:urls withIntermediateDirectories:YES openingAttributes:nil itemHandler:^(NSURL *url, NSError *error) {
+            STAssertNil(error, @"got unexpected error %@", error);
+            [reported addObject:url];
+        } completionHandler:^(NSError *error) {
+            STAssertNil(error, @"got unexpected error %@", error);
+            [self pause];
+        }];
+        [self runUntilPaused];
+
+        STAssertEquals([reported count], [urls count], @"every item should have been reported");
+
+        BOOL isDirectory;
+        for (NSURL* url in urls)
+        {
+            STAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[url path] isDirectory:&isDirectory] && isDirectory, @"directory %@ should have been created", url);
+        }
+    }
+}
+
+- (void)testMoveItemAtURL
+{
+    if ([self setupSession])
+    {
+        NSURL* temp = [self makeTestContents];
+        if (temp)
+        {
+            NSFileManager* fm = [NSFileManager defaultManager];
+            NSURL* testFile = [temp URLByAppendingPathComponent:@"test.txt"];
+            NSURL* otherFile = [[temp URLByAppendingPathComponent:@"subfolder"] URLByAppendingPathComponent:@"another.txt"];
+            NSURL* movedFile = [temp URLByAppendingPathComponent:@"moved.txt"];
+
+            // move to a new name
+            [self.session moveItemAtURL:testFile toURL:movedFile completionHandler:^(NSError *error) {
+                STAssertNil(error, @"got unexpected error %@", error);
+                [self pause];
+            }];
+            [self runUntilPaused];
+            STAssertFalse([fm fileExistsAtPath:[testFile path]], @"move should have worked");
+            STAssertTrue([fm fileExistsAtPath:[movedFile path]], @"move should have worked");
+
+            // move on top of an existing file - should replace it
+            [self.session moveItemAtURL:otherFile toURL:movedFile completionHandler:^(NSError *error) {
+                STAssertNil(error, @"got unexpected error %@", error);
+                [self pause];
+            }];
+            [self runUntilPaused];
+            STAssertFalse([fm fileExistsAtPath:[otherFile path]], @"move should have worked");
+            STAssertEqualObjects([NSString stringWithContentsOfURL:movedFile encoding:NSUTF8StringEncoding error:NULL], @"Some more text", @"existing file should have been replaced");
+
+            // move something that isn't there - should obviously fail
+            [self.session moveItemAtURL:testFile toURL:movedFile completionHandler:^(NSError *error) {
+                STAssertNotNil(error, @"expected error");
+                STAssertTrue([[error domain] isEqualToString:NSCocoaErrorDomain], @"unexpected error domain %@", [error domain]);
+                STAssertEquals([error code], (NSInteger) NSFileNoSuchFileError, @"unexpected error code %ld", [error code]);
+                [self pause];
+            }];
+            [self runUntilPaused];
+        }
+    }
+}
+
+- (void)testCopyItemAtURL
+{
+    if ([self setupSession])
+    {
+        NSURL* temp = [self makeTestContents];
+        if (temp)
+        {
+            NSFileManager* fm = [NSFileManager defaultManager];
+            NSURL* testFile = [temp URLByAppendingPathComponent:@"test.txt"];
+            NSURL* copiedFile = [temp URLByAppendingPathComponent:@"copied.txt"];
+
+            [self.session copyItemAtURL:testFile toURL:copiedFile completionHandler:^(NSError *error) {
+                STAssertNil(error, @"got unexpected error %@", error);
+                [self pause];
+            }];
+            [self runUntilPaused];
+            STAssertTrue([fm fileExistsAtPath:[testFile path]], @"original should be left alone");
+            STAssertTrue([fm contentsEqualAtPath:[testFile path] andPath:[copiedFile path]], @"copy should match original");
+
+            // copying again should fail, rather than overwrite
+            [self.session copyItemAtURL:testFile toURL:copiedFile completionHandler:^(NSError *error) {
+                STAssertNotNil(error, @"expected error");
+                [self pause];
+            }];
+            [self runUntilPaused];
+        }
+    }
+}
+
+- (void)testMetrics
+{
+    if ([self setupSession])
+    {
+        NSURL* file = [[self temporaryFolder] URLByAppendingPathComponent:@"metrics.txt"];
+        [[NSFileManager defaultManager] removeItemAtURL:file error:nil];
+
+        CK2FileOperationMetricsCollector* collector = [[CK2FileOperationMetricsCollector alloc] init];
+        self.session.metricsCollector = collector;
+        [collector release];
+
+        // metrics arrive after the completion handler, so wait for them instead
+        NSData* data = [@"Some test text" dataUsingEncoding:NSUTF8StringEncoding];
+        _expectingMetrics = YES;
+        [self.session createFileAtURL:file contents:data withIntermediateDirectories:YES openingAttributes:nil progressBlock:nil completionHandler:^(NSError *error) {
+            STAssertNil(error, @"got unexpected error %@", error);
+        }];
+        [self runUntilPaused];
+
+        STAssertNotNil(_metrics, @"should have been handed metrics");
+        STAssertEqualObjects([_metrics name], @"upload", @"unexpected name");
+        STAssertNil([_metrics error], @"got unexpected error %@", [_metrics error]);
+        STAssertEquals([_metrics bytesSent], (unsigned long long)[data length], @"unexpected byte count");
+        STAssertNil([_metrics reusedConnection], @"file: URLs don't connect");
+
+        NSTimeInterval resolved = [_metrics timeToPhase:CK2FileOperationPhaseProtocolResolved];
+        NSTimeInterval firstByte = [_metrics timeToPhase:CK2FileOperationPhaseFirstByte];
+        NSTimeInterval completed = [_metrics timeToPhase:CK2FileOperationPhaseCompleted];
+        STAssertTrue(resolved >= 0 && firstByte >= resolved && completed >= firstByte, @"phases out of order: %@", _metrics);
+        STAssertTrue([_metrics timeToPhase:CK2FileOperationPhaseAuthenticated] < 0, @"file: URLs don't authenticate");
+
+        NSDictionary* counters = [collector counters];
+        STAssertEqualObjects([counters objectForKey:@"operations.upload"], @1, @"unexpected counters %@", counters);
+        STAssertEqualObjects([counters objectForKey:@"bytesSent"], @([data length]), @"unexpected counters %@", counters);
+        STAssertNil([counters objectForKey:@"failures"], @"unexpected counters %@", counters);
+
+        NSArray* completions = [[collector histograms] objectForKey:@"completed"];
+        STAssertEquals([completions count], [[CK2FileOperationMetricsCollector histogramBucketBounds] count] + 1, @"unexpected bucket count");
+        STAssertEqualObjects([completions valueForKeyPath:@"@sum.self"], @1, @"operation should be in exactly one bucket");
+    }
+}
+
 @end
 
@@ -0,0 +1,173 @@
+//
+//  CK2LocalFileSourceTests.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CK2LocalFileSource.h"
+
+#import <SenTestingKit/SenTestingKit.h>
+#include <fcntl.h>
+
+
+@interface CK2LocalFileSource (Internals)
+- (BOOL)copyToFileDescriptor:(int)fileDescriptor error:(NSError **)outError;
+@end
+
+
+@interface CK2LocalFileSourceTests : SenTestCase
+{
+    NSURL*  _folder;
+}
+
+@end
+
+@implementation CK2LocalFileSourceTests
+
+- (void)setUp
+{
+    NSString* name = [NSString stringWithFormat:@"CK2LocalFileSourceTests-%@", [[NSProcessInfo processInfo] globallyUniqueString]];
+    _folder = [[[NSURL fileURLWithPath:NSTemporaryDirectory()] URLByAppendingPathComponent:name isDirectory:YES] retain];
+
+    NSError* error = nil;
+    BOOL ok = [[NSFileManager defaultManager] createDirectoryAtURL:_folder withIntermediateDirectories:YES attributes:nil error:&error];
+    STAssertTrue(ok, @"failed to make temporary folder with error %@", error);
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtURL:_folder error:NULL];
+    [_folder release]; _folder = nil;
+}
+
+// Every byte different from its neighbours for a good stretch, so a slice from the wrong place shows up
+- (NSData*)contentsOfLength:(NSUInteger)length
+{
+    NSMutableData* result = [NSMutableData dataWithLength:length];
+    uint8_t* bytes = [result mutableBytes];
+    for (NSUInteger i = 0; i < length; i++) bytes[i] = (uint8_t)(i % 251);
+    return result;
+}
+
+- (NSURL*)fileWithContents:(NSData*)contents name:(NSString*)name
+{
+    NSURL* url = [_folder URLByAppendingPathComponent:name];
+    NSError* error = nil;
+    BOOL ok = [contents writeToURL:url options:0 error:&error];
+    STAssertTrue(ok, @"failed to write %@ with error %@", name, error);
+    return url;
+}
+
+- (CK2LocalFileSource*)sourceWithURL:(NSURL*)url
+{
+    NSError* error = nil;
+    CK2LocalFileSource* source = [[[CK2LocalFileSource alloc] initWithURL:url error:&error] autorelease];
+    STAssertNotNil(source, @"failed to map %@ with error %@", url, error);
+    return source;
+}
+
+- (int)openDestinationWithContents:(NSData*)contents name:(NSString*)name
+{
+    NSURL* url = [self fileWithContents:contents name:name];
+    int fd = open([[url path] fileSystemRepresentation], O_RDWR);
+    STAssertTrue(fd != -1, @"failed to open %@", url);
+    return fd;
+}
+
+#pragma mark - Slicing
+
+- (void)testDataWithRange
+{
+    NSData* contents = [self contentsOfLength:3 * 4096 + 100];
+    CK2LocalFileSource* source = [self sourceWithURL:[self fileWithContents:contents name:@"source.dat"]];
+    STAssertEquals([source length], (unsigned long long)[contents length], @"length should be the file's");
+
+    NSData* whole = [source data];
+    STAssertEqualObjects(whole, contents, @"whole file");
+    STAssertEquals([CK2LocalFileSource sourceOfData:whole], source, @"data should lead back to its source");
+
+    NSRange ranges[] = { { 0, 1 }, { 10, 20 }, { 4095, 2 }, { 4096, 4096 }, { [contents length] - 7, 7 }, { 5000, 0 } };
+    for (NSUInteger i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++)
+    {
+        NSData* slice = [source dataWithRange:ranges[i]];
+        STAssertEqualObjects(slice, [contents subdataWithRange:ranges[i]], @"wrong bytes for %@", NSStringFromRange(ranges[i]));
+        STAssertEquals([CK2LocalFileSource sourceOfData:slice], source, @"slice should lead back to its source");
+    }
+
+    STAssertNil([CK2LocalFileSource sourceOfData:[NSData dataWithData:contents]], @"other data has no source");
+}
+
+- (void)testEmptyFile
+{
+    CK2LocalFileSource* source = [self sourceWithURL:[self fileWithContents:[NSData data] name:@"empty.dat"]];
+    STAssertEquals([source length], 0ULL, @"nothing in the file");
+    STAssertEquals([[source data] length], (NSUInteger)0, @"nothing to read, but still data");
+}
+
+- (void)testTruncatedFile
+{
+    NSData* contents = [self contentsOfLength:3 * 4096];
+    NSURL* url = [self fileWithContents:contents name:@"source.dat"];
+    CK2LocalFileSource* source = [self sourceWithURL:url];
+
+    STAssertEquals(truncate([[url path] fileSystemRepresentation], 100), 0, @"failed to truncate file");
+
+    STAssertEqualObjects([source dataWithRange:NSMakeRange(0, 100)], [contents subdataWithRange:NSMakeRange(0, 100)], @"what's left of the file is still fine to read");
+    STAssertNil([source dataWithRange:NSMakeRange(50, 51)], @"range running past the new end of the file");
+    STAssertNil([source dataWithRange:NSMakeRange(4096, 4096)], @"range wholly past the new end of the file");
+    STAssertNil([source data], @"whole file is no longer there");
+}
+
+#pragma mark - Writing
+
+- (void)testWriteToFileDescriptor
+{
+    NSData* contents = [self contentsOfLength:100000];
+    CK2LocalFileSource* source = [self sourceWithURL:[self fileWithContents:contents name:@"source.dat"]];
+    int fd = [self openDestinationWithContents:[NSData data] name:@"destination.dat"];
+
+    NSError* error = nil;
+    STAssertTrue([source writeToFileDescriptor:fd error:&error], @"failed to copy with error %@", error);
+    close(fd);
+
+    STAssertEqualObjects([NSData dataWithContentsOfURL:[_folder URLByAppendingPathComponent:@"destination.dat"]], contents, @"copy should match");
+}
+
+// Several times the buffer, not a multiple of it, and replacing a longer file, so every part of the loop gets a go
+- (void)testCopyToFileDescriptor
+{
+    NSData* contents = [self contentsOfLength:2 * 1024 * 1024 + 12345];
+    CK2LocalFileSource* source = [self sourceWithURL:[self fileWithContents:contents name:@"source.dat"]];
+    int fd = [self openDestinationWithContents:[self contentsOfLength:3 * 1024 * 1024] name:@"destination.dat"];
+    lseek(fd, 0, SEEK_END);
+
+    NSError* error = nil;
+    STAssertTrue([source copyToFileDescriptor:fd error:&error], @"failed to copy with error %@", error);
+    close(fd);
+
+    STAssertEqualObjects([NSData dataWithContentsOfURL:[_folder URLByAppendingPathComponent:@"destination.dat"]], contents, @"copy should replace what was there");
+}
+
+- (void)testCopyToFileDescriptorFromTruncatedFile
+{
+    NSData* contents = [self contentsOfLength:3 * 4096];
+    NSURL* url = [self fileWithContents:contents name:@"source.dat"];
+    CK2LocalFileSource* source = [self sourceWithURL:url];
+    STAssertEquals(truncate([[url path] fileSystemRepresentation], 100), 0, @"failed to truncate file");
+
+    int fd = [self openDestinationWithContents:[NSData data] name:@"destination.dat"];
+
+    NSError* error = nil;
+    STAssertFalse([source copyToFileDescriptor:fd error:&error], @"shouldn't copy a file that's been cut short");
+    STAssertEqualObjects([error domain], NSPOSIXErrorDomain, @"error should be POSIX");
+    STAssertEquals([error code], (NSInteger)EIO, @"file ran out early");
+
+    error = nil;
+    STAssertFalse([source writeToFileDescriptor:fd error:&error], @"shouldn't copy a file that's been cut short, whichever way it's done");
+    STAssertNotNil(error, @"should explain why");
+    close(fd);
+}
+
+@end
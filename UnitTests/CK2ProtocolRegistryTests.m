@@ -0,0 +1,143 @@
+//
+//  CK2ProtocolRegistryTests.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CK2Protocol.h"
+#import "CK2FTPProtocol.h"
+#import "CK2FileProtocol.h"
+#import "CK2WebDAVProtocol.h"
+
+#import <SenTestingKit/SenTestingKit.h>
+#include <libkern/OSAtomic.h>
+
+
+@interface CK2Protocol (Internals)
++ (void)classForURL:(NSURL *)url completionHandler:(void (^)(Class protocolClass))block;
++ (Class)classForURL:(NSURL *)url;
+@end
+
+
+@interface CK2RegistryTestProtocol : CK2Protocol
+@end
+
+@implementation CK2RegistryTestProtocol
+
++ (BOOL)canHandleURL:(NSURL *)url;
+{
+    return [[url scheme] isEqualToString:@"ck2-registry-test"];
+}
+
+@end
+
+
+// Only takes over the one host, to check it's asked ahead of whichever protocol accepted the scheme last time
+@interface CK2RegistryHostProtocol : CK2Protocol
+@end
+
+@implementation CK2RegistryHostProtocol
+
++ (BOOL)canHandleURL:(NSURL *)url;
+{
+    return [[url scheme] isEqualToString:@"ftp"] && [[url host] isEqualToString:@"ck2-registry-test.example.com"];
+}
+
+@end
+
+
+// Registered while lookups are in flight; handles nothing
+@interface CK2RegistryIdleProtocol : CK2Protocol
+@end
+
+@implementation CK2RegistryIdleProtocol
+
++ (BOOL)canHandleURL:(NSURL *)url;
+{
+    return NO;
+}
+
+@end
+
+
+@interface CK2ProtocolRegistryTests : SenTestCase
+
+@end
+
+@implementation CK2ProtocolRegistryTests
+
+- (void)testBuiltInProtocols
+{
+    STAssertEquals([CK2Protocol classForURL:[NSURL URLWithString:@"ftp://example.com/"]], [CK2FTPProtocol class], @"FTP");
+    STAssertEquals([CK2Protocol classForURL:[NSURL URLWithString:@"FTP://example.com/"]], [CK2FTPProtocol class], @"FTP accepts any case of scheme");
+    STAssertEquals([CK2Protocol classForURL:[NSURL URLWithString:@"https://example.com/"]], [CK2WebDAVProtocol class], @"WebDAV");
+    STAssertEquals([CK2Protocol classForURL:[NSURL fileURLWithPath:@"/tmp"]], [CK2FileProtocol class], @"file");
+    STAssertNil([CK2Protocol classForURL:[NSURL URLWithString:@"gopher://example.com/"]], @"nothing handles gopher");
+    STAssertNil([CK2Protocol classForURL:[NSURL URLWithString:@"gopher://example.com/"]], @"still nothing, the second time");
+}
+
+// WebDAV only accepts lower case schemes. Turning down an upper case one mustn't stop it being asked about the lower case equivalent
+- (void)testSchemeCase
+{
+    Class upper = [CK2Protocol classForURL:[NSURL URLWithString:@"HTTP://example.com/"]];
+    STAssertFalse(upper == [CK2WebDAVProtocol class], @"WebDAV compares schemes case sensitively");
+    
+    STAssertEquals([CK2Protocol classForURL:[NSURL URLWithString:@"http://example.com/"]], [CK2WebDAVProtocol class], @"lower case should still find WebDAV");
+    STAssertEquals([CK2Protocol classForURL:[NSURL URLWithString:@"https://example.com/"]], [CK2WebDAVProtocol class], @"so should https");
+    STAssertEquals([CK2Protocol classForURL:[NSURL URLWithString:@"HTTP://example.com/"]], upper, @"upper case answer shouldn't change either");
+}
+
+- (void)testRegistrationTakesEffect
+{
+    NSURL* url = [NSURL URLWithString:@"ck2-registry-test://example.com/"];
+    STAssertNil([CK2Protocol classForURL:url], @"not registered yet");
+
+    [CK2Protocol registerClass:[CK2RegistryTestProtocol class]];
+    STAssertEquals([CK2Protocol classForURL:url], [CK2RegistryTestProtocol class], @"registration should take effect straight away");
+
+    __block Class asyncResult = nil;
+    dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
+    [CK2Protocol classForURL:url completionHandler:^(Class protocolClass) {
+        asyncResult = protocolClass;
+        dispatch_semaphore_signal(semaphore);
+    }];
+    dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+    dispatch_release(semaphore);
+    STAssertEquals(asyncResult, [CK2RegistryTestProtocol class], @"asynchronous lookup");
+}
+
+- (void)testNewerProtocolLookingAtHost
+{
+    [CK2Protocol registerClass:[CK2RegistryHostProtocol class]];
+
+    STAssertEquals([CK2Protocol classForURL:[NSURL URLWithString:@"ftp://example.com/"]], [CK2FTPProtocol class], @"other hosts should still go to FTP");
+    STAssertEquals([CK2Protocol classForURL:[NSURL URLWithString:@"ftp://ck2-registry-test.example.com/"]], [CK2RegistryHostProtocol class], @"newer protocol should get its host, even after FTP accepted the scheme");
+    STAssertEquals([CK2Protocol classForURL:[NSURL URLWithString:@"ftp://example.com/"]], [CK2FTPProtocol class], @"and not take over the scheme");
+}
+
+- (void)testConcurrentLookups
+{
+    NSArray* urls = @[ [NSURL URLWithString:@"ftp://example.com/"], [NSURL URLWithString:@"http://example.com/"], [NSURL URLWithString:@"sftp://example.com/"] ];
+    NSArray* expected = @[ [CK2FTPProtocol class], [CK2WebDAVProtocol class], [CK2Protocol classForURL:[urls objectAtIndex:2]] ];
+
+    __block int32_t mismatches = 0;
+    dispatch_group_t group = dispatch_group_create();
+
+    // Register while looking up, so the registry's swapped out from under the lookups. Only the once, as the registry lasts for the rest of the process
+    dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [CK2Protocol registerClass:[CK2RegistryIdleProtocol class]];
+    });
+
+    dispatch_apply(100000, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        if ([CK2Protocol classForURL:[urls objectAtIndex:i % 3]] != [expected objectAtIndex:i % 3]) OSAtomicIncrement32(&mismatches);
+    });
+
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    dispatch_release(group);
+
+    STAssertEquals(mismatches, 0, @"every lookup should find the right protocol");
+}
+
+@end
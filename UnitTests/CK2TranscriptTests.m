@@ -0,0 +1,97 @@
+//
+//  CK2TranscriptTests.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CK2Transcript.h"
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@interface CK2TranscriptTests : SenTestCase
+
+@end
+
+@implementation CK2TranscriptTests
+
+- (NSArray*)entriesOfTranscript:(CK2Transcript*)transcript fromSequence:(int64_t*)sequence
+{
+    NSMutableArray* result = [NSMutableArray array];
+    *sequence = [transcript enumerateEntriesFromSequence:*sequence usingBlock:^(NSDate *date, CKTranscriptType type, NSString *string) {
+        [result addObject:string];
+    }];
+    return result;
+}
+
+- (void)testAppendAndRead
+{
+    CK2Transcript* transcript = [[CK2Transcript alloc] init];
+    NSString* longString = [@"" stringByPaddingToLength:1000 withString:@"0123456789" startingAtIndex:0];
+
+    [transcript appendString:@"USER test" ofType:CKTranscriptSent];
+    [transcript appendString:@"" ofType:CKTranscriptInfo];
+    [transcript appendString:longString ofType:CKTranscriptReceived];
+    [transcript appendString:@"café" ofType:CKTranscriptReceived];
+
+    int64_t sequence = 0;
+    NSArray* entries = [self entriesOfTranscript:transcript fromSequence:&sequence];
+    NSArray* expected = @[ @"USER test", @"", longString, @"café" ];
+    STAssertEqualObjects(entries, expected, @"entries should come back as appended");
+
+    // picking up from where we left off should only give new entries
+    [transcript appendString:@"QUIT" ofType:CKTranscriptSent];
+    entries = [self entriesOfTranscript:transcript fromSequence:&sequence];
+    STAssertEqualObjects(entries, @[ @"QUIT" ], @"should only get the new entry");
+
+    entries = [self entriesOfTranscript:transcript fromSequence:&sequence];
+    STAssertEquals([entries count], (NSUInteger)0, @"should be nothing new");
+
+    NSString* string = [transcript stringRepresentation];
+    STAssertTrue([string hasPrefix:@"--> USER test\n(i) \n<-- 0123"], @"unexpected string %@", string);
+
+    [transcript release];
+}
+
+- (void)testOverwritesOldest
+{
+    CK2Transcript* transcript = [[CK2Transcript alloc] initWithCapacity:16 * 1024];
+
+    for (NSUInteger i = 0; i < 10000; i++)
+    {
+        [transcript appendString:[NSString stringWithFormat:@"line %lu", (unsigned long)i] ofType:CKTranscriptSent];
+    }
+
+    int64_t sequence = 0;
+    NSArray* entries = [self entriesOfTranscript:transcript fromSequence:&sequence];
+    STAssertTrue([entries count] > 0 && [entries count] < 10000, @"should have lost the oldest entries, got %lu", (unsigned long)[entries count]);
+    STAssertEqualObjects([entries lastObject], @"line 9999", @"newest entry should be kept");
+
+    // what's left should be a contiguous run up to the newest
+    NSUInteger first = 10000 - [entries count];
+    STAssertEqualObjects([entries objectAtIndex:0], ([NSString stringWithFormat:@"line %lu", (unsigned long)first]), @"entries should be contiguous");
+
+    [transcript release];
+}
+
+- (void)testConcurrentAppends
+{
+    CK2Transcript* transcript = [[CK2Transcript alloc] init];
+
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+        for (NSUInteger i = 0; i < 100; i++)
+        {
+            [transcript appendString:[NSString stringWithFormat:@"%lu %lu", (unsigned long)thread, (unsigned long)i] ofType:CKTranscriptSent];
+        }
+    });
+
+    int64_t sequence = 0;
+    NSArray* entries = [self entriesOfTranscript:transcript fromSequence:&sequence];
+    STAssertEquals([entries count], (NSUInteger)800, @"should have every entry");
+    STAssertEquals([[NSSet setWithArray:entries] count], (NSUInteger)800, @"every entry should be intact and distinct");
+
+    [transcript release];
+}
+
+@end
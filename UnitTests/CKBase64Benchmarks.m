@@ -0,0 +1,100 @@
+//
+//  CKBase64Benchmarks.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CKBase64.h"
+
+#import <SenTestingKit/SenTestingKit.h>
+
+// Times the base64 codec at sizes typical of auth headers (64B), public keys (4KB) and bulk data (1MB), with and without its SIMD paths.
+// Like CK2FileManagerBenchmarks, does nothing unless CKBenchmarkOutput is set, and appends its results to that JSON file.
+
+@interface CKBase64Benchmarks : SenTestCase
+@end
+
+
+@implementation CKBase64Benchmarks
+
+// Enough repetitions to get through 64MB at each size
+#define CKBase64BenchmarkBytes (64 * 1024 * 1024)
+
+- (NSDictionary*)resultForWorkload:(NSString*)workload size:(size_t)size block:(void (^)(void))block
+{
+    NSUInteger count = CKBase64BenchmarkBytes / size;
+
+    NSDate* start = [NSDate date];
+    for (NSUInteger i = 0; i < count; i++) block();
+    NSTimeInterval time = -[start timeIntervalSinceNow];
+
+    NSLog(@"%@ %lu: %.0f MB/s", workload, (unsigned long)size, (time > 0 ? CKBase64BenchmarkBytes / time / (1024 * 1024) : 0));
+
+    return @{
+             @"protocol" : @"none",
+             @"workload" : workload,
+             @"count" : @(count),
+             @"size" : @(size),
+             @"seconds" : @(time),
+             @"items_per_second" : @(time > 0 ? count / time : 0),
+             @"bytes_per_second" : @(time > 0 ? CKBase64BenchmarkBytes / time : 0),
+             @"date" : [[NSDate date] description],
+             };
+}
+
+- (void)testBenchmarks
+{
+    NSString* path = [[NSUserDefaults standardUserDefaults] stringForKey:@"CKBenchmarkOutput"];
+    if (!path) return;
+
+    NSMutableArray* results = [NSMutableArray array];
+
+    for (NSNumber* aSize in @[ @64, @4096, @(1024 * 1024) ])
+    {
+        size_t size = [aSize unsignedLongValue];
+        NSMutableData* data = [NSMutableData dataWithLength:size];
+        uint8_t* bytes = [data mutableBytes];
+        for (size_t i = 0; i < size; i++) bytes[i] = (uint8_t)(i * 131);
+
+        size_t encodedLength = CKBase64EncodedLength(size);
+        char* encoded = malloc(encodedLength);
+        uint8_t* decoded = malloc(CKBase64DecodedMaximumLength(encodedLength));
+        __block size_t decodedLength;
+
+        [results addObject:[self resultForWorkload:@"base64 encode" size:size block:^{
+            CKBase64Encode(bytes, size, encoded);
+        }]];
+        [results addObject:[self resultForWorkload:@"base64 encode scalar" size:size block:^{
+            CKBase64EncodeScalar(bytes, size, encoded);
+        }]];
+        [results addObject:[self resultForWorkload:@"base64 decode" size:size block:^{
+            CKBase64Decode(encoded, encodedLength, decoded, &decodedLength);
+        }]];
+        [results addObject:[self resultForWorkload:@"base64 decode scalar" size:size block:^{
+            CKBase64DecodeScalar(encoded, encodedLength, decoded, &decodedLength);
+        }]];
+
+        STAssertTrue(decodedLength == size && memcmp(decoded, bytes, size) == 0, @"round trip of %lu bytes failed", (unsigned long)size);
+
+        free(encoded);
+        free(decoded);
+    }
+
+    // Appends, the same as the file manager benchmarks
+    NSMutableArray* all = [NSMutableArray array];
+    NSData* existing = [NSData dataWithContentsOfFile:path];
+    if (existing)
+    {
+        NSArray* previous = [NSJSONSerialization JSONObjectWithData:existing options:0 error:NULL];
+        if ([previous isKindOfClass:[NSArray class]]) [all addObjectsFromArray:previous];
+    }
+    [all addObjectsFromArray:results];
+
+    NSError* error = nil;
+    NSData* json = [NSJSONSerialization dataWithJSONObject:all options:NSJSONWritingPrettyPrinted error:&error];
+    STAssertTrue([json writeToFile:path options:NSDataWritingAtomic error:&error], @"failed to write benchmark results with error %@", error);
+}
+
+@end
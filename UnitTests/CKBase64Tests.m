@@ -0,0 +1,88 @@
+//
+//  CKBase64Tests.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CKBase64.h"
+#import "NSData+Connection.h"
+
+#import <SenTestingKit/SenTestingKit.h>
+
+
+@interface CKBase64Tests : SenTestCase
+
+@end
+
+@implementation CKBase64Tests
+
+- (NSString*)encode:(NSString*)string
+{
+    NSData* data = [string dataUsingEncoding:NSUTF8StringEncoding];
+    char buffer[64];
+    size_t length = CKBase64Encode([data bytes], [data length], buffer);
+    STAssertEquals(length, CKBase64EncodedLength([data length]), @"encoded length should be as predicted");
+    return [[[NSString alloc] initWithBytes:buffer length:length encoding:NSASCIIStringEncoding] autorelease];
+}
+
+- (NSString*)decode:(NSString*)string
+{
+    char buffer[64];
+    size_t length;
+    if (!CKBase64Decode([string UTF8String], strlen([string UTF8String]), buffer, &length)) return nil;
+    return [[[NSString alloc] initWithBytes:buffer length:length encoding:NSUTF8StringEncoding] autorelease];
+}
+
+// RFC 4648's test vectors
+- (void)testVectors
+{
+    NSArray* vectors = @[ @"", @"", @"f", @"Zg==", @"fo", @"Zm8=", @"foo", @"Zm9v", @"foob", @"Zm9vYg==", @"fooba", @"Zm9vYmE=", @"foobar", @"Zm9vYmFy" ];
+    for (NSUInteger i = 0; i < [vectors count]; i += 2)
+    {
+        STAssertEqualObjects([self encode:[vectors objectAtIndex:i]], [vectors objectAtIndex:i + 1], @"encoding");
+        STAssertEqualObjects([self decode:[vectors objectAtIndex:i + 1]], [vectors objectAtIndex:i], @"decoding");
+    }
+}
+
+- (void)testDecodingSkipsAnythingElse
+{
+    STAssertEqualObjects([self decode:@"Zm9v\r\nYmFy\n"], @"foobar", @"line breaks should be skipped");
+    STAssertEqualObjects([self decode:@"Zm9vYg"], @"foob", @"padding is optional");
+    STAssertNil([self decode:@"Zm9vY"], @"a lone character left over is an error");
+}
+
+// Long enough to go through the SIMD paths, broken up like a PEM file, with lengths either side of a block boundary
+- (void)testMatchesScalar
+{
+    for (NSUInteger length = 0; length < 300; length++)
+    {
+        NSMutableData* data = [NSMutableData dataWithLength:length];
+        uint8_t* bytes = [data mutableBytes];
+        for (NSUInteger i = 0; i < length; i++) bytes[i] = (uint8_t)(i * 37 + length);
+
+        NSMutableData* encoded = [NSMutableData dataWithLength:CKBase64EncodedLength(length)];
+        NSMutableData* scalar = [NSMutableData dataWithLength:CKBase64EncodedLength(length)];
+        CKBase64Encode(bytes, length, [encoded mutableBytes]);
+        CKBase64EncodeScalar(bytes, length, [scalar mutableBytes]);
+        STAssertEqualObjects(encoded, scalar, @"encoding %lu bytes", (unsigned long)length);
+
+        NSMutableString* pem = [NSMutableString stringWithString:[[[NSString alloc] initWithData:encoded encoding:NSASCIIStringEncoding] autorelease]];
+        for (NSUInteger i = 64; i < [pem length]; i += 65) [pem insertString:@"\n" atIndex:i];
+
+        NSMutableData* decoded = [NSMutableData dataWithLength:CKBase64DecodedMaximumLength([pem length])];
+        size_t decodedLength;
+        STAssertTrue(CKBase64Decode([pem UTF8String], [pem length], [decoded mutableBytes], &decodedLength), @"decoding %lu bytes", (unsigned long)length);
+        [decoded setLength:decodedLength];
+        STAssertEqualObjects(decoded, data, @"round trip of %lu bytes", (unsigned long)length);
+    }
+}
+
+- (void)testNSData
+{
+    STAssertEqualObjects([[@"foobar" dataUsingEncoding:NSUTF8StringEncoding] base64Encoding], @"Zm9vYmFy", @"category should use the codec");
+    STAssertEqualObjects([[NSData data] base64Encoding], @"", @"empty data");
+}
+
+@end
@@ -0,0 +1,412 @@
+//
+//  CKFolderPublisherTests.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CKFolderPublisher.h"
+
+#import <SenTestingKit/SenTestingKit.h>
+
+
+@interface CKTransferRecord (CKFolderPublisherTests)
+- (void)transferDidFinish:(CKTransferRecord *)transfer error:(NSError *)error;
+@end
+
+@interface CKFolderPublisher (CKFolderPublisherTests)
+- (void)watcher:(id)watcher receivedNotifications:(NSDictionary *)changes;
+@end
+
+
+// Records what it's asked to do, rather than connecting anywhere. Uploads stay in flight until the test finishes their records
+@interface CKFolderPublisherTestUploader : CKUploader
+{
+    NSMutableArray  *_calls;
+    NSMutableArray  *_records;
+}
+@property(nonatomic, readonly) NSMutableArray *calls;
+@property(nonatomic, readonly) NSMutableArray *records;
+@end
+
+@implementation CKFolderPublisherTestUploader
+
+- (void)dealloc
+{
+    [_calls release];
+    [_records release];
+    [super dealloc];
+}
+
+- (NSMutableArray *)calls;
+{
+    if (!_calls) _calls = [[NSMutableArray alloc] init];
+    return _calls;
+}
+
+- (NSMutableArray *)records;
+{
+    if (!_records) _records = [[NSMutableArray alloc] init];
+    return _records;
+}
+
+- (CKTransferRecord *)uploadFileAtURL:(NSURL *)url toPath:(NSString *)path;
+{
+    [[self calls] addObject:[@"upload " stringByAppendingString:path]];
+
+    CKTransferRecord *result = [CKTransferRecord recordWithName:[path lastPathComponent] size:0];
+    [[self records] addObject:result];
+    return result;
+}
+
+- (CKTransferRecord *)createDirectoryAtPath:(NSString *)path;
+{
+    [[self calls] addObject:[@"mkdir " stringByAppendingString:path]];
+    return nil;
+}
+
+- (void)removeFileAtPath:(NSString *)path;
+{
+    [[self calls] addObject:[@"rm " stringByAppendingString:path]];
+}
+
+- (void)removeDirectoryAtPath:(NSString *)path;
+{
+    [[self calls] addObject:[@"rmdir " stringByAppendingString:path]];
+}
+
+- (void)finishUploading;
+{
+    [[self calls] addObject:@"finish"];
+    [[self delegate] uploaderDidFinishUploading:self];
+}
+
+- (void)cancel; { }
+
+@end
+
+
+@interface CKFolderPublisherTestPublisher : CKFolderPublisher
+{
+    NSMutableArray  *_uploaders;
+}
+@property(nonatomic, readonly) NSMutableArray *uploaders;
+@end
+
+@implementation CKFolderPublisherTestPublisher
+
+- (void)dealloc
+{
+    [_uploaders release];
+    [super dealloc];
+}
+
+- (NSMutableArray *)uploaders;
+{
+    if (!_uploaders) _uploaders = [[NSMutableArray alloc] init];
+    return _uploaders;
+}
+
+- (CKUploader *)newUploader;
+{
+    CKUploader *result = [[CKFolderPublisherTestUploader uploaderWithRequest:[self request] filePosixPermissions:nil options:0] retain];
+    [[self uploaders] addObject:result];
+    return result;
+}
+
+@end
+
+
+@interface CKFolderPublisherTests : SenTestCase <CKFolderPublisherDelegate>
+{
+    NSString                        *_folder;
+    CKFolderPublisherTestPublisher  *_publisher;
+    BOOL                            _idle;
+}
+@end
+
+@implementation CKFolderPublisherTests
+
+- (void)setUp
+{
+    _folder = [[NSTemporaryDirectory() stringByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString]] retain];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_folder withIntermediateDirectories:YES attributes:nil error:NULL];
+
+    NSURLRequest* request = [NSURLRequest requestWithURL:[NSURL URLWithString:@"test://example.com/site/"]];
+    _publisher = [[CKFolderPublisherTestPublisher alloc] initWithFolderURL:[NSURL fileURLWithPath:_folder] request:request filePosixPermissions:nil options:0];
+    [_publisher setDelegate:self];
+    [_publisher setSettleInterval:0.2];
+    [_publisher setIdleInterval:60.0];
+    _idle = NO;
+}
+
+- (void)tearDown
+{
+    [_publisher cancel];
+    [_publisher release]; _publisher = nil;
+
+    [[NSFileManager defaultManager] removeItemAtPath:_folder error:NULL];
+    [_folder release]; _folder = nil;
+}
+
+#pragma mark Helpers
+
+- (void)runFor:(NSTimeInterval)interval;
+{
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:interval]];
+}
+
+// Backdated by default, so it doesn't look to still be being written
+- (void)writeFileAtPath:(NSString *)path backdated:(BOOL)backdate;
+{
+    NSString *localPath = [_folder stringByAppendingPathComponent:path];
+    [[NSFileManager defaultManager] createDirectoryAtPath:[localPath stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:NULL];
+    [@"content" writeToFile:localPath atomically:NO encoding:NSUTF8StringEncoding error:NULL];
+
+    if (backdate)
+    {
+        NSDictionary *attributes = [NSDictionary dictionaryWithObject:[NSDate dateWithTimeIntervalSinceNow:-60.0] forKey:NSFileModificationDate];
+        [[NSFileManager defaultManager] setAttributes:attributes ofItemAtPath:localPath error:NULL];
+    }
+}
+
+- (void)writeFileAtPath:(NSString *)path;
+{
+    [self writeFileAtPath:path backdated:YES];
+}
+
+// Stands in for the watcher
+- (void)noteChangesAtPaths:(NSArray *)paths notifications:(NSArray *)notifications;
+{
+    NSMutableDictionary *changes = [NSMutableDictionary dictionary];
+    for (NSString *aPath in paths)
+    {
+        [changes setObject:notifications forKey:[_folder stringByAppendingPathComponent:aPath]];
+    }
+    [_publisher watcher:nil receivedNotifications:changes];
+}
+
+- (void)noteChangesAtPaths:(NSArray *)paths;
+{
+    [self noteChangesAtPaths:paths notifications:@[ @"UKKQueueFileWrittenToNotification" ]];
+}
+
+- (NSArray *)calls;
+{
+    NSMutableArray *result = [NSMutableArray array];
+    for (CKFolderPublisherTestUploader *anUploader in [_publisher uploaders])
+    {
+        [result addObjectsFromArray:[anUploader calls]];
+    }
+    return result;
+}
+
+- (void)finishRecord:(CKTransferRecord *)record;
+{
+    [record transferDidFinish:record error:nil];
+}
+
+#pragma mark Delegate
+
+- (void)folderPublisher:(CKFolderPublisher *)publisher didReceiveAuthenticationChallenge:(NSURLAuthenticationChallenge *)challenge;
+{
+    [[challenge sender] cancelAuthenticationChallenge:challenge];
+}
+
+- (void)folderPublisherDidBecomeIdle:(CKFolderPublisher *)publisher;
+{
+    _idle = YES;
+}
+
+#pragma mark Tests
+
+- (void)testSkipsTemporaryFiles
+{
+    NSURLRequest* request = [NSURLRequest requestWithURL:[NSURL URLWithString:@"file:///tmp/destination/"]];
+    CKFolderPublisher* publisher = [[CKFolderPublisher alloc] initWithFolderURL:[NSURL fileURLWithPath:@"/tmp/source"] request:request filePosixPermissions:nil options:0];
+
+    STAssertTrue([publisher shouldPublishItemAtPath:@"index.html"], @"ordinary files should be published");
+    STAssertTrue([publisher shouldPublishItemAtPath:@"images/photo.jpg"], @"ordinary files in folders should be published");
+
+    NSArray* skipped = @[ @".DS_Store", @".git/config", @"index.html~", @"#index.html#", @"~$report.doc",
+                          @"movie.mov.part", @"archive.zip.crdownload", @"images/.photo.jpg.ckupload", @"drafts.tmp/page.html" ];
+    for (NSString* path in skipped)
+    {
+        STAssertFalse([publisher shouldPublishItemAtPath:path], @"%@ shouldn't be published", path);
+    }
+
+    [publisher release];
+}
+
+- (void)testChangesWaitToSettle
+{
+    [_publisher setSettleInterval:0.5];
+    [self writeFileAtPath:@"a.html"];
+    [self writeFileAtPath:@"b.html"];
+
+    [self noteChangesAtPaths:@[ @"a.html" ]];
+    [self runFor:0.3];
+    [self noteChangesAtPaths:@[ @"b.html" ]];
+    [self runFor:0.3];
+    STAssertEqualObjects([self calls], @[], @"nothing should go out while changes are still arriving");
+
+    [self runFor:0.4];
+    NSArray *expected = @[ @"upload /site/a.html", @"upload /site/b.html" ];
+    STAssertEqualObjects([self calls], expected, @"both changes should go out together once settled");
+    STAssertEquals([[_publisher uploaders] count], (NSUInteger)1, @"one uploader for the batch");
+}
+
+// Modification dates are only looked at to the second, hence the longer settle interval
+- (void)testHoldsBackFilesBeingWritten
+{
+    [_publisher setSettleInterval:1.5];
+    [self writeFileAtPath:@"a.html"];
+    [self noteChangesAtPaths:@[ @"a.html" ]];
+
+    // Written to again just before the batch goes out, but not yet reported
+    [self runFor:1.3];
+    [self writeFileAtPath:@"a.html" backdated:NO];
+    [self runFor:0.5];
+    STAssertEqualObjects([self calls], @[], @"a file modified within the settle interval should be held back");
+
+    [self runFor:1.7];
+    STAssertEqualObjects([self calls], @[ @"upload /site/a.html" ], @"and published once it's settled");
+}
+
+- (void)testMaximumUploadsInFlight
+{
+    [_publisher setMaximumUploadsInFlight:2];
+
+    NSArray *paths = @[ @"1.html", @"2.html", @"3.html", @"4.html", @"5.html" ];
+    for (NSString *aPath in paths) [self writeFileAtPath:aPath];
+    [self noteChangesAtPaths:paths];
+    [self runFor:0.3];
+
+    NSArray *expected = @[ @"upload /site/1.html", @"upload /site/2.html" ];
+    STAssertEqualObjects([self calls], expected, @"only two uploads should be queued up at once");
+
+    CKFolderPublisherTestUploader *uploader = [[_publisher uploaders] lastObject];
+    [self finishRecord:[[uploader records] objectAtIndex:0]];
+
+    expected = @[ @"upload /site/1.html", @"upload /site/2.html", @"upload /site/3.html" ];
+    STAssertEqualObjects([self calls], expected, @"the next should start as soon as there's room");
+}
+
+- (void)testMaximumPendingChangesFallsBackToRescan
+{
+    [_publisher setMaximumPendingChanges:2];
+
+    NSArray *paths = @[ @"1.html", @"2.html", @"3.html" ];
+    for (NSString *aPath in paths) [self writeFileAtPath:aPath backdated:NO];
+    [self writeFileAtPath:@"old.html"];     // untouched since well before the changes
+
+    [self noteChangesAtPaths:paths];
+    [self runFor:0.75];
+
+    NSArray *calls = [[self calls] sortedArrayUsingSelector:@selector(compare:)];
+    NSArray *expected = @[ @"upload /site/1.html", @"upload /site/2.html", @"upload /site/3.html" ];
+    STAssertEqualObjects(calls, expected, @"the folder should be walked for everything modified recently, and only that");
+}
+
+- (void)testRetriesWhenUploaderFinishesEarly
+{
+    [self writeFileAtPath:@"a.html"];
+    [self noteChangesAtPaths:@[ @"a.html" ]];
+    [self runFor:0.3];
+    STAssertEquals([[_publisher uploaders] count], (NSUInteger)1, @"should have started uploading");
+
+    // As though the connection dropped before the upload was done
+    CKFolderPublisherTestUploader *uploader = [[_publisher uploaders] objectAtIndex:0];
+    [[uploader delegate] uploaderDidFinishUploading:uploader];
+    [self runFor:0.3];
+
+    STAssertEquals([[_publisher uploaders] count], (NSUInteger)2, @"a fresh uploader should take over");
+    uploader = [[_publisher uploaders] objectAtIndex:1];
+    STAssertEqualObjects([uploader calls], @[ @"upload /site/a.html" ], @"and try the upload again");
+}
+
+- (void)testRemovesDeletedFolders
+{
+    [self writeFileAtPath:@"d/f.txt"];
+    [_publisher start];
+
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    STAssertTrue([fileManager removeItemAtPath:[_folder stringByAppendingPathComponent:@"d"] error:NULL], @"couldn't delete the folder");
+    [self noteChangesAtPaths:@[ @"d", @"d/f.txt" ]];
+    [self runFor:0.3];
+
+    NSArray *expected = @[ @"rm /site/d/f.txt", @"rmdir /site/d" ];
+    STAssertEqualObjects([self calls], expected, @"contents should be removed, then the folder, as a folder");
+}
+
+// Only the folder itself is reported when it's renamed, not what's inside
+- (void)testRenamedFoldersMoveWithTheirContents
+{
+    [self writeFileAtPath:@"d/f.txt"];
+    [self writeFileAtPath:@"d/e/g.txt"];
+    [_publisher start];
+
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    STAssertTrue([fileManager moveItemAtPath:[_folder stringByAppendingPathComponent:@"d"] toPath:[_folder stringByAppendingPathComponent:@"moved"] error:NULL], @"couldn't rename the folder");
+    [self noteChangesAtPaths:@[ @"d", @"moved" ]];
+    [self runFor:0.7];
+
+    NSArray *expected = @[ @"mkdir /site/moved",
+                           @"rm /site/d/f.txt", @"rm /site/d/e/g.txt", @"rmdir /site/d/e", @"rmdir /site/d",
+                           @"mkdir /site/moved/e", @"upload /site/moved/e/g.txt", @"upload /site/moved/f.txt" ];
+    STAssertEqualObjects([self calls], expected, @"the old folder should be removed contents first, and the new one walked for its contents");
+}
+
+- (void)testWalksFoldersTheWatcherLostTrackOf
+{
+    [self writeFileAtPath:@"d/f.txt"];
+    [_publisher start];
+
+    [self noteChangesAtPaths:@[ @"d" ] notifications:@[ @"UKKQueueFileWrittenToNotification", @"UKKQueueFileRescanNotification" ]];
+    [self runFor:0.7];
+
+    NSArray *expected = @[ @"mkdir /site/d", @"upload /site/d/f.txt" ];
+    STAssertEqualObjects([self calls], expected, @"a rescan should publish everything inside the folder");
+}
+
+- (void)testStopWithNothingPublishableBecomesIdle
+{
+    [_publisher start];
+    [self noteChangesAtPaths:@[ @"" ]];     // just the folder itself, as when something's added and deleted again
+    [_publisher stop];
+
+    [self runFor:0.1];
+    STAssertTrue(_idle, @"stopping with nothing that needed publishing should still report idle");
+    STAssertEquals([[_publisher uploaders] count], (NSUInteger)0, @"no uploader needed");
+}
+
+- (void)testStopWithoutChangesBecomesIdle
+{
+    [_publisher start];
+    [_publisher stop];
+    STAssertFalse(_idle, @"idle shouldn't be reported from inside -stop");
+
+    [self runFor:0.1];
+    STAssertTrue(_idle, @"stopping with nothing to publish should still report idle");
+    STAssertEquals([[_publisher uploaders] count], (NSUInteger)0, @"no uploader needed");
+}
+
+- (void)testStopPublishesPendingChanges
+{
+    [_publisher start];
+    [self writeFileAtPath:@"a.html"];
+    [self noteChangesAtPaths:@[ @"a.html" ]];
+    [_publisher stop];
+
+    CKFolderPublisherTestUploader *uploader = [[_publisher uploaders] lastObject];
+    STAssertEqualObjects([uploader calls], @[ @"upload /site/a.html" ], @"pending changes should go out straight away");
+
+    [self finishRecord:[[uploader records] objectAtIndex:0]];
+    [self runFor:0.1];
+    NSArray *expected = @[ @"upload /site/a.html", @"finish" ];
+    STAssertEqualObjects([uploader calls], expected, @"then the uploader should be let go");
+    STAssertTrue(_idle, @"and idle reported");
+}
+
+@end
@@ -0,0 +1,88 @@
+//
+//  CKS3ListingTests.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CKS3Listing.h"
+#import "CKS3MultipartUpload.h"
+#import "CKS3Signer.h"
+
+#import <SenTestingKit/SenTestingKit.h>
+
+
+@interface CKS3ListingTests : SenTestCase
+
+@end
+
+@implementation CKS3ListingTests
+
+- (void)testURL
+{
+    NSURL* bucket = [NSURL URLWithString:@"http://localhost:9000/bucket"];
+
+    NSURL* url = [CKS3Listing URLForListingBucketURL:bucket prefix:nil delimiter:nil continuationToken:nil];
+    STAssertEqualObjects([url absoluteString], @"http://localhost:9000/bucket?list-type=2&encoding-type=url", @"first page of everything");
+
+    url = [CKS3Listing URLForListingBucketURL:bucket prefix:@"photos & videos/" delimiter:@"/" continuationToken:@"1ueGcxLPRx1Tr/XYExHnhbYLgveDs2J/wm36Hy4vbOwM="];
+    STAssertEqualObjects([url absoluteString], @"http://localhost:9000/bucket?list-type=2&encoding-type=url&prefix=photos%20%26%20videos%2F&delimiter=%2F&continuation-token=1ueGcxLPRx1Tr%2FXYExHnhbYLgveDs2J%2Fwm36Hy4vbOwM%3D", @"parameters should be encoded");
+
+    NSString* canonical = [CKS3Signer canonicalRequestForRequest:[NSURLRequest requestWithURL:url] payloadHash:@"UNSIGNED-PAYLOAD" signedHeaders:NULL];
+    STAssertEqualObjects([[canonical componentsSeparatedByString:@"\n"] objectAtIndex:2], @"continuation-token=1ueGcxLPRx1Tr%2FXYExHnhbYLgveDs2J%2Fwm36Hy4vbOwM%3D&delimiter=%2F&encoding-type=url&list-type=2&prefix=photos%20%26%20videos%2F", @"listing parameters should be signed, sorted");
+}
+
+- (void)testParse
+{
+    NSString* xml = @"<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+    "<ListBucketResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\">"
+    "<Name>bucket</Name><Prefix>photos%2F</Prefix><KeyCount>3</KeyCount><MaxKeys>1000</MaxKeys><Delimiter>%2F</Delimiter>"
+    "<IsTruncated>true</IsTruncated><EncodingType>url</EncodingType>"
+    "<NextContinuationToken>1ueGcxLPRx1Tr/XYExHnhbYLgveDs2J/wm36Hy4vbOwM=</NextContinuationToken>"
+    "<Contents><Key>photos%2F</Key><LastModified>2009-10-12T17:50:30.000Z</LastModified><ETag>&quot;d41d8cd98f00b204e9800998ecf8427e&quot;</ETag><Size>0</Size><StorageClass>STANDARD</StorageClass></Contents>"
+    "<Contents><Key>photos%2Fmy+holiday+%2B+more.jpg</Key><LastModified>2009-10-12T17:50:30Z</LastModified><ETag>&quot;fba9dede5f27731c9771645a39863328&quot;</ETag><Size>434234</Size><StorageClass>STANDARD</StorageClass></Contents>"
+    "<CommonPrefixes><Prefix>photos%2F2006%2F</Prefix></CommonPrefixes>"
+    "</ListBucketResult>";
+
+    NSArray* objects = nil;
+    NSArray* prefixes = nil;
+    NSString* token = nil;
+    NSError* error = nil;
+    BOOL ok = [CKS3Listing parseListBucketResult:[xml dataUsingEncoding:NSUTF8StringEncoding] objects:&objects commonPrefixes:&prefixes nextContinuationToken:&token error:&error];
+
+    STAssertTrue(ok, @"parsing failed: %@", error);
+    STAssertEquals([objects count], (NSUInteger)2, @"two objects");
+    STAssertEqualObjects([[objects objectAtIndex:1] objectForKey:CKS3ListingKeyKey], @"photos/my holiday + more.jpg", @"keys should be decoded");
+    STAssertEqualObjects([[objects objectAtIndex:1] objectForKey:CKS3ListingSizeKey], @434234, @"size");
+    STAssertEqualObjects([[objects objectAtIndex:1] objectForKey:CKS3ListingETagKey], @"\"fba9dede5f27731c9771645a39863328\"", @"ETag");
+    STAssertEqualObjects([[objects objectAtIndex:1] objectForKey:CKS3ListingLastModifiedKey], [NSDate dateWithTimeIntervalSince1970:1255369830], @"dates without milliseconds should parse too");
+    STAssertEqualObjects([[objects objectAtIndex:0] objectForKey:CKS3ListingLastModifiedKey], [NSDate dateWithTimeIntervalSince1970:1255369830], @"date");
+    STAssertEqualObjects(prefixes, @[ @"photos/2006/" ], @"common prefixes should be decoded");
+    STAssertEqualObjects(token, @"1ueGcxLPRx1Tr/XYExHnhbYLgveDs2J/wm36Hy4vbOwM=", @"truncated listing should give a token");
+}
+
+- (void)testParseLastPage
+{
+    NSString* xml = @"<ListBucketResult><Name>bucket</Name><IsTruncated>false</IsTruncated>"
+    "<Contents><Key>100%.txt</Key><Size>1</Size></Contents></ListBucketResult>";
+
+    NSArray* objects = nil;
+    NSString* token = @"stale";
+    STAssertTrue([CKS3Listing parseListBucketResult:[xml dataUsingEncoding:NSUTF8StringEncoding] objects:&objects commonPrefixes:NULL nextContinuationToken:&token error:NULL], @"should parse");
+    STAssertNil(token, @"last page has no token");
+    STAssertEqualObjects([[objects lastObject] objectForKey:CKS3ListingKeyKey], @"100%.txt", @"keys shouldn't be decoded unless the server encoded them");
+}
+
+- (void)testParseError
+{
+    NSString* xml = @"<Error><Code>AccessDenied</Code><Message>Access Denied</Message></Error>";
+
+    NSError* error = nil;
+    STAssertFalse([CKS3Listing parseListBucketResult:[xml dataUsingEncoding:NSUTF8StringEncoding] objects:NULL commonPrefixes:NULL nextContinuationToken:NULL error:&error], @"error documents should fail");
+    STAssertEqualObjects([error domain], S3ErrorDomain, @"domain");
+    STAssertEqualObjects([[error userInfo] objectForKey:@"S3ErrorCode"], @"AccessDenied", @"code");
+    STAssertEqualObjects([error localizedDescription], @"Access Denied", @"message");
+}
+
+@end
@@ -0,0 +1,96 @@
+//
+//  CKTransferRecordTests.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//
+
+#import "CKTransferRecord.h"
+
+#import <SenTestingKit/SenTestingKit.h>
+
+
+@interface CKTransferRecordTests : SenTestCase
+
+@end
+
+@implementation CKTransferRecordTests
+
+- (void)testTotals
+{
+    CKTransferRecord* root = [CKTransferRecord rootRecordWithPath:@"/"];
+    CKTransferRecord* directory = [CKTransferRecord recordWithName:@"directory" size:0];
+    CKTransferRecord* first = [CKTransferRecord recordWithName:@"first.html" size:100];
+    CKTransferRecord* second = [CKTransferRecord recordWithName:@"second.html" size:300];
+
+    // build the tree out of order, so a subtree with totals of its own gets added
+    [directory addContent:first];
+    [root addContent:directory];
+    [directory addContent:second];
+
+    STAssertEquals([root size], 400ULL, @"root size should include everything");
+    STAssertEquals([root numberOfTransfers], (NSUInteger)2, @"directories shouldn't count as transfers");
+    STAssertEquals([root transferred], 0ULL, @"nothing transferred yet");
+
+    [first transferDidBegin:first];
+    [first transfer:first transferredDataOfLength:50];
+    STAssertEquals([root transferred], 50ULL, @"root should see the leaf's progress");
+    STAssertEquals([directory progress], (NSInteger)12, @"50 of 400 bytes");
+
+    [second setSize:500];
+    STAssertEquals([root size], 600ULL, @"resizing a leaf should reach the root");
+
+    [first transferDidFinish:first error:nil];
+    STAssertEquals([root transferred], 100ULL, @"finished leaf counts as fully transferred");
+    STAssertEquals([root numberOfCompletedTransfers], (NSUInteger)1, @"one transfer done");
+
+    NSError* error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:nil];
+    [second transferDidFinish:second error:error];
+    STAssertEquals([root numberOfErrors], (NSUInteger)1, @"error should be counted once");
+    STAssertEquals([root numberOfCompletedTransfers], (NSUInteger)2, @"both transfers done");
+
+    NSInteger errors = 0;
+    NSInteger successes = 0;
+    STAssertTrue([root problemsTransferringCountingErrors:&errors successes:&successes], @"should report the problem");
+    STAssertEquals(errors, (NSInteger)1, @"one failure");
+    STAssertEquals(successes, (NSInteger)1, @"one success");
+}
+
+- (void)testLeafBecomingDirectory
+{
+    CKTransferRecord* root = [CKTransferRecord rootRecordWithPath:@"/"];
+    CKTransferRecord* record = [CKTransferRecord recordWithName:@"directory" size:0];
+    [root addContent:record];
+
+    [record transferDidBegin:record];
+    [record transfer:record transferredDataOfLength:10];
+    STAssertEquals([root numberOfTransfers], (NSUInteger)1, @"record starts out as a leaf");
+
+    // once it has children, only they count
+    [record addContent:[CKTransferRecord recordWithName:@"child" size:20]];
+    STAssertEquals([root numberOfTransfers], (NSUInteger)1, @"only the child is a transfer now");
+    STAssertEquals([root transferred], 0ULL, @"the record's own progress no longer counts");
+    STAssertEquals([root size], 20ULL, @"size should come from the child");
+}
+
+- (void)testPathLookup
+{
+    CKTransferRecord* root = [CKTransferRecord recordWithName:@"site" size:0];
+    CKTransferRecord* file = [CKTransferRecord recordWithName:@"site/images/photo.jpg" size:10];
+    [CKTransferRecord mergeTextPathRecord:file withRoot:root];
+
+    STAssertEqualObjects([file name], @"photo.jpg", @"merging should strip the directories from the name");
+    STAssertEquals([root recordForPath:@"images/photo.jpg"], file, @"should find the record by relative path");
+    STAssertEquals([file recordForPath:@"/images/photo.jpg"], file, @"absolute paths search from the root");
+    STAssertEquals([root childWithName:@"images"], [file parent], @"directories should have been created");
+    STAssertNil([root recordForPath:@"images/missing.jpg"], @"shouldn't find anything that isn't there");
+
+    // renaming has to be reflected in later lookups, even though the path has been looked up before
+    [[file parent] setName:@"pictures"];
+    STAssertNil([root recordForPath:@"images/photo.jpg"], @"old path should be gone");
+    STAssertEquals([root recordForPath:@"pictures/photo.jpg"], file, @"should find the record by its new path");
+    STAssertEquals([CKTransferRecord recursiveRecord:root forFullPath:@"/site/pictures/photo.jpg"], file, @"full paths start with the root's own name");
+}
+
+@end
@@ -223,6 +223,34 @@
     }
 }
 
+- (void)testUploadDataAtomically
+{
+    NSURL* folder = [self temporaryFolder];
+    NSURLRequest* request = [NSURLRequest requestWithURL:folder];
+    CKUploader* uploader = [CKUploader uploaderWithRequest:request filePosixPermissions:nil options:CKUploadingAtomic];
+    uploader.delegate = self;
+
+    NSURL* url = [folder URLByAppendingPathComponent:@"test.txt"];
+    NSError* error = nil;
+    BOOL ok = [@"Old content" writeToURL:url atomically:YES encoding:NSUTF8StringEncoding error:&error];
+    STAssertTrue(ok, @"failed to write test file with error %@", error);
+
+    NSString* stagingPath = [uploader stagingPathForPath:@"test.txt"];
+    STAssertFalse([stagingPath isEqualToString:@"test.txt"], @"should upload to a temporary name");
+
+    NSData* testData = [@"Some test content" dataUsingEncoding:NSUTF8StringEncoding];
+    CKTransferRecord *record = [uploader uploadData:testData toPath:@"test.txt"];
+    STAssertNotNil(record, @"got a transfer record");
+    STAssertEqualObjects([record name], @"test.txt", @"record should be named for the final path");
+    [uploader finishUploading];
+
+    [self runUntilPaused];
+    [self checkResultForRecord:record uploading:YES];
+
+    STAssertEqualObjects([NSString stringWithContentsOfURL:url encoding:NSUTF8StringEncoding error:NULL], @"Some test content", @"existing file should have been replaced");
+    STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[[folder URLByAppendingPathComponent:stagingPath] path]], @"staged file should have been moved into place");
+}
+
 - (void)testPosixPermissionsForPath
 {
     CKUploader* uploader = [self setupUploader];
@@ -0,0 +1,295 @@
+//
+//  KTLogTests.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//  These go through the shared logger, so write to the test runner's own log in ~/Library/Logs, the same as any other logging would.
+//
+
+#import "KTLog.h"
+
+#import <SenTestingKit/SenTestingKit.h>
+
+static NSString* const kTestDomain = @"KTLogTests";
+
+
+@interface KTLogTests : SenTestCase
+{
+    NSNumber* _maximumLogSize;
+}
+
+@end
+
+@implementation KTLogTests
+
+- (void)setUp
+{
+    _maximumLogSize = [[[NSUserDefaults standardUserDefaults] objectForKey:@"KTLogFileSize"] retain];
+    [KTLogger setLoggingLevel:KTLogDebug forDomain:kTestDomain];
+}
+
+- (void)tearDown
+{
+    [KTLogger flush];
+    [KTLogger setMaximumLogSize:(_maximumLogSize ? [_maximumLogSize unsignedLongLongValue] : 5242880)];
+    if (!_maximumLogSize) [[NSUserDefaults standardUserDefaults] removeObjectForKey:@"KTLogFileSize"];
+    [_maximumLogSize release]; _maximumLogSize = nil;
+
+    [[NSUserDefaults standardUserDefaults] removeObjectForKey:[KTLogKeyPrefix stringByAppendingString:kTestDomain]];
+}
+
+- (NSString*)logPathWithSuffix:(NSString*)suffix
+{
+    NSString* name = [NSString stringWithFormat:@"%@%@.ktlog", [[NSProcessInfo processInfo] processName], suffix];
+    return [[NSHomeDirectory() stringByAppendingPathComponent:@"Library/Logs"] stringByAppendingPathComponent:name];
+}
+
+- (KTLogReader*)readerForPath:(NSString*)path
+{
+    KTLogReader* reader = [[[KTLogReader alloc] initWithContentsOfFile:path] autorelease];
+    STAssertNotNil(reader, @"couldn't read log at %@", path);
+    return reader;
+}
+
+// Copies the log somewhere it can be messed with
+- (NSString*)copyOfLog
+{
+    NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"KTLogTests-%@.ktlog", [[NSProcessInfo processInfo] globallyUniqueString]]];
+    NSError* error = nil;
+    BOOL ok = [[NSFileManager defaultManager] copyItemAtPath:[self logPathWithSuffix:@""] toPath:path error:&error];
+    STAssertTrue(ok, @"failed to copy log with error %@", error);
+    return path;
+}
+
+- (NSUInteger)occurrencesOfString:(NSString*)string inFile:(NSString*)path
+{
+    NSData* data = [NSData dataWithContentsOfFile:path];
+    NSData* utf8 = [string dataUsingEncoding:NSUTF8StringEncoding];
+    NSUInteger result = 0;
+    NSRange range = NSMakeRange(0, [data length]);
+    while (1)
+    {
+        NSRange found = [data rangeOfData:utf8 options:0 range:range];
+        if (found.location == NSNotFound) break;
+        ++result;
+        range = NSMakeRange(NSMaxRange(found), [data length] - NSMaxRange(found));
+    }
+    return result;
+}
+
+#pragma mark - Reading
+
+- (void)testEntriesReadBackAsLogged
+{
+    NSDate* start = [NSDate date];
+    NSInteger line = __LINE__ + 1;
+    KTLog(kTestDomain, KTLogInfo, @"first entry %d", 1);
+    KTLog(kTestDomain, KTLogDebug, @"second entry, with ünïcödé");
+    [KTLogger flush];
+
+    KTLogReader* reader = [self readerForPath:[self logPathWithSuffix:@""]];
+    STAssertTrue([reader count] >= 2, @"both entries should have been written");
+    if ([reader count] < 2) return;
+
+    NSDictionary* first = [reader entryAtIndex:[reader count] - 2];
+    STAssertEqualObjects([first objectForKey:@"m"], @"first entry 1", @"message should be formatted");
+    STAssertEqualObjects([first objectForKey:@"d"], kTestDomain, @"domain should come back from the interned strings");
+    STAssertEqualObjects([[first objectForKey:@"f"] lastPathComponent], @"KTLogTests.m", @"file should come back from the interned strings");
+    STAssertEquals([[first objectForKey:@"n"] integerValue], line, @"line should be the statement's");
+    STAssertEquals([[first objectForKey:@"l"] integerValue], (NSInteger)KTLogInfo, @"level should be kept");
+    STAssertEqualObjects([first objectForKey:@"th"], ([NSString stringWithFormat:@"0x%llx", (unsigned long long)(uintptr_t)[NSThread currentThread]]), @"thread should be the logging one");
+    STAssertTrue([[first objectForKey:@"t"] timeIntervalSinceDate:start] > -0.001, @"time should be when it was logged");
+
+    NSDictionary* second = [reader entryAtIndex:[reader count] - 1];
+    STAssertEqualObjects([second objectForKey:@"m"], @"second entry, with ünïcödé", @"message should survive UTF-8");
+    STAssertEquals([[second objectForKey:@"l"] integerValue], (NSInteger)KTLogDebug, @"level should be kept");
+    STAssertFalse([[second objectForKey:@"t"] compare:[first objectForKey:@"t"]] == NSOrderedAscending, @"entries should be in the order they were logged");
+
+    NSIndexSet* infoAndAbove = [reader indexesOfEntriesWithLevelAtMost:KTLogInfo domain:kTestDomain];
+    STAssertTrue([infoAndAbove containsIndex:[reader count] - 2], @"info entry should match");
+    STAssertFalse([infoAndAbove containsIndex:[reader count] - 1], @"debug entry is chattier than info");
+
+    NSArray* entries = [KTLogger entriesWithLogFile:[self logPathWithSuffix:@""]];
+    STAssertEquals([entries count], [reader count], @"entries array should wrap a reader");
+    STAssertEqualObjects([entries lastObject], second, @"entries array should decode the same as the reader");
+}
+
+- (void)testTruncatedTail
+{
+    KTLog(kTestDomain, KTLogInfo, @"kept entry");
+    KTLog(kTestDomain, KTLogInfo, @"entry to be cut short by a crash");
+    [KTLogger flush];
+
+    NSString* path = [self copyOfLog];
+    KTLogReader* reader = [self readerForPath:path];
+    NSUInteger count = [reader count];
+    STAssertTrue(count >= 2, @"both entries should have been written");
+
+    // Records are a multiple of 8 bytes, and the message is longer than that, so this leaves the last entry half there
+    NSDictionary* attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL];
+    STAssertEquals(truncate([path fileSystemRepresentation], [attributes fileSize] - 8), 0, @"failed to truncate log");
+
+    STAssertEquals([reader count], count - 1, @"open reader should drop the half-written entry");
+    STAssertEqualObjects([[reader entryAtIndex:count - 2] objectForKey:@"m"], @"kept entry", @"entries before it should still read");
+    STAssertThrowsSpecificNamed([reader entryAtIndex:count - 1], NSException, NSRangeException, @"half-written entry should be out of range");
+
+    KTLogReader* reopened = [self readerForPath:path];
+    STAssertEquals([reopened count], count - 1, @"fresh reader should stop at the half-written entry");
+    STAssertEqualObjects([[reopened entryAtIndex:count - 2] objectForKey:@"m"], @"kept entry", @"entries before it should still read");
+
+    // Not even the file header left
+    STAssertEquals(truncate([path fileSystemRepresentation], 8), 0, @"failed to truncate log");
+    STAssertEquals([reader count], (NSUInteger)0, @"open reader should find nothing left");
+    STAssertNil([[[KTLogReader alloc] initWithContentsOfFile:path] autorelease], @"a file without a header isn't a log");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+}
+
+#pragma mark - Writing
+
+- (void)testRotationInternsStringsAfresh
+{
+    [KTLogger flush];
+    NSString* path = [self logPathWithSuffix:@""];
+    unsigned long long size = [[[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL] fileSize];
+
+    // Room for some of the entries, but not all. What's left over is far short of another rotation
+    [KTLogger setMaximumLogSize:size + 2048];
+
+    NSString* domain = [NSString stringWithFormat:@"%@.%@", kTestDomain, [[NSProcessInfo processInfo] globallyUniqueString]];
+    [KTLogger setLoggingLevel:KTLogDebug forDomain:domain];
+
+    NSUInteger i;
+    for (i = 0; i < 20; i++)
+    {
+        KTLog(domain, KTLogInfo, @"entry %2lu, padded out to be a decent length so twenty of them are well over the space left", (unsigned long)i);
+    }
+    [KTLogger flush];
+    [[NSUserDefaults standardUserDefaults] removeObjectForKey:[KTLogKeyPrefix stringByAppendingString:domain]];
+
+    NSString* rotatedPath = [self logPathWithSuffix:@".0"];
+    KTLogReader* rotated = [self readerForPath:rotatedPath];
+    KTLogReader* current = [self readerForPath:path];
+    STAssertTrue([rotated count] > 0 && [current count] > 0, @"entries should be split between the logs");
+    if (![rotated count] || ![current count]) return;
+
+    NSUInteger inRotated = [[rotated indexesOfEntriesWithLevelAtMost:KTLogDebug domain:domain] count];
+    NSUInteger inCurrent = [[current indexesOfEntriesWithLevelAtMost:KTLogDebug domain:domain] count];
+    STAssertTrue(inRotated > 0 && inCurrent > 0, @"both logs should have some of the entries");
+    STAssertEquals(inRotated + inCurrent, (NSUInteger)20, @"every entry should be in one log or the other");
+    STAssertEquals([current count], inCurrent, @"current log should only have what's been logged since rotating");
+
+    NSDictionary* last = [current entryAtIndex:[current count] - 1];
+    STAssertEqualObjects([last objectForKey:@"d"], domain, @"new log should intern the domain again");
+    STAssertEqualObjects([[last objectForKey:@"f"] lastPathComponent], @"KTLogTests.m", @"new log should intern the filename again");
+    STAssertTrue([[last objectForKey:@"m"] hasPrefix:@"entry 19,"], @"last entry should be in the current log");
+
+    // However many entries refer to it, each log only spells the domain out the once
+    STAssertEquals([self occurrencesOfString:domain inFile:path], (NSUInteger)1, @"domain should be interned in the current log");
+    STAssertEquals([self occurrencesOfString:domain inFile:rotatedPath], (NSUInteger)1, @"domain should be interned in the rotated log");
+}
+
+- (void)testConcurrentLoggingArrivesOnceAndInOrder
+{
+    // No rotating part way through, which would split the entries between logs
+    [KTLogger setMaximumLogSize:1024ULL * 1024 * 1024];
+
+    NSString* token = [[NSProcessInfo processInfo] globallyUniqueString];
+    const NSUInteger threads = 8;
+    const NSUInteger entriesPerThread = 500;
+
+    dispatch_group_t group = dispatch_group_create();
+    NSUInteger t;
+    for (t = 0; t < threads; t++)
+    {
+        dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            NSUInteger i;
+            for (i = 0; i < entriesPerThread; i++)
+            {
+                KTLog(kTestDomain, KTLogDebug, @"%@ %lu %lu", token, (unsigned long)t, (unsigned long)i);
+
+                // Flushing while others are still logging mustn't lose or repeat anything either
+                if (t == 0 && i % 100 == 0) [KTLogger flush];
+            }
+        });
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    dispatch_release(group);
+    [KTLogger flush];
+
+    // Each thread's entries should carry on from exactly where the last one left off
+    NSUInteger next[threads];
+    memset(next, 0, sizeof(next));
+
+    KTLogReader* reader = [self readerForPath:[self logPathWithSuffix:@""]];
+    NSUInteger i;
+    for (i = 0; i < [reader count]; i++)
+    {
+        NSArray* words = [[[reader entryAtIndex:i] objectForKey:@"m"] componentsSeparatedByString:@" "];
+        if ([words count] != 3 || ![[words objectAtIndex:0] isEqualToString:token]) continue;
+
+        NSUInteger thread = [[words objectAtIndex:1] integerValue];
+        NSUInteger index = [[words objectAtIndex:2] integerValue];
+        STAssertTrue(thread < threads, @"unexpected thread %lu", (unsigned long)thread);
+        if (thread >= threads) continue;
+
+        STAssertEquals(index, next[thread], @"thread %lu's entries out of order or repeated", (unsigned long)thread);
+        next[thread] = index + 1;
+    }
+
+    for (t = 0; t < threads; t++)
+    {
+        STAssertEquals(next[t], entriesPerThread, @"thread %lu's entries should all have arrived", (unsigned long)t);
+    }
+}
+
+#pragma mark - Searching
+
+- (NSUInteger)indexOfFirstDateOnOrAfterDate:(NSDate*)date inDates:(NSArray*)dates
+{
+    NSUInteger result;
+    for (result = 0; result < [dates count]; result++)
+    {
+        if ([[dates objectAtIndex:result] compare:date] != NSOrderedAscending) return result;
+    }
+    return NSNotFound;
+}
+
+- (void)testFindingEntriesByDate
+{
+    // Enough to span several index blocks
+    NSUInteger i;
+    for (i = 0; i < 300; i++)
+    {
+        KTLog(kTestDomain, KTLogDebug, @"dated entry %lu", (unsigned long)i);
+        if (i % 50 == 0) usleep(1000);   // so the times aren't all bunched together
+    }
+    [KTLogger flush];
+
+    KTLogReader* reader = [self readerForPath:[self logPathWithSuffix:@""]];
+    NSUInteger count = [reader count];
+    STAssertTrue(count >= 300, @"entries should have been written");
+    if (count < 300) return;
+
+    NSMutableArray* dates = [NSMutableArray arrayWithCapacity:count];
+    for (i = 0; i < count; i++)
+    {
+        [dates addObject:[[reader entryAtIndex:i] objectForKey:@"t"]];
+    }
+
+    // Check against a straightforward scan, at points all through the entries just logged
+    for (i = count - 300; i < count; i += 37)
+    {
+        NSDate* date = [dates objectAtIndex:i];
+        STAssertEquals([reader indexOfFirstEntryOnOrAfterDate:date], [self indexOfFirstDateOnOrAfterDate:date inDates:dates], @"wrong entry found for entry %lu's date", (unsigned long)i);
+
+        date = [date dateByAddingTimeInterval:0.0005];
+        STAssertEquals([reader indexOfFirstEntryOnOrAfterDate:date], [self indexOfFirstDateOnOrAfterDate:date inDates:dates], @"wrong entry found for just after entry %lu's date", (unsigned long)i);
+    }
+
+    STAssertEquals([reader indexOfFirstEntryOnOrAfterDate:[NSDate distantPast]], (NSUInteger)0, @"everything is after the distant past");
+    STAssertEquals([reader indexOfFirstEntryOnOrAfterDate:[[dates lastObject] dateByAddingTimeInterval:1]], (NSUInteger)NSNotFound, @"nothing is after the last entry");
+}
+
+@end
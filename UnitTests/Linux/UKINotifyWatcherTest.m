@@ -0,0 +1,216 @@
+//
+//  UKINotifyWatcherTest.m
+//  Connection
+//
+//  Created on 19/10/2026.
+//
+//  Exercises UKINotifyWatcher against real inotify. SenTestingKit isn't available on Linux, so this is a plain tool; see the Makefile alongside.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "UKINotifyWatcher.h"
+
+
+static int gFailures = 0;
+
+#define UKAssert(condition, description, ...) \
+    do { if (!(condition)) { gFailures++; NSLog(@"%s:%d: %@", __FILE__, __LINE__, [NSString stringWithFormat:description, ##__VA_ARGS__]); } } while (0)
+
+
+// Gathers up each batch as it's delivered
+@interface UKINotifyWatcherTestDelegate : NSObject
+{
+    NSMutableArray  *_batches;
+}
+@property(nonatomic, readonly) NSMutableArray *batches;
+- (NSDictionary *)allChanges;
+@end
+
+@implementation UKINotifyWatcherTestDelegate
+
+- (id)init
+{
+    if (self = [super init])
+    {
+        _batches = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [_batches release];
+    [super dealloc];
+}
+
+@synthesize batches = _batches;
+
+- (void)watcher:(id <UKFileWatcher>)watcher receivedNotifications:(NSDictionary *)changes;
+{
+    [_batches addObject:changes];
+}
+
+- (NSDictionary *)allChanges;
+{
+    NSMutableDictionary *result = [NSMutableDictionary dictionary];
+    for (NSDictionary *aBatch in _batches) [result addEntriesFromDictionary:aBatch];
+    return result;
+}
+
+@end
+
+
+#pragma mark Helpers
+
+static NSString *MakeTemporaryFolder(void)
+{
+    NSString *result = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSProcessInfo processInfo] globallyUniqueString]];
+    [[NSFileManager defaultManager] createDirectoryAtPath:result withIntermediateDirectories:YES attributes:nil error:NULL];
+    return [result stringByStandardizingPath];
+}
+
+static void WriteFile(NSString *path)
+{
+    [@"content" writeToFile:path atomically:NO encoding:NSUTF8StringEncoding error:NULL];
+}
+
+static void RunFor(NSTimeInterval interval)
+{
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:interval]];
+}
+
+
+#pragma mark Tests
+
+static void TestReportsChangesInSubfolders(void)
+{
+    NSString *folder = MakeTemporaryFolder();
+    NSString *subfolder = [folder stringByAppendingPathComponent:@"sub"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:subfolder withIntermediateDirectories:NO attributes:nil error:NULL];
+
+    UKINotifyWatcher *watcher = [[UKINotifyWatcher alloc] init];
+    UKINotifyWatcherTestDelegate *delegate = [[UKINotifyWatcherTestDelegate alloc] init];
+    [watcher setDelegate:delegate];
+    [watcher setCoalescingInterval:0.1];
+    [watcher addPath:folder recursive:YES];
+
+    NSString *file = [subfolder stringByAppendingPathComponent:@"file.txt"];
+    WriteFile(file);
+
+    // A folder created after watching began gets picked up too
+    NSString *later = [folder stringByAppendingPathComponent:@"later"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:later withIntermediateDirectories:NO attributes:nil error:NULL];
+    RunFor(0.5);
+    NSString *laterFile = [later stringByAppendingPathComponent:@"file.txt"];
+    WriteFile(laterFile);
+    RunFor(0.5);
+
+    NSDictionary *changes = [delegate allChanges];
+    UKAssert([[changes objectForKey:file] containsObject:UKFileWatcherWriteNotification], @"write to %@ should be reported: %@", file, changes);
+    UKAssert([[changes objectForKey:laterFile] containsObject:UKFileWatcherWriteNotification], @"write inside a new folder should be reported: %@", changes);
+
+    [[NSFileManager defaultManager] removeItemAtPath:file error:NULL];
+    RunFor(0.5);
+    UKAssert([[[delegate allChanges] objectForKey:file] containsObject:UKFileWatcherDeleteNotification], @"deleting %@ should be reported", file);
+
+    [watcher setDelegate:nil];
+    [watcher release];
+    [delegate release];
+    [[NSFileManager defaultManager] removeItemAtPath:folder error:NULL];
+}
+
+static void TestChangesWaitForQuiet(void)
+{
+    NSString *folder = MakeTemporaryFolder();
+
+    UKINotifyWatcher *watcher = [[UKINotifyWatcher alloc] init];
+    UKINotifyWatcherTestDelegate *delegate = [[UKINotifyWatcherTestDelegate alloc] init];
+    [watcher setDelegate:delegate];
+    [watcher setCoalescingInterval:0.4];
+    [watcher addPath:folder recursive:YES];
+
+    // Each change comes in before the last has had time to go out on its own
+    for (NSUInteger i = 0; i < 4; i++)
+    {
+        WriteFile([folder stringByAppendingPathComponent:[NSString stringWithFormat:@"%lu.txt", (unsigned long)i]]);
+        RunFor(0.2);
+    }
+    UKAssert([[delegate batches] count] == 0, @"nothing should be delivered while changes keep arriving: %@", [delegate batches]);
+
+    RunFor(0.6);
+    UKAssert([[delegate batches] count] == 1, @"all the changes should go out together once quiet: %@", [delegate batches]);
+    UKAssert([[[delegate batches] lastObject] count] >= 4, @"every file should be in the batch: %@", [delegate batches]);
+
+    [watcher setDelegate:nil];
+    [watcher release];
+    [delegate release];
+    [[NSFileManager defaultManager] removeItemAtPath:folder error:NULL];
+}
+
+static void TestRemovingRootKeepsNestedPaths(void)
+{
+    NSString *folder = MakeTemporaryFolder();
+    NSString *nested = [folder stringByAppendingPathComponent:@"nested"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:nested withIntermediateDirectories:NO attributes:nil error:NULL];
+
+    UKINotifyWatcher *watcher = [[UKINotifyWatcher alloc] init];
+    UKINotifyWatcherTestDelegate *delegate = [[UKINotifyWatcherTestDelegate alloc] init];
+    [watcher setDelegate:delegate];
+    [watcher setCoalescingInterval:0.1];
+    [watcher addPath:folder recursive:YES];
+    [watcher addPath:nested];
+    [watcher removePath:folder];
+
+    NSString *nestedFile = [nested stringByAppendingPathComponent:@"file.txt"];
+    NSString *rootFile = [folder stringByAppendingPathComponent:@"file.txt"];
+    WriteFile(nestedFile);
+    WriteFile(rootFile);
+    RunFor(0.5);
+
+    NSDictionary *changes = [delegate allChanges];
+    UKAssert([changes objectForKey:nestedFile] != nil, @"the explicitly added folder should still be watched: %@", changes);
+    UKAssert([changes objectForKey:rootFile] == nil, @"the removed folder shouldn't be: %@", changes);
+
+    [watcher setDelegate:nil];
+    [watcher release];
+    [delegate release];
+    [[NSFileManager defaultManager] removeItemAtPath:folder error:NULL];
+}
+
+static void TestNotificationCenterWithoutDelegate(void)
+{
+    NSString *folder = MakeTemporaryFolder();
+
+    UKINotifyWatcher *watcher = [[UKINotifyWatcher alloc] init];
+    [watcher setCoalescingInterval:0.1];
+    [watcher addPath:folder];
+
+    __block NSUInteger posted = 0;
+    id observer = [[NSNotificationCenter defaultCenter] addObserverForName:UKFileWatcherWriteNotification object:watcher queue:nil usingBlock:^(NSNotification *notification) {
+        posted++;
+    }];
+
+    WriteFile([folder stringByAppendingPathComponent:@"file.txt"]);
+    RunFor(0.5);
+    UKAssert(posted > 0, @"writes should be posted to the default notification center");
+
+    [[NSNotificationCenter defaultCenter] removeObserver:observer];
+    [watcher release];
+    [[NSFileManager defaultManager] removeItemAtPath:folder error:NULL];
+}
+
+
+int main(int argc, const char *argv[])
+{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    TestReportsChangesInSubfolders();
+    TestChangesWaitForQuiet();
+    TestRemovingRootKeepsNestedPaths();
+    TestNotificationCenterWithoutDelegate();
+
+    NSLog(@"%d failure(s)", gFailures);
+    [pool release];
+    return (gFailures ? 1 : 0);
+}
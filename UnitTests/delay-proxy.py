@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+
+# Forwards TCP connections from a local port to a server, delaying everything passing through by a fixed amount.
+# Used by benchmark.sh to simulate a distant server without needing root for dummynet/netem.
+#
+# usage: delay-proxy.py <listen-port> <target-host> <target-port> <round-trip-ms>
+#
+# Note that FTP data connections go straight to the address the server hands out, so only the control connection gets delayed.
+
+import asyncio
+import sys
+
+
+async def pipe(reader, writer, delay):
+    # Reading and writing are decoupled by a queue, so data is held back by the delay without throttling throughput
+    loop = asyncio.get_running_loop()
+    queue = asyncio.Queue()
+
+    async def read():
+        try:
+            while True:
+                data = await reader.read(65536)
+                await queue.put((loop.time() + delay, data))
+                if not data:
+                    break
+        except ConnectionError:
+            await queue.put((loop.time(), b''))
+
+    async def write():
+        try:
+            while True:
+                when, data = await queue.get()
+                await asyncio.sleep(max(0, when - loop.time()))
+                if not data:
+                    break
+                writer.write(data)
+                await writer.drain()
+        except ConnectionError:
+            pass
+        finally:
+            writer.close()
+
+    await asyncio.gather(read(), write())
+
+
+async def main(listen_port, target_host, target_port, round_trip):
+    delay = round_trip / 2000.0
+
+    async def handle(client_reader, client_writer):
+        try:
+            server_reader, server_writer = await asyncio.open_connection(target_host, target_port)
+        except OSError:
+            client_writer.close()
+            return
+        await asyncio.gather(pipe(client_reader, server_writer, delay), pipe(server_reader, client_writer, delay))
+
+    server = await asyncio.start_server(handle, '127.0.0.1', listen_port)
+    async with server:
+        await server.serve_forever()
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 5:
+        sys.exit('usage: %s <listen-port> <target-host> <target-port> <round-trip-ms>' % sys.argv[0])
+    asyncio.run(main(int(sys.argv[1]), sys.argv[2], int(sys.argv[3]), int(sys.argv[4])))
@@ -0,0 +1,3 @@
+#!/usr/bin/env bash
+
+defaults write otest CKS3TestURL $1